@@ -1,19 +1,61 @@
 let AccessoryJSON = [];
+let editedAccessory = -1;
+let accessoryVersion = null;
+let eventRetryDelay = 1000;
+// the types and properties the firmware validates accessories against, see DeviceCreator
 let AccessoryTypeArray = {
     "LIGHT": ["name", "lightPin", "buttonPin"],
     "FAN": ["name", "fanPin", "buttonPin"],
-    "OUTLET": ["name", "outletPin", "buttonPin"],
-    "SWITCH": ["name", "switchPin", "buttonPin"],
+    "PLUGIN": ["name", "pluginPin", "buttonPin"],
     "BUTTON": ["name", "buttonPin"],
-    "BOILER": ["name", "boilerPin", "buttonPin"],
-    "DOOR": ["name", "doorPin", "doorButtonPin", "doorbellButtonPin", "openDuration"],
-    "WINDOW": ["name", "motorUpPin", "motorDownPin", "buttonUpPin", "buttonDownPin", "timeToOpen", "timeToClose"],
-    "BLIND": ["name", "motorUpPin", "motorDownPin", "buttonUpPin", "buttonDownPin", "timeToOpen", "timeToClose"]
+    "WINDOW": ["name", "motorUpPin", "motorDownPin", "buttonUpPin", "buttonDownPin", "timeToOpen", "timeToClose"]
 };
 
 async function onLoadFunc() {
     getAccsoriesFromDB().then(function () { gridLoader(); });
     getStoredWifi();
+    connectEvents();
+}
+
+function connectEvents() {
+    let socket = new WebSocket("ws://" + location.host + "/events");
+    socket.onopen = function () { eventRetryDelay = 1000; };
+    socket.onmessage = function (message) { onDeviceEvent(JSON.parse(message.data)); };
+    socket.onclose = function () {
+        // the server closes idle sockets when it runs short of them, reconnect with backoff
+        setTimeout(connectEvents, eventRetryDelay);
+        eventRetryDelay = Math.min(eventRetryDelay * 2, 30000);
+    };
+}
+
+function onDeviceEvent(event) {
+    if (event.type == "accessories") {
+        // reload after a change, unless an accessory is being edited
+        let changed = accessoryVersion != null && accessoryVersion != event.version;
+        accessoryVersion = event.version;
+        if (changed && document.getElementById("editFullScreen").style.display != "block")
+            getAccsoriesFromDB().then(function () { gridLoader(); });
+    } else if (event.type == "save") {
+        let status = document.getElementById("saveStatus");
+        if (event.result == undefined)
+            status.textContent = "Saving... " + event.stored + " accessories stored";
+        else if (event.result == "ok")
+            status.textContent = "Saved " + event.stored + " accessories";
+        else
+            status.textContent = "Save failed";
+    } else if (event.type == "stations") {
+        document.getElementById("stationCount").textContent = event.count + " device(s) connected to the setup network";
+    } else if (event.type == "ota") {
+        // the upload request reports the outcome
+        if (event.result == undefined)
+            document.getElementById("firmwareStatus").textContent = "Writing... " + Math.floor(event.written * 100 / event.total) + "%";
+    } else if (event.type == "wifi") {
+        let button = document.getElementById("TryConnect");
+        button.style.color = event.state == "connected" ? "green" : "red";
+        button.innerHTML = event.state == "connected" ? "Good" : "Wrong";
+        button.title = event.state == "connected" ? "Connected in " + event.ms + " ms" : "";
+        document.getElementById("loaderConnect").style.display = "none";
+    }
 }
 
 function SideBarClick(clickedElement) {
@@ -71,6 +113,15 @@ async function postRequest(url, body) {
     }
 }
 
+async function accessoryRequest(method, url, body) {
+    const res = await fetch(url, { method: method, body: body === undefined ? undefined : JSON.stringify(body) });
+    if (!res.ok) {
+        alert("The accessory was not saved: " + await res.text());
+        return null;
+    }
+    return await res.json();
+}
+
 async function getStoredWifi() {
     try {
         getRequest("/wifi/stored").then(function onSuccess(responseData) {
@@ -101,15 +152,13 @@ async function tryWifiPasswordConnect() {
             "SSID": SSID,
             "PASSWORD": PASSWORD
         };
+        // the outcome arrives as a "wifi" event once the station got an IP or gave up
         putRequest("/wifi/connect", response).then(function onSuccess(responseData) {
-            if (responseData.data) {
-                document.getElementById("TryConnect").style.color = "green";
-                document.getElementById("TryConnect").innerHTML = "Good";
-            } else {
+            if (!responseData || !responseData.data) {
                 document.getElementById("TryConnect").style.color = "red";
                 document.getElementById("TryConnect").innerHTML = "Wrong";
+                document.getElementById("loaderConnect").style.display = "none";
             }
-            document.getElementById("loaderConnect").style.display = "none";
         });
     } catch { () => { document.getElementById("loaderConnect").style.display = "none"; } }
 }
@@ -139,8 +188,8 @@ function creatGridItem(itemData, indexJson) {
     newItem.className = "grid-item";
     newItem.style.width = 300;
     Object.keys(itemData).forEach(function (key) {
-        // if (key != "type")
-        tableData.appendChild(creatPropertyRow(key, itemData[key]));
+        if (key != "id")
+            tableData.appendChild(creatPropertyRow(key, itemData[key]));
     });
 
     let buttonEdit = document.createElement("img");
@@ -194,7 +243,7 @@ function onWindowResizeModifyGridSize() {
 }
 
 async function getAccsoriesFromDB() {
-    await getRequest("/accessories/stored").then(function onSuccess(responseData) {
+    await getRequest("/accessories").then(function onSuccess(responseData) {
         if (responseData && responseData.message == "success") {
             AccessoryJSON = responseData.data;
         }
@@ -211,12 +260,14 @@ function editeButton(indexJson) {
     gridViewContainer.appendChild(tableEdit);
 
     Object.keys(itemData).forEach(function (key) {
-        if (key != "type" && key != "aidMeta")
+        if (key != "type" && key != "aidMeta" && key != "id")
             tableEdit.appendChild(creatPropertyRowEdit(key, itemData[key], indexJson));
     });
 }
 
-function removeButton(indexJson) {
+async function removeButton(indexJson) {
+    if (await accessoryRequest("DELETE", "/accessories/" + AccessoryJSON[indexJson].id) == null)
+        return;
     AccessoryJSON.splice(indexJson, 1);
     gridLoader();
 }
@@ -260,9 +311,16 @@ function saveNewValueJson(Key, newValue, indexJson) {
     }
     AccessoryJSON[indexJson][Key] = newValue.value.trim();
     newValue.value = AccessoryJSON[indexJson][Key];
+    editedAccessory = indexJson;
 }
 
-function closeButton() {
+async function closeButton() {
+    if (editedAccessory >= 0) {
+        let accessory = AccessoryJSON[editedAccessory];
+        editedAccessory = -1;
+        if (await accessoryRequest("PUT", "/accessories/" + accessory.id, accessory) == null)
+            await getAccsoriesFromDB();
+    }
     document.getElementById("editFullScreen").style.display = "none";
     gridLoader();
 }
@@ -292,7 +350,7 @@ function addButton() {
     tdDivValue.appendChild(selectOptions);
 }
 
-function addButtonDone() {
+async function addButtonDone() {
 
     let accessoryType = document.getElementById("AccType").value
     console.log(accessoryType);
@@ -311,6 +369,10 @@ function addButtonDone() {
         else
             newAccessory[accessProp[i]] = 1;
     }
+    const response = await accessoryRequest("POST", "/accessories", newAccessory);
+    if (response == null)
+        return;
+    newAccessory.id = response.data.id;
     AccessoryJSON.push(newAccessory);
 
     document.getElementById("addAccessoryScreen").style.display = "none";
@@ -318,11 +380,6 @@ function addButtonDone() {
     editeButton(AccessoryJSON.length - 1);
 }
 
-async function sendAccessoriesToServer() {
-    await postRequest("/accessories/save", AccessoryJSON);
-    location.reload();
-}
-
 function unpairDevice() {
     if (confirm("Are you sure you want to Unpair this decive, you will not be able to control it throw your IOS devices until you pair it again!, the device will restart after unpairing.") == true) {
         getRequest("/command/unpair");
@@ -335,11 +392,38 @@ function factoryresetDevice() {
     }
 }
 
+async function uploadFirmware() {
+    let file = document.getElementById("firmwareFile").files[0];
+    if (file == undefined) {
+        alert("Choose a firmware image first.");
+        return;
+    }
+    let status = document.getElementById("firmwareStatus");
+    let headers = {};
+    // a delta made with make_delta.py is rebuilt on the device and carries the hash of the new image
+    let delta = await file.slice(0, 8).text() == "MHDELTA1";
+    // browsers only hash on a secure origin, the device verifies the image either way
+    if (!delta && window.crypto && crypto.subtle) {
+        let digest = await crypto.subtle.digest("SHA-256", await file.arrayBuffer());
+        headers["X-Firmware-SHA256"] = Array.from(new Uint8Array(digest), b => b.toString(16).padStart(2, "0")).join("");
+    }
+    status.textContent = "Uploading...";
+    try {
+        const res = await fetch(delta ? "/firmware/delta" : "/firmware", { method: "POST", headers: headers, body: file });
+        if (!res.ok) {
+            status.textContent = "Update failed: " + await res.text();
+            return;
+        }
+        let responseData = await res.json();
+        status.textContent = "Firmware " + responseData.data.version + " is ready, restart to run it.";
+    } catch (e) {
+        status.textContent = "Update failed: " + e.message;
+    }
+}
+
 function updatefirmwareDevice() {
-    if (confirm("Are you sure you want to factory reset the device, all data will be erased.") == true) {
-        getRequest("/command/updatefirmware").then(function onSuccess(responseData) {
-            document.getElementById("updateLabel").innerHTML = responseData.message;
-        });
+    if (confirm("Restart the device into the uploaded firmware? It goes back to this one if the new firmware does not start.") == true) {
+        getRequest("/command/updatefirmware");
     }
 }
 
@@ -2,11 +2,46 @@
 
 #include <esp_err.h>
 #include <esp_http_server.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <atomic>
 
 #include <StorageManagerInterface.hpp>
+#include <WifiStation.hpp>
+
+#include "FrontendBundle.hpp"
+#include "HttpWorkerPool.hpp"
+#include "WebSocketHub.hpp"
+
+class EndpointManager;
+struct AppEvent;
 
 class AccessPoint {
+ public:
+  /**
+   * @brief Listener of the live config session, called when it opens or closes.
+   */
+  using SessionListener = void (*)(bool open, void *context);
+
+ private:
   StorageManagerInterface *storageManager;
+  EndpointManager *endpointManager;    // live endpoints next to Matter, nullptr in program mode
+  httpd_handle_t server;               // web server, nullptr until started
+  FrontendBundle frontendBundle;       // frontend assets served by file_read_handler
+  HttpWorkerPool workerPool;           // runs the slow handlers off the server task
+  HttpWorkerPool::Limit storageLimit;  // concurrent requests touching the accessory database
+  HttpWorkerPool::Limit updateLimit;   // concurrent firmware uploads, there is one OTA slot to write
+  WebSocketHub events;                 // live events pushed to the config UI
+  WifiStation station;                 // joins the stored network next to the access point
+  esp_timer_handle_t sessionTimer;     // closes an idle live config session
+  QueueHandle_t sessionRequests;       // toggles and timeouts of the session, run in order by sessionTask
+  TaskHandle_t sessionTask;            // opens and closes the session, off the event bus dispatcher
+  std::atomic<bool> sessionOpen;       // whether clients are accepted, always in program mode
+  SessionListener sessionListener;     // told when the live config session opens or closes
+  void *sessionContext;                // context of the session listener
 
   // delete the copy constructor and the assignment operator
   AccessPoint(const AccessPoint &) = delete;
@@ -15,19 +50,75 @@ class AccessPoint {
   static esp_err_t file_read_handler(httpd_req_t *req);
   static esp_err_t command_handler(httpd_req_t *req);
   static esp_err_t accessories_handler(httpd_req_t *req);
+  static esp_err_t accessory_handler(httpd_req_t *req);
   static esp_err_t wifi_handler(httpd_req_t *req);
+  static esp_err_t events_handler(httpd_req_t *req);
+  static esp_err_t metrics_handler(httpd_req_t *req);
+  static esp_err_t firmware_handler(httpd_req_t *req);
+
+  // gate of the web server, refuses new connections while no session is open
+  static esp_err_t session_open_handler(httpd_handle_t hd, int sockfd);
+  static void session_timeout_handler(void *arg);
+  static void session_task(void *arg);
+
+  // requests of the session task
+  enum class SessionRequest : uint8_t { Toggle, Close };
+  void requestSession(SessionRequest request);
+
+  /**
+   * @brief Open the live config session: start the soft-AP next to the station, on its channel, and
+   * accept web clients. The session closes after CONFIG_AP_SESSION_TIMEOUT seconds without an
+   * accessory change. Runs on the session task only.
+   * @return ESP_OK on success, the error of the WiFi driver or the web server otherwise.
+   */
+  esp_err_t openSession();
+
+  /**
+   * @brief Close the live config session: stop the soft-AP and drop the web clients. Runs on the session
+   * task only.
+   */
+  void closeSession();
+
+  // push the accessory database version, so clients reload it after a change
+  void publishAccessories();
+  // publish a change of the accessory database, and apply it to the live endpoints
+  void accessoriesChanged();
+  // push the number of stations connected to the access point
+  void publishStations();
 
   // callback function for the wifi event
   static void change_led_status(int32_t event_id);  /// TODO : Reimplement this function
 
-  /**  event handler for wifi events
-   *   to handle the wifi events and change the led status when WIFI_EVENT_AP_STACONNECTED and
-   * WIFI_EVENT_AP_STADISCONNECTED
+  /**  event bus handler for wifi events
+   *   to handle the wifi events and change the led status when a station joins or leaves the access
+   * point, and to report the station connection to the config UI
    */
-  static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+  static void wifi_event_handler(const AppEvent &event, void *context);
 
  public:
   AccessPoint(StorageManagerInterface *storageManager);
+
+  /**
+   * @brief Serve the config UI next to Matter, which owns the WiFi. Nothing is served until a session
+   * is opened with toggleSession().
+   * @param storageManager Storage of the accessory database and the WiFi credentials.
+   * @param endpointManager Endpoints the saved accessories are applied to, without a restart.
+   */
+  AccessPoint(StorageManagerInterface *storageManager, EndpointManager *endpointManager);
   ~AccessPoint();
   esp_err_t startWebServer();
+
+  /**
+   * @brief Open the live config session if it is closed, close it otherwise.
+   *
+   * Only queues the request and returns, callable from any task. The session task opens or closes the
+   * session, one request at a time with the idle timeout, as the first open starts the web server and
+   * upgrades the accessory database on a stack sized for it.
+   */
+  void toggleSession();
+
+  /**
+   * @brief Set the listener told when the live config session opens or closes.
+   */
+  void setSessionListener(SessionListener listener, void *context);
 };
\ No newline at end of file
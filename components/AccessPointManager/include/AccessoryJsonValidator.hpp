@@ -0,0 +1,145 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Incremental validator for the accessory JSON configuration.
+ *
+ * The configuration is fed in arbitrary chunks, so a body can be checked while it is received without
+ * ever holding it in memory. It must be an array of flat objects, each with a "type" known to the
+ * schema and every property the schema requires for that type. "name" must be a non-empty string,
+ * pins an integer from 1 to 16 and the other properties non-negative integers, numeric strings
+ * included. An optional "id" identifies a stored accessory. Other keys are accepted as they are.
+ *
+ * Every valid accessory is handed to the record handler minified and without its "id", the form it is
+ * stored in.
+ */
+class AccessoryJsonValidator {
+ public:
+  /**
+   * @brief Receives each accessory once it is validated.
+   * @param id Value of the accessory "id", 0 if it has none.
+   * @param json The accessory object, minified and without its "id".
+   * @param length Length of json.
+   * @param context Context passed to setRecordHandler().
+   * @return ESP_OK to continue, any other value fails the validation.
+   */
+  using RecordHandler = esp_err_t (*)(uint16_t id, const char* json, size_t length, void* context);
+
+  /**
+   * @brief Longest accessory handed to the record handler, a longer one fails the validation.
+   */
+  static constexpr size_t kMaxRecordLength = 512;
+
+  AccessoryJsonValidator();
+
+  /**
+   * @brief Expect a single accessory object instead of an array. Must be called before feed().
+   */
+  void expectSingle() { m_single = true; }
+
+  /**
+   * @brief Set the handler receiving each validated accessory.
+   */
+  void setRecordHandler(RecordHandler handler, void* context) {
+    m_handler = handler;
+    m_handlerContext = context;
+  }
+
+  /**
+   * @brief Load the schema, an object mapping every device type to the array of properties it requires,
+   * as produced by DeviceCreator::getJsonSchemaForAllDevices().
+   * @param schema NUL-terminated schema JSON.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the schema cannot be parsed or is too large.
+   */
+  esp_err_t loadSchema(const char* schema);
+
+  /**
+   * @brief Validate the next chunk of the configuration.
+   * @param data Pointer to the chunk.
+   * @param length Length of the chunk.
+   * @return ESP_OK if the configuration is valid so far, ESP_ERR_INVALID_ARG otherwise, see error().
+   */
+  esp_err_t feed(const char* data, size_t length);
+
+  /**
+   * @brief Check that the configuration is complete.
+   * @return ESP_OK if the whole configuration is valid, ESP_ERR_INVALID_ARG otherwise, see error().
+   */
+  esp_err_t finish();
+
+  /**
+   * @brief Description of the first error, empty while the configuration is valid.
+   */
+  const char* error() const { return m_error; }
+
+  /**
+   * @brief Number of complete accessories validated so far.
+   */
+  uint16_t count() const { return m_count; }
+
+ private:
+  static constexpr size_t kMaxTypes = 16;
+  static constexpr size_t kMaxProperties = 32;
+  static constexpr size_t kMaxNameLength = 24;
+  static constexpr size_t kMaxTokenLength = 64;
+
+  enum class State : uint8_t {
+    Start,       ///< Before the opening '['
+    ArrayFirst,  ///< After '[', an accessory or ']'
+    ArrayNext,   ///< After an accessory, ',' or ']'
+    Element,     ///< After ',', an accessory
+    FirstKey,    ///< After '{', a property name or '}'
+    Key,         ///< After ',', a property name
+    Colon,       ///< After a property name
+    Value,       ///< After ':'
+    ObjectNext,  ///< After a value, ',' or '}'
+    End,         ///< After the closing ']'
+  };
+  enum class Token : uint8_t { None, String, Number, Literal };
+
+  struct Type {
+    char name[kMaxNameLength];
+    uint32_t required;  ///< Bit mask of the required properties
+  };
+
+  char m_properties[kMaxProperties][kMaxNameLength];  ///< Property names of all types
+  uint8_t m_propertyCount;
+  Type m_types[kMaxTypes];
+  uint8_t m_typeCount;
+
+  bool m_single;
+  RecordHandler m_handler;
+  void* m_handlerContext;
+
+  State m_state;
+  Token m_token;  ///< Token being read, may span chunks
+  bool m_escape;
+  char m_buffer[kMaxTokenLength + 1];
+  size_t m_bufferLength;
+
+  int8_t m_key;                 ///< Property index of the current key, or kTypeKey / kOtherKey
+  uint32_t m_seen;              ///< Valid properties of the current object
+  char m_type[kMaxNameLength];  ///< Type of the current object
+  uint16_t m_count;
+
+  char m_record[kMaxRecordLength];  ///< Current object as it is stored
+  size_t m_recordLength;
+  size_t m_memberStart;  ///< Record length before the current member and its ','
+  bool m_memberFirst;    ///< The current member has no ',' before it
+  bool m_dropComma;      ///< The first member was dropped, so is the ',' after it
+  uint16_t m_recordId;   ///< "id" of the current object, 0 if it has none
+  size_t m_offset;  ///< Bytes consumed, reported with errors
+  char m_error[96];
+
+  esp_err_t step(char c);
+  esp_err_t append(char c);
+  esp_err_t startObject();
+  esp_err_t endToken(Token token);
+  esp_err_t onKey();
+  esp_err_t onValue(Token token);
+  esp_err_t endObject();
+  esp_err_t fail(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FirmwareUpdate.hpp"
+
+struct tinfl_decompressor_tag;
+
+/**
+ * @brief Rebuilds a new firmware image from a delta against the running one, see tools/make_delta.py.
+ *
+ * The delta is inflated and applied while it streams in. Every record adds its difference bytes to the
+ * running image at a source cursor and appends its extra bytes as they are. The result is written
+ * through a FirmwareUpdate, which checks and verifies it exactly like a full upload. RAM stays bounded
+ * by the inflate window and one write chunk, about 48 KiB, allocated by begin().
+ */
+class DeltaPatcher {
+ public:
+  /**
+   * @brief Length of the delta header.
+   */
+  static constexpr size_t kHeaderLength = 80;
+
+  /**
+   * @param update Update the rebuilt image is written to, not begun yet.
+   */
+  explicit DeltaPatcher(FirmwareUpdate *update);
+  ~DeltaPatcher();
+
+  /**
+   * @brief Allocate the inflate state and the write chunk.
+   * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise.
+   */
+  esp_err_t begin();
+
+  /**
+   * @brief Apply the next part of the delta.
+   *
+   * Once the header is complete the running image is checked against it and the update is begun with
+   * the size of the new image.
+   * @return ESP_OK on success, ESP_ERR_INVALID_VERSION if the delta was made against another image,
+   *         ESP_ERR_INVALID_ARG if the delta is corrupt, the error of the update otherwise.
+   */
+  esp_err_t feed(const uint8_t *data, size_t length);
+
+  /**
+   * @brief Write the end of the image, verify it and make it the boot image.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the delta ended early, the error of
+   *         FirmwareUpdate::finish() otherwise.
+   */
+  esp_err_t finish();
+
+ private:
+  enum class State : uint8_t { Header, Record, Diff, Extra };
+
+  static constexpr size_t kRecordLength = 12;
+
+  FirmwareUpdate *m_update;                   ///< Update the rebuilt image is written to
+  const esp_partition_t *m_source;            ///< Running image the differences are added to
+  tinfl_decompressor_tag *m_inflater;         ///< Inflate state
+  uint8_t *m_window;                          ///< Ring the inflater writes into, its dictionary
+  size_t m_windowPos;                         ///< Next write position in the ring
+  bool m_streamEnd;                           ///< Whether the deflate stream is complete
+  uint8_t *m_chunk;                           ///< Rebuilt bytes not written to the update yet
+  size_t m_chunkFill;                         ///< Bytes in the chunk
+  State m_state;                              ///< Part of the delta expected next
+  uint8_t m_pending[kHeaderLength];           ///< Header or record being collected
+  size_t m_pendingFill;                       ///< Bytes of the header or record collected
+  uint32_t m_sourceSize;                      ///< Size of the image the delta was made against
+  uint8_t m_targetHash[kFirmwareHashLength];  ///< SHA-256 of the rebuilt image
+  uint32_t m_sourcePos;                       ///< Source cursor
+  uint32_t m_diffLeft;                        ///< Difference bytes left in the record
+  uint32_t m_extraLeft;                       ///< Extra bytes left in the record
+  int32_t m_seek;                             ///< Cursor move at the end of the record
+
+  esp_err_t startUpdate();
+  esp_err_t inflate(const uint8_t *data, size_t length);
+  esp_err_t apply(const uint8_t *data, size_t length);
+  esp_err_t applyDiff(const uint8_t *data, size_t length);
+  esp_err_t nextPart();
+  esp_err_t emit(const uint8_t *data, size_t length);
+
+  // delete the copy constructor and the assignment operator
+  DeltaPatcher(const DeltaPatcher &) = delete;
+  DeltaPatcher &operator=(const DeltaPatcher &) = delete;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#include <StorageManagerInterface.hpp>
+
+#include "HttpWorkerPool.hpp"
+#include "PrometheusWriter.hpp"
+
+/**
+ * @brief Device health in the Prometheus text format, served on /metrics.
+ *
+ * Families, all prefixed with metahouse_:
+ *   uptime_seconds, reset_reason                       boot
+ *   heap_free_bytes, heap_min_free_bytes,
+ *   heap_largest_block_bytes                           heap per capability
+ *   task_stack_free_bytes, task_cpu_ratio,
+ *   task_runtime_seconds_total                         per task, needs the trace facility
+ *   http_requests_total, http_request_failures_total,
+ *   http_requests_rejected_total,
+ *   http_request_duration_seconds                      per route of the worker pool
+ *   storage_operations_total, storage_errors_total,
+ *   storage_bytes_total, storage_duration_seconds_total,
+ *   storage_max_duration_seconds                       StorageManager counters
+ *   wifi_stations, wifi_station_rssi_dbm, wifi_rssi_dbm
+ */
+class DeviceMetrics {
+ public:
+  /**
+   * @brief Stream every metric family.
+   * @param req The request to respond to.
+   * @param storageManager Storage whose counters are reported, nullptr to skip them.
+   * @param workerPool Pool whose route counters are reported.
+   * @return ESP_OK if the whole response was sent, the send error otherwise.
+   */
+  static esp_err_t write(httpd_req_t *req, StorageManagerInterface *storageManager,
+                         const HttpWorkerPool &workerPool);
+
+ private:
+  static void writeSystem(PrometheusWriter &writer);
+  static void writeTasks(PrometheusWriter &writer);
+  // the task statistics of the TaskMonitor, written instead of the raw ones while it runs
+  static void writeMonitoredTasks(PrometheusWriter &writer);
+  static void writeHttp(PrometheusWriter &writer, const HttpWorkerPool &workerPool);
+  static void writeStorage(PrometheusWriter &writer, StorageManagerInterface *storageManager);
+  static void writeWifi(PrometheusWriter &writer);
+
+  DeviceMetrics() = delete;
+};
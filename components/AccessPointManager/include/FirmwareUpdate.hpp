@@ -0,0 +1,97 @@
+#pragma once
+
+#include <esp_app_desc.h>
+#include <esp_app_format.h>
+#include <esp_err.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Length of the SHA-256 of an uploaded image in bytes.
+ */
+constexpr size_t kFirmwareHashLength = 32;
+
+/**
+ * @brief Streams an application image into the inactive OTA slot.
+ *
+ * The image is written as it arrives, so it is never held in RAM, and hashed on the way. The first
+ * write must hold the image, segment and app description headers, they are checked before anything
+ * is written to flash. finish() verifies the whole image, its signature too when signed apps are
+ * enabled, and only then switches the boot partition. An update that is not finished is aborted by
+ * the destructor, the running image stays the boot image.
+ */
+class FirmwareUpdate {
+ public:
+  /**
+   * @brief Bytes the first write must hold for the headers to be checked.
+   */
+  static constexpr size_t kHeaderLength =
+      sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+
+  FirmwareUpdate();
+  ~FirmwareUpdate();
+
+  /**
+   * @brief Start an update into the next OTA slot.
+   * @param imageSize Size of the image in bytes.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no OTA slot to write,
+   *         ESP_ERR_INVALID_SIZE if the image does not fit the slot, ESP_ERR_INVALID_STATE if an update
+   *         is already in progress.
+   */
+  esp_err_t begin(size_t imageSize);
+
+  /**
+   * @brief Write the next part of the image.
+   * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the first write is shorter than kHeaderLength or
+   *         the image grows past its size, ESP_ERR_OTA_VALIDATE_FAILED if the headers are not the ones of
+   *         an image of this project for this chip, the flash error otherwise.
+   */
+  esp_err_t write(const void *data, size_t length);
+
+  /**
+   * @brief Verify the complete image and make it the boot image.
+   * @param expectedHash SHA-256 the image must have, nullptr to skip the comparison.
+   * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if fewer bytes than announced were written,
+   *         ESP_ERR_INVALID_CRC if the hash does not match, ESP_ERR_OTA_VALIDATE_FAILED if the image or
+   *         its signature is invalid.
+   */
+  esp_err_t finish(const uint8_t *expectedHash);
+
+  /**
+   * @brief Drop the update, the slot keeps the partial image but is never booted.
+   */
+  void abort();
+
+  /**
+   * @brief Bytes written so far.
+   */
+  size_t written() const { return m_written; }
+
+  /**
+   * @brief SHA-256 of the image, valid once finish() succeeded.
+   */
+  const uint8_t *hash() const { return m_hash; }
+
+  /**
+   * @brief Version string of the image, valid once the first write succeeded.
+   */
+  const char *version() const { return m_version; }
+
+ private:
+  const esp_partition_t *m_partition;               ///< Slot being written, nullptr while idle
+  esp_ota_handle_t m_handle;                        ///< Handle of the OTA write
+  mbedtls_sha256_context m_sha;                     ///< Hash of the bytes written so far
+  size_t m_size;                                    ///< Announced image size
+  size_t m_written;                                 ///< Bytes written so far
+  uint8_t m_hash[kFirmwareHashLength];              ///< Hash of the finished image
+  char m_version[sizeof(esp_app_desc_t::version)];  ///< Version from the app description
+
+  esp_err_t checkHeaders(const uint8_t *data);
+
+  // delete the copy constructor and the assignment operator
+  FirmwareUpdate(const FirmwareUpdate &) = delete;
+  FirmwareUpdate &operator=(const FirmwareUpdate &) = delete;
+};
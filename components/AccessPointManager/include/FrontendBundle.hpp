@@ -0,0 +1,77 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Length of an asset hash in bytes.
+ */
+constexpr size_t kFrontendHashLength = 8;
+
+/**
+ * @brief One asset of the frontend bundle. All pointers reference the memory-mapped partition.
+ */
+struct FrontendAsset {
+  const char* path;         ///< Request path, e.g. "/index.html"
+  const char* mimeType;     ///< Content type sent with the asset
+  const uint8_t* data;      ///< Minified asset contents
+  uint32_t length;          ///< Length of the contents in bytes
+  const uint8_t* gzipData;  ///< Gzip variant of the contents, nullptr if compression does not pay off
+  uint32_t gzipLength;      ///< Length of the gzip variant in bytes
+  const uint8_t* hash;      ///< First 8 bytes of the SHA-256 of the contents, the asset version
+};
+
+/**
+ * @brief Read-only frontend bundle memory-mapped from a flash partition.
+ *
+ * The bundle is produced at build time by tools/pack_frontend.py. Its index is sorted by path, so a
+ * lookup is a binary search over the mapped index and assets are served straight from flash without
+ * a filesystem.
+ */
+class FrontendBundle {
+ public:
+  FrontendBundle();
+  ~FrontendBundle();
+
+  /**
+   * @brief Map the bundle and validate its header, index and checksum.
+   * @param partitionLabel Label of the data partition holding the bundle.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition does not exist,
+   *         ESP_ERR_INVALID_VERSION or ESP_ERR_INVALID_CRC if the image is not a valid bundle.
+   */
+  esp_err_t open(const char* partitionLabel);
+
+  /**
+   * @brief Unmap the bundle.
+   */
+  void close();
+
+  /**
+   * @brief Look up an asset.
+   * @param path Request path, not necessarily NUL-terminated.
+   * @param length Length of the path.
+   * @param[out] asset Asset found.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the bundle has no such asset.
+   */
+  esp_err_t find(const char* path, size_t length, FrontendAsset* asset) const;
+
+  /**
+   * @brief Number of assets in the bundle, 0 while the bundle is not open.
+   */
+  uint16_t size() const;
+
+ private:
+  struct Header;
+  struct Entry;
+
+  const uint8_t* m_base;                  ///< Start of the mapped bundle
+  const Header* m_header;                 ///< Bundle header
+  const Entry* m_entries;                 ///< Sorted index
+  esp_partition_mmap_handle_t m_mapping;  ///< Handle of the flash mapping
+
+  // delete the copy constructor and the assignment operator
+  FrontendBundle(const FrontendBundle&) = delete;
+  FrontendBundle& operator=(const FrontendBundle&) = delete;
+};
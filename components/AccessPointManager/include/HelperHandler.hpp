@@ -5,13 +5,13 @@
 
 #include <StorageManagerInterface.hpp>
 
-esp_err_t check_file_exist(const char *filename);
+#include "AccessoryJsonValidator.hpp"
 
-esp_err_t set_content_type(httpd_req_t *req, const char *filename);
+bool accepts_gzip(httpd_req_t *req);
 
-esp_err_t stream_file(httpd_req_t *req, const char *filename);
+bool etag_matches(httpd_req_t *req, const char *etag);
 
-esp_err_t mount_fs(char *base_path, char *partition_label);
+bool is_versioned_request(httpd_req_t *req, const char *version);
 
 esp_err_t unpair_device(StorageManagerInterface *storageManager);
 
@@ -23,7 +23,10 @@ esp_err_t restart_device();
 
 esp_err_t existProgramMode(StorageManagerInterface *storageManager);
 
-esp_err_t get_accessory_DB_JSON(StorageManagerInterface *storageManager, char *response,
-                                size_t response_size);
+esp_err_t set_accessory_DB_JSON(StorageManagerInterface *storageManager, const char *new_accessory_json);
 
-esp_err_t set_accessory_DB_JSON(StorageManagerInterface *storageManager, const char *new_accessory_json);
\ No newline at end of file
+esp_err_t upgrade_accessory_DB(StorageManagerInterface *storageManager);
+
+esp_err_t load_accessory_schema(AccessoryJsonValidator *validator);
+
+esp_err_t stage_accessory(uint16_t id, const char *json, size_t length, void *context);
\ No newline at end of file
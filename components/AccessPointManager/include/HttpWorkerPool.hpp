@@ -0,0 +1,152 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * @brief Pool of worker tasks running the slow handlers of an httpd server.
+ *
+ * httpd serves every socket from a single task, so one slow response holds up all the others. A route
+ * built with route() is dispatched on the server task, which only hands the request off with
+ * httpd_req_async_handler_begin() and returns to the other sockets, while a worker runs the handler.
+ * Cheap routes built with inlineRoute() keep running on the server task.
+ *
+ * The pool counts the requests of every route it built and their latency, from the moment the server
+ * dispatches them until the handler returns.
+ */
+class HttpWorkerPool {
+ public:
+  using Handler = esp_err_t (*)(httpd_req_t *req);
+
+  /**
+   * @brief Upper bounds of the latency histogram buckets, in microseconds.
+   */
+  static constexpr uint32_t kLatencyBucketsUs[] = {5000,   10000,  25000,   50000,  100000,
+                                                   250000, 500000, 1000000, 2500000};
+  static constexpr size_t kLatencyBucketCount = sizeof(kLatencyBucketsUs) / sizeof(kLatencyBucketsUs[0]);
+
+  /**
+   * @brief Counters of one route since boot.
+   */
+  struct RouteStats {
+    const char *uri;
+    httpd_method_t method;
+    uint32_t requests;                      ///< Requests handled, failures included
+    uint32_t failures;                      ///< Requests whose handler failed
+    uint32_t rejected;                      ///< Requests answered with 503 without running the handler
+    uint64_t totalUs;                       ///< Sum of the latencies of the handled requests
+    uint32_t buckets[kLatencyBucketCount];  ///< Handled requests per latency bucket, not cumulative
+  };
+
+  /**
+   * @brief Concurrency limit shared by the routes it is assigned to.
+   *
+   * A request arriving while the limit is reached is answered with 503 and a Retry-After header
+   * instead of waiting for a worker.
+   */
+  class Limit {
+   public:
+    explicit Limit(uint8_t max) : m_max(max), m_active(0) {}
+
+    bool tryAcquire();
+    void release();
+
+   private:
+    const uint8_t m_max;
+    std::atomic<uint8_t> m_active;
+  };
+
+  HttpWorkerPool();
+
+  /**
+   * @brief Delete the workers, the server must be stopped first.
+   */
+  ~HttpWorkerPool();
+
+  /**
+   * @brief Create the workers.
+   * @param workers Number of worker tasks, at most kMaxWorkers.
+   * @param queueLength Number of requests that can wait for a worker, further requests get a 503.
+   * @param stackSize Stack size of each worker.
+   * @param priority Priority of the workers, usually the priority of the server task.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if an argument is out of range, ESP_ERR_NO_MEM otherwise.
+   */
+  esp_err_t start(uint8_t workers, uint8_t queueLength, uint32_t stackSize, UBaseType_t priority);
+
+  /**
+   * @brief Build a route whose handler runs on a worker.
+   * @param uri URI template of the route.
+   * @param method HTTP method of the route.
+   * @param handler Handler run on a worker, req->user_ctx is set to context.
+   * @param context User context of the handler.
+   * @param limit Concurrency limit of the route, nullptr for none.
+   * @return The route to register with httpd_register_uri_handler().
+   */
+  httpd_uri_t route(const char *uri, httpd_method_t method, Handler handler, void *context, Limit *limit);
+
+  /**
+   * @brief Build a route whose handler runs on the server task, only to count its requests.
+   * @param uri URI template of the route.
+   * @param method HTTP method of the route.
+   * @param handler Handler, req->user_ctx is set to context.
+   * @param context User context of the handler.
+   * @return The route to register with httpd_register_uri_handler().
+   */
+  httpd_uri_t inlineRoute(const char *uri, httpd_method_t method, Handler handler, void *context);
+
+  /**
+   * @brief Number of routes built by the pool.
+   */
+  uint8_t routeCount() const { return m_routeCount; }
+
+  /**
+   * @brief Get a consistent copy of the counters of a route.
+   * @param index Index of the route, below routeCount().
+   * @param[out] stats Counters of the route.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the index is out of range.
+   */
+  esp_err_t getRouteStats(uint8_t index, RouteStats *stats) const;
+
+ private:
+  static constexpr uint8_t kMaxWorkers = 8;
+  static constexpr uint8_t kMaxRoutes = 24;
+
+  struct Route {
+    HttpWorkerPool *pool;
+    Handler handler;
+    void *context;
+    Limit *limit;
+    bool onWorker;
+    RouteStats stats;
+  };
+
+  struct Job {
+    httpd_req_t *req;  ///< Copy of the request owned by the job
+    Route *route;
+    int64_t startUs;  ///< Time the server dispatched the request
+  };
+
+  Route m_routes[kMaxRoutes];
+  uint8_t m_routeCount;
+  QueueHandle_t m_queue;
+  TaskHandle_t m_workers[kMaxWorkers];
+  uint8_t m_workerCount;
+
+  httpd_uri_t addRoute(const char *uri, httpd_method_t method, Handler handler, void *context, Limit *limit,
+                       bool onWorker);
+
+  static esp_err_t dispatch(httpd_req_t *req);
+  static void worker(void *arg);
+  static void record(Route *route, int64_t startUs, esp_err_t result);
+
+  // delete the copy constructor and the assignment operator
+  HttpWorkerPool(const HttpWorkerPool &) = delete;
+  HttpWorkerPool &operator=(const HttpWorkerPool &) = delete;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Streams a response in the Prometheus text exposition format.
+ *
+ * Lines are collected in a small buffer and sent as chunks whenever it fills, so the size of the
+ * response is not bounded by any buffer. The first send error is kept and stops all further output.
+ */
+class PrometheusWriter {
+ public:
+  /**
+   * @brief Size of the buffer lines are collected in.
+   */
+  static constexpr size_t kBufferSize = 512;
+
+  explicit PrometheusWriter(httpd_req_t *req);
+
+  /**
+   * @brief Write the HELP and TYPE lines of a metric family.
+   * @param name Name of the family.
+   * @param type "counter", "gauge" or "histogram".
+   * @param help Description of the family.
+   */
+  void family(const char *name, const char *type, const char *help);
+
+  /**
+   * @brief Write an integer sample.
+   * @param name Name of the sample.
+   * @param labels Labels without the braces, e.g. task="main", nullptr for none.
+   * @param value Value of the sample.
+   */
+  void sample(const char *name, const char *labels, int64_t value);
+
+  /**
+   * @brief Write a sample in seconds from a duration in microseconds.
+   */
+  void seconds(const char *name, const char *labels, uint64_t microseconds);
+
+  /**
+   * @brief Write a ratio sample with three decimals.
+   */
+  void ratio(const char *name, const char *labels, uint32_t permille);
+
+  /**
+   * @brief Send the buffered lines and the final chunk.
+   * @return ESP_OK if the whole response was sent, the first send error otherwise.
+   */
+  esp_err_t finish();
+
+ private:
+  httpd_req_t *m_req;
+  char m_buffer[kBufferSize];
+  size_t m_fill;
+  esp_err_t m_err;
+
+  void print(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  void flush();
+
+  // delete the copy constructor and the assignment operator
+  PrometheusWriter(const PrometheusWriter &) = delete;
+  PrometheusWriter &operator=(const PrometheusWriter &) = delete;
+};
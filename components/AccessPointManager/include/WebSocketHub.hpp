@@ -0,0 +1,54 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <stddef.h>
+
+#include <atomic>
+
+/**
+ * @brief Broadcasts compact JSON events to the WebSocket clients of an httpd server.
+ *
+ * Events are formatted by the publishing task and sent from the server task with httpd_queue_work(),
+ * so frames never interleave on a socket however many tasks publish. Nothing is formatted or queued
+ * while no client is connected.
+ */
+class WebSocketHub {
+ public:
+  /**
+   * @brief Longest event, in bytes.
+   */
+  static constexpr size_t kMaxEventLength = 128;
+
+  WebSocketHub();
+
+  /**
+   * @brief Set the server the events are sent on. Must be called before publish().
+   */
+  void attach(httpd_handle_t server) { m_server = server; }
+
+  /**
+   * @brief Handle a request of the WebSocket route: accept the handshake and drop the frames clients send.
+   * @param req The request.
+   * @return ESP_OK on success, an error closes the connection.
+   */
+  esp_err_t handle(httpd_req_t *req);
+
+  /**
+   * @brief Send an event to every connected client.
+   * @param format printf format of the event JSON.
+   * @return ESP_OK on success or when no client is connected, ESP_ERR_INVALID_SIZE if the event is longer
+   *         than kMaxEventLength, ESP_ERR_NO_MEM if it cannot be queued.
+   */
+  esp_err_t publish(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+ private:
+  httpd_handle_t m_server;
+  std::atomic<bool> m_hasClients;  ///< A client connected since the last broadcast found none
+
+  static void broadcast(void *arg);
+
+  // delete the copy constructor and the assignment operator
+  WebSocketHub(const WebSocketHub &) = delete;
+  WebSocketHub &operator=(const WebSocketHub &) = delete;
+};
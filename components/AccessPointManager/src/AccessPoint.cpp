@@ -1,43 +1,49 @@
 #include "AccessPoint.hpp"
 
+#include <ArduinoJson.h>
+#include <ctype.h>
 #include <esp_err.h>
 #include <esp_event.h>
 #include <esp_http_server.h>
 #include <esp_log.h>
 #include <esp_netif.h>
-#include <esp_spiffs.h>
 #include <esp_wifi.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <EndpointManager.hpp>
+
+#include "AccessoryJsonValidator.hpp"
+#include "AppEventBus.hpp"
+#include "DeltaPatcher.hpp"
+#include "DeviceMetrics.hpp"
+#include "FirmwareUpdate.hpp"
 #include "HelperHandler.hpp"
 
 static const char *TAG = "AccessPoint";
 
-AccessPoint::AccessPoint(StorageManagerInterface *storageManager) : storageManager(storageManager) {
-  ESP_LOGI(TAG, "AccessPoint instance created");
-  esp_err_t err = esp_event_loop_create_default();
-  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
-    ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(err));
-    return;
-  }
+static constexpr int AP_RECV_MAX_TIMEOUTS = 3;
 
-  err = esp_netif_init();
+// bytes written between two progress events of a firmware upload
+static constexpr size_t AP_OTA_PROGRESS_STEP = 64 * 1024;
 
-  esp_netif_create_default_wifi_ap();
+// longest body of a WiFi request, the credentials with room for JSON escapes
+static constexpr size_t AP_WIFI_BODY_MAX_SIZE = 256;
 
-  wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-  err = esp_wifi_init(&cfg);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to initialize wifi: %s", esp_err_to_name(err));
-    return;
-  }
+// sockets the web server keeps for itself next to its clients, the listener and its control sockets
+static constexpr int AP_SERVER_SOCKETS = 3;
 
+/**
+ * @brief Configure the soft-AP, on the given channel.
+ */
+static esp_err_t set_ap_config(uint8_t channel) {
   wifi_config_t wifi_config = {
       .ap =
           {
               .ssid = CONFIG_AP_SSID,
               .password = CONFIG_AP_PASSWORD,
               .ssid_len = strlen(CONFIG_AP_SSID),
-              .channel = CONFIG_AP_CHANNEL,
+              .channel = channel,
               .authmode = WIFI_AUTH_WPA2_PSK,
               .max_connection = CONFIG_AP_MAX_CONNECTIONS,
               .pmf_cfg =
@@ -46,6 +52,40 @@ AccessPoint::AccessPoint(StorageManagerInterface *storageManager) : storageManag
                   },
           },
   };
+  return esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+}
+
+AccessPoint::AccessPoint(StorageManagerInterface *storageManager)
+    : storageManager(storageManager),
+      endpointManager(nullptr),
+      server(nullptr),
+      storageLimit(1),
+      updateLimit(1),
+      station(storageManager),
+      sessionTimer(nullptr),
+      sessionRequests(nullptr),
+      sessionTask(nullptr),
+      sessionOpen(true),
+      sessionListener(nullptr),
+      sessionContext(nullptr) {
+  ESP_LOGI(TAG, "AccessPoint instance created");
+  esp_err_t err = esp_event_loop_create_default();
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(err));
+    return;
+  }
+
+  err = esp_netif_init();
+
+  esp_netif_create_default_wifi_ap();
+  esp_netif_create_default_wifi_sta();
+
+  wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+  err = esp_wifi_init(&cfg);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to initialize wifi: %s", esp_err_to_name(err));
+    return;
+  }
 
   err = esp_wifi_set_mode(WIFI_MODE_AP);
   if (err != ESP_OK) {
@@ -53,21 +93,22 @@ AccessPoint::AccessPoint(StorageManagerInterface *storageManager) : storageManag
     return;
   }
 
-  err = esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+  err = set_ap_config(CONFIG_AP_CHANNEL);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to set wifi config: %s", esp_err_to_name(err));
     return;
   }
 
+  // before the subscription below, so the station state is up to date when the events are reported
+  station.start(true);
+
   err = esp_wifi_start();
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to start wifi: %s", esp_err_to_name(err));
     return;
   }
 
-  // register event task handler for wifi events
-  err = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, this);
-
+  err = AppEventBus::subscribe(AppEventBus::kWifiEvents | AppEventBus::kIpEvents, &wifi_event_handler, this);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to register wifi event handler: %s", esp_err_to_name(err));
   }
@@ -75,44 +116,255 @@ AccessPoint::AccessPoint(StorageManagerInterface *storageManager) : storageManag
   ESP_LOGI(TAG, "Access point started");
 }
 
-AccessPoint::~AccessPoint() { ESP_LOGI(TAG, "AccessPoint instance destroyed"); }
+AccessPoint::AccessPoint(StorageManagerInterface *storageManager, EndpointManager *endpointManager)
+    : storageManager(storageManager),
+      endpointManager(endpointManager),
+      server(nullptr),
+      storageLimit(1),
+      updateLimit(1),
+      station(storageManager),
+      sessionTimer(nullptr),
+      sessionRequests(nullptr),
+      sessionTask(nullptr),
+      sessionOpen(false),
+      sessionListener(nullptr),
+      sessionContext(nullptr) {
+  ESP_LOGI(TAG, "AccessPoint instance created next to Matter");
+
+  /* Matter connects the station, it is only pointed at the last access point before Matter starts it */
+  esp_err_t err = station.start(false);
+  if (err == ESP_OK) {
+    err =
+        AppEventBus::subscribe(AppEventBus::kWifiEvents | AppEventBus::kIpEvents, &wifi_event_handler, this);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to register wifi event handler: %s", esp_err_to_name(err));
+  }
+
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = session_timeout_handler;
+  timer_args.arg = this;
+  timer_args.name = "ap_session";
+  err = esp_timer_create(&timer_args, &sessionTimer);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create the session timer: %s", esp_err_to_name(err));
+  }
+
+  /* The first open starts the web server and upgrades the accessory database, which needs the stack of a
+     web worker rather than that of the event bus dispatcher the button presses arrive on */
+  sessionRequests = xQueueCreate(4, sizeof(SessionRequest));
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  if (sessionRequests == nullptr || xTaskCreate(session_task, "apSession", CONFIG_AP_WORKER_STACK_SIZE, this,
+                                                config.task_priority, &sessionTask) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create the session task");
+  }
+}
+
+AccessPoint::~AccessPoint() {
+  if (sessionTask != nullptr) {
+    vTaskDelete(sessionTask);
+  }
+  if (sessionRequests != nullptr) {
+    vQueueDelete(sessionRequests);
+  }
+  ESP_LOGI(TAG, "AccessPoint instance destroyed");
+}
+
+esp_err_t AccessPoint::openSession() {
+  if (endpointManager == nullptr || sessionOpen) {
+    return ESP_OK;
+  }
+
+  /* Matter creates the soft-AP interface only when it runs its own soft-AP */
+  if (esp_netif_get_handle_from_ifkey("WIFI_AP_DEF") == nullptr &&
+      esp_netif_create_default_wifi_ap() == nullptr) {
+    ESP_LOGE(TAG, "Failed to create the soft-AP interface");
+    return ESP_FAIL;
+  }
+
+  /* The radio has one channel, the soft-AP follows the station so the Matter network is not left */
+  uint8_t channel = CONFIG_AP_CHANNEL;
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+    channel = ap.primary;
+  }
+
+  esp_err_t err = esp_wifi_set_mode(WIFI_MODE_APSTA);
+  if (err == ESP_OK) {
+    err = set_ap_config(channel);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start the soft-AP: %s", esp_err_to_name(err));
+    esp_wifi_set_mode(WIFI_MODE_STA);
+    return err;
+  }
+
+  sessionOpen = true;
+  if (server == nullptr) {
+    err = startWebServer();
+    if (err != ESP_OK) {
+      closeSession();
+      return err;
+    }
+  }
+
+  esp_timer_start_once(sessionTimer, CONFIG_AP_SESSION_TIMEOUT * 1000000ULL);
+  ESP_LOGI(TAG, "Config session open on channel %u for %d s", channel, CONFIG_AP_SESSION_TIMEOUT);
+  if (sessionListener != nullptr) {
+    sessionListener(true, sessionContext);
+  }
+  return ESP_OK;
+}
+
+void AccessPoint::closeSession() {
+  if (endpointManager == nullptr || !sessionOpen) {
+    return;
+  }
+  sessionOpen = false;
+  esp_timer_stop(sessionTimer);
+
+  /* The open handler refuses new clients from now on, drop the ones still connected */
+  if (server != nullptr) {
+    int fds[CONFIG_AP_MAX_OPEN_SOCKETS];
+    size_t count = CONFIG_AP_MAX_OPEN_SOCKETS;
+    if (httpd_get_client_list(server, &count, fds) == ESP_OK) {
+      for (size_t i = 0; i < count; i++) {
+        httpd_sess_trigger_close(server, fds[i]);
+      }
+    }
+  }
+
+  esp_err_t err = esp_wifi_set_mode(WIFI_MODE_STA);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to stop the soft-AP: %s", esp_err_to_name(err));
+  }
+  ESP_LOGI(TAG, "Config session closed");
+  if (sessionListener != nullptr) {
+    sessionListener(false, sessionContext);
+  }
+}
+
+void AccessPoint::toggleSession() { requestSession(SessionRequest::Toggle); }
+
+void AccessPoint::requestSession(SessionRequest request) {
+  if (sessionTask == nullptr || xQueueSend(sessionRequests, &request, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Config session request dropped");
+  }
+}
+
+void AccessPoint::session_task(void *arg) {
+  AccessPoint *self = static_cast<AccessPoint *>(arg);
+  SessionRequest request;
+  while (true) {
+    if (xQueueReceive(self->sessionRequests, &request, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    /* The only task opening and closing the session, a timeout racing a press is run after it */
+    if (request == SessionRequest::Close || self->sessionOpen) {
+      self->closeSession();
+    } else {
+      self->openSession();
+    }
+  }
+}
+
+void AccessPoint::setSessionListener(SessionListener listener, void *context) {
+  sessionListener = listener;
+  sessionContext = context;
+}
+
+esp_err_t AccessPoint::session_open_handler(httpd_handle_t hd, int sockfd) {
+  AccessPoint *self = (AccessPoint *)httpd_get_global_user_ctx(hd);
+  return self->sessionOpen ? ESP_OK : ESP_FAIL;
+}
+
+void AccessPoint::session_timeout_handler(void *arg) {
+  ESP_LOGI(TAG, "Config session idle for %d s", CONFIG_AP_SESSION_TIMEOUT);
+  static_cast<AccessPoint *>(arg)->requestSession(SessionRequest::Close);
+}
+
+// the server must not free the AccessPoint it is given as its global context
+static void keep_global_context(void *ctx) {}
 
 esp_err_t AccessPoint::startWebServer() {
   ESP_LOGI(TAG, "Starting web server");
 
+  /* Slow handlers run on the worker pool, so parallel asset fetches and saves do not queue behind one
+     another. The handlers touching the accessory database share a single slot, its storage is not
+     reentrant and a second request is answered with 503 and Retry-After */
   httpd_uri_t uri_routes[] = {
-      {.uri = "/command/unpair", .method = HTTP_GET, .handler = command_handler, .user_ctx = this},
-      {.uri = "/command/factory", .method = HTTP_GET, .handler = command_handler, .user_ctx = this},
-      {.uri = "/command/updatefirmware", .method = HTTP_GET, .handler = command_handler, .user_ctx = this},
-      {.uri = "/command/restart", .method = HTTP_GET, .handler = command_handler, .user_ctx = this},
-      {.uri = "/accessories/stored", .method = HTTP_GET, .handler = accessories_handler, .user_ctx = this},
-      {.uri = "/accessories/save", .method = HTTP_POST, .handler = accessories_handler, .user_ctx = this},
-      {.uri = "/wifi/stored", .method = HTTP_GET, .handler = wifi_handler, .user_ctx = this},
-      {.uri = "/wifi/save", .method = HTTP_POST, .handler = wifi_handler, .user_ctx = this},
-      {.uri = "/wifi/connect", .method = HTTP_PUT, .handler = wifi_handler, .user_ctx = this},
-      {.uri = "/\*", .method = HTTP_GET, .handler = file_read_handler, .user_ctx = this},
+      workerPool.route("/command/unpair", HTTP_GET, command_handler, this, &storageLimit),
+      workerPool.route("/command/factory", HTTP_GET, command_handler, this, &storageLimit),
+      workerPool.route("/command/updatefirmware", HTTP_GET, command_handler, this, &storageLimit),
+      workerPool.route("/firmware", HTTP_POST, firmware_handler, this, &updateLimit),
+      workerPool.route("/firmware/delta", HTTP_POST, firmware_handler, this, &updateLimit),
+      workerPool.inlineRoute("/command/restart", HTTP_GET, command_handler, this),
+      workerPool.route("/accessories/stored", HTTP_GET, accessories_handler, this, &storageLimit),
+      workerPool.route("/accessories/save", HTTP_POST, accessories_handler, this, &storageLimit),
+      workerPool.route("/accessories", HTTP_GET, accessories_handler, this, &storageLimit),
+      workerPool.route("/accessories", HTTP_POST, accessories_handler, this, &storageLimit),
+      workerPool.route("/accessories/*", HTTP_GET, accessory_handler, this, &storageLimit),
+      workerPool.route("/accessories/*", HTTP_PUT, accessory_handler, this, &storageLimit),
+      workerPool.route("/accessories/*", HTTP_DELETE, accessory_handler, this, &storageLimit),
+      workerPool.inlineRoute("/wifi/stored", HTTP_GET, wifi_handler, this),
+      workerPool.route("/wifi/save", HTTP_POST, wifi_handler, this, nullptr),
+      workerPool.route("/wifi/connect", HTTP_PUT, wifi_handler, this, nullptr),
+      {.uri = "/events", .method = HTTP_GET, .handler = events_handler, .user_ctx = this,
+       .is_websocket = true},
+      workerPool.route("/metrics", HTTP_GET, metrics_handler, this, nullptr),
+      workerPool.route("/\*", HTTP_GET, file_read_handler, this, nullptr),
   };
 
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
-  httpd_handle_t server = nullptr;
+  /* Give a database saved before accessories had ids its ids, so it can be edited one accessory at a time */
+  if (upgrade_accessory_DB(storageManager) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to upgrade the accessory database, it can only be replaced as a whole");
+  }
 
-  /* Mount the filesystem */
-  esp_err_t err = mount_fs("", "frontend");
+  /* Map the frontend bundle */
+  esp_err_t err = frontendBundle.open(CONFIG_AP_FRONTEND_PARTITION);
   if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to mount filesystem: %s", esp_err_to_name(err));
+    ESP_LOGE(TAG, "Failed to open the frontend bundle: %s", esp_err_to_name(err));
     return err;
   }
 
   config.uri_match_fn = httpd_uri_match_wildcard;
   config.max_uri_handlers = sizeof(uri_routes) / sizeof(uri_routes[0]);
   config.stack_size = CONFIG_AP_WEB_STACK_SIZE;
+  /* A page load opens several sockets, close the idle ones instead of refusing new connections */
+  config.max_open_sockets = CONFIG_AP_MAX_OPEN_SOCKETS;
+  config.lru_purge_enable = true;
+  /* Next to Matter the sockets of lwIP are shared, take fewer and leave Matter its own */
+  int reservedSockets = 0;
+  if (endpointManager != nullptr) {
+    config.max_open_sockets = CONFIG_AP_LIVE_MAX_OPEN_SOCKETS;
+    reservedSockets = CONFIG_AP_MATTER_SOCKETS;
+  }
+  if (config.max_open_sockets + AP_SERVER_SOCKETS + reservedSockets > CONFIG_LWIP_MAX_SOCKETS) {
+    ESP_LOGE(TAG, "%u client, %d server and %d Matter sockets do not fit in the %d of lwIP",
+             (unsigned)config.max_open_sockets, AP_SERVER_SOCKETS, reservedSockets, CONFIG_LWIP_MAX_SOCKETS);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  /* Next to Matter, clients are only accepted while a config session is open */
+  config.open_fn = session_open_handler;
+  config.global_user_ctx = this;
+  config.global_user_ctx_free_fn = keep_global_context;
+
+  /* Each socket has at most one request in flight, so a request waiting for a worker always has a slot */
+  err = workerPool.start(CONFIG_AP_WORKER_COUNT, config.max_open_sockets, CONFIG_AP_WORKER_STACK_SIZE,
+                         config.task_priority);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start the web workers: %s", esp_err_to_name(err));
+    return err;
+  }
 
   err = httpd_start(&server, &config);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to start server: %s", esp_err_to_name(err));
     return err;
   }
+  events.attach(server);
 
   for (uint8_t i = 0; i < config.max_uri_handlers; i++) {
     err = httpd_register_uri_handler(server, &uri_routes[i]);
@@ -128,62 +380,63 @@ esp_err_t AccessPoint::startWebServer() {
 }
 
 esp_err_t AccessPoint::file_read_handler(httpd_req_t *req) {
-  /* Get the URI from the request */
+  AccessPoint *self = (AccessPoint *)req->user_ctx;
+
+  /* Strip the query string and a trailing slash from the URI */
   const char *uri = req->uri;
+  size_t length = strcspn(uri, "?#");
+  if (length > 1 && uri[length - 1] == '/') {
+    length--;
+  }
 
-  /* Check if the URI is NULL */
-  if (!uri || strlen(uri) == 0) {
-    ESP_LOGE(TAG, "URI is NULL");
-    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "URI is NULL");
-    return ESP_OK;
+  /* Serve the index page for the root */
+  if (length <= 1) {
+    uri = "/index.html";
+    length = strlen(uri);
   }
 
-  /* Check if the URI is a file */
-  if (uri[strlen(uri) - 1] == '.') {
-    ESP_LOGE(TAG, "URI is INVALID");
-    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "URI is INVALID");
+  FrontendAsset asset;
+  if (self->frontendBundle.find(uri, length, &asset) != ESP_OK) {
+    ESP_LOGD(TAG, "File does not exist: %.*s", (int)length, uri);
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
     return ESP_OK;
   }
 
-  char filename[CONFIG_AP_MAX_PATH_SIZE];
-  /* Check if the URI is a directory*/
-  if (uri[0] == '/' && uri[1] == '\0') {
-    strncpy(filename, "/index.html", CONFIG_AP_MAX_PATH_SIZE);
-  } else {
-    if (uri[strlen(uri) - 1] == '/') {
-      strncpy(filename, uri, strlen(uri) - 1);
-    } else {
-      strncpy(filename, uri, CONFIG_AP_MAX_PATH_SIZE);
-    }
+  /* The content hash is the asset version, each encoding gets its own strong ETag */
+  char version[2 * kFrontendHashLength + 1];
+  for (size_t i = 0; i < kFrontendHashLength; i++) {
+    snprintf(&version[2 * i], 3, "%02x", asset.hash[i]);
   }
+  bool gzip = asset.gzipData != nullptr && accepts_gzip(req);
+  char etag[sizeof(version) + 5];
+  snprintf(etag, sizeof(etag), "\"%s%s\"", version, gzip ? "-gz" : "");
 
-  ESP_LOGI(TAG, "Filename: %s", filename);
-
-  /* Check if the file exists */
-  esp_err_t err = check_file_exist(filename);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "File does not exist");
-    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
-    return ESP_OK;
+  /* References carrying the asset version never change, everything else is revalidated */
+  char cache_control[48];
+  if (is_versioned_request(req, version)) {
+    snprintf(cache_control, sizeof(cache_control), "public, max-age=%d, immutable", CONFIG_AP_ASSET_MAX_AGE);
+  } else {
+    strncpy(cache_control, "no-cache", sizeof(cache_control));
   }
 
-  /* Set the content type of the response */
-  err = set_content_type(req, filename);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to set content type");
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set content type");
-    return ESP_OK;
+  httpd_resp_set_hdr(req, "ETag", etag);
+  httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+  if (asset.gzipData != nullptr) {
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
   }
 
-  /* Stream the file to the response */
-  err = stream_file(req, filename);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to stream file");
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to stream file");
-    return ESP_OK;
+  if (etag_matches(req, etag)) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, nullptr, 0);
   }
 
-  return ESP_OK;
+  /* Send the asset straight from the mapped flash */
+  httpd_resp_set_type(req, asset.mimeType);
+  if (gzip) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset.gzipData, asset.gzipLength);
+  }
+  return httpd_resp_send(req, (const char *)asset.data, asset.length);
 }
 
 esp_err_t AccessPoint::command_handler(httpd_req_t *req) {
@@ -217,10 +470,10 @@ esp_err_t AccessPoint::command_handler(httpd_req_t *req) {
       }
 
     } else if (strcmp(uri, "/command/updatefirmware") == 0) {
-      /* Update the firmware, restart the device */
+      /* Restart into the firmware uploaded to /firmware */
       if (update_firmware(self->storageManager) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to update the firmware");
-        httpd_resp_send_500(req);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No new firmware was uploaded");
         return ESP_FAIL;
       }
 
@@ -253,132 +506,689 @@ esp_err_t AccessPoint::command_handler(httpd_req_t *req) {
   }
 }
 
+static esp_err_t send_accessory_chunk(const char *data, size_t length, void *context) {
+  return httpd_resp_send_chunk(static_cast<httpd_req_t *>(context), data, length);
+}
+
+/**
+ * @brief Response of a single accessory, the envelope is only opened once the accessory is found.
+ */
+struct AccessoryResponse {
+  httpd_req_t *req;
+  bool started;
+};
+
+static esp_err_t send_accessory_record(const char *data, size_t length, void *context) {
+  AccessoryResponse *response = static_cast<AccessoryResponse *>(context);
+  if (!response->started) {
+    response->started = true;
+    httpd_resp_set_type(response->req, "application/json");
+    httpd_resp_sendstr_chunk(response->req, "{\"data\": ");
+  }
+  return httpd_resp_send_chunk(response->req, data, length);
+}
+
+/**
+ * @brief Destination of a single accessory, copied out so it is only stored once the whole body is valid.
+ */
+struct AccessoryRecord {
+  char json[AccessoryJsonValidator::kMaxRecordLength];  // any record the validator accepts fits
+  size_t length;
+};
+
+static esp_err_t copy_accessory(uint16_t id, const char *json, size_t length, void *context) {
+  AccessoryRecord *record = static_cast<AccessoryRecord *>(context);
+  if (length > sizeof(record->json)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(record->json, json, length);
+  record->length = length;
+  return ESP_OK;
+}
+
+/**
+ * @brief Stream the request body through the validator, which hands each accessory to its record handler.
+ * @return ESP_OK if the body is valid, ESP_ERR_INVALID_ARG if it is not, ESP_ERR_TIMEOUT if it could not be
+ *         received.
+ */
+static esp_err_t receive_accessories(httpd_req_t *req, AccessoryJsonValidator *validator) {
+  char chunk[CONFIG_AP_RECV_CHUNK_SIZE];
+  size_t remaining = req->content_len;
+  int timeouts = 0;
+  while (remaining > 0) {
+    int received = httpd_req_recv(req, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+    if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= AP_RECV_MAX_TIMEOUTS) {
+      continue;
+    }
+    if (received <= 0) {
+      ESP_LOGE(TAG, "Failed to read the request");
+      return ESP_ERR_TIMEOUT;
+    }
+    remaining -= received;
+
+    if (validator->feed(chunk, received) != ESP_OK) {
+      return ESP_ERR_INVALID_ARG;
+    }
+  }
+
+  return validator->finish();
+}
+
+/**
+ * @brief Progress of a bulk save, reported to the WebSocket clients as each accessory is staged.
+ */
+struct SaveProgress {
+  StorageManagerInterface *storageManager;
+  WebSocketHub *events;
+  uint16_t stored;
+};
+
+static esp_err_t stage_and_report(uint16_t id, const char *json, size_t length, void *context) {
+  SaveProgress *progress = static_cast<SaveProgress *>(context);
+  esp_err_t err = stage_accessory(id, json, length, progress->storageManager);
+  if (err == ESP_OK) {
+    progress->events->publish("{\"type\":\"save\",\"stored\":%u}", ++progress->stored);
+  }
+  return err;
+}
+
+/**
+ * @brief Send the error response matching a failed accessory request.
+ */
+static esp_err_t send_accessory_error(httpd_req_t *req, esp_err_t err,
+                                      const AccessoryJsonValidator *validator) {
+  const char *reason = validator != nullptr ? validator->error() : "Invalid accessory";
+  switch (err) {
+    case ESP_ERR_INVALID_ARG:
+      ESP_LOGE(TAG, "Invalid accessory: %s", reason);
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, reason);
+      break;
+    case ESP_ERR_TIMEOUT:
+      httpd_resp_send_408(req);
+      break;
+    case ESP_ERR_NOT_FOUND:
+      httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such accessory");
+      break;
+    case ESP_ERR_NO_MEM:
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Too many accessories");
+      break;
+    case ESP_ERR_INVALID_STATE:
+      /* The stored database predates accessory ids and could not be upgraded */
+      httpd_resp_set_status(req, "409 Conflict");
+      httpd_resp_sendstr(req, "Save all accessories once before editing them one by one");
+      break;
+    default:
+      ESP_LOGE(TAG, "Accessory request failed: %s", esp_err_to_name(err));
+      httpd_resp_send_500(req);
+      break;
+  }
+  return ESP_FAIL;
+}
+
+/**
+ * @brief Send {"data": {"id": <id>}, "message": "success"}.
+ */
+static esp_err_t send_accessory_id(httpd_req_t *req, uint16_t id) {
+  char response[64];
+  snprintf(response, sizeof(response), "{\"data\": {\"id\": %u}, \"message\": \"success\"}", id);
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, response);
+}
+
 esp_err_t AccessPoint::accessories_handler(httpd_req_t *req) {
   AccessPoint *self = (AccessPoint *)req->user_ctx;
 
   /* Check the method of the request */
   if (req->method == HTTP_GET) {
-    /* Get the accessory database as a JSON string */
-    char response[CONFIG_AP_ACCESSORY_JSON_SIZE];
-    if (get_accessory_DB_JSON(self->storageManager, response, sizeof(response)) != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to get the accessory database");
-      httpd_resp_send_500(req);
-      return ESP_FAIL;
-    }
-
-    /* Send the response in format :
+    /* The envelope is sent around the database as it is read from storage:
         {"data": <accessory database JSON>, "message": "success"}
     */
     httpd_resp_set_type(req, "application/json");
 
-    char response_buffer[CONFIG_AP_ACCESSORY_JSON_SIZE + 64];
-    snprintf(response_buffer, sizeof(response_buffer), "{\"data\": %s, \"message\": \"success\"}", response);
-    httpd_resp_send(req, response_buffer, HTTPD_RESP_USE_STRLEN);
-
-  } else if (req->method == HTTP_POST) {
-    /* Get the content length of the request */
-    size_t content_length = req->content_len;
-    if (content_length == 0) {
-      ESP_LOGE(TAG, "No content in the request");
-      httpd_resp_send_408(req);
+    uint32_t version = 0;
+    esp_err_t err = self->storageManager->getAccessoryJsonVersion(&version);
+    if (err == ESP_ERR_NOT_FOUND) {
+      return httpd_resp_sendstr(req, "{\"data\": [], \"message\": \"success\"}");
+    } else if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to get the accessory database version");
+      httpd_resp_send_500(req);
       return ESP_FAIL;
     }
 
-    /* Allocate a buffer to store the request */
-    char *buffer = (char *)malloc(content_length + 1);
-    if (buffer == NULL) {
-      ESP_LOGE(TAG, "Failed to allocate memory for the request");
-      httpd_resp_send_500(req);
-      return ESP_FAIL;
+    /* Every save changes the version, so the browser always revalidates and gets a 304 until then */
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"adb-%08lx\"", (unsigned long)version);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (etag_matches(req, etag)) {
+      httpd_resp_set_status(req, "304 Not Modified");
+      return httpd_resp_send(req, nullptr, 0);
     }
 
-    /* Read the request */
-    if (httpd_req_recv(req, buffer, content_length) <= 0) {
-      ESP_LOGE(TAG, "Failed to read the request");
-      httpd_resp_send_500(req);
-      free(buffer);
+    httpd_resp_sendstr_chunk(req, "{\"data\": ");
+    err = self->storageManager->readAccessoryJson(send_accessory_chunk, req);
+    if (err != ESP_OK) {
+      /* The status line is already sent, dropping the connection tells the client the body is incomplete */
+      ESP_LOGE(TAG, "Failed to stream the accessory database: %s", esp_err_to_name(err));
       return ESP_FAIL;
     }
+    httpd_resp_sendstr_chunk(req, ", \"message\": \"success\"}");
+    return httpd_resp_send_chunk(req, nullptr, 0);
+  }
 
-    /* Null-terminate the buffer */
-    buffer[content_length] = '\0';
+  if (req->method != HTTP_POST) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
 
-    /* Set the accessory database from the request */
-    if (set_accessory_DB_JSON(self->storageManager, buffer) != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to set the accessory database");
-      httpd_resp_send_500(req);
-      free(buffer);
+  /* Validate against the schema of the devices this firmware can create */
+  AccessoryJsonValidator validator;
+  if (load_accessory_schema(&validator) != ESP_OK) {
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  if (strcmp(req->uri, "/accessories") == 0) {
+    /* Create one accessory, the reply carries its new id */
+    AccessoryRecord record;
+    validator.expectSingle();
+    validator.setRecordHandler(copy_accessory, &record);
+    esp_err_t err = receive_accessories(req, &validator);
+
+    uint16_t id = 0;
+    if (err == ESP_OK) {
+      err = self->storageManager->setAccessory(&id, record.json, record.length);
+    }
+    if (err != ESP_OK) {
+      return send_accessory_error(req, err, &validator);
+    }
+
+    self->accessoriesChanged();
+    httpd_resp_set_status(req, "201 Created");
+    return send_accessory_id(req, id);
+  }
+
+  /* Replace the whole database, streamed into storage and only committed once all of it is valid */
+  SaveProgress progress = {self->storageManager, &self->events, 0};
+  esp_err_t err = self->storageManager->beginAccessoryJsonWrite();
+  if (err == ESP_OK) {
+    validator.setRecordHandler(stage_and_report, &progress);
+    err = receive_accessories(req, &validator);
+    if (err == ESP_OK) {
+      err = self->storageManager->commitAccessoryJsonWrite();
+    } else {
+      self->storageManager->abortAccessoryJsonWrite();
+    }
+  }
+  self->events.publish("{\"type\":\"save\",\"stored\":%u,\"result\":\"%s\"}", progress.stored,
+                       err == ESP_OK ? "ok" : "failed");
+  if (err != ESP_OK) {
+    return send_accessory_error(req, err, &validator);
+  }
+  self->accessoriesChanged();
+
+  /* Send the response
+  {"data": {"count": <accessories>, "length": <bytes>}, "message": "success"}
+  */
+  httpd_resp_set_type(req, "application/json");
+
+  char response_buffer[80];
+  snprintf(response_buffer, sizeof(response_buffer),
+           "{\"data\": {\"count\": %u, \"length\": %u}, \"message\": \"success\"}", validator.count(),
+           (unsigned)req->content_len);
+  return httpd_resp_send(req, response_buffer, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t AccessPoint::accessory_handler(httpd_req_t *req) {
+  AccessPoint *self = (AccessPoint *)req->user_ctx;
+
+  /* The id is the last path segment: /accessories/<id> */
+  const char *segment = req->uri + strlen("/accessories/");
+  char *end = nullptr;
+  unsigned long id = strtoul(segment, &end, 10);
+  if (end == segment || (*end != '\0' && *end != '?') || id == 0 || id > UINT16_MAX) {
+    return send_accessory_error(req, ESP_ERR_NOT_FOUND, nullptr);
+  }
+
+  if (req->method == HTTP_GET) {
+    /* Send {"data": <accessory>, "message": "success"}, the envelope is opened with the first chunk so a
+       missing accessory can still be answered with a 404 */
+    AccessoryResponse response = {req, false};
+    esp_err_t err = self->storageManager->readAccessory(id, send_accessory_record, &response);
+    if (err != ESP_OK && !response.started) {
+      return send_accessory_error(req, err, nullptr);
+    } else if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to stream accessory %lu: %s", id, esp_err_to_name(err));
       return ESP_FAIL;
     }
+    httpd_resp_sendstr_chunk(req, ", \"message\": \"success\"}");
+    return httpd_resp_send_chunk(req, nullptr, 0);
+  }
 
-    /* Send the response
-    {"data": <accessory database JSON>, "message": "success"}
-    */
-    httpd_resp_set_type(req, "application/json");
+  if (req->method == HTTP_DELETE) {
+    esp_err_t err = self->storageManager->deleteAccessory(id);
+    if (err != ESP_OK) {
+      return send_accessory_error(req, err, nullptr);
+    }
+    self->accessoriesChanged();
+    return send_accessory_id(req, id);
+  }
+
+  if (req->method != HTTP_PUT) {
+    httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Invalid method");
+    return ESP_FAIL;
+  }
 
-    char response_buffer[CONFIG_AP_ACCESSORY_JSON_SIZE + 64];
-    snprintf(response_buffer, sizeof(response_buffer), "{\"data\": %s, \"message\": \"success\"}", buffer);
-    httpd_resp_send(req, response_buffer, HTTPD_RESP_USE_STRLEN);
-    free(buffer);
+  /* Replace one accessory, an "id" in the body is ignored in favour of the path */
+  AccessoryJsonValidator validator;
+  AccessoryRecord record;
+  esp_err_t err = load_accessory_schema(&validator);
+  if (err == ESP_OK) {
+    validator.expectSingle();
+    validator.setRecordHandler(copy_accessory, &record);
+    err = receive_accessories(req, &validator);
+  }
+  uint16_t accessoryId = id;
+  if (err == ESP_OK) {
+    err = self->storageManager->setAccessory(&accessoryId, record.json, record.length);
+  }
+  if (err != ESP_OK) {
+    return send_accessory_error(req, err, &validator);
+  }
+  self->accessoriesChanged();
+  return send_accessory_id(req, accessoryId);
+}
+
+/**
+ * @brief Receive the {"SSID", "PASSWORD"} body of a WiFi request. The stored password is never sent to
+ * the UI, so an empty password for the stored SSID keeps it.
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the body is too long, ESP_ERR_INVALID_ARG if it is not
+ *         valid credentials, ESP_ERR_TIMEOUT if it could not be received.
+ */
+static esp_err_t receive_wifi_credentials(httpd_req_t *req, StorageManagerInterface *storageManager,
+                                          WifiCredentials *credentials) {
+  char body[AP_WIFI_BODY_MAX_SIZE + 1];
+  if (req->content_len > AP_WIFI_BODY_MAX_SIZE) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  size_t length = 0;
+  int timeouts = 0;
+  while (length < req->content_len) {
+    int received = httpd_req_recv(req, body + length, req->content_len - length);
+    if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= AP_RECV_MAX_TIMEOUTS) {
+      continue;
+    }
+    if (received <= 0) {
+      ESP_LOGE(TAG, "Failed to read the request");
+      return ESP_ERR_TIMEOUT;
+    }
+    length += received;
+  }
+  body[length] = '\0';
+
+  DynamicJsonDocument doc(AP_WIFI_BODY_MAX_SIZE * 2);
+  if (deserializeJson(doc, body, length)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const char *ssid = doc["SSID"] | "";
+  const char *password = doc["PASSWORD"] | "";
+
+  /* A passphrase has 8 to 63 characters, 64 are the hex key */
+  size_t ssidLength = strlen(ssid);
+  size_t passwordLength = strlen(password);
+  if (ssidLength == 0 || ssidLength >= sizeof(credentials->ssid) ||
+      passwordLength >= sizeof(credentials->password) || (passwordLength > 0 && passwordLength < 8)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  WifiCredentials stored;
+  bool keepPassword = passwordLength == 0 && storageManager->getWifiCredentials(&stored) == ESP_OK &&
+                      strcmp(stored.ssid, ssid) == 0;
+
+  memset(credentials, 0, sizeof(*credentials));
+  memcpy(credentials->ssid, ssid, ssidLength);
+  if (keepPassword) {
+    memcpy(credentials->password, stored.password, sizeof(credentials->password));
   } else {
-    /* Send the response */
-    httpd_resp_send_404(req);
+    memcpy(credentials->password, password, passwordLength);
   }
   return ESP_OK;
 }
 
 esp_err_t AccessPoint::wifi_handler(httpd_req_t *req) {
-  /* Check the method of the request */
+  AccessPoint *self = (AccessPoint *)req->user_ctx;
+  WifiCredentials credentials;
+  char response[AP_WIFI_BODY_MAX_SIZE];
+
   if (req->method == HTTP_GET) {
-    /* Get the stored WiFi credentials */
-    char wifi_stored_SSID[] = "No Need For Matter";
-    char wifi_stored_password[] = "No Need For Matter";
+    /* Send the stored SSID, the password stays on the device */
+    esp_err_t err = self->storageManager->getWifiCredentials(&credentials);
+    if (err == ESP_ERR_NOT_FOUND) {
+      credentials.ssid[0] = '\0';
+    } else if (err != ESP_OK) {
+      httpd_resp_send_500(req);
+      return ESP_FAIL;
+    }
 
-    /* Send the stored WiFi credentials as JSON */
+    DynamicJsonDocument doc(AP_WIFI_BODY_MAX_SIZE);
+    doc["data"]["SSID"] = credentials.ssid;
+    doc["data"]["PASSWORD"] = "";
+    size_t length = serializeJson(doc, response, sizeof(response));
     httpd_resp_set_type(req, "application/json");
-    char response[100];
-    // {data: {SSID: "MetaHouse", Password: "MetaHouse123"}}
-    sprintf(response, "{\"data\": {\"SSID\": \"%s\", \"PASSWORD\": \"%s\"}}", wifi_stored_SSID,
-            wifi_stored_password);
+    httpd_resp_send(req, response, length);
+    return ESP_OK;
+  }
 
-    httpd_resp_send(req, response, strlen(response));
+  if (req->method != HTTP_POST && req->method != HTTP_PUT) {
+    httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Invalid method");
+    return ESP_FAIL;
+  }
 
-    return ESP_OK;
-  } else if (req->method == HTTP_POST) {
-    /* Save the WiFi credentials */
-    /* Respond success as JSON*/
-    httpd_resp_set_type(req, "application/json");
-    char response[100];
-    sprintf(response, "{\"message\": \"success\"}");
-    httpd_resp_send(req, response, strlen(response));
-    return ESP_OK;
-  } else if (req->method == HTTP_PUT) {
-    /* Try to connect to WiFi */
-    /* Respond success as JSON data "" and message success*/
-    httpd_resp_set_type(req, "application/json");
-    char response[100];
-    sprintf(response, "{\"data\": \"\", \"message\": \"success\"}");
-    httpd_resp_send(req, response, strlen(response));
-    return ESP_OK;
+  /* Save the credentials, and for PUT connect with them, the result follows as a "wifi" event */
+  esp_err_t err = receive_wifi_credentials(req, self->storageManager, &credentials);
+  if (err == ESP_OK) {
+    err = self->storageManager->setWifiCredentials(&credentials);
+  }
+  if (err == ESP_OK && req->method == HTTP_PUT) {
+    err = self->station.connect();
+  }
+  switch (err) {
+    case ESP_OK:
+      break;
+    case ESP_ERR_INVALID_SIZE:
+      httpd_resp_set_status(req, "413 Payload Too Large");
+      httpd_resp_sendstr(req, "Request too long");
+      return ESP_FAIL;
+    case ESP_ERR_INVALID_ARG:
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid SSID or password");
+      return ESP_FAIL;
+    case ESP_ERR_TIMEOUT:
+      httpd_resp_send_408(req);
+      return ESP_FAIL;
+    case ESP_ERR_INVALID_STATE:
+      /* Next to Matter, the station stays on the network it was commissioned on */
+      httpd_resp_set_status(req, "409 Conflict");
+      httpd_resp_sendstr(req, "The WiFi connection is managed by Matter");
+      return ESP_FAIL;
+    default:
+      ESP_LOGE(TAG, "WiFi request failed: %s", esp_err_to_name(err));
+      httpd_resp_send_500(req);
+      return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  if (req->method == HTTP_PUT) {
+    httpd_resp_sendstr(req, "{\"data\": \"connecting\", \"message\": \"success\"}");
+  } else {
+    httpd_resp_sendstr(req, "{\"message\": \"success\"}");
   }
   return ESP_OK;
 }
 
+esp_err_t AccessPoint::metrics_handler(httpd_req_t *req) {
+  AccessPoint *self = (AccessPoint *)req->user_ctx;
+  return DeviceMetrics::write(req, self->storageManager, self->workerPool);
+}
+
+/**
+ * @brief Parse the optional X-Firmware-SHA256 header, the hex SHA-256 of the uploaded image.
+ * @return ESP_OK if the request has a hash, ESP_ERR_NOT_FOUND if it has none, ESP_ERR_INVALID_ARG if the
+ *         header is not 64 hex digits.
+ */
+static esp_err_t firmware_expected_hash(httpd_req_t *req, uint8_t *hash) {
+  char value[2 * kFirmwareHashLength + 2];
+  esp_err_t err = httpd_req_get_hdr_value_str(req, "X-Firmware-SHA256", value, sizeof(value));
+  if (err == ESP_ERR_NOT_FOUND) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (err != ESP_OK || strlen(value) != 2 * kFirmwareHashLength) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  for (size_t i = 0; i < kFirmwareHashLength; i++) {
+    if (!isxdigit((unsigned char)value[2 * i]) || !isxdigit((unsigned char)value[2 * i + 1])) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    char byte[3] = {value[2 * i], value[2 * i + 1], '\0'};
+    hash[i] = strtoul(byte, nullptr, 16);
+  }
+  return ESP_OK;
+}
+
+using FirmwareSink = esp_err_t (*)(const uint8_t *data, size_t length, void *context);
+
+static esp_err_t write_image(const uint8_t *data, size_t length, void *context) {
+  return static_cast<FirmwareUpdate *>(context)->write(data, length);
+}
+
+static esp_err_t apply_delta(const uint8_t *data, size_t length, void *context) {
+  return static_cast<DeltaPatcher *>(context)->feed(data, length);
+}
+
+/**
+ * @brief Stream the request body into a firmware sink, reporting the progress to the WebSocket clients.
+ * @return ESP_OK once the whole body is consumed, ESP_ERR_TIMEOUT if it could not be received, the error of
+ *         the sink otherwise.
+ */
+static esp_err_t receive_firmware(httpd_req_t *req, FirmwareSink sink, void *context, WebSocketHub *events) {
+  /* On the heap, a flash sector is too big for the worker stack */
+  uint8_t *chunk = static_cast<uint8_t *>(malloc(CONFIG_AP_OTA_CHUNK_SIZE));
+  if (chunk == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  size_t remaining = req->content_len;
+  size_t reported = 0;
+  int timeouts = 0;
+  esp_err_t err = ESP_OK;
+  while (remaining > 0 && err == ESP_OK) {
+    /* Fill the whole chunk, the first one of an image must hold its headers */
+    size_t length = remaining < CONFIG_AP_OTA_CHUNK_SIZE ? remaining : CONFIG_AP_OTA_CHUNK_SIZE;
+    size_t filled = 0;
+    while (filled < length) {
+      int received = httpd_req_recv(req, reinterpret_cast<char *>(chunk) + filled, length - filled);
+      if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= AP_RECV_MAX_TIMEOUTS) {
+        continue;
+      }
+      if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to read the firmware after %u bytes",
+                 (unsigned)(req->content_len - remaining + filled));
+        err = ESP_ERR_TIMEOUT;
+        break;
+      }
+      filled += received;
+    }
+    if (err != ESP_OK) {
+      break;
+    }
+    remaining -= length;
+
+    err = sink(chunk, length, context);
+    size_t received = req->content_len - remaining;
+    if (err == ESP_OK && (received - reported >= AP_OTA_PROGRESS_STEP || remaining == 0)) {
+      reported = received;
+      events->publish("{\"type\":\"ota\",\"written\":%u,\"total\":%u}", (unsigned)reported,
+                      (unsigned)req->content_len);
+    }
+  }
+
+  free(chunk);
+  return err;
+}
+
+/**
+ * @brief Send the error response matching a failed firmware upload.
+ */
+static esp_err_t send_firmware_error(httpd_req_t *req, esp_err_t err) {
+  switch (err) {
+    case ESP_ERR_INVALID_SIZE:
+      httpd_resp_set_status(req, "413 Payload Too Large");
+      httpd_resp_sendstr(req, "The image does not fit the firmware slot");
+      break;
+    case ESP_ERR_OTA_VALIDATE_FAILED:
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not a valid firmware image for this device");
+      break;
+    case ESP_ERR_INVALID_CRC:
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "The image does not match its SHA-256");
+      break;
+    case ESP_ERR_INVALID_ARG:
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not a valid firmware delta");
+      break;
+    case ESP_ERR_INVALID_VERSION:
+      /* The delta was made against another release than the running one */
+      httpd_resp_set_status(req, "409 Conflict");
+      httpd_resp_sendstr(req, "The delta does not apply to the running firmware, upload the whole image");
+      break;
+    case ESP_ERR_TIMEOUT:
+      httpd_resp_send_408(req);
+      break;
+    default:
+      ESP_LOGE(TAG, "Firmware update failed: %s", esp_err_to_name(err));
+      httpd_resp_send_500(req);
+      break;
+  }
+  return ESP_FAIL;
+}
+
+esp_err_t AccessPoint::firmware_handler(httpd_req_t *req) {
+  AccessPoint *self = (AccessPoint *)req->user_ctx;
+
+  /* The image is written as it arrives, so its size must be known up front */
+  if (req->content_len == 0) {
+    httpd_resp_send_err(req, HTTPD_411_LENGTH_REQUIRED, "Upload the image with its Content-Length");
+    return ESP_FAIL;
+  }
+
+  uint8_t expected[kFirmwareHashLength];
+  esp_err_t err = firmware_expected_hash(req, expected);
+  if (err == ESP_ERR_INVALID_ARG) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "X-Firmware-SHA256 must be 64 hex digits");
+    return ESP_FAIL;
+  }
+  bool hasHash = err == ESP_OK;
+
+  /* Nothing changes for the running firmware until the whole image is verified */
+  FirmwareUpdate update;
+  if (strcmp(req->uri, "/firmware/delta") == 0) {
+    /* The new image is rebuilt from the running one, the delta carries the hash it must have */
+    DeltaPatcher patcher(&update);
+    err = patcher.begin();
+    if (err == ESP_OK) {
+      err = receive_firmware(req, apply_delta, &patcher, &self->events);
+    }
+    if (err == ESP_OK) {
+      err = patcher.finish();
+    }
+  } else {
+    err = update.begin(req->content_len);
+    if (err == ESP_OK) {
+      err = receive_firmware(req, write_image, &update, &self->events);
+    }
+    if (err == ESP_OK) {
+      err = update.finish(hasHash ? expected : nullptr);
+    }
+  }
+  self->events.publish("{\"type\":\"ota\",\"result\":\"%s\"}", err == ESP_OK ? "ok" : "failed");
+  if (err != ESP_OK) {
+    return send_firmware_error(req, err);
+  }
+
+  /* Send the response
+  {"data": {"version": <version>, "sha256": <hex>}, "message": "success"}
+  */
+  char hash[2 * kFirmwareHashLength + 1];
+  for (size_t i = 0; i < kFirmwareHashLength; i++) {
+    snprintf(&hash[2 * i], 3, "%02x", update.hash()[i]);
+  }
+  char response[160];
+  snprintf(response, sizeof(response),
+           "{\"data\": {\"version\": \"%s\", \"sha256\": \"%s\"}, \"message\": \"success\"}",
+           update.version(), hash);
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, response);
+}
+
+esp_err_t AccessPoint::events_handler(httpd_req_t *req) {
+  AccessPoint *self = (AccessPoint *)req->user_ctx;
+
+  esp_err_t err = self->events.handle(req);
+  if (err == ESP_OK && req->method == HTTP_GET) {
+    /* Bring the new client up to date, the others ignore state they already have */
+    self->publishStations();
+    self->publishAccessories();
+  }
+  return err;
+}
+
+void AccessPoint::publishAccessories() {
+  uint32_t version = 0;
+  if (storageManager->getAccessoryJsonVersion(&version) == ESP_OK) {
+    events.publish("{\"type\":\"accessories\",\"version\":\"adb-%08lx\"}", (unsigned long)version);
+  }
+}
+
+void AccessPoint::accessoriesChanged() {
+  publishAccessories();
+  if (endpointManager == nullptr) {
+    return;
+  }
+
+  /* Keep the session open while it is being used */
+  esp_timer_stop(sessionTimer);
+  esp_timer_start_once(sessionTimer, CONFIG_AP_SESSION_TIMEOUT * 1000000ULL);
+
+  char *json = nullptr;
+  size_t length = 0;
+  esp_err_t err = storageManager->getAccessoryJsonCopy(&json, &length);
+  if (err == ESP_OK) {
+    err = endpointManager->applyAccessories(json, length);
+  }
+  free(json);
+  events.publish("{\"type\":\"apply\",\"result\":\"%s\"}", err == ESP_OK ? "ok" : "failed");
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to apply the accessories: %s", esp_err_to_name(err));
+  }
+}
+
+void AccessPoint::publishStations() {
+  wifi_sta_list_t stations;
+  if (esp_wifi_ap_get_sta_list(&stations) == ESP_OK) {
+    events.publish("{\"type\":\"stations\",\"count\":%d}", stations.num);
+  }
+}
+
 void AccessPoint::change_led_status(int32_t event_id) {
   // change the led status
 }
 
-void AccessPoint::wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id,
-                                     void *event_data) {
-  if (event_base == WIFI_EVENT) {
-    AccessPoint *self = (AccessPoint *)arg;
+void AccessPoint::wifi_event_handler(const AppEvent &event, void *context) {
+  AccessPoint *self = (AccessPoint *)context;
 
-    if (event_id == WIFI_EVENT_AP_STACONNECTED) {
+  switch (event.type) {
+    case AppEventType::IpGotAddress:
+      self->events.publish("{\"type\":\"wifi\",\"state\":\"connected\",\"ms\":%lu,\"directed\":%s}",
+                           (unsigned long)self->station.connectTimeMs(),
+                           self->station.connectedDirected() ? "true" : "false");
+      break;
+    case AppEventType::WifiApStationConnected:
       ESP_LOGI(TAG, "station connected");
       self->change_led_status(WIFI_EVENT_AP_STACONNECTED);
-    } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+      self->publishStations();
+      break;
+    case AppEventType::WifiApStationDisconnected:
       ESP_LOGI(TAG, "station disconnected");
       self->change_led_status(WIFI_EVENT_AP_STADISCONNECTED);
-    }
+      self->publishStations();
+      break;
+    case AppEventType::WifiStationDisconnected:
+      /* Not reported while the station retries, with a full scan after a directed attempt */
+      if (!self->station.connecting()) {
+        self->events.publish("{\"type\":\"wifi\",\"state\":\"disconnected\",\"reason\":%u}",
+                             (unsigned)event.data);
+      }
+      break;
+    default:
+      break;
   }
 }
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "AccessoryJsonValidator.hpp"
+
+#include <ArduinoJson.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr int8_t kTypeKey = -1;
+static constexpr int8_t kOtherKey = -2;
+static constexpr int8_t kIdKey = -3;
+static constexpr unsigned long kMaxPin = 16;  // same range as the config UI
+
+static bool is_pin_property(const char *name) {
+  size_t length = strlen(name);
+  return length > 3 && strcmp(&name[length - 3], "Pin") == 0;
+}
+
+static bool parse_unsigned(const char *text, unsigned long *value) {
+  if (*text < '0' || *text > '9') {
+    return false;
+  }
+  char *end = nullptr;
+  *value = strtoul(text, &end, 10);
+  return *end == '\0';
+}
+
+AccessoryJsonValidator::AccessoryJsonValidator()
+    : m_properties(),
+      m_propertyCount(0),
+      m_types(),
+      m_typeCount(0),
+      m_single(false),
+      m_handler(nullptr),
+      m_handlerContext(nullptr),
+      m_state(State::Start),
+      m_token(Token::None),
+      m_escape(false),
+      m_buffer(),
+      m_bufferLength(0),
+      m_key(kOtherKey),
+      m_seen(0),
+      m_type(),
+      m_count(0),
+      m_record(),
+      m_recordLength(0),
+      m_memberStart(0),
+      m_memberFirst(false),
+      m_dropComma(false),
+      m_recordId(0),
+      m_offset(0),
+      m_error() {}
+
+esp_err_t AccessoryJsonValidator::loadSchema(const char *schema) {
+  DynamicJsonDocument doc(1024);
+  if (deserializeJson(doc, schema) || !doc.is<JsonObject>()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  m_typeCount = 0;
+  m_propertyCount = 0;
+  for (JsonPair type : doc.as<JsonObject>()) {
+    if (m_typeCount == kMaxTypes || strlen(type.key().c_str()) >= kMaxNameLength) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    Type &entry = m_types[m_typeCount++];
+    strcpy(entry.name, type.key().c_str());
+    entry.required = 0;
+
+    for (JsonVariant property : type.value().as<JsonArray>()) {
+      const char *name = property.as<const char *>();
+      if (name == nullptr || strlen(name) >= kMaxNameLength) {
+        return ESP_ERR_INVALID_ARG;
+      }
+
+      uint8_t index = 0;
+      while (index < m_propertyCount && strcmp(m_properties[index], name) != 0) {
+        index++;
+      }
+      if (index == m_propertyCount) {
+        if (m_propertyCount == kMaxProperties) {
+          return ESP_ERR_INVALID_ARG;
+        }
+        strcpy(m_properties[m_propertyCount++], name);
+      }
+      entry.required |= 1UL << index;
+    }
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::feed(const char *data, size_t length) {
+  if (m_error[0] != '\0') {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    m_offset++;
+    esp_err_t err = step(data[i]);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::finish() {
+  if (m_error[0] != '\0') {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (m_token == Token::String) {
+    return fail("unterminated string");
+  }
+  if (m_state != State::End) {
+    return fail("unexpected end of data");
+  }
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::step(char c) {
+  if (m_token == Token::String) {
+    if (static_cast<uint8_t>(c) < 0x20) {
+      return fail("control character in string");
+    }
+    esp_err_t err = append(c);
+    if (err != ESP_OK) {
+      return err;
+    }
+    if (m_escape) {
+      m_escape = false;
+    } else if (c == '\\') {
+      m_escape = true;
+      return ESP_OK;
+    } else if (c == '"') {
+      m_token = Token::None;
+      return endToken(Token::String);
+    }
+    if (m_bufferLength == kMaxTokenLength) {
+      return fail("string longer than %u characters", (unsigned)kMaxTokenLength);
+    }
+    m_buffer[m_bufferLength++] = c;
+    return ESP_OK;
+  }
+
+  if (m_token == Token::Number || m_token == Token::Literal) {
+    bool continues = m_token == Token::Number ? (strchr("0123456789+-.eE", c) != nullptr && c != '\0')
+                                              : (c >= 'a' && c <= 'z');
+    if (continues) {
+      if (m_bufferLength == kMaxTokenLength) {
+        return fail("value too long");
+      }
+      m_buffer[m_bufferLength++] = c;
+      return append(c);
+    }
+    Token token = m_token;
+    m_token = Token::None;
+    esp_err_t err = endToken(token);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+    return ESP_OK;
+  }
+
+  switch (m_state) {
+    case State::Start:
+      if (m_single) {
+        return c == '{' ? startObject() : fail("expected an accessory object");
+      }
+      if (c != '[') {
+        return fail("expected an array of accessories");
+      }
+      m_state = State::ArrayFirst;
+      return ESP_OK;
+
+    case State::ArrayFirst:
+    case State::Element:
+      if (c == ']' && m_state == State::ArrayFirst) {
+        m_state = State::End;
+        return ESP_OK;
+      }
+      if (c != '{') {
+        return fail("expected an accessory object");
+      }
+      return startObject();
+
+    case State::ArrayNext:
+      if (c == ',') {
+        m_state = State::Element;
+      } else if (c == ']') {
+        m_state = State::End;
+      } else {
+        return fail("expected ',' or ']'");
+      }
+      return ESP_OK;
+
+    case State::FirstKey:
+    case State::Key:
+      if (c == '}' && m_state == State::FirstKey) {
+        return endObject();
+      }
+      if (c != '"') {
+        return fail("expected a property name");
+      }
+      m_token = Token::String;
+      m_bufferLength = 0;
+      return append(c);
+
+    case State::Colon:
+      if (c != ':') {
+        return fail("expected ':'");
+      }
+      m_state = State::Value;
+      return append(c);
+
+    case State::Value:
+      m_bufferLength = 0;
+      if (c == '"') {
+        m_token = Token::String;
+      } else if (c == '-' || (c >= '0' && c <= '9')) {
+        m_token = Token::Number;
+        m_buffer[m_bufferLength++] = c;
+      } else if (c >= 'a' && c <= 'z') {
+        m_token = Token::Literal;
+        m_buffer[m_bufferLength++] = c;
+      } else if (c == '{' || c == '[') {
+        return fail("nested values are not supported");
+      } else {
+        return fail("expected a value");
+      }
+      return append(c);
+
+    case State::ObjectNext:
+      if (c == ',') {
+        m_state = State::Key;
+        m_memberStart = m_recordLength;
+        m_memberFirst = m_dropComma;
+        if (m_dropComma) {
+          m_dropComma = false;
+          return ESP_OK;
+        }
+        return append(c);
+      } else if (c == '}') {
+        esp_err_t err = append(c);
+        return err == ESP_OK ? endObject() : err;
+      } else {
+        return fail("expected ',' or '}'");
+      }
+
+    case State::End:
+    default:
+      return fail("unexpected data after the accessories");
+  }
+}
+
+esp_err_t AccessoryJsonValidator::append(char c) {
+  if (m_recordLength == kMaxRecordLength) {
+    return fail("accessory %u longer than %u bytes", m_count + 1, (unsigned)kMaxRecordLength);
+  }
+  m_record[m_recordLength++] = c;
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::startObject() {
+  m_seen = 0;
+  m_type[0] = '\0';
+  m_state = State::FirstKey;
+
+  m_record[0] = '{';
+  m_recordLength = 1;
+  m_memberStart = 1;
+  m_memberFirst = true;
+  m_dropComma = false;
+  m_recordId = 0;
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::endToken(Token token) {
+  m_buffer[m_bufferLength] = '\0';
+
+  if (m_state == State::FirstKey || m_state == State::Key) {
+    m_state = State::Colon;
+    return onKey();
+  }
+  return onValue(token);
+}
+
+esp_err_t AccessoryJsonValidator::onKey() {
+  if (strcmp(m_buffer, "type") == 0) {
+    m_key = kTypeKey;
+    return ESP_OK;
+  }
+  if (strcmp(m_buffer, "id") == 0) {
+    m_key = kIdKey;
+    return ESP_OK;
+  }
+
+  m_key = kOtherKey;
+  for (uint8_t i = 0; i < m_propertyCount; i++) {
+    if (strcmp(m_buffer, m_properties[i]) == 0) {
+      m_key = i;
+      break;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::onValue(Token token) {
+  m_state = State::ObjectNext;
+
+  if (token == Token::Literal && strcmp(m_buffer, "true") != 0 && strcmp(m_buffer, "false") != 0 &&
+      strcmp(m_buffer, "null") != 0) {
+    return fail("invalid literal %s", m_buffer);
+  }
+  if (token == Token::Number) {
+    char *end = nullptr;
+    strtod(m_buffer, &end);
+    if (*end != '\0') {
+      return fail("invalid number %s", m_buffer);
+    }
+  }
+
+  if (m_key == kOtherKey) {
+    return ESP_OK;
+  }
+
+  if (m_key == kIdKey) {
+    unsigned long value = 0;
+    if ((token != Token::String && token != Token::Number) || !parse_unsigned(m_buffer, &value) ||
+        value < 1 || value > UINT16_MAX) {
+      return fail("accessory %u: id must be between 1 and %u", m_count + 1, (unsigned)UINT16_MAX);
+    }
+    // The id names the record, it is not part of it
+    m_recordId = value;
+    m_recordLength = m_memberStart;
+    m_dropComma = m_memberFirst;
+    return ESP_OK;
+  }
+
+  if (m_key == kTypeKey) {
+    if (token != Token::String || m_bufferLength >= kMaxNameLength) {
+      return fail("accessory %u: invalid type", m_count + 1);
+    }
+    strcpy(m_type, m_buffer);
+    return ESP_OK;
+  }
+
+  const char *property = m_properties[m_key];
+  if (strcmp(property, "name") == 0) {
+    if (token != Token::String || m_bufferLength == 0) {
+      return fail("accessory %u: name must be a non-empty string", m_count + 1);
+    }
+  } else {
+    unsigned long value = 0;
+    if ((token != Token::String && token != Token::Number) || !parse_unsigned(m_buffer, &value)) {
+      return fail("accessory %u: %s must be a non-negative integer", m_count + 1, property);
+    }
+    if (is_pin_property(property) && (value < 1 || value > kMaxPin)) {
+      return fail("accessory %u: %s must be between 1 and %lu", m_count + 1, property, kMaxPin);
+    }
+  }
+
+  m_seen |= 1UL << m_key;
+  return ESP_OK;
+}
+
+esp_err_t AccessoryJsonValidator::endObject() {
+  m_state = m_single ? State::End : State::ArrayNext;
+
+  if (m_type[0] == '\0') {
+    return fail("accessory %u: missing type", m_count + 1);
+  }
+
+  for (uint8_t i = 0; i < m_typeCount; i++) {
+    if (strcmp(m_types[i].name, m_type) != 0) {
+      continue;
+    }
+
+    uint32_t missing = m_types[i].required & ~m_seen;
+    if (missing != 0) {
+      return fail("accessory %u (%s): missing %s", m_count + 1, m_type, m_properties[__builtin_ctz(missing)]);
+    }
+    if (m_handler != nullptr) {
+      esp_err_t err = m_handler(m_recordId, m_record, m_recordLength, m_handlerContext);
+      if (err != ESP_OK) {
+        return fail("accessory %u: not stored (%s)", m_count + 1, esp_err_to_name(err));
+      }
+    }
+    m_count++;
+    return ESP_OK;
+  }
+
+  return fail("accessory %u: unknown type %s", m_count + 1, m_type);
+}
+
+esp_err_t AccessoryJsonValidator::fail(const char *format, ...) {
+  int written = snprintf(m_error, sizeof(m_error), "offset %u: ", (unsigned)m_offset);
+
+  va_list args;
+  va_start(args, format);
+  vsnprintf(m_error + written, sizeof(m_error) - written, format, args);
+  va_end(args);
+
+  return ESP_ERR_INVALID_ARG;
+}
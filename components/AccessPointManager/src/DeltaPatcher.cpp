@@ -0,0 +1,282 @@
+#include "DeltaPatcher.hpp"
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include <miniz.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "DeltaPatcher";
+
+static const char kMagic[8] = {'M', 'H', 'D', 'E', 'L', 'T', 'A', '1'};
+
+// Source bytes read per flash access while adding a difference
+static constexpr size_t kSourceReadSize = 256;
+
+DeltaPatcher::DeltaPatcher(FirmwareUpdate *update)
+    : m_update(update),
+      m_source(nullptr),
+      m_inflater(nullptr),
+      m_window(nullptr),
+      m_windowPos(0),
+      m_streamEnd(false),
+      m_chunk(nullptr),
+      m_chunkFill(0),
+      m_state(State::Header),
+      m_pending(),
+      m_pendingFill(0),
+      m_sourceSize(0),
+      m_targetHash(),
+      m_sourcePos(0),
+      m_diffLeft(0),
+      m_extraLeft(0),
+      m_seek(0) {}
+
+DeltaPatcher::~DeltaPatcher() {
+  free(m_inflater);
+  free(m_window);
+  free(m_chunk);
+}
+
+esp_err_t DeltaPatcher::begin() {
+  m_inflater = static_cast<tinfl_decompressor *>(malloc(sizeof(tinfl_decompressor)));
+  m_window = static_cast<uint8_t *>(malloc(TINFL_LZ_DICT_SIZE));
+  m_chunk = static_cast<uint8_t *>(malloc(CONFIG_AP_OTA_CHUNK_SIZE));
+  if (m_inflater == nullptr || m_window == nullptr || m_chunk == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+  tinfl_init(m_inflater);
+  return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::feed(const uint8_t *data, size_t length) {
+  if (m_state == State::Header) {
+    size_t take = length < kHeaderLength - m_pendingFill ? length : kHeaderLength - m_pendingFill;
+    memcpy(m_pending + m_pendingFill, data, take);
+    m_pendingFill += take;
+    data += take;
+    length -= take;
+    if (m_pendingFill < kHeaderLength) {
+      return ESP_OK;
+    }
+
+    m_pendingFill = 0;
+    m_state = State::Record;
+    esp_err_t err = startUpdate();
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  return length > 0 ? inflate(data, length) : ESP_OK;
+}
+
+esp_err_t DeltaPatcher::finish() {
+  if (!m_streamEnd || m_state != State::Record || m_pendingFill != 0) {
+    ESP_LOGE(TAG, "Delta ended early");
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (m_chunkFill > 0) {
+    esp_err_t err = m_update->write(m_chunk, m_chunkFill);
+    m_chunkFill = 0;
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  return m_update->finish(m_targetHash);
+}
+
+esp_err_t DeltaPatcher::startUpdate() {
+  /* magic, source size, target size, source SHA-256, target SHA-256 */
+  if (memcmp(m_pending, kMagic, sizeof(kMagic)) != 0) {
+    ESP_LOGE(TAG, "Not a firmware delta");
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint32_t targetSize;
+  memcpy(&m_sourceSize, m_pending + 8, sizeof(m_sourceSize));
+  memcpy(&targetSize, m_pending + 12, sizeof(targetSize));
+  const uint8_t *sourceHash = m_pending + 16;
+  memcpy(m_targetHash, m_pending + 16 + kFirmwareHashLength, kFirmwareHashLength);
+
+  m_source = esp_ota_get_running_partition();
+  if (m_source == nullptr || m_sourceSize > m_source->size) {
+    ESP_LOGE(TAG, "Delta is for a larger image than the running one");
+    return ESP_ERR_INVALID_VERSION;
+  }
+
+  /* Hash the running image through the chunk, nothing is rebuilt into it yet */
+  uint8_t hash[kFirmwareHashLength];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  esp_err_t err = ESP_OK;
+  for (uint32_t offset = 0; offset < m_sourceSize && err == ESP_OK; offset += CONFIG_AP_OTA_CHUNK_SIZE) {
+    size_t length = m_sourceSize - offset;
+    length = length < CONFIG_AP_OTA_CHUNK_SIZE ? length : CONFIG_AP_OTA_CHUNK_SIZE;
+    err = esp_partition_read(m_source, offset, m_chunk, length);
+    mbedtls_sha256_update(&sha, m_chunk, length);
+  }
+  mbedtls_sha256_finish(&sha, hash);
+  mbedtls_sha256_free(&sha);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to read the running image: %s", esp_err_to_name(err));
+    return err;
+  }
+  if (memcmp(hash, sourceHash, kFirmwareHashLength) != 0) {
+    ESP_LOGE(TAG, "Delta was made against another image than %s", esp_app_get_description()->version);
+    return ESP_ERR_INVALID_VERSION;
+  }
+
+  ESP_LOGI(TAG, "Rebuilding %lu bytes from %lu bytes of %s", (unsigned long)targetSize,
+           (unsigned long)m_sourceSize, m_source->label);
+  return m_update->begin(targetSize);
+}
+
+esp_err_t DeltaPatcher::inflate(const uint8_t *data, size_t length) {
+  if (m_streamEnd) {
+    ESP_LOGE(TAG, "Data after the end of the delta");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  /* The window is the inflater's dictionary, each output is applied before the ring wraps over it */
+  while (true) {
+    size_t inLength = length;
+    size_t outLength = TINFL_LZ_DICT_SIZE - m_windowPos;
+    tinfl_status status = tinfl_decompress(m_inflater, data, &inLength, m_window, m_window + m_windowPos,
+                                           &outLength, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inLength;
+    length -= inLength;
+
+    if (outLength > 0) {
+      esp_err_t err = apply(m_window + m_windowPos, outLength);
+      if (err != ESP_OK) {
+        return err;
+      }
+      m_windowPos = (m_windowPos + outLength) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+
+    if (status < TINFL_STATUS_DONE) {
+      ESP_LOGE(TAG, "Corrupt delta stream: %d", status);
+      return ESP_ERR_INVALID_ARG;
+    }
+    if (status == TINFL_STATUS_DONE) {
+      m_streamEnd = true;
+      return length == 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+    }
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0) {
+      return ESP_OK;
+    }
+  }
+}
+
+esp_err_t DeltaPatcher::apply(const uint8_t *data, size_t length) {
+  while (length > 0) {
+    size_t take = 0;
+    esp_err_t err = ESP_OK;
+
+    if (m_state == State::Record) {
+      /* diff length, extra length, seek */
+      take = length < kRecordLength - m_pendingFill ? length : kRecordLength - m_pendingFill;
+      memcpy(m_pending + m_pendingFill, data, take);
+      m_pendingFill += take;
+      if (m_pendingFill == kRecordLength) {
+        m_pendingFill = 0;
+        memcpy(&m_diffLeft, m_pending, sizeof(m_diffLeft));
+        memcpy(&m_extraLeft, m_pending + 4, sizeof(m_extraLeft));
+        memcpy(&m_seek, m_pending + 8, sizeof(m_seek));
+        if (m_diffLeft > m_sourceSize - m_sourcePos) {
+          ESP_LOGE(TAG, "Difference past the end of the running image");
+          return ESP_ERR_INVALID_ARG;
+        }
+        m_state = State::Diff;
+        err = nextPart();
+      }
+    } else if (m_state == State::Diff) {
+      take = length < m_diffLeft ? length : m_diffLeft;
+      err = applyDiff(data, take);
+      m_diffLeft -= take;
+      if (err == ESP_OK) {
+        err = nextPart();
+      }
+    } else {
+      take = length < m_extraLeft ? length : m_extraLeft;
+      err = emit(data, take);
+      m_extraLeft -= take;
+      if (err == ESP_OK) {
+        err = nextPart();
+      }
+    }
+
+    if (err != ESP_OK) {
+      return err;
+    }
+    data += take;
+    length -= take;
+  }
+  return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::applyDiff(const uint8_t *data, size_t length) {
+  uint8_t source[kSourceReadSize];
+  while (length > 0) {
+    size_t take = length < sizeof(source) ? length : sizeof(source);
+    esp_err_t err = esp_partition_read(m_source, m_sourcePos, source, take);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to read the running image at %lu: %s", (unsigned long)m_sourcePos,
+               esp_err_to_name(err));
+      return err;
+    }
+    for (size_t i = 0; i < take; i++) {
+      source[i] += data[i];
+    }
+    err = emit(source, take);
+    if (err != ESP_OK) {
+      return err;
+    }
+    m_sourcePos += take;
+    data += take;
+    length -= take;
+  }
+  return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::nextPart() {
+  if (m_state == State::Diff && m_diffLeft == 0) {
+    m_state = State::Extra;
+  }
+  if (m_state != State::Extra || m_extraLeft > 0) {
+    return ESP_OK;
+  }
+
+  /* The record is done, move the cursor */
+  int64_t position = static_cast<int64_t>(m_sourcePos) + m_seek;
+  if (position < 0 || position > m_sourceSize) {
+    ESP_LOGE(TAG, "Seek out of the running image");
+    return ESP_ERR_INVALID_ARG;
+  }
+  m_sourcePos = static_cast<uint32_t>(position);
+  m_state = State::Record;
+  return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::emit(const uint8_t *data, size_t length) {
+  while (length > 0) {
+    size_t take = CONFIG_AP_OTA_CHUNK_SIZE - m_chunkFill;
+    take = length < take ? length : take;
+    memcpy(m_chunk + m_chunkFill, data, take);
+    m_chunkFill += take;
+    data += take;
+    length -= take;
+
+    /* Whole chunks only, the first write must hold the image headers */
+    if (m_chunkFill == CONFIG_AP_OTA_CHUNK_SIZE) {
+      m_chunkFill = 0;
+      esp_err_t err = m_update->write(m_chunk, CONFIG_AP_OTA_CHUNK_SIZE);
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,259 @@
+#include "DeviceMetrics.hpp"
+
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <TaskMonitor.hpp>
+
+static const char *reset_reason_name(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:
+      return "power-on";
+    case ESP_RST_EXT:
+      return "external pin";
+    case ESP_RST_SW:
+      return "software";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_INT_WDT:
+      return "interrupt watchdog";
+    case ESP_RST_TASK_WDT:
+      return "task watchdog";
+    case ESP_RST_WDT:
+      return "other watchdog";
+    case ESP_RST_DEEPSLEEP:
+      return "deep sleep";
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+    case ESP_RST_SDIO:
+      return "SDIO";
+    default:
+      return "unknown";
+  }
+}
+
+esp_err_t DeviceMetrics::write(httpd_req_t *req, StorageManagerInterface *storageManager,
+                               const HttpWorkerPool &workerPool) {
+  PrometheusWriter writer(req);
+  writeSystem(writer);
+  writeTasks(writer);
+  writeHttp(writer, workerPool);
+  if (storageManager != nullptr) {
+    writeStorage(writer, storageManager);
+  }
+  writeWifi(writer);
+  return writer.finish();
+}
+
+void DeviceMetrics::writeSystem(PrometheusWriter &writer) {
+  writer.family("metahouse_uptime_seconds", "gauge", "Time since boot.");
+  writer.seconds("metahouse_uptime_seconds", nullptr, esp_timer_get_time());
+
+  char labels[48];
+  snprintf(labels, sizeof(labels), "reason=\"%s\"", reset_reason_name(esp_reset_reason()));
+  writer.family("metahouse_reset_reason", "gauge", "Reason of the last reset, always 1.");
+  writer.sample("metahouse_reset_reason", labels, 1);
+
+  static const struct {
+    const char *labels;
+    uint32_t caps;
+  } heaps[] = {
+      {"caps=\"default\"", MALLOC_CAP_8BIT},
+      {"caps=\"internal\"", MALLOC_CAP_INTERNAL},
+  };
+
+  writer.family("metahouse_heap_free_bytes", "gauge", "Free heap.");
+  for (const auto &heap : heaps) {
+    writer.sample("metahouse_heap_free_bytes", heap.labels, heap_caps_get_free_size(heap.caps));
+  }
+  writer.family("metahouse_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+  for (const auto &heap : heaps) {
+    writer.sample("metahouse_heap_min_free_bytes", heap.labels, heap_caps_get_minimum_free_size(heap.caps));
+  }
+  writer.family("metahouse_heap_largest_block_bytes", "gauge", "Largest free block, the biggest allocation.");
+  for (const auto &heap : heaps) {
+    writer.sample("metahouse_heap_largest_block_bytes", heap.labels,
+                  heap_caps_get_largest_free_block(heap.caps));
+  }
+}
+
+void DeviceMetrics::writeTasks(PrometheusWriter &writer) {
+#if CONFIG_DM_TASK_MONITOR
+  if (TaskMonitor::isRunning()) {
+    writeMonitoredTasks(writer);
+    return;
+  }
+#endif
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+  // Without the monitor the task list is the only snapshot needed, a few dozen bytes per task
+  UBaseType_t capacity = uxTaskGetNumberOfTasks() + 2;
+  TaskStatus_t *tasks = static_cast<TaskStatus_t *>(malloc(capacity * sizeof(TaskStatus_t)));
+  if (tasks == nullptr) {
+    return;
+  }
+  uint32_t totalRunTime = 0;
+  UBaseType_t count = uxTaskGetSystemState(tasks, capacity, &totalRunTime);
+
+  char labels[40];
+  writer.family("metahouse_task_stack_free_bytes", "gauge", "Lowest free stack of the task.");
+  for (UBaseType_t i = 0; i < count; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", tasks[i].pcTaskName);
+    writer.sample("metahouse_task_stack_free_bytes", labels, tasks[i].usStackHighWaterMark);
+  }
+
+  // Run time counters advance on every core and wrap with the total, so the share is since the last wrap
+  uint64_t window = static_cast<uint64_t>(totalRunTime) * portNUM_PROCESSORS;
+  writer.family("metahouse_task_cpu_ratio", "gauge", "CPU share of the task since the counters wrapped.");
+  for (UBaseType_t i = 0; i < count; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", tasks[i].pcTaskName);
+    uint32_t permille = window ? static_cast<uint32_t>(tasks[i].ulRunTimeCounter * 1000ULL / window) : 0;
+    writer.ratio("metahouse_task_cpu_ratio", labels, permille);
+  }
+
+#if CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER
+  writer.family("metahouse_task_runtime_seconds_total", "counter", "CPU time of the task, wraps at 32 bits.");
+  for (UBaseType_t i = 0; i < count; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", tasks[i].pcTaskName);
+    writer.seconds("metahouse_task_runtime_seconds_total", labels, tasks[i].ulRunTimeCounter);
+  }
+#endif
+
+  free(tasks);
+#endif
+}
+
+void DeviceMetrics::writeMonitoredTasks(PrometheusWriter &writer) {
+#if CONFIG_DM_TASK_MONITOR
+  // The monitor averages over its sliding window, and remembers the stacks and alerts of deleted tasks
+  TaskMonitorEntry *entries =
+      static_cast<TaskMonitorEntry *>(malloc(CONFIG_DM_TASK_MONITOR_MAX_TASKS * sizeof(TaskMonitorEntry)));
+  size_t count = 0;
+  if (entries == nullptr ||
+      TaskMonitor::getSnapshot(entries, CONFIG_DM_TASK_MONITOR_MAX_TASKS, &count) != ESP_OK) {
+    free(entries);
+    return;
+  }
+
+  char labels[40];
+  writer.family("metahouse_task_stack_free_bytes", "gauge", "Lowest free stack of the task.");
+  for (size_t i = 0; i < count; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", entries[i].name);
+    writer.sample("metahouse_task_stack_free_bytes", labels, entries[i].stackFree);
+  }
+  writer.family("metahouse_task_cpu_window_ratio", "gauge", "CPU share of the task over the window.");
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].alive) {
+      snprintf(labels, sizeof(labels), "task=\"%s\"", entries[i].name);
+      writer.ratio("metahouse_task_cpu_window_ratio", labels, entries[i].cpuWindowPermille);
+    }
+  }
+  writer.family("metahouse_task_alerts", "gauge", "Monitor alerts raised by the task, 1 CPU, 2 stack.");
+  for (size_t i = 0; i < count; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", entries[i].name);
+    writer.sample("metahouse_task_alerts", labels, entries[i].flags);
+  }
+  free(entries);
+#endif
+}
+
+void DeviceMetrics::writeHttp(PrometheusWriter &writer, const HttpWorkerPool &workerPool) {
+  static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+  } families[] = {
+      {"metahouse_http_requests_total", "counter", "Requests handled by the route."},
+      {"metahouse_http_request_failures_total", "counter", "Requests whose handler failed."},
+      {"metahouse_http_requests_rejected_total", "counter", "Requests answered with 503 while busy."},
+      {"metahouse_http_request_duration_seconds", "histogram", "Time from dispatch to the handler's end."},
+  };
+
+  char labels[96];
+  HttpWorkerPool::RouteStats stats;
+  for (size_t family = 0; family < sizeof(families) / sizeof(families[0]); family++) {
+    writer.family(families[family].name, families[family].type, families[family].help);
+
+    for (uint8_t route = 0; route < workerPool.routeCount(); route++) {
+      if (workerPool.getRouteStats(route, &stats) != ESP_OK) {
+        continue;
+      }
+      int prefix = snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"", stats.uri,
+                            http_method_str(static_cast<enum http_method>(stats.method)));
+
+      if (family == 0) {
+        writer.sample(families[family].name, labels, stats.requests);
+      } else if (family == 1) {
+        writer.sample(families[family].name, labels, stats.failures);
+      } else if (family == 2) {
+        writer.sample(families[family].name, labels, stats.rejected);
+      } else {
+        uint32_t cumulative = 0;
+        for (size_t bucket = 0; bucket < HttpWorkerPool::kLatencyBucketCount; bucket++) {
+          uint32_t bound = HttpWorkerPool::kLatencyBucketsUs[bucket];
+          cumulative += stats.buckets[bucket];
+          snprintf(labels + prefix, sizeof(labels) - prefix, ",le=\"%lu.%06lu\"",
+                   (unsigned long)(bound / 1000000), (unsigned long)(bound % 1000000));
+          writer.sample("metahouse_http_request_duration_seconds_bucket", labels, cumulative);
+        }
+        snprintf(labels + prefix, sizeof(labels) - prefix, ",le=\"+Inf\"");
+        writer.sample("metahouse_http_request_duration_seconds_bucket", labels, stats.requests);
+        labels[prefix] = '\0';
+        writer.seconds("metahouse_http_request_duration_seconds_sum", labels, stats.totalUs);
+        writer.sample("metahouse_http_request_duration_seconds_count", labels, stats.requests);
+      }
+    }
+  }
+}
+
+void DeviceMetrics::writeStorage(PrometheusWriter &writer, StorageManagerInterface *storageManager) {
+  StorageStats stats;
+  if (storageManager->getStats(&stats) != ESP_OK) {
+    return;
+  }
+
+  writer.family("metahouse_storage_operations_total", "counter", "Storage operations, erases included.");
+  writer.sample("metahouse_storage_operations_total", "op=\"read\"", stats.reads);
+  writer.sample("metahouse_storage_operations_total", "op=\"write\"", stats.writes);
+  writer.family("metahouse_storage_errors_total", "counter", "Failed storage operations.");
+  writer.sample("metahouse_storage_errors_total", nullptr, stats.errors);
+  writer.family("metahouse_storage_bytes_total", "counter", "Payload bytes read and written.");
+  writer.sample("metahouse_storage_bytes_total", "op=\"read\"", stats.bytesRead);
+  writer.sample("metahouse_storage_bytes_total", "op=\"write\"", stats.bytesWritten);
+  writer.family("metahouse_storage_duration_seconds_total", "counter", "Time spent in storage operations.");
+  writer.seconds("metahouse_storage_duration_seconds_total", "op=\"read\"", stats.readTimeUs);
+  writer.seconds("metahouse_storage_duration_seconds_total", "op=\"write\"", stats.writeTimeUs);
+  writer.family("metahouse_storage_max_duration_seconds", "gauge", "Slowest storage operation since boot.");
+  writer.seconds("metahouse_storage_max_duration_seconds", "op=\"read\"", stats.maxReadUs);
+  writer.seconds("metahouse_storage_max_duration_seconds", "op=\"write\"", stats.maxWriteUs);
+}
+
+void DeviceMetrics::writeWifi(PrometheusWriter &writer) {
+  wifi_sta_list_t stations;
+  if (esp_wifi_ap_get_sta_list(&stations) == ESP_OK) {
+    writer.family("metahouse_wifi_stations", "gauge", "Clients connected to the access point.");
+    writer.sample("metahouse_wifi_stations", nullptr, stations.num);
+
+    char labels[32];
+    writer.family("metahouse_wifi_station_rssi_dbm", "gauge", "Signal strength of each client.");
+    for (int i = 0; i < stations.num; i++) {
+      const uint8_t *mac = stations.sta[i].mac;
+      snprintf(labels, sizeof(labels), "mac=\"%02x:%02x:%02x:%02x:%02x:%02x\"", mac[0], mac[1], mac[2],
+               mac[3], mac[4], mac[5]);
+      writer.sample("metahouse_wifi_station_rssi_dbm", labels, stations.sta[i].rssi);
+    }
+  }
+
+  // Only while the station interface is associated
+  wifi_ap_record_t uplink;
+  if (esp_wifi_sta_get_ap_info(&uplink) == ESP_OK) {
+    writer.family("metahouse_wifi_rssi_dbm", "gauge", "Signal strength of the upstream access point.");
+    writer.sample("metahouse_wifi_rssi_dbm", nullptr, uplink.rssi);
+  }
+}
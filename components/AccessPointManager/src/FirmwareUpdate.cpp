@@ -0,0 +1,151 @@
+#include "FirmwareUpdate.hpp"
+
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "FirmwareUpdate";
+
+FirmwareUpdate::FirmwareUpdate()
+    : m_partition(nullptr), m_handle(0), m_sha(), m_size(0), m_written(0), m_hash(), m_version() {}
+
+FirmwareUpdate::~FirmwareUpdate() { abort(); }
+
+esp_err_t FirmwareUpdate::begin(size_t imageSize) {
+  if (m_partition != nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  const esp_partition_t *partition = esp_ota_get_next_update_partition(nullptr);
+  if (partition == nullptr) {
+    ESP_LOGE(TAG, "No OTA partition to write");
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (imageSize < kHeaderLength || imageSize > partition->size) {
+    ESP_LOGE(TAG, "Image of %u bytes does not fit %s", (unsigned)imageSize, partition->label);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  /* Erase sector by sector as the image arrives, erasing the whole slot up front stalls the upload */
+  esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &m_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to begin the update: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  mbedtls_sha256_init(&m_sha);
+  mbedtls_sha256_starts(&m_sha, 0);
+  m_partition = partition;
+  m_size = imageSize;
+  m_written = 0;
+  m_version[0] = '\0';
+  ESP_LOGI(TAG, "Writing %u bytes to %s", (unsigned)imageSize, partition->label);
+  return ESP_OK;
+}
+
+esp_err_t FirmwareUpdate::write(const void *data, size_t length) {
+  if (m_partition == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (length > m_size - m_written) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  if (m_written == 0) {
+    /* Reject an image that cannot boot here before the first sector is erased */
+    if (length < kHeaderLength) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = checkHeaders(bytes);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  esp_err_t err = esp_ota_write(m_handle, bytes, length);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write at %u: %s", (unsigned)m_written, esp_err_to_name(err));
+    return err;
+  }
+  mbedtls_sha256_update(&m_sha, bytes, length);
+  m_written += length;
+  return ESP_OK;
+}
+
+esp_err_t FirmwareUpdate::finish(const uint8_t *expectedHash) {
+  if (m_partition == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (m_written != m_size) {
+    abort();
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  mbedtls_sha256_finish(&m_sha, m_hash);
+  if (expectedHash != nullptr && memcmp(m_hash, expectedHash, kFirmwareHashLength) != 0) {
+    ESP_LOGE(TAG, "Image hash does not match");
+    abort();
+    return ESP_ERR_INVALID_CRC;
+  }
+
+  /* Verifies every segment and the appended digest, and the signature when signed apps are enabled.
+     The handle is released whatever the outcome */
+  const esp_partition_t *partition = m_partition;
+  esp_err_t err = esp_ota_end(m_handle);
+  mbedtls_sha256_free(&m_sha);
+  m_partition = nullptr;
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Image verification failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  err = esp_ota_set_boot_partition(partition);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set the boot partition: %s", esp_err_to_name(err));
+    return err;
+  }
+  ESP_LOGI(TAG, "Version %s will boot from %s", m_version, partition->label);
+  return ESP_OK;
+}
+
+void FirmwareUpdate::abort() {
+  if (m_partition == nullptr) {
+    return;
+  }
+  esp_ota_abort(m_handle);
+  mbedtls_sha256_free(&m_sha);
+  m_partition = nullptr;
+  ESP_LOGW(TAG, "Update aborted after %u bytes", (unsigned)m_written);
+}
+
+esp_err_t FirmwareUpdate::checkHeaders(const uint8_t *data) {
+  esp_image_header_t image;
+  memcpy(&image, data, sizeof(image));
+  if (image.magic != ESP_IMAGE_HEADER_MAGIC) {
+    ESP_LOGE(TAG, "Not an application image");
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+  if (image.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+    ESP_LOGE(TAG, "Image is built for chip %d", image.chip_id);
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+
+  /* The app description is the start of the first segment */
+  esp_app_desc_t app;
+  memcpy(&app, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(app));
+  if (app.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+    ESP_LOGE(TAG, "Image has no app description");
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+
+  const esp_app_desc_t *running = esp_app_get_description();
+  if (strncmp(app.project_name, running->project_name, sizeof(app.project_name)) != 0) {
+    ESP_LOGE(TAG, "Image is of project %.*s", (int)sizeof(app.project_name), app.project_name);
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+
+  strncpy(m_version, app.version, sizeof(m_version) - 1);
+  m_version[sizeof(m_version) - 1] = '\0';
+  ESP_LOGI(TAG, "Updating from %s to %s", running->version, m_version);
+  return ESP_OK;
+}
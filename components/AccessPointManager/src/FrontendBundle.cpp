@@ -0,0 +1,166 @@
+#include "FrontendBundle.hpp"
+
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <string.h>
+
+static const char *TAG = "FrontendBundle";
+
+static constexpr uint32_t kBundleMagic = 0x4E424546;  // "FEBN"
+static constexpr uint16_t kBundleVersion = 2;
+
+/**
+ * @brief Bundle header, layout shared with tools/pack_frontend.py.
+ */
+struct FrontendBundle::Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+  uint32_t totalSize;
+  uint32_t indexOffset;
+  uint32_t stringsOffset;
+  uint32_t dataOffset;
+  uint32_t crc32;  ///< CRC32 of everything after the header
+  uint32_t reserved;
+};
+
+/**
+ * @brief Index record, layout shared with tools/pack_frontend.py. Offsets are from the bundle start.
+ */
+struct FrontendBundle::Entry {
+  uint32_t pathOffset;
+  uint32_t mimeOffset;
+  uint32_t dataOffset;
+  uint32_t length;
+  uint32_t gzipOffset;
+  uint32_t gzipLength;  ///< 0 if the asset has no gzip variant
+  uint8_t hash[kFrontendHashLength];
+  uint16_t pathLength;
+  uint16_t reserved;
+};
+
+FrontendBundle::FrontendBundle() : m_base(nullptr), m_header(nullptr), m_entries(nullptr), m_mapping(0) {}
+
+FrontendBundle::~FrontendBundle() { close(); }
+
+esp_err_t FrontendBundle::open(const char *partitionLabel) {
+  static_assert(sizeof(Header) == 32 && sizeof(Entry) == 36, "bundle layout changed");
+
+  close();
+
+  const esp_partition_t *partition =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+  if (partition == nullptr) {
+    ESP_LOGE(TAG, "Partition %s not found", partitionLabel);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  // Read the header first so only the used part of the partition is mapped
+  Header header;
+  esp_err_t err = esp_partition_read(partition, 0, &header, sizeof(header));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to read the bundle header: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  if (header.magic != kBundleMagic || header.version != kBundleVersion) {
+    ESP_LOGE(TAG, "No frontend bundle in partition %s", partitionLabel);
+    return ESP_ERR_INVALID_VERSION;
+  }
+
+  if (header.totalSize < sizeof(Header) || header.totalSize > partition->size ||
+      header.indexOffset < sizeof(Header) ||
+      header.indexOffset + header.count * sizeof(Entry) > header.stringsOffset ||
+      header.stringsOffset > header.dataOffset || header.dataOffset > header.totalSize) {
+    ESP_LOGE(TAG, "Corrupt bundle header");
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  const void *mapped = nullptr;
+  err = esp_partition_mmap(partition, 0, header.totalSize, ESP_PARTITION_MMAP_DATA, &mapped, &m_mapping);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to map the bundle: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  const uint8_t *base = static_cast<const uint8_t *>(mapped);
+  uint32_t crc = esp_rom_crc32_le(0, base + sizeof(Header), header.totalSize - sizeof(Header));
+  if (crc != header.crc32) {
+    ESP_LOGE(TAG, "Bundle checksum mismatch");
+    esp_partition_munmap(m_mapping);
+    return ESP_ERR_INVALID_CRC;
+  }
+
+  const Entry *entries = reinterpret_cast<const Entry *>(base + header.indexOffset);
+  for (uint16_t i = 0; i < header.count; i++) {
+    const Entry &entry = entries[i];
+    if (entry.pathOffset + entry.pathLength >= header.dataOffset ||
+        base[entry.pathOffset + entry.pathLength] != '\0' || entry.mimeOffset >= header.dataOffset ||
+        entry.dataOffset + entry.length > header.totalSize ||
+        entry.gzipOffset + entry.gzipLength > header.totalSize) {
+      ESP_LOGE(TAG, "Corrupt bundle index entry %u", i);
+      esp_partition_munmap(m_mapping);
+      return ESP_ERR_INVALID_SIZE;
+    }
+  }
+
+  m_base = base;
+  m_header = reinterpret_cast<const Header *>(base);
+  m_entries = entries;
+
+  ESP_LOGI(TAG, "Frontend bundle mapped: %u assets, %lu bytes", header.count,
+           (unsigned long)header.totalSize);
+  return ESP_OK;
+}
+
+void FrontendBundle::close() {
+  if (m_base == nullptr) {
+    return;
+  }
+
+  esp_partition_munmap(m_mapping);
+  m_base = nullptr;
+  m_header = nullptr;
+  m_entries = nullptr;
+}
+
+esp_err_t FrontendBundle::find(const char *path, size_t length, FrontendAsset *asset) const {
+  if (m_base == nullptr || path == nullptr || asset == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  size_t low = 0;
+  size_t high = m_header->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    const Entry &entry = m_entries[middle];
+    const char *entryPath = reinterpret_cast<const char *>(m_base + entry.pathOffset);
+
+    int cmp = memcmp(path, entryPath, length < entry.pathLength ? length : entry.pathLength);
+    if (cmp == 0) {
+      cmp = (length > entry.pathLength) - (length < entry.pathLength);
+    }
+
+    if (cmp == 0) {
+      asset->path = entryPath;
+      asset->mimeType = reinterpret_cast<const char *>(m_base + entry.mimeOffset);
+      asset->data = m_base + entry.dataOffset;
+      asset->length = entry.length;
+      asset->gzipData = entry.gzipLength ? m_base + entry.gzipOffset : nullptr;
+      asset->gzipLength = entry.gzipLength;
+      asset->hash = entry.hash;
+      return ESP_OK;
+    }
+
+    if (cmp < 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+uint16_t FrontendBundle::size() const { return m_header ? m_header->count : 0; }
@@ -3,110 +3,79 @@
 #include <esp_err.h>
 #include <esp_http_server.h>
 #include <esp_log.h>
-#include <esp_spiffs.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
-#define IS_FILE_EXT(filename, ext) (strcasecmp(&filename[strlen(filename) - sizeof(ext) + 1], ext) == 0)
+#include "EndpointCreator.hpp"
 
-esp_err_t check_file_exist(const char *filename) {
-  // Check if the file exists
-  if (!filename) {
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  FILE *file = fopen(filename, "r");
-  if (!file) {
-    return ESP_ERR_NOT_FOUND;
-  }
+static const char *TAG = "HelperHandler";
 
-  fclose(file);
-  return ESP_OK;
-}
+// DeviceCreator::getJsonSchemaSizeForAllDevices() does not count the type names, so use a fixed size
+static constexpr size_t AP_ACCESSORY_SCHEMA_SIZE = 512;
 
-esp_err_t set_content_type(httpd_req_t *req, const char *filename) {
-  if (!filename || !req) {
-    return ESP_ERR_INVALID_ARG;
-  }
-  if (IS_FILE_EXT(filename, ".htm")) return httpd_resp_set_type(req, "text/html");
-  if (IS_FILE_EXT(filename, ".html")) return httpd_resp_set_type(req, "text/html");
-  if (IS_FILE_EXT(filename, ".css")) return httpd_resp_set_type(req, "text/css");
-  if (IS_FILE_EXT(filename, ".js")) return httpd_resp_set_type(req, "application/javascript");
-  if (IS_FILE_EXT(filename, ".png")) return httpd_resp_set_type(req, "image/png");
-  if (IS_FILE_EXT(filename, ".gif")) return httpd_resp_set_type(req, "image/gif");
-  if (IS_FILE_EXT(filename, ".jpg")) return httpd_resp_set_type(req, "image/jpeg");
-  if (IS_FILE_EXT(filename, ".ico")) return httpd_resp_set_type(req, "image/x-icon");
-  if (IS_FILE_EXT(filename, ".xml")) return httpd_resp_set_type(req, "text/xml");
-  if (IS_FILE_EXT(filename, ".pdf")) return httpd_resp_set_type(req, "application/x-pdf");
-  if (IS_FILE_EXT(filename, ".zip")) return httpd_resp_set_type(req, "application/x-zip");
-  if (IS_FILE_EXT(filename, ".gz")) return httpd_resp_set_type(req, "application/x-gzip");
-
-  return httpd_resp_set_type(req, "text/plain");
+static bool header_value(httpd_req_t *req, const char *field, char *value, size_t size) {
+  // A truncated value still holds the leading tokens, which is enough for the checks below
+  esp_err_t err = httpd_req_get_hdr_value_str(req, field, value, size);
+  return err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC;
 }
 
-esp_err_t stream_file(httpd_req_t *req, const char *filename) {
-  if (!filename || !req) {
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  // Open the file
-  FILE *file = fopen(filename, "r");
-  if (!file) {
-    return ESP_FAIL;
+bool accepts_gzip(httpd_req_t *req) {
+  char value[128];
+  if (!header_value(req, "Accept-Encoding", value, sizeof(value))) {
+    return false;
   }
 
-  // Stream the file
-  char buffer[CONFIG_AP_STREAM_BUFFER_SIZE];
-  size_t read_bytes;
-  do {
-    read_bytes = fread(buffer, 1, CONFIG_AP_STREAM_BUFFER_SIZE, file);
-    ESP_LOGI("stream_file", "Read %zu bytes", read_bytes);
-    if (read_bytes > 0) {
-      esp_err_t err = httpd_resp_send_chunk(req, buffer, read_bytes);
-      if (err != ESP_OK) {
-        fclose(file);
-        /* Abort sending file */
-        httpd_resp_sendstr_chunk(req, NULL);  // TODO:  httpd_resp_send_chunk(req, NULL, 0);
-        return err;
-      }
+  // Look for a "gzip" or "*" coding that is not disabled with q=0
+  char *save = nullptr;
+  for (char *token = strtok_r(value, ",", &save); token; token = strtok_r(nullptr, ",", &save)) {
+    while (*token == ' ') {
+      token++;
     }
-  } while (read_bytes > 0);
-
-  // Close the file
-  fclose(file);
-
-  // Finish the response
-  return httpd_resp_send_chunk(req, NULL, 0);
+    size_t length = strcspn(token, " ;");
+    if ((length == 4 && strncasecmp(token, "gzip", 4) == 0) || (length == 1 && token[0] == '*')) {
+      const char *quality = strstr(token + length, "q=");
+      return quality == nullptr || strtod(quality + 2, nullptr) > 0;
+    }
+  }
+  return false;
 }
 
-esp_err_t mount_fs(char *base_path, char *partition_label) {
-  if (!base_path || !partition_label) {
-    return ESP_ERR_INVALID_ARG;
+bool etag_matches(httpd_req_t *req, const char *etag) {
+  char value[128];
+  if (!header_value(req, "If-None-Match", value, sizeof(value))) {
+    return false;
   }
 
-  esp_vfs_spiffs_conf_t conf = {
-      .base_path = base_path,
-      .partition_label = partition_label,
-      .max_files = 5,  // This sets the maximum number of files that can be open at the same time
-      .format_if_mount_failed = false};
+  return strcmp(value, "*") == 0 || strstr(value, etag) != nullptr;
+}
 
-  esp_err_t err = esp_vfs_spiffs_register(&conf);
-  if (err != ESP_OK) {
-    return err;
+bool is_versioned_request(httpd_req_t *req, const char *version) {
+  char query[64];
+  char value[32];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+      httpd_query_key_value(query, "v", value, sizeof(value)) != ESP_OK) {
+    return false;
   }
 
-  return ESP_OK;
+  return strcmp(value, version) == 0;
 }
 
 esp_err_t unpair_device(StorageManagerInterface *storageManager) {
-  // get the accessory DB from the storageManager
-  char response[CONFIG_AP_ACCESSORY_JSON_SIZE];
-  storageManager->getAccessoryJson(response, sizeof(response));
-  ESP_LOGI("unpair_device", "Accessory DB: %s", response);
+  // get the accessory DB from the storageManager, sized to what is stored
+  char *accessoryJson = nullptr;
+  storageManager->getAccessoryJsonCopy(&accessoryJson, nullptr);
 
   // erase the storage
   storageManager->eraseAllData();
 
-  // set the accessory DB to the storageManager
-  storageManager->setAccessoryJson(response, strlen(response));
+  // set the accessory DB to the storageManager, the ids come back with it
+  if (accessoryJson != nullptr) {
+    set_accessory_DB_JSON(storageManager, accessoryJson);
+    free(accessoryJson);
+  }
 
   // restart the device
   restart_device();
@@ -124,7 +93,19 @@ esp_err_t factory_reset(StorageManagerInterface *storageManager) {
   return ESP_OK;
 }
 
-esp_err_t update_firmware(StorageManagerInterface *storageManager) { return ESP_OK; }
+esp_err_t update_firmware(StorageManagerInterface *storageManager) {
+  // an uploaded image only becomes the boot partition once it is verified
+  const esp_partition_t *boot = esp_ota_get_boot_partition();
+  if (boot == nullptr || boot == esp_ota_get_running_partition()) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  // restart into it, the bootloader rolls back if it never confirms itself
+  ESP_LOGI(TAG, "Restarting into %s", boot->label);
+  restart_device();
+
+  return ESP_OK;
+}
 
 esp_err_t restart_device() {
   esp_restart();
@@ -137,15 +118,59 @@ esp_err_t existProgramMode(StorageManagerInterface *storageManager) {
   return ESP_OK;
 }
 
-esp_err_t get_accessory_DB_JSON(StorageManagerInterface *storageManager, char *response,
-                                size_t response_size) {
-  storageManager->getAccessoryJson(response, response_size);
+esp_err_t set_accessory_DB_JSON(StorageManagerInterface *storageManager, const char *new_accessory_json) {
+  AccessoryJsonValidator validator;
+  esp_err_t err = load_accessory_schema(&validator);
+  if (err == ESP_OK) {
+    err = storageManager->beginAccessoryJsonWrite();
+  }
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  validator.setRecordHandler(stage_accessory, storageManager);
+  err = validator.feed(new_accessory_json, strlen(new_accessory_json));
+  if (err == ESP_OK) {
+    err = validator.finish();
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Invalid accessory database: %s", validator.error());
+    storageManager->abortAccessoryJsonWrite();
+    return err;
+  }
 
-  return ESP_OK;
+  return storageManager->commitAccessoryJsonWrite();
 }
 
-esp_err_t set_accessory_DB_JSON(StorageManagerInterface *storageManager, const char *new_accessory_json) {
-  storageManager->setAccessoryJson(new_accessory_json, strlen(new_accessory_json));
+esp_err_t upgrade_accessory_DB(StorageManagerInterface *storageManager) {
+  // only a database saved before accessories had ids has version 0
+  uint32_t version = 0;
+  if (storageManager->getAccessoryJsonVersion(&version) != ESP_OK || version != 0) {
+    return ESP_OK;
+  }
 
-  return ESP_OK;
+  ESP_LOGI(TAG, "Upgrading the accessory database");
+  char *accessoryJson = nullptr;
+  esp_err_t err = storageManager->getAccessoryJsonCopy(&accessoryJson, nullptr);
+  if (err == ESP_OK) {
+    err = set_accessory_DB_JSON(storageManager, accessoryJson);
+  }
+  free(accessoryJson);
+
+  return err;
+}
+
+esp_err_t load_accessory_schema(AccessoryJsonValidator *validator) {
+  char schema[AP_ACCESSORY_SCHEMA_SIZE];
+  DeviceCreator().getJsonSchemaForAllDevices(schema, sizeof(schema));
+
+  esp_err_t err = validator->loadSchema(schema);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to load the accessory schema");
+  }
+  return err;
+}
+
+esp_err_t stage_accessory(uint16_t id, const char *json, size_t length, void *context) {
+  return static_cast<StorageManagerInterface *>(context)->stageAccessory(id, json, length);
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "HttpWorkerPool.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+static const char *TAG = "HttpWorkerPool";
+
+// Guards the route counters, updated by the server task and every worker
+static portMUX_TYPE s_statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_err_t send_busy(httpd_req_t *req) {
+  httpd_resp_set_status(req, "503 Service Unavailable");
+  httpd_resp_set_hdr(req, "Retry-After", "1");
+  return httpd_resp_sendstr(req, "Server busy, try again");
+}
+
+bool HttpWorkerPool::Limit::tryAcquire() {
+  uint8_t active = m_active.load();
+  do {
+    if (active >= m_max) {
+      return false;
+    }
+  } while (!m_active.compare_exchange_weak(active, active + 1));
+  return true;
+}
+
+void HttpWorkerPool::Limit::release() { m_active--; }
+
+HttpWorkerPool::HttpWorkerPool()
+    : m_routes(), m_routeCount(0), m_queue(nullptr), m_workers(), m_workerCount(0) {}
+
+HttpWorkerPool::~HttpWorkerPool() {
+  for (uint8_t i = 0; i < m_workerCount; i++) {
+    vTaskDelete(m_workers[i]);
+  }
+  if (m_queue != nullptr) {
+    vQueueDelete(m_queue);
+  }
+}
+
+esp_err_t HttpWorkerPool::start(uint8_t workers, uint8_t queueLength, uint32_t stackSize,
+                                UBaseType_t priority) {
+  if (workers == 0 || workers > kMaxWorkers || queueLength == 0 || m_queue != nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  m_queue = xQueueCreate(queueLength, sizeof(Job));
+  if (m_queue == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (uint8_t i = 0; i < workers; i++) {
+    char name[configMAX_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "httpWorker%u", i);
+    if (xTaskCreate(worker, name, stackSize, this, priority, &m_workers[m_workerCount]) != pdPASS) {
+      ESP_LOGE(TAG, "Failed to create %s", name);
+      return ESP_ERR_NO_MEM;
+    }
+    m_workerCount++;
+  }
+
+  ESP_LOGI(TAG, "Started %u workers", m_workerCount);
+  return ESP_OK;
+}
+
+httpd_uri_t HttpWorkerPool::route(const char *uri, httpd_method_t method, Handler handler, void *context,
+                                  Limit *limit) {
+  return addRoute(uri, method, handler, context, limit, true);
+}
+
+httpd_uri_t HttpWorkerPool::inlineRoute(const char *uri, httpd_method_t method, Handler handler,
+                                        void *context) {
+  return addRoute(uri, method, handler, context, nullptr, false);
+}
+
+httpd_uri_t HttpWorkerPool::addRoute(const char *uri, httpd_method_t method, Handler handler, void *context,
+                                     Limit *limit, bool onWorker) {
+  if (m_routeCount == kMaxRoutes) {
+    ESP_LOGW(TAG, "Too many routes, %s runs on the server task uncounted", uri);
+    return {.uri = uri, .method = method, .handler = handler, .user_ctx = context};
+  }
+
+  Route *route = &m_routes[m_routeCount++];
+  *route = {.pool = this, .handler = handler, .context = context, .limit = limit, .onWorker = onWorker};
+  route->stats = {.uri = uri, .method = method};
+  return {.uri = uri, .method = method, .handler = dispatch, .user_ctx = route};
+}
+
+esp_err_t HttpWorkerPool::getRouteStats(uint8_t index, RouteStats *stats) const {
+  if (index >= m_routeCount || stats == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&s_statsLock);
+  *stats = m_routes[index].stats;
+  portEXIT_CRITICAL(&s_statsLock);
+  return ESP_OK;
+}
+
+void HttpWorkerPool::record(Route *route, int64_t startUs, esp_err_t result) {
+  uint32_t latencyUs = esp_timer_get_time() - startUs;
+  size_t bucket = 0;
+  while (bucket < kLatencyBucketCount && latencyUs > kLatencyBucketsUs[bucket]) {
+    bucket++;
+  }
+
+  portENTER_CRITICAL(&s_statsLock);
+  RouteStats &stats = route->stats;
+  stats.requests++;
+  if (result != ESP_OK) {
+    stats.failures++;
+  }
+  stats.totalUs += latencyUs;
+  if (bucket < kLatencyBucketCount) {
+    stats.buckets[bucket]++;
+  }
+  portEXIT_CRITICAL(&s_statsLock);
+}
+
+esp_err_t HttpWorkerPool::dispatch(httpd_req_t *req) {
+  Route *route = static_cast<Route *>(req->user_ctx);
+  int64_t startUs = esp_timer_get_time();
+
+  if (!route->onWorker) {
+    req->user_ctx = route->context;
+    esp_err_t result = route->handler(req);
+    record(route, startUs, result);
+    return result;
+  }
+
+  if (route->limit != nullptr && !route->limit->tryAcquire()) {
+    ESP_LOGW(TAG, "Route busy: %s", req->uri);
+    portENTER_CRITICAL(&s_statsLock);
+    route->stats.rejected++;
+    portEXIT_CRITICAL(&s_statsLock);
+    return send_busy(req);
+  }
+
+  /* The copy keeps the socket out of the server's select until the worker completes it */
+  httpd_req_t *copy = nullptr;
+  esp_err_t err = httpd_req_async_handler_begin(req, &copy);
+  if (err == ESP_OK) {
+    Job job = {.req = copy, .route = route, .startUs = startUs};
+    if (xQueueSend(route->pool->m_queue, &job, 0) == pdTRUE) {
+      return ESP_OK;
+    }
+    httpd_req_async_handler_complete(copy);
+    err = ESP_ERR_NO_MEM;
+  }
+
+  if (route->limit != nullptr) {
+    route->limit->release();
+  }
+  ESP_LOGW(TAG, "Failed to hand off %s: %s", req->uri, esp_err_to_name(err));
+  portENTER_CRITICAL(&s_statsLock);
+  route->stats.rejected++;
+  portEXIT_CRITICAL(&s_statsLock);
+  return send_busy(req);
+}
+
+void HttpWorkerPool::worker(void *arg) {
+  HttpWorkerPool *pool = static_cast<HttpWorkerPool *>(arg);
+
+  Job job;
+  while (true) {
+    if (xQueueReceive(pool->m_queue, &job, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    job.req->user_ctx = job.route->context;
+    esp_err_t result = job.route->handler(job.req);
+    if (result != ESP_OK) {
+      /* Same as a failing handler on the server task: the connection is closed */
+      httpd_sess_trigger_close(job.req->handle, httpd_req_to_sockfd(job.req));
+    }
+    httpd_req_async_handler_complete(job.req);
+    record(job.route, job.startUs, result);
+
+    if (job.route->limit != nullptr) {
+      job.route->limit->release();
+    }
+  }
+}
@@ -0,0 +1,82 @@
+#include "PrometheusWriter.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+PrometheusWriter::PrometheusWriter(httpd_req_t *req) : m_req(req), m_buffer(), m_fill(0), m_err(ESP_OK) {
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+}
+
+void PrometheusWriter::family(const char *name, const char *type, const char *help) {
+  print("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void PrometheusWriter::sample(const char *name, const char *labels, int64_t value) {
+  if (labels != nullptr) {
+    print("%s{%s} %lld\n", name, labels, (long long)value);
+  } else {
+    print("%s %lld\n", name, (long long)value);
+  }
+}
+
+void PrometheusWriter::seconds(const char *name, const char *labels, uint64_t microseconds) {
+  unsigned long long whole = microseconds / 1000000;
+  unsigned long fraction = microseconds % 1000000;
+  if (labels != nullptr) {
+    print("%s{%s} %llu.%06lu\n", name, labels, whole, fraction);
+  } else {
+    print("%s %llu.%06lu\n", name, whole, fraction);
+  }
+}
+
+void PrometheusWriter::ratio(const char *name, const char *labels, uint32_t permille) {
+  unsigned long whole = permille / 1000;
+  unsigned long fraction = permille % 1000;
+  if (labels != nullptr) {
+    print("%s{%s} %lu.%03lu\n", name, labels, whole, fraction);
+  } else {
+    print("%s %lu.%03lu\n", name, whole, fraction);
+  }
+}
+
+esp_err_t PrometheusWriter::finish() {
+  flush();
+  if (m_err == ESP_OK) {
+    m_err = httpd_resp_send_chunk(m_req, nullptr, 0);
+  }
+  return m_err;
+}
+
+void PrometheusWriter::print(const char *format, ...) {
+  if (m_err != ESP_OK) {
+    return;
+  }
+
+  // Format at the end of the buffer, and again into an empty one if the line did not fit
+  for (int attempt = 0; attempt < 2; attempt++) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(m_buffer + m_fill, sizeof(m_buffer) - m_fill, format, args);
+    va_end(args);
+
+    if (length >= 0 && (size_t)length < sizeof(m_buffer) - m_fill) {
+      m_fill += length;
+      return;
+    }
+    if (m_fill == 0) {
+      // A line longer than the buffer is a bug of the caller, drop it rather than emit a broken one
+      return;
+    }
+    flush();
+    if (m_err != ESP_OK) {
+      return;
+    }
+  }
+}
+
+void PrometheusWriter::flush() {
+  if (m_fill > 0 && m_err == ESP_OK) {
+    m_err = httpd_resp_send_chunk(m_req, m_buffer, m_fill);
+  }
+  m_fill = 0;
+}
@@ -0,0 +1,111 @@
+#include "WebSocketHub.hpp"
+
+#include <esp_log.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "WebSocketHub";
+
+// LWIP_MAX_SOCKETS is at most 16, the server never has more clients
+static constexpr size_t kMaxClients = 16;
+
+/**
+ * @brief Event waiting in the server's work queue.
+ */
+struct HubEvent {
+  WebSocketHub *hub;
+  httpd_handle_t server;
+  size_t length;
+  char text[WebSocketHub::kMaxEventLength + 1];
+};
+
+WebSocketHub::WebSocketHub() : m_server(nullptr), m_hasClients(false) {}
+
+esp_err_t WebSocketHub::handle(httpd_req_t *req) {
+  if (req->method == HTTP_GET) {
+    /* The handshake is done, the socket now receives every broadcast */
+    ESP_LOGI(TAG, "Client %d connected", httpd_req_to_sockfd(req));
+    m_hasClients = true;
+    return ESP_OK;
+  }
+
+  /* Clients only listen, read and drop whatever they send */
+  httpd_ws_frame_t frame = {};
+  esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+  if (err != ESP_OK || frame.len == 0) {
+    return err;
+  }
+  if (frame.len > kMaxEventLength) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  uint8_t payload[kMaxEventLength];
+  frame.payload = payload;
+  return httpd_ws_recv_frame(req, &frame, frame.len);
+}
+
+esp_err_t WebSocketHub::publish(const char *format, ...) {
+  if (!m_hasClients || m_server == nullptr) {
+    return ESP_OK;
+  }
+
+  HubEvent *event = static_cast<HubEvent *>(malloc(sizeof(HubEvent)));
+  if (event == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(event->text, sizeof(event->text), format, args);
+  va_end(args);
+  if (length < 0 || (size_t)length > kMaxEventLength) {
+    ESP_LOGW(TAG, "Event too long: %s", format);
+    free(event);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  event->hub = this;
+  event->server = m_server;
+  event->length = length;
+
+  esp_err_t err = httpd_queue_work(m_server, broadcast, event);
+  if (err != ESP_OK) {
+    free(event);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+void WebSocketHub::broadcast(void *arg) {
+  HubEvent *event = static_cast<HubEvent *>(arg);
+
+  int fds[kMaxClients];
+  size_t count = kMaxClients;
+  if (httpd_get_client_list(event->server, &count, fds) != ESP_OK) {
+    free(event);
+    return;
+  }
+
+  httpd_ws_frame_t frame = {};
+  frame.final = true;
+  frame.type = HTTPD_WS_TYPE_TEXT;
+  frame.payload = reinterpret_cast<uint8_t *>(event->text);
+  frame.len = event->length;
+
+  bool sent = false;
+  for (size_t i = 0; i < count; i++) {
+    if (httpd_ws_get_fd_info(event->server, fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) {
+      continue;
+    }
+    if (httpd_ws_send_frame_async(event->server, fds[i], &frame) != ESP_OK) {
+      ESP_LOGD(TAG, "Failed to send to client %d", fds[i]);
+    }
+    sent = true;
+  }
+
+  /* The handshake runs on this task too, so no client can connect between the scan and the reset */
+  if (!sent) {
+    event->hub->m_hasClients = false;
+  }
+  free(event);
+}
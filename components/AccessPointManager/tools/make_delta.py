@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""Make a compressed delta that rebuilds a new firmware image from the one running on the device.
+
+Upload the delta to /firmware/delta instead of the whole image to /firmware. The device rebuilds
+the new image into its inactive OTA slot while the delta streams in, then verifies it like a full
+upload before it boots it.
+
+Releases mostly move code around, which shifts the addresses embedded in it. A copy/insert delta
+would store every shifted reference as new data. Like bsdiff, this tool pairs each region of the
+new image with a similar region of the old one and stores the bytewise difference, which is mostly
+zeros and compresses very well. Whatever has no counterpart is stored as it is. All integers are
+little-endian.
+
+  header   magic "MHDELTA1", source size, target size, SHA-256 of the source image,
+           SHA-256 of the target image
+  stream   raw deflate of records, each record is
+             diff length, extra length, seek (signed)   3 x 32 bits
+             diff bytes    added bytewise to the source at the cursor, which then advances
+             extra bytes   copied as they are
+           the cursor then moves by seek
+
+The device checks the SHA-256 of its running image against the header before it writes anything,
+so a delta made against another release is refused. The delta is also applied here and compared
+with the target before it is written.
+
+Usage: make_delta.py <running image> <new image> <output file> [--block <bytes>]
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"MHDELTA1"
+HEADER = struct.Struct("<8sII32s32s")
+RECORD = struct.Struct("<IIi")
+
+# Positions whose block hash has these bits clear are indexed, a quarter of them on average.
+# The choice depends only on the content, so a block of the target is looked up exactly when
+# the same block of the source is indexed
+SAMPLE_MASK = 3
+
+# Exact matches shorter than this are not worth a record
+MIN_MATCH = 32
+
+
+def index_source(source, block):
+    index = {}
+    for offset in range(len(source) - block + 1):
+        key = hash(source[offset:offset + block])
+        if key & SAMPLE_MASK == 0:
+            index.setdefault(key, offset)
+    return index
+
+
+def match_length(source, source_pos, target, target_pos, limit):
+    length = 0
+    while length < limit and source[source_pos + length] == target[target_pos + length]:
+        length += 1
+    return length
+
+
+def forward_extension(source, source_pos, target, target_pos, limit):
+    """Length of the region after target_pos best coded as a difference against source_pos."""
+    limit = min(limit, len(source) - source_pos)
+    best, best_score, score = 0, 0, 0
+    for i in range(limit):
+        score += 1 if source[source_pos + i] == target[target_pos + i] else -1
+        if score > best_score:
+            best, best_score = i + 1, score
+    return best
+
+
+def backward_extension(source, source_pos, target, target_pos, limit):
+    """Length of the region before target_pos best coded as a difference against source_pos."""
+    limit = min(limit, source_pos)
+    best, best_score, score = 0, 0, 0
+    for i in range(1, limit + 1):
+        score += 1 if source[source_pos - i] == target[target_pos - i] else -1
+        if score > best_score:
+            best, best_score = i, score
+    return best
+
+
+def find_match(source, target, index, block, start, aligned_source, aligned_target):
+    """Next exact match at or after start that does not just continue the current alignment."""
+    for pos in range(start, len(target) - block + 1):
+        window = target[pos:pos + block]
+        key = hash(window)
+        if key & SAMPLE_MASK:
+            continue
+        offset = index.get(key)
+        if offset is None or source[offset:offset + block] != window:
+            continue
+
+        # Still paired with the current alignment, the next record's difference covers it for free
+        continued = aligned_source + (pos - aligned_target)
+        if 0 <= continued <= len(source) - block and source[continued:continued + block] == window:
+            continue
+
+        length = match_length(source, offset, target, pos, min(len(source) - offset, len(target) - pos))
+        if length >= MIN_MATCH:
+            return offset, pos, length
+    return None
+
+
+def diff_records(source, target, block):
+    index = index_source(source, block)
+    records = []
+
+    # The next record pairs target[emitted:] with source[cursor:]
+    emitted = 0
+    cursor = 0
+    scan = 0
+    while True:
+        match = find_match(source, target, index, block, scan, cursor, emitted)
+        end = match[1] if match else len(target)
+
+        gap = end - emitted
+        forward = forward_extension(source, cursor, target, emitted, gap)
+        backward = 0
+        if match:
+            backward = backward_extension(source, match[0], target, match[1], gap - forward)
+        extra_end = end - backward
+
+        diff = bytes((target[emitted + i] - source[cursor + i]) & 0xFF for i in range(forward))
+        extra = target[emitted + forward:extra_end]
+        next_cursor = match[0] - backward if match else cursor + forward
+        records.append((diff, extra, next_cursor - (cursor + forward)))
+
+        if not match:
+            return records
+        emitted = extra_end
+        cursor = next_cursor
+        scan = match[1] + match[2]
+
+
+def encode(records):
+    stream = bytearray()
+    for diff, extra, seek in records:
+        stream += RECORD.pack(len(diff), len(extra), seek)
+        stream += diff
+        stream += extra
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    return compressor.compress(bytes(stream)) + compressor.flush()
+
+
+def apply(source, delta):
+    """Rebuild the target the way the firmware does."""
+    magic, source_size, target_size, source_hash, target_hash = HEADER.unpack_from(delta)
+    if magic != MAGIC or source_size != len(source) or hashlib.sha256(source).digest() != source_hash:
+        raise ValueError("delta does not apply to this source")
+
+    stream = zlib.decompress(delta[HEADER.size:], -15)
+    target = bytearray()
+    cursor = 0
+    pos = 0
+    while pos < len(stream):
+        diff_length, extra_length, seek = RECORD.unpack_from(stream, pos)
+        pos += RECORD.size
+        if cursor + diff_length > source_size:
+            raise ValueError("difference past the end of the source")
+        target += bytes((stream[pos + i] + source[cursor + i]) & 0xFF for i in range(diff_length))
+        pos += diff_length
+        target += stream[pos:pos + extra_length]
+        pos += extra_length
+        cursor += diff_length + seek
+        if not 0 <= cursor <= source_size:
+            raise ValueError("seek out of the source")
+
+    if len(target) != target_size or hashlib.sha256(target).digest() != target_hash:
+        raise ValueError("rebuilt image does not match the target")
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="image running on the device, the build of its current release")
+    parser.add_argument("target", help="new image to rebuild")
+    parser.add_argument("output", help="delta to write")
+    parser.add_argument("--block", type=int, default=16, help="bytes hashed to find matches (default 16)")
+    args = parser.parse_args()
+
+    with open(args.source, "rb") as f:
+        source = f.read()
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    records = diff_records(source, target, args.block)
+    header = HEADER.pack(MAGIC, len(source), len(target), hashlib.sha256(source).digest(),
+                         hashlib.sha256(target).digest())
+    delta = header + encode(records)
+
+    try:
+        apply(source, delta)
+    except ValueError as e:
+        sys.exit(f"error: {e}")
+
+    with open(args.output, "wb") as f:
+        f.write(delta)
+
+    extra = sum(len(record[1]) for record in records)
+    print(f"Wrote {args.output} ({len(delta)} bytes, {100.0 * len(delta) / len(target):.1f}% of the "
+          f"{len(target)} byte image, {len(records)} records, {extra} new bytes)")
+
+
+if __name__ == "__main__":
+    main()
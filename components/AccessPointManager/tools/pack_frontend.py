@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Pack the frontend assets into a single read-only bundle for the frontend partition.
+
+Text assets are minified, references between assets are versioned with the content hash of the
+target ("script.js?v=<hash>") so the firmware can mark them immutable, and every asset that shrinks
+under gzip also gets a precompressed variant.
+
+The firmware memory-maps the bundle and serves assets straight from flash, so the layout is
+fixed-size records that can be read in place. All integers are little-endian.
+
+  header   magic "FEBN", version, entry count, total size, index/strings/data offsets,
+           CRC32 of everything after the header
+  index    one record per asset sorted by path (byte order), so lookups are a binary search
+  strings  NUL-terminated paths and MIME types
+  data     asset contents and gzip variants, 4-byte aligned
+
+Usage: pack_frontend.py <source dir> <output file> [--max-size <bytes>] [--no-minify] [--no-gzip]
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import posixpath
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = 0x4E424546  # "FEBN"
+VERSION = 2
+
+HEADER = struct.Struct("<IHHIIIIII")
+ENTRY = struct.Struct("<IIIIII8sHH")
+
+MIME_TYPES = {
+    ".htm": "text/html",
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".gif": "image/gif",
+    ".jpg": "image/jpeg",
+    ".jpeg": "image/jpeg",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+    ".xml": "text/xml",
+    ".pdf": "application/x-pdf",
+    ".zip": "application/x-zip",
+    ".gz": "application/x-gzip",
+}
+DEFAULT_MIME_TYPE = "text/plain"
+
+# Text assets in the order they are finalized: a file may only reference files of earlier groups
+TEXT_ORDER = {".css": 0, ".js": 1, ".htm": 2, ".html": 2}
+
+# Quoted or url() references to sibling assets, e.g. src="script.js" or "editicon.png"
+REFERENCE = re.compile(r"""(["'(])([A-Za-z0-9_\-./]+\.[A-Za-z0-9]+)(["')])""")
+
+
+def align(value, alignment=4):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};,])\s*", r"\1", text)
+    text = re.sub(r":\s+", ":", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_js(text):
+    # Line based so automatic semicolon insertion and string contents are left alone
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line and not line.startswith("//"):
+            lines.append(line)
+    return "\n".join(lines)
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip())
+
+
+MINIFIERS = {".css": minify_css, ".js": minify_js, ".htm": minify_html, ".html": minify_html}
+
+
+def version_references(text, url_path, hashes):
+    base = posixpath.dirname(url_path)
+
+    def replace(match):
+        reference = match.group(2)
+        target = posixpath.normpath(posixpath.join(base, reference))
+        if target not in hashes:
+            return match.group(0)
+        return "{}{}?v={}{}".format(match.group(1), reference, hashes[target].hex(), match.group(3))
+
+    return REFERENCE.sub(replace, text)
+
+
+def collect(source_dir, minify, compress):
+    files = []
+    for root, dirs, names in os.walk(source_dir):
+        dirs[:] = [d for d in dirs if not d.startswith(".")]
+        for name in names:
+            if name.startswith("."):
+                continue
+            full_path = os.path.join(root, name)
+            url_path = "/" + os.path.relpath(full_path, source_dir).replace(os.sep, "/")
+            files.append((url_path, os.path.splitext(name)[1].lower(), full_path))
+
+    # Binary assets first, then text assets in reference order, so every reference can be versioned
+    files.sort(key=lambda f: TEXT_ORDER.get(f[1], -1))
+
+    hashes = {}
+    assets = []
+    for url_path, extension, full_path in files:
+        with open(full_path, "rb") as f:
+            data = f.read()
+
+        if extension in TEXT_ORDER:
+            text = data.decode("utf-8")
+            if minify:
+                text = MINIFIERS[extension](text)
+            data = version_references(text, url_path, hashes).encode("utf-8")
+
+        digest = hashlib.sha256(data).digest()[:8]
+        hashes[url_path] = digest
+
+        compressed = gzip.compress(data, 9, mtime=0) if compress else b""
+        if len(compressed) >= len(data):
+            compressed = b""
+
+        mime_type = MIME_TYPES.get(extension, DEFAULT_MIME_TYPE)
+        assets.append((url_path.encode(), mime_type.encode(), data, compressed, digest))
+
+    assets.sort(key=lambda asset: asset[0])
+    return assets
+
+
+def pack(assets):
+    index_offset = HEADER.size
+    strings_offset = index_offset + ENTRY.size * len(assets)
+
+    strings = bytearray()
+    string_offsets = {}
+
+    def add_string(value):
+        if value not in string_offsets:
+            string_offsets[value] = strings_offset + len(strings)
+            strings.extend(value + b"\0")
+        return string_offsets[value]
+
+    located = [(add_string(path), add_string(mime), path, data, compressed, digest)
+               for path, mime, data, compressed, digest in assets]
+
+    data_offset = align(strings_offset + len(strings))
+    blob = bytearray()
+
+    def add_data(data):
+        offset = data_offset + len(blob)
+        blob.extend(data)
+        blob.extend(b"\0" * (align(len(blob)) - len(blob)))
+        return offset
+
+    index = bytearray()
+    for path_offset, mime_offset, path, data, compressed, digest in located:
+        offset = add_data(data)
+        gzip_offset = add_data(compressed) if compressed else 0
+        index.extend(ENTRY.pack(path_offset, mime_offset, offset, len(data), gzip_offset, len(compressed), digest,
+                                len(path), 0))
+
+    body = bytes(index) + bytes(strings) + b"\0" * (data_offset - strings_offset - len(strings)) + bytes(blob)
+    total_size = HEADER.size + len(body)
+    header = HEADER.pack(MAGIC, VERSION, len(assets), total_size, index_offset, strings_offset, data_offset,
+                         zlib.crc32(body) & 0xFFFFFFFF, 0)
+    return header + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="directory holding the frontend assets")
+    parser.add_argument("output", help="bundle image to write")
+    parser.add_argument("--max-size", type=lambda v: int(v, 0), default=0,
+                        help="size of the target partition, the bundle must fit")
+    parser.add_argument("--no-minify", action="store_true", help="keep text assets as they are")
+    parser.add_argument("--no-gzip", action="store_true", help="do not add gzip variants")
+    args = parser.parse_args()
+
+    assets = collect(args.source, not args.no_minify, not args.no_gzip)
+    if not assets:
+        sys.exit("No assets found in {}".format(args.source))
+
+    bundle = pack(assets)
+    if args.max_size and len(bundle) > args.max_size:
+        sys.exit("Frontend bundle is {} bytes, the partition holds {}".format(len(bundle), args.max_size))
+
+    with open(args.output, "wb") as f:
+        f.write(bundle)
+
+    source_size = sum(os.path.getsize(os.path.join(root, name))
+                      for root, _, names in os.walk(args.source) for name in names)
+    transfer_size = sum(len(compressed or data) for _, _, data, compressed, _ in assets)
+    print("Packed {} assets into {} ({} bytes, {} bytes of sources, {} bytes to transfer)".format(
+        len(assets), args.output, len(bundle), source_size, transfer_size))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Boot phases, in the order a bridge usually reaches them.
+ */
+enum class BootPhase : uint8_t {
+  AppStarted,                 ///< app_main entered, at BootTimeline::init()
+  NvsReady,                   ///< nvs_flash_init() returned
+  StorageReady,               ///< StorageManager opened its namespace
+  ProgramModeRead,            ///< Program mode flag read
+  AccessoriesRead,            ///< Accessory configuration read, or the warm boot plan found
+  EndpointsCreated,           ///< Bridged endpoints created
+  MatterStarted,              ///< esp_matter::start() returned
+  WebServerStarted,           ///< Config web server serving, in program mode
+  WifiConnected,              ///< Station associated with an access point
+  IpAcquired,                 ///< Station got its first IPv4 address
+  MatterIpReady,              ///< Matter saw the IP address change
+  CommissioningWindowOpened,  ///< Commissioning window opened
+  CommissioningComplete,      ///< Commissioning complete
+  Operational,                ///< Device operational, the summary is logged
+  Count,
+};
+
+constexpr size_t kBootPhaseCount = static_cast<size_t>(BootPhase::Count);
+
+/**
+ * @brief Timeline of one boot.
+ */
+struct BootRecord {
+  uint16_t bootCount;                ///< Boots since the last power loss
+  uint8_t resetReason;               ///< esp_reset_reason_t of the boot
+  uint8_t reserved;
+  uint32_t timeUs[kBootPhaseCount];  ///< Microseconds since the application started, 0 if not reached
+};
+
+/**
+ * @brief Boot phase markers with microsecond timestamps, kept for the last CONFIG_BT_HISTORY boots in RTC
+ * no-init memory.
+ *
+ * Each phase is stamped the first time it is marked, later marks of the same phase are ignored, so a Wi-Fi
+ * reconnection does not move the association of the boot. Marking takes a timer read and a store under a
+ * spinlock and logs nothing. Reaching BootPhase::Operational logs the whole timeline as one line, next to
+ * the previous boot. The times count from the start of the application, the ROM and the bootloader before
+ * it are not included.
+ */
+class BootTimeline {
+ public:
+  /**
+   * @brief Validate the timelines left by the previous boots, or reset them after a power loss, and start
+   * the timeline of this boot with BootPhase::AppStarted. Must be called first thing in app_main.
+   */
+  static void init();
+
+  /**
+   * @brief Stamp a phase of this boot, if not stamped yet. Callable from any task, ignored before init().
+   * @param phase The phase reached.
+   */
+  static void mark(BootPhase phase);
+
+  /**
+   * @brief Check if this boot reached BootPhase::Operational.
+   * @return true once operational.
+   */
+  static bool isOperational();
+
+  /**
+   * @brief Copy the timelines of the last boots, oldest first and this boot last.
+   * @param[out] records Destination array.
+   * @param maxRecords Capacity of the destination array.
+   * @param[out] count Number of records copied.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a pointer is null,
+   *         ESP_ERR_NOT_SUPPORTED without CONFIG_BT_BOOT_TIMELINE.
+   */
+  static esp_err_t read(BootRecord* records, size_t maxRecords, size_t* count);
+
+  /**
+   * @brief Get the name of a phase.
+   * @param phase The phase.
+   * @return A static, short name.
+   */
+  static const char* phaseName(BootPhase phase);
+
+ private:
+  BootTimeline() = delete;
+};
@@ -0,0 +1,224 @@
+#include "BootTimeline.hpp"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "BootTimeline";
+
+#if CONFIG_BT_BOOT_TIMELINE
+
+namespace {
+
+constexpr uint32_t kTimelineMagic = 0x424F4F54;  // "BOOT"
+constexpr uint16_t kTimelineVersion = 1;
+
+struct Timelines {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t capacity;
+  uint8_t phases;
+  uint8_t head;  // record of the current boot
+  uint8_t count;
+  uint16_t checksum;
+  BootRecord records[CONFIG_BT_HISTORY];
+};
+
+RTC_NOINIT_ATTR Timelines s_timelines;
+portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+BootRecord *s_current = nullptr;
+
+uint16_t headerChecksum(const Timelines &timelines) {
+  return static_cast<uint16_t>(timelines.magic ^ (timelines.magic >> 16) ^ timelines.version ^
+                               timelines.capacity ^ (timelines.phases << 8) ^ timelines.head ^
+                               (timelines.count << 8) ^ 0x5A5A);
+}
+
+bool isValid(const Timelines &timelines) {
+  // a new phase moves the others, timelines of an older layout are dropped
+  return timelines.magic == kTimelineMagic && timelines.version == kTimelineVersion &&
+         timelines.capacity == CONFIG_BT_HISTORY && timelines.phases == kBootPhaseCount &&
+         timelines.head < timelines.capacity && timelines.count <= timelines.capacity &&
+         timelines.checksum == headerChecksum(timelines);
+}
+
+/* Appends " name 12.3" for every phase reached, stops short of the end of the buffer */
+size_t appendPhases(char *buffer, size_t size, const BootRecord &record) {
+  size_t length = 0;
+  for (size_t i = 0; i < kBootPhaseCount && length < size; i++) {
+    BootPhase phase = static_cast<BootPhase>(i);
+    if (record.timeUs[i] == 0 || phase == BootPhase::Operational) {
+      continue;
+    }
+    int written = snprintf(buffer + length, size - length, "%s%s %lu.%lu", length > 0 ? ", " : "",
+                           BootTimeline::phaseName(phase), (unsigned long)(record.timeUs[i] / 1000),
+                           (unsigned long)(record.timeUs[i] % 1000 / 100));
+    if (written < 0) {
+      break;
+    }
+    length += written;
+  }
+  return length;
+}
+
+/* Called once per boot, outside the lock */
+void logSummary() {
+  BootRecord current;
+  BootRecord previous;
+  bool hasPrevious = false;
+  portENTER_CRITICAL(&s_lock);
+  current = *s_current;
+  if (s_timelines.count > 1) {
+    previous = s_timelines.records[(s_timelines.head + s_timelines.capacity - 1) % s_timelines.capacity];
+    hasPrevious = previous.timeUs[static_cast<size_t>(BootPhase::Operational)] != 0;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  char phases[384];
+  appendPhases(phases, sizeof(phases), current);
+
+  uint32_t operationalUs = current.timeUs[static_cast<size_t>(BootPhase::Operational)];
+  char comparison[48] = "";
+  if (hasPrevious) {
+    uint32_t previousUs = previous.timeUs[static_cast<size_t>(BootPhase::Operational)];
+    snprintf(comparison, sizeof(comparison), ", boot %u took %lu.%lu ms", previous.bootCount,
+             (unsigned long)(previousUs / 1000), (unsigned long)(previousUs % 1000 / 100));
+  }
+  ESP_LOGI(TAG, "Boot %u operational after %lu.%lu ms (reset reason %u%s): %s", current.bootCount,
+           (unsigned long)(operationalUs / 1000), (unsigned long)(operationalUs % 1000 / 100),
+           current.resetReason, comparison, phases);
+}
+
+}  // namespace
+
+void BootTimeline::init() {
+  esp_reset_reason_t reason = esp_reset_reason();
+
+  portENTER_CRITICAL(&s_lock);
+  // RTC no-init memory holds garbage after power loss, start over unless the header is intact
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || !isValid(s_timelines)) {
+    memset(&s_timelines, 0, sizeof(s_timelines));
+    s_timelines.magic = kTimelineMagic;
+    s_timelines.version = kTimelineVersion;
+    s_timelines.capacity = CONFIG_BT_HISTORY;
+    s_timelines.phases = kBootPhaseCount;
+  }
+
+  uint16_t bootCount = 1;
+  if (s_timelines.count > 0) {
+    bootCount = s_timelines.records[s_timelines.head].bootCount + 1;
+    s_timelines.head = (s_timelines.head + 1) % s_timelines.capacity;
+  }
+  if (s_timelines.count < s_timelines.capacity) {
+    s_timelines.count++;
+  }
+  s_current = &s_timelines.records[s_timelines.head];
+  memset(s_current, 0, sizeof(*s_current));
+  s_current->bootCount = bootCount;
+  s_current->resetReason = static_cast<uint8_t>(reason);
+  s_timelines.checksum = headerChecksum(s_timelines);
+  portEXIT_CRITICAL(&s_lock);
+
+  mark(BootPhase::AppStarted);
+}
+
+void BootTimeline::mark(BootPhase phase) {
+  size_t index = static_cast<size_t>(phase);
+  if (index >= kBootPhaseCount) {
+    return;
+  }
+  // 0 marks a phase not reached, a timeline past 71 minutes keeps the last representable time
+  int64_t now = esp_timer_get_time();
+  uint32_t timeUs = now <= 0 ? 1 : now >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(now);
+
+  bool stamped = false;
+  portENTER_CRITICAL(&s_lock);
+  if (s_current != nullptr && s_current->timeUs[index] == 0) {
+    s_current->timeUs[index] = timeUs;
+    stamped = true;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (stamped && phase == BootPhase::Operational) {
+    logSummary();
+  }
+}
+
+bool BootTimeline::isOperational() {
+  portENTER_CRITICAL(&s_lock);
+  bool operational =
+      s_current != nullptr && s_current->timeUs[static_cast<size_t>(BootPhase::Operational)] != 0;
+  portEXIT_CRITICAL(&s_lock);
+  return operational;
+}
+
+esp_err_t BootTimeline::read(BootRecord *records, size_t maxRecords, size_t *count) {
+  if (records == nullptr || count == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  size_t available = s_current != nullptr ? s_timelines.count : 0;
+  size_t skip = available > maxRecords ? available - maxRecords : 0;
+  size_t oldest = (s_timelines.head + s_timelines.capacity + 1 - available) % s_timelines.capacity;
+
+  *count = available - skip;
+  for (size_t i = 0; i < *count; i++) {
+    records[i] = s_timelines.records[(oldest + skip + i) % s_timelines.capacity];
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+#else
+
+void BootTimeline::init() {}
+
+void BootTimeline::mark(BootPhase phase) {}
+
+bool BootTimeline::isOperational() { return false; }
+
+esp_err_t BootTimeline::read(BootRecord *records, size_t maxRecords, size_t *count) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_BT_BOOT_TIMELINE
+
+const char *BootTimeline::phaseName(BootPhase phase) {
+  switch (phase) {
+    case BootPhase::AppStarted:
+      return "app";
+    case BootPhase::NvsReady:
+      return "nvs";
+    case BootPhase::StorageReady:
+      return "storage";
+    case BootPhase::ProgramModeRead:
+      return "program mode";
+    case BootPhase::AccessoriesRead:
+      return "accessories";
+    case BootPhase::EndpointsCreated:
+      return "endpoints";
+    case BootPhase::MatterStarted:
+      return "matter";
+    case BootPhase::WebServerStarted:
+      return "web server";
+    case BootPhase::WifiConnected:
+      return "wifi";
+    case BootPhase::IpAcquired:
+      return "ip";
+    case BootPhase::MatterIpReady:
+      return "matter ip";
+    case BootPhase::CommissioningWindowOpened:
+      return "commissioning window";
+    case BootPhase::CommissioningComplete:
+      return "commissioned";
+    case BootPhase::Operational:
+      return "operational";
+    default:
+      return "unknown";
+  }
+}
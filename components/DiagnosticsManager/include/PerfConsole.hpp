@@ -0,0 +1,54 @@
+#pragma once
+
+#include <esp_err.h>
+
+#include <StorageManagerInterface.hpp>
+
+/**
+ * @brief "perf" command family of the Matter shell.
+ *
+ * Views:
+ *   perf heap                      free, minimum and largest block per heap capability
+ *   perf tasks [window_ms]         CPU share over a window and stack high-water mark per task
+ *   perf monitor                   task monitor statistics: CPU share over its sliding window, stack use
+ *                                  and alerts, deleted tasks included
+ *   perf storage                   storage operation counters and timings
+ *   perf endpoints [reset]         per-endpoint actuation counters and latency percentiles
+ *   perf boot                      reset reason, uptime and the lifecycle events of this boot
+ *   perf timeline                  boot phase times of the last boots side by side, this boot last
+ *   perf journal [clear]           lifecycle events of the last boots
+ *
+ * Micro-benchmarks:
+ *   perf bench nvs [iterations]    NVS blob write+commit and read of a scratch key
+ *   perf bench json [iterations]   parse of the stored accessory DB
+ *   perf bench relay <endpoint> [iterations]   OnOff toggle loop through the Matter data model
+ */
+class PerfConsole {
+ public:
+  /**
+   * @brief Register the perf commands and start the Matter shell.
+   * @param storageManager Pointer to the storage manager interface.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  static esp_err_t registerCommands(StorageManagerInterface* storageManager);
+
+ private:
+  static StorageManagerInterface* s_storageManager;  ///< Storage used by the storage view and benchmarks
+
+  static esp_err_t dispatch(int argc, char** argv);
+  static esp_err_t heapView(int argc, char** argv);
+  static esp_err_t tasksView(int argc, char** argv);
+  static esp_err_t monitorView(int argc, char** argv);
+  static esp_err_t storageView(int argc, char** argv);
+  static esp_err_t endpointsView(int argc, char** argv);
+  static esp_err_t bootView(int argc, char** argv);
+  static esp_err_t timelineView(int argc, char** argv);
+  static esp_err_t journalView(int argc, char** argv);
+  static esp_err_t eventsView(int argc, char** argv);
+  static esp_err_t bench(int argc, char** argv);
+  static esp_err_t benchNvs(int argc, char** argv);
+  static esp_err_t benchJson(int argc, char** argv);
+  static esp_err_t benchRelay(int argc, char** argv);
+
+  PerfConsole() = delete;
+};
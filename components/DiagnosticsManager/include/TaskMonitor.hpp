@@ -0,0 +1,83 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Alert flags of a monitored task.
+ */
+enum TaskMonitorFlag : uint8_t {
+  kTaskCpuHigh = 1 << 0,   ///< CPU share over the window above CONFIG_DM_TASK_MONITOR_CPU_ALERT
+  kTaskStackLow = 1 << 1,  ///< Stack use above CONFIG_DM_TASK_MONITOR_STACK_ALERT, or too little free
+};
+
+/**
+ * @brief Statistics of a task, as seen by the monitor.
+ */
+struct TaskMonitorEntry {
+  char name[16];               ///< Task name
+  uint8_t priority;            ///< Current priority
+  bool alive;                  ///< false once the task is deleted, its statistics are kept
+  uint8_t flags;               ///< TaskMonitorFlag set since the task was first seen
+  uint16_t cpuLastPermille;    ///< CPU share over the last interval, in per mille of all cores
+  uint16_t cpuWindowPermille;  ///< CPU share over the sliding window
+  uint16_t cpuPeakPermille;    ///< Highest CPU share of an interval
+  uint32_t stackFree;          ///< Lowest free stack in bytes
+  uint32_t stackSize;          ///< Stack size in bytes, 0 if not registered with setStackSize()
+};
+
+/**
+ * @brief Background monitor of the FreeRTOS run-time statistics.
+ *
+ * Every CONFIG_DM_TASK_MONITOR_INTERVAL_MS an esp_timer samples the run-time counters and the stack
+ * high-water marks of all tasks. The CPU share is kept per interval and averaged over the last
+ * CONFIG_DM_TASK_MONITOR_WINDOW intervals. A task crossing a threshold is flagged and logged once, and
+ * stays flagged so a short burst is not missed. Deleted tasks keep their statistics, so the stack use of
+ * short-lived tasks such as the main task can still be read.
+ */
+class TaskMonitor {
+ public:
+  /**
+   * @brief Take the first sample and start the periodic sampling.
+   * @return ESP_OK on success, also when already started, ESP_ERR_NOT_SUPPORTED without
+   *         CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS,
+   *         an error from esp_err_t otherwise.
+   */
+  static esp_err_t start();
+
+  /**
+   * @brief Check if the monitor is sampling.
+   * @return true once started.
+   */
+  static bool isRunning();
+
+  /**
+   * @brief Register the stack size of tasks, FreeRTOS does not report it. The stack alert is then
+   * relative to the size instead of CONFIG_DM_TASK_MONITOR_STACK_MIN_FREE.
+   * @param namePrefix Start of the task names, e.g. "httpWorker" for all the web server workers.
+   * @param bytes The stack size in bytes.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the prefix is empty or the size is 0,
+   *         ESP_ERR_NO_MEM if CONFIG_DM_TASK_MONITOR_STACK_SIZES are already registered.
+   */
+  static esp_err_t setStackSize(const char* namePrefix, uint32_t bytes);
+
+  /**
+   * @brief Copy the statistics of the monitored tasks.
+   * @param[out] entries Destination array.
+   * @param maxEntries Capacity of the destination array.
+   * @param[out] count Number of entries copied.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if an argument is null,
+   *         ESP_ERR_INVALID_STATE if the monitor is not started.
+   */
+  static esp_err_t getSnapshot(TaskMonitorEntry* entries, size_t maxEntries, size_t* count);
+
+  /**
+   * @brief Get the time the CPU shares are averaged over.
+   * @return The length of the sliding window in milliseconds, shorter while the first window fills.
+   */
+  static uint32_t getWindowMs();
+
+ private:
+  TaskMonitor() = delete;
+};
@@ -0,0 +1,598 @@
+#include "PerfConsole.hpp"
+
+#include <ArduinoJson.h>
+#include <app-common/zap-generated/ids/Attributes.h>
+#include <app-common/zap-generated/ids/Clusters.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_matter.h>
+#include <esp_matter_console.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <nvs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <AppEventBus.hpp>
+#include <BootTimeline.hpp>
+#include <EventJournal.hpp>
+#include <LatencyTracer.hpp>
+
+#include "TaskMonitor.hpp"
+
+static const char *TAG = "PerfConsole";
+
+StorageManagerInterface *PerfConsole::s_storageManager = nullptr;
+
+/**
+ * @brief Sub command of the perf command family.
+ */
+struct PerfCommand {
+  const char *name;                           ///< Sub command name
+  const char *usage;                          ///< One line usage shown by "perf"
+  esp_err_t (*handler)(int argc, char **argv);  ///< Handler, called with the arguments after the name
+};
+
+/**
+ * @brief Min, max and total of a series of timings.
+ */
+struct Timing {
+  uint32_t count = 0;
+  uint64_t totalUs = 0;
+  uint32_t maxUs = 0;
+
+  void add(int64_t startUs) {
+    uint32_t us = static_cast<uint32_t>(esp_timer_get_time() - startUs);
+    count++;
+    totalUs += us;
+    if (us > maxUs) {
+      maxUs = us;
+    }
+  }
+
+  uint32_t avgUs() const { return count ? static_cast<uint32_t>(totalUs / count) : 0; }
+};
+
+static uint32_t parse_iterations(int argc, char **argv, int index) {
+  if (argc > index) {
+    uint32_t iterations = strtoul(argv[index], nullptr, 10);
+    if (iterations > 0) {
+      return iterations;
+    }
+  }
+  return CONFIG_DM_PERF_BENCH_ITERATIONS;
+}
+
+static const char *reset_reason_name(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:
+      return "power-on";
+    case ESP_RST_EXT:
+      return "external pin";
+    case ESP_RST_SW:
+      return "software";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_INT_WDT:
+      return "interrupt watchdog";
+    case ESP_RST_TASK_WDT:
+      return "task watchdog";
+    case ESP_RST_WDT:
+      return "other watchdog";
+    case ESP_RST_DEEPSLEEP:
+      return "deep sleep";
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+    case ESP_RST_SDIO:
+      return "SDIO";
+    default:
+      return "unknown";
+  }
+}
+
+esp_err_t PerfConsole::registerCommands(StorageManagerInterface *storageManager) {
+#if CONFIG_ENABLE_CHIP_SHELL
+  s_storageManager = storageManager;
+
+  static const esp_matter::console::command_t command = {
+      .name = "perf",
+      .description = "Performance views and micro-benchmarks. Usage: perf <view|bench> [args]",
+      .handler = dispatch,
+  };
+
+  esp_err_t err = esp_matter::console::add_commands(&command, 1);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to register perf commands: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  return esp_matter::console::init();
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t PerfConsole::dispatch(int argc, char **argv) {
+  static const PerfCommand commands[] = {
+      {"heap", "heap                      free, minimum and largest block per capability", heapView},
+      {"tasks", "tasks [window_ms]         CPU share and stack free per task, window_ms without monitor",
+       tasksView},
+      {"monitor", "monitor                   task monitor: windowed CPU share, stack use and alerts",
+       monitorView},
+      {"storage", "storage                   storage operation counters", storageView},
+      {"endpoints", "endpoints [reset]         actuation counters and latencies per endpoint", endpointsView},
+      {"boot", "boot                      reset reason, uptime and events of this boot", bootView},
+      {"timeline", "timeline                  boot phase times of the last boots, side by side",
+       timelineView},
+      {"journal", "journal [clear]           lifecycle events of the last boots", journalView},
+      {"events", "events                    application event bus counters", eventsView},
+      {"bench", "bench <nvs|json|relay>    micro-benchmarks, see perf bench", bench},
+  };
+
+  if (argc > 0) {
+    for (const PerfCommand &command : commands) {
+      if (strcmp(argv[0], command.name) == 0) {
+        return command.handler(argc - 1, &argv[1]);
+      }
+    }
+  }
+
+  for (const PerfCommand &command : commands) {
+    printf("perf %s\n", command.usage);
+  }
+  return argc > 0 ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t PerfConsole::heapView(int argc, char **argv) {
+  static const struct {
+    const char *name;
+    uint32_t caps;
+  } capabilities[] = {
+      {"internal", MALLOC_CAP_INTERNAL}, {"8bit", MALLOC_CAP_8BIT}, {"32bit", MALLOC_CAP_32BIT},
+      {"dma", MALLOC_CAP_DMA},           {"exec", MALLOC_CAP_EXEC}, {"spiram", MALLOC_CAP_SPIRAM},
+  };
+
+  printf("%-9s %9s %9s %9s %9s\n", "caps", "free", "min free", "largest", "allocated");
+  for (const auto &capability : capabilities) {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, capability.caps);
+    if (info.total_free_bytes == 0 && info.total_allocated_bytes == 0) {
+      continue;
+    }
+    printf("%-9s %9u %9u %9u %9u\n", capability.name, (unsigned)info.total_free_bytes,
+           (unsigned)info.minimum_free_bytes, (unsigned)info.largest_free_block,
+           (unsigned)info.total_allocated_bytes);
+  }
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::tasksView(int argc, char **argv) {
+#if CONFIG_DM_TASK_MONITOR
+  // The monitor already samples every task, its window replaces the one measured here
+  if (TaskMonitor::isRunning()) {
+    TaskMonitorEntry *entries =
+        static_cast<TaskMonitorEntry *>(malloc(CONFIG_DM_TASK_MONITOR_MAX_TASKS * sizeof(TaskMonitorEntry)));
+    if (entries == nullptr) {
+      return ESP_ERR_NO_MEM;
+    }
+    size_t count = 0;
+    esp_err_t err = TaskMonitor::getSnapshot(entries, CONFIG_DM_TASK_MONITOR_MAX_TASKS, &count);
+    if (err == ESP_OK) {
+      printf("window %lu ms\n", (unsigned long)TaskMonitor::getWindowMs());
+      printf("%-16s %4s %6s %10s\n", "task", "prio", "cpu %", "stack free");
+      for (size_t i = 0; i < count; i++) {
+        const TaskMonitorEntry &entry = entries[i];
+        if (entry.alive) {
+          printf("%-16s %4u %4u.%u %10lu\n", entry.name, entry.priority, entry.cpuWindowPermille / 10,
+                 entry.cpuWindowPermille % 10, (unsigned long)entry.stackFree);
+        }
+      }
+    }
+    free(entries);
+    return err;
+  }
+#endif
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+  uint32_t windowMs = argc > 0 ? strtoul(argv[0], nullptr, 10) : CONFIG_DM_PERF_CPU_WINDOW_MS;
+  if (windowMs == 0) {
+    windowMs = CONFIG_DM_PERF_CPU_WINDOW_MS;
+  }
+
+  // Leave room for tasks created during the sampling window
+  UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+  TaskStatus_t *before = static_cast<TaskStatus_t *>(malloc(capacity * sizeof(TaskStatus_t)));
+  TaskStatus_t *after = static_cast<TaskStatus_t *>(malloc(capacity * sizeof(TaskStatus_t)));
+  if (before == nullptr || after == nullptr) {
+    free(before);
+    free(after);
+    return ESP_ERR_NO_MEM;
+  }
+
+  uint32_t totalBefore = 0;
+  uint32_t totalAfter = 0;
+  UBaseType_t countBefore = uxTaskGetSystemState(before, capacity, &totalBefore);
+  vTaskDelay(pdMS_TO_TICKS(windowMs));
+  UBaseType_t countAfter = uxTaskGetSystemState(after, capacity, &totalAfter);
+
+  // Run time counters advance on every core, so the window holds one period per core
+  uint64_t window = static_cast<uint64_t>(totalAfter - totalBefore) * portNUM_PROCESSORS;
+
+  printf("%-16s %4s %6s %10s\n", "task", "prio", "cpu %", "stack free");
+  for (UBaseType_t i = 0; i < countAfter; i++) {
+    uint32_t runTime = after[i].ulRunTimeCounter;
+    for (UBaseType_t j = 0; j < countBefore; j++) {
+      if (before[j].xTaskNumber == after[i].xTaskNumber) {
+        runTime -= before[j].ulRunTimeCounter;
+        break;
+      }
+    }
+    uint32_t permille = window ? static_cast<uint32_t>(runTime * 1000ULL / window) : 0;
+    printf("%-16s %4u %4lu.%lu %10u\n", after[i].pcTaskName, (unsigned)after[i].uxCurrentPriority,
+           (unsigned long)(permille / 10), (unsigned long)(permille % 10),
+           (unsigned)after[i].usStackHighWaterMark);
+  }
+
+  free(before);
+  free(after);
+  return ESP_OK;
+#else
+  printf("Enable CONFIG_FREERTOS_USE_TRACE_FACILITY for task statistics\n");
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t PerfConsole::monitorView(int argc, char **argv) {
+#if CONFIG_DM_TASK_MONITOR
+  TaskMonitorEntry *entries =
+      static_cast<TaskMonitorEntry *>(malloc(CONFIG_DM_TASK_MONITOR_MAX_TASKS * sizeof(TaskMonitorEntry)));
+  if (entries == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+  size_t count = 0;
+  esp_err_t err = TaskMonitor::getSnapshot(entries, CONFIG_DM_TASK_MONITOR_MAX_TASKS, &count);
+  if (err != ESP_OK) {
+    printf("Task monitor not running\n");
+    free(entries);
+    return err;
+  }
+
+  printf("window %lu ms, cpu %% of all cores\n", (unsigned long)TaskMonitor::getWindowMs());
+  printf("%-16s %4s %6s %6s %6s %10s %10s %s\n", "task", "prio", "last", "window", "peak", "stack free",
+         "stack size", "alerts");
+  for (size_t i = 0; i < count; i++) {
+    const TaskMonitorEntry &entry = entries[i];
+    printf("%-16s %4u %4u.%u %4u.%u %4u.%u %10lu %10lu %s%s%s\n", entry.name, entry.priority,
+           entry.cpuLastPermille / 10, entry.cpuLastPermille % 10, entry.cpuWindowPermille / 10,
+           entry.cpuWindowPermille % 10, entry.cpuPeakPermille / 10, entry.cpuPeakPermille % 10,
+           (unsigned long)entry.stackFree, (unsigned long)entry.stackSize,
+           (entry.flags & kTaskCpuHigh) ? "cpu " : "", (entry.flags & kTaskStackLow) ? "stack " : "",
+           entry.alive ? "" : "(deleted)");
+  }
+  free(entries);
+  return ESP_OK;
+#else
+  printf("Enable CONFIG_DM_TASK_MONITOR for the task monitor\n");
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t PerfConsole::storageView(int argc, char **argv) {
+  StorageStats stats;
+  if (s_storageManager == nullptr || s_storageManager->getStats(&stats) != ESP_OK) {
+    printf("Storage statistics not available\n");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  printf("reads  %6lu  bytes %8lu  avg %6lu us  max %6lu us\n", (unsigned long)stats.reads,
+         (unsigned long)stats.bytesRead, (unsigned long)(stats.reads ? stats.readTimeUs / stats.reads : 0),
+         (unsigned long)stats.maxReadUs);
+  printf("writes %6lu  bytes %8lu  avg %6lu us  max %6lu us\n", (unsigned long)stats.writes,
+         (unsigned long)stats.bytesWritten,
+         (unsigned long)(stats.writes ? stats.writeTimeUs / stats.writes : 0),
+         (unsigned long)stats.maxWriteUs);
+  printf("errors %6lu\n", (unsigned long)stats.errors);
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::endpointsView(int argc, char **argv) {
+  if (argc > 0 && strcmp(argv[0], "reset") == 0) {
+    LatencyTracer::reset();
+    printf("Endpoint counters reset\n");
+    return ESP_OK;
+  }
+
+  printf("%-4s %10s %28s %28s\n", "ep", "actuations", "cmd->relay n/p50/p99 us",
+         "button->report n/p50/p99 us");
+  LatencyStats stats;
+  for (size_t i = 0; i < LatencyTracer::getEndpointCount(); i++) {
+    if (LatencyTracer::getStats(i, &stats) != ESP_OK) {
+      continue;
+    }
+    const LatencyHistogram &forward = stats.histograms[static_cast<size_t>(LatencyPath::CommandToRelay)];
+    const LatencyHistogram &reverse = stats.histograms[static_cast<size_t>(LatencyPath::ButtonToReport)];
+    printf("%-4u %10lu %8lu/%8lu/%8lu %10lu/%8lu/%8lu\n", stats.endpointId, (unsigned long)stats.actuations,
+           (unsigned long)forward.count, (unsigned long)LatencyTracer::percentileUs(forward, 50),
+           (unsigned long)LatencyTracer::percentileUs(forward, 99), (unsigned long)reverse.count,
+           (unsigned long)LatencyTracer::percentileUs(reverse, 50),
+           (unsigned long)LatencyTracer::percentileUs(reverse, 99));
+  }
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::bootView(int argc, char **argv) {
+  printf("reset reason: %s\n", reset_reason_name(esp_reset_reason()));
+  printf("uptime:       %llu ms\n", (unsigned long long)(esp_timer_get_time() / 1000));
+
+  JournalEntry entries[CONFIG_EM_EVENT_JOURNAL_SIZE];
+  size_t count = 0;
+  EventJournal::read(entries, CONFIG_EM_EVENT_JOURNAL_SIZE, &count);
+  if (count == 0) {
+    return ESP_OK;
+  }
+
+  uint16_t currentBoot = entries[count - 1].bootCount;
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].bootCount == currentBoot) {
+      printf("%8lu ms  %s\n", (unsigned long)entries[i].uptimeMs, EventJournal::eventName(entries[i].event));
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::timelineView(int argc, char **argv) {
+#if CONFIG_BT_BOOT_TIMELINE
+  BootRecord *records = static_cast<BootRecord *>(malloc(CONFIG_BT_HISTORY * sizeof(BootRecord)));
+  if (records == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+  size_t count = 0;
+  BootTimeline::read(records, CONFIG_BT_HISTORY, &count);
+
+  printf("%-22s", "ms since app start");
+  for (size_t i = 0; i < count; i++) {
+    printf("  boot %4u", records[i].bootCount);
+  }
+  printf("\n%-22s", "reset reason");
+  for (size_t i = 0; i < count; i++) {
+    printf("  %9u", records[i].resetReason);
+  }
+  printf("\n");
+  for (size_t phase = 0; phase < kBootPhaseCount; phase++) {
+    printf("%-22s", BootTimeline::phaseName(static_cast<BootPhase>(phase)));
+    for (size_t i = 0; i < count; i++) {
+      uint32_t us = records[i].timeUs[phase];
+      if (us == 0) {
+        printf("  %9s", "-");
+      } else {
+        printf("  %7lu.%lu", (unsigned long)(us / 1000), (unsigned long)(us % 1000 / 100));
+      }
+    }
+    printf("\n");
+  }
+  free(records);
+  return ESP_OK;
+#else
+  printf("Enable CONFIG_BT_BOOT_TIMELINE for the boot timeline\n");
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t PerfConsole::journalView(int argc, char **argv) {
+  if (argc > 0 && strcmp(argv[0], "clear") == 0) {
+    EventJournal::clear();
+    printf("Journal cleared\n");
+    return ESP_OK;
+  }
+
+  JournalEntry entries[CONFIG_EM_EVENT_JOURNAL_SIZE];
+  size_t count = 0;
+  EventJournal::read(entries, CONFIG_EM_EVENT_JOURNAL_SIZE, &count);
+  for (size_t i = 0; i < count; i++) {
+    printf("boot %5u %8lu ms  %s (%u)\n", entries[i].bootCount, (unsigned long)entries[i].uptimeMs,
+           EventJournal::eventName(entries[i].event), entries[i].data);
+  }
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::eventsView(int argc, char **argv) {
+  AppEventBusStats stats;
+  AppEventBus::getStats(&stats);
+  printf("published   %8lu  dropped %6lu\n", (unsigned long)stats.published, (unsigned long)stats.dropped);
+  printf("dispatched  %8lu  queue high-water %u/%u\n", (unsigned long)stats.dispatched, stats.highWater,
+         (unsigned)CONFIG_EB_QUEUE_LENGTH);
+  printf("subscribers %8u  slowest handler %lu us\n", stats.subscribers, (unsigned long)stats.maxHandlerUs);
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::bench(int argc, char **argv) {
+  if (argc > 0 && strcmp(argv[0], "nvs") == 0) {
+    return benchNvs(argc - 1, &argv[1]);
+  }
+  if (argc > 0 && strcmp(argv[0], "json") == 0) {
+    return benchJson(argc - 1, &argv[1]);
+  }
+  if (argc > 0 && strcmp(argv[0], "relay") == 0) {
+    return benchRelay(argc - 1, &argv[1]);
+  }
+
+  printf("perf bench nvs [iterations]               NVS blob write+commit and read\n");
+  printf("perf bench json [iterations]              parse of the stored accessory DB\n");
+  printf("perf bench relay <endpoint> [iterations]  OnOff toggle loop through the data model\n");
+  return argc > 0 ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t PerfConsole::benchNvs(int argc, char **argv) {
+  static const char *kNamespace = "perf_bench";
+  static const char *kKey = "bench";
+  uint32_t iterations = parse_iterations(argc, argv, 0);
+
+  uint8_t *value = static_cast<uint8_t *>(malloc(CONFIG_DM_PERF_BENCH_NVS_VALUE_SIZE));
+  if (value == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, kNamespace, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    printf("Failed to open NVS: %s\n", esp_err_to_name(err));
+    free(value);
+    return err;
+  }
+
+  Timing writes;
+  Timing reads;
+  for (uint32_t i = 0; i < iterations && err == ESP_OK; i++) {
+    memset(value, static_cast<int>(i), CONFIG_DM_PERF_BENCH_NVS_VALUE_SIZE);
+    int64_t start = esp_timer_get_time();
+    err = nvs_set_blob(handle, kKey, value, CONFIG_DM_PERF_BENCH_NVS_VALUE_SIZE);
+    if (err == ESP_OK) {
+      err = nvs_commit(handle);
+    }
+    writes.add(start);
+  }
+  for (uint32_t i = 0; i < iterations && err == ESP_OK; i++) {
+    size_t length = CONFIG_DM_PERF_BENCH_NVS_VALUE_SIZE;
+    int64_t start = esp_timer_get_time();
+    err = nvs_get_blob(handle, kKey, value, &length);
+    reads.add(start);
+  }
+
+  nvs_erase_key(handle, kKey);
+  nvs_commit(handle);
+  nvs_close(handle);
+  free(value);
+
+  if (err != ESP_OK) {
+    printf("NVS benchmark failed: %s\n", esp_err_to_name(err));
+    return err;
+  }
+
+  printf("nvs %u byte blob, %lu iterations\n", CONFIG_DM_PERF_BENCH_NVS_VALUE_SIZE,
+         (unsigned long)iterations);
+  printf("write+commit avg %6lu us  max %6lu us\n", (unsigned long)writes.avgUs(),
+         (unsigned long)writes.maxUs);
+  printf("read         avg %6lu us  max %6lu us\n", (unsigned long)reads.avgUs(), (unsigned long)reads.maxUs);
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::benchJson(int argc, char **argv) {
+  uint32_t iterations = parse_iterations(argc, argv, 0);
+
+  if (s_storageManager == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  char *json = nullptr;
+  size_t length = 0;
+  Timing read;
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = s_storageManager->getAccessoryJsonCopy(&json, &length);
+  read.add(start);
+  if (err == ESP_ERR_NOT_FOUND || (err == ESP_OK && length == 0)) {
+    printf("No accessory DB stored\n");
+    free(json);
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  Timing parse;
+  size_t devices = 0;
+  size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  size_t lowest = freeBefore;
+  for (uint32_t i = 0; i < iterations; i++) {
+    DynamicJsonDocument doc(CONFIG_JSON_ACCESSORIES_LENGTH);
+    start = esp_timer_get_time();
+    DeserializationError error = deserializeJson(doc, json);
+    parse.add(start);
+    if (error) {
+      printf("Stored accessory DB does not parse: %s\n", error.c_str());
+      free(json);
+      return ESP_ERR_INVALID_STATE;
+    }
+    devices = doc.as<JsonArray>().size();
+    size_t current = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    if (current < lowest) {
+      lowest = current;
+    }
+  }
+  free(json);
+
+  printf("json %u bytes, %u devices, %lu iterations\n", (unsigned)length, (unsigned)devices,
+         (unsigned long)iterations);
+  printf("nvs read   %6lu us\n", (unsigned long)read.avgUs());
+  printf("parse  avg %6lu us  max %6lu us  heap %u bytes\n", (unsigned long)parse.avgUs(),
+         (unsigned long)parse.maxUs, (unsigned)(freeBefore - lowest));
+  return ESP_OK;
+}
+
+esp_err_t PerfConsole::benchRelay(int argc, char **argv) {
+  if (argc < 1) {
+    printf("Usage: perf bench relay <endpoint> [iterations]\n");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  uint16_t endpointId = static_cast<uint16_t>(strtoul(argv[0], nullptr, 10));
+  uint32_t iterations = parse_iterations(argc, argv, 1);
+  const uint32_t clusterId = chip::app::Clusters::OnOff::Id;
+  const uint32_t attributeId = chip::app::Clusters::OnOff::Attributes::OnOff::Id;
+
+  esp_matter_attr_val_t val = esp_matter_invalid(nullptr);
+  esp_matter::lock::chip_stack_lock(portMAX_DELAY);
+  esp_matter::attribute_t *attribute = esp_matter::attribute::get(endpointId, clusterId, attributeId);
+  if (attribute != nullptr) {
+    esp_matter::attribute::get_val(attribute, &val);
+  }
+  esp_matter::lock::chip_stack_unlock();
+
+  if (attribute == nullptr) {
+    printf("Endpoint %u has no OnOff attribute\n", endpointId);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  const bool initial = val.val.b;
+  bool state = initial;
+  Timing updates;
+  esp_err_t err = ESP_OK;
+  for (uint32_t i = 0; i <= iterations && err == ESP_OK; i++) {
+    // The extra round restores the initial state
+    if (i == iterations && state == initial) {
+      break;
+    }
+    state = !state;
+    val = esp_matter_bool(state);
+
+    esp_matter::lock::chip_stack_lock(portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    err = esp_matter::attribute::update(endpointId, clusterId, attributeId, &val);
+    if (i < iterations) {
+      updates.add(start);
+    }
+    esp_matter::lock::chip_stack_unlock();
+
+    // Give the relay time to settle before the next edge
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_DM_PERF_BENCH_RELAY_GAP_MS));
+  }
+
+  if (err != ESP_OK) {
+    printf("Relay benchmark failed: %s\n", esp_err_to_name(err));
+    return err;
+  }
+
+  printf("relay ep %u, %lu toggles\n", endpointId, (unsigned long)updates.count);
+  printf("attribute update avg %6lu us  max %6lu us\n", (unsigned long)updates.avgUs(),
+         (unsigned long)updates.maxUs);
+
+  LatencyHistogram histogram;
+  if (LatencyTracer::getHistogram(endpointId, LatencyPath::CommandToRelay, &histogram) == ESP_OK) {
+    printf("cmd->relay       p50 %6lu us  p99 %6lu us  (all samples)\n",
+           (unsigned long)LatencyTracer::percentileUs(histogram, 50),
+           (unsigned long)LatencyTracer::percentileUs(histogram, 99));
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,303 @@
+#include "TaskMonitor.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <string.h>
+
+static const char *TAG = "TaskMonitor";
+
+#if CONFIG_DM_TASK_MONITOR && CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+namespace {
+
+constexpr size_t kWindow = CONFIG_DM_TASK_MONITOR_WINDOW;
+constexpr size_t kMaxTasks = CONFIG_DM_TASK_MONITOR_MAX_TASKS;
+
+struct TaskRecord {
+  UBaseType_t taskNumber;  // 0 for a free record
+  TaskMonitorEntry entry;
+  uint32_t lastRunTime;
+  uint16_t samples[kWindow];  // CPU share of the last intervals, in per mille
+};
+
+struct StackSize {
+  char prefix[sizeof(TaskMonitorEntry::name)];
+  uint32_t bytes;
+};
+
+// guarded by the lock: the registered stack sizes and the entries of the last sample
+StackSize s_stackSizes[CONFIG_DM_TASK_MONITOR_STACK_SIZES];
+size_t s_stackSizeCount = 0;
+TaskMonitorEntry s_entries[kMaxTasks];
+size_t s_entryCount = 0;
+size_t s_windowSamples = 0;
+
+// only touched by the sampling timer, which computes the entries without the lock
+TaskRecord s_records[kMaxTasks];
+TaskStatus_t s_status[kMaxTasks];
+StackSize s_knownStackSizes[CONFIG_DM_TASK_MONITOR_STACK_SIZES];
+size_t s_knownStackSizeCount = 0;
+size_t s_slot = 0;          // samples[] index of the next interval
+size_t s_sampleCount = 0;   // intervals in the window, up to kWindow
+uint32_t s_lastTotal = 0;
+bool s_overflowLogged = false;
+
+esp_timer_handle_t s_timer = nullptr;
+portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Looks the name up in the stack sizes copied by the last sample */
+uint32_t stackSizeOf(const char *name) {
+  for (size_t i = 0; i < s_knownStackSizeCount; i++) {
+    if (strncmp(name, s_knownStackSizes[i].prefix, strlen(s_knownStackSizes[i].prefix)) == 0) {
+      return s_knownStackSizes[i].bytes;
+    }
+  }
+  return 0;
+}
+
+/* Reuses the record of a deleted task once all records are taken */
+TaskRecord *recordOf(const TaskStatus_t &status) {
+  TaskRecord *unused = nullptr;
+  TaskRecord *dead = nullptr;
+  for (TaskRecord &record : s_records) {
+    if (record.taskNumber == status.xTaskNumber) {
+      return &record;
+    }
+    if (record.taskNumber == 0 && unused == nullptr) {
+      unused = &record;
+    } else if (record.taskNumber != 0 && !record.entry.alive && dead == nullptr) {
+      dead = &record;
+    }
+  }
+
+  TaskRecord *record = unused != nullptr ? unused : dead;
+  if (record == nullptr) {
+    return nullptr;
+  }
+  memset(record, 0, sizeof(*record));
+  record->taskNumber = status.xTaskNumber;
+  record->lastRunTime = status.ulRunTimeCounter;
+  strncpy(record->entry.name, status.pcTaskName, sizeof(record->entry.name) - 1);
+  record->entry.stackFree = status.usStackHighWaterMark;
+  return record;
+}
+
+uint8_t alertsOf(const TaskMonitorEntry &entry) {
+  uint8_t flags = 0;
+  // the idle tasks take whatever is left, a high share is good news
+  if (strncmp(entry.name, "IDLE", 4) != 0 &&
+      entry.cpuWindowPermille >= CONFIG_DM_TASK_MONITOR_CPU_ALERT * 10) {
+    flags |= kTaskCpuHigh;
+  }
+  if (entry.stackSize > entry.stackFree) {
+    uint64_t used = entry.stackSize - entry.stackFree;
+    if (used * 100 >= static_cast<uint64_t>(entry.stackSize) * CONFIG_DM_TASK_MONITOR_STACK_ALERT) {
+      flags |= kTaskStackLow;
+    }
+  } else if (entry.stackFree < CONFIG_DM_TASK_MONITOR_STACK_MIN_FREE) {
+    flags |= kTaskStackLow;
+  }
+  return flags;
+}
+
+void sample(void *arg) {
+  uint32_t total = 0;
+  UBaseType_t count = uxTaskGetSystemState(s_status, kMaxTasks, &total);
+  if (count == 0) {
+    // FreeRTOS fills nothing when the array cannot hold every task
+    if (!s_overflowLogged) {
+      ESP_LOGW(TAG, "More than %u tasks, raise CONFIG_DM_TASK_MONITOR_MAX_TASKS", (unsigned)kMaxTasks);
+      s_overflowLogged = true;
+    }
+    return;
+  }
+
+  // run time counters advance on every core, so the interval holds one period per core
+  uint64_t interval = static_cast<uint64_t>(total - s_lastTotal) * portNUM_PROCESSORS;
+  bool first = s_lastTotal == 0;
+  s_lastTotal = total;
+
+  TaskRecord *raised[kMaxTasks];
+  uint8_t raisedFlags[kMaxTasks];
+  size_t raisedCount = 0;
+
+  // setStackSize() may register a size at any time, the sample works on a copy
+  portENTER_CRITICAL(&s_lock);
+  s_knownStackSizeCount = s_stackSizeCount;
+  memcpy(s_knownStackSizes, s_stackSizes, s_stackSizeCount * sizeof(s_stackSizes[0]));
+  portEXIT_CRITICAL(&s_lock);
+
+  for (TaskRecord &record : s_records) {
+    record.entry.alive = false;
+    record.entry.cpuLastPermille = 0;
+    record.entry.cpuWindowPermille = 0;
+  }
+  for (UBaseType_t i = 0; i < count; i++) {
+    const TaskStatus_t &status = s_status[i];
+    TaskRecord *record = recordOf(status);
+    if (record == nullptr) {
+      continue;
+    }
+    TaskMonitorEntry &entry = record->entry;
+    entry.alive = true;
+    if (entry.stackSize == 0) {
+      // also covers the tasks seen before their size was registered
+      entry.stackSize = stackSizeOf(entry.name);
+    }
+    entry.priority = static_cast<uint8_t>(status.uxCurrentPriority);
+    if (status.usStackHighWaterMark < entry.stackFree) {
+      entry.stackFree = status.usStackHighWaterMark;
+    }
+
+    uint32_t runTime = status.ulRunTimeCounter - record->lastRunTime;
+    record->lastRunTime = status.ulRunTimeCounter;
+    uint16_t permille = 0;
+    if (!first && interval > 0) {
+      permille = static_cast<uint16_t>(runTime * 1000ULL / interval);
+    }
+    record->samples[s_slot] = permille;
+    entry.cpuLastPermille = permille;
+    if (permille > entry.cpuPeakPermille) {
+      entry.cpuPeakPermille = permille;
+    }
+    uint32_t sum = 0;
+    for (uint16_t value : record->samples) {
+      sum += value;
+    }
+    size_t samples = s_sampleCount < kWindow ? s_sampleCount + 1 : kWindow;
+    entry.cpuWindowPermille = first ? 0 : static_cast<uint16_t>(sum / samples);
+
+    uint8_t flags = alertsOf(entry) & ~entry.flags;
+    if (flags != 0) {
+      entry.flags |= flags;
+      raised[raisedCount] = record;
+      raisedFlags[raisedCount++] = flags;
+    }
+  }
+  // the first sample only sets the counters up, it has no interval
+  if (!first) {
+    s_slot = (s_slot + 1) % kWindow;
+    if (s_sampleCount < kWindow) {
+      s_sampleCount++;
+    }
+  }
+  for (TaskRecord &record : s_records) {
+    record.samples[s_slot] = 0;
+  }
+
+  // publish the entries, the readers only ever take them under the lock
+  portENTER_CRITICAL(&s_lock);
+  s_entryCount = 0;
+  for (const TaskRecord &record : s_records) {
+    if (record.taskNumber != 0) {
+      s_entries[s_entryCount++] = record.entry;
+    }
+  }
+  s_windowSamples = s_sampleCount;
+  portEXIT_CRITICAL(&s_lock);
+
+  for (size_t i = 0; i < raisedCount; i++) {
+    const TaskMonitorEntry &entry = raised[i]->entry;
+    if (raisedFlags[i] & kTaskCpuHigh) {
+      ESP_LOGW(TAG, "%s at %u.%u%% CPU over the window", entry.name, entry.cpuWindowPermille / 10,
+               entry.cpuWindowPermille % 10);
+    }
+    if (raisedFlags[i] & kTaskStackLow) {
+      ESP_LOGW(TAG, "%s stack low: %lu bytes free of %lu", entry.name, (unsigned long)entry.stackFree,
+               (unsigned long)entry.stackSize);
+    }
+  }
+}
+
+}  // namespace
+
+esp_err_t TaskMonitor::start() {
+  if (s_timer != nullptr) {
+    return ESP_OK;
+  }
+
+  esp_timer_create_args_t args = {};
+  args.callback = sample;
+  args.name = "taskMonitor";
+  esp_err_t err = esp_timer_create(&args, &s_timer);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create the sampling timer: %s", esp_err_to_name(err));
+    s_timer = nullptr;
+    return err;
+  }
+
+  sample(nullptr);
+  err = esp_timer_start_periodic(s_timer, CONFIG_DM_TASK_MONITOR_INTERVAL_MS * 1000ULL);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start the sampling timer: %s", esp_err_to_name(err));
+    esp_timer_delete(s_timer);
+    s_timer = nullptr;
+    return err;
+  }
+
+  ESP_LOGI(TAG, "Sampling %u tasks every %d ms", (unsigned)uxTaskGetNumberOfTasks(),
+           CONFIG_DM_TASK_MONITOR_INTERVAL_MS);
+  return ESP_OK;
+}
+
+bool TaskMonitor::isRunning() { return s_timer != nullptr; }
+
+esp_err_t TaskMonitor::setStackSize(const char *namePrefix, uint32_t bytes) {
+  if (namePrefix == nullptr || namePrefix[0] == '\0' || bytes == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_err_t err = ESP_ERR_NO_MEM;
+  portENTER_CRITICAL(&s_lock);
+  if (s_stackSizeCount < CONFIG_DM_TASK_MONITOR_STACK_SIZES) {
+    StackSize &size = s_stackSizes[s_stackSizeCount++];
+    strncpy(size.prefix, namePrefix, sizeof(size.prefix) - 1);
+    size.bytes = bytes;
+    err = ESP_OK;
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
+
+esp_err_t TaskMonitor::getSnapshot(TaskMonitorEntry *entries, size_t maxEntries, size_t *count) {
+  if (entries == nullptr || count == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (s_timer == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  *count = s_entryCount < maxEntries ? s_entryCount : maxEntries;
+  memcpy(entries, s_entries, *count * sizeof(s_entries[0]));
+  portEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+uint32_t TaskMonitor::getWindowMs() {
+  portENTER_CRITICAL(&s_lock);
+  size_t samples = s_windowSamples;
+  portEXIT_CRITICAL(&s_lock);
+  return samples * CONFIG_DM_TASK_MONITOR_INTERVAL_MS;
+}
+
+#else
+
+esp_err_t TaskMonitor::start() {
+  ESP_LOGW(TAG, "Task monitor needs CONFIG_FREERTOS_USE_TRACE_FACILITY and run time statistics");
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool TaskMonitor::isRunning() { return false; }
+
+esp_err_t TaskMonitor::setStackSize(const char *namePrefix, uint32_t bytes) { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t TaskMonitor::getSnapshot(TaskMonitorEntry *entries, size_t maxEntries, size_t *count) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+uint32_t TaskMonitor::getWindowMs() { return 0; }
+
+#endif  // CONFIG_DM_TASK_MONITOR
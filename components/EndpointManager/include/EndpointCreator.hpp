@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ArduinoJson.h>
+#include <esp_err.h>
 #include <esp_matter.h>
 
 #include <BaseDeviceInterface.hpp>
@@ -21,6 +22,19 @@ using CreateFunction = BaseDeviceInterface* (*)(JsonObject deviceJson, esp_matte
 struct DeviceType {
   const char* type;              /**< Type of the device. */
   CreateFunction createFunction; /**< Function to create the device. */
+  const char* properties;        /**< JSON array of the properties of the device, the name first. */
+};
+
+/**
+ * @brief Device JSON input decoded down to its values, so it can be kept without the JSON.
+ */
+struct DevicePlan {
+  static constexpr size_t kNameLength = 33;  /**< Longest name plus the NUL, as long as a Matter label. */
+  static constexpr size_t kValueCount = 6;   /**< Most numeric properties of a device type. */
+
+  char name[kNameLength];       /**< NUL-terminated name of the device. */
+  uint8_t type;                 /**< Index of the device type. */
+  uint32_t values[kValueCount]; /**< Properties following the name, in the order of the schema. */
 };
 
 /**
@@ -52,6 +66,23 @@ class DeviceCreator {
    */
   BaseDeviceInterface* createDevice(JsonObject deviceJson, esp_matter::endpoint_t* aggregator);
 
+  /**
+   * @brief Decode the JSON input of a device into a plan.
+   * @param deviceJson The JSON input for the device.
+   * @param plan Pointer to the plan to fill.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the device type is unknown,
+   *         ESP_ERR_INVALID_ARG if the name is missing, ESP_ERR_INVALID_SIZE if it does not fit.
+   */
+  esp_err_t planDevice(JsonObject deviceJson, DevicePlan* plan);
+
+  /**
+   * @brief Create a device from a plan, the same device as from the JSON input it was decoded from.
+   * @param plan The plan.
+   * @param aggregator Pointer to the aggregator.
+   * @return Pointer to the created device.
+   */
+  BaseDeviceInterface* createDevice(const DevicePlan& plan, esp_matter::endpoint_t* aggregator);
+
   // Static functions to create specific device types
   static BaseDeviceInterface* createLight(JsonObject deviceJson, esp_matter::endpoint_t* aggregator);
   static BaseDeviceInterface* createFan(JsonObject deviceJson, esp_matter::endpoint_t* aggregator);
@@ -1,12 +1,26 @@
 #pragma once
 
+#include <ArduinoJson.h>
 #include <esp_err.h>
 #include <esp_matter.h>
 
+class BaseDeviceInterface;
+struct DevicePlan;
+
 class EndpointManager {
  private:
+  /* A device created from an accessory, with what identifies the accessory it was created from */
+  struct BridgedDevice {
+    BaseDeviceInterface *device;
+    uint16_t accessoryId;  // 0 for an accessory stored without an id
+    uint16_t endpointId;
+    uint32_t checksum;  // CRC-32 of the accessory JSON
+  };
+
   esp_matter::endpoint_t *node;
   esp_matter::endpoint_t *aggregator;
+  BridgedDevice devices[CONFIG_EM_MAX_BRIDGED_DEVICES];
+  size_t deviceCount;
 
   // delete the copy constructor and the assignment operator
   EndpointManager(const EndpointManager &) = delete;
@@ -21,11 +35,45 @@ class EndpointManager {
 
   static void app_event_cb(const chip::DeviceLayer::ChipDeviceEvent *event, intptr_t arg);
 
+  // create the device of an accessory and enable its endpoint once Matter runs
+  esp_err_t addDevice(JsonObject accessory, uint32_t checksum);
+  // the same for an accessory kept in the warm boot plan
+  esp_err_t addDevice(const DevicePlan &plan, uint16_t accessoryId, uint32_t checksum);
+  // track a device created since LatencyTracer::openSlot()
+  esp_err_t trackDevice(BaseDeviceInterface *device, uint16_t accessoryId, uint32_t checksum);
+  // delete a device and the endpoint it leaves behind
+  void removeDevice(size_t index);
+
  public:
   EndpointManager(bool isBridge = false);
   ~EndpointManager();
 
   esp_err_t createArrayOfEndpoints(const char *jsonArray, size_t jsonArraySize);
 
+  /**
+   * @brief Create the endpoints from the accessories createArrayOfEndpoints() decoded before a software
+   * restart, without reading or parsing the accessory JSON configuration.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no accessories were kept, they then have to be
+   *         created by createArrayOfEndpoints().
+   */
+  esp_err_t createEndpointsFromWarmBoot();
+
+  /**
+   * @brief Bring the endpoints in line with a new accessory configuration while Matter runs.
+   *
+   * Accessories whose JSON did not change keep their device and endpoint, so controllers keep their
+   * bindings. The devices of removed or changed accessories are deleted before the new ones are created,
+   * which may reuse their pins.
+   * @param jsonArray The accessory JSON configuration, each accessory with its "id".
+   * @param jsonArraySize Length of jsonArray.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the configuration is not a JSON array,
+   *         ESP_ERR_NO_MEM if a device could not be created.
+   */
+  esp_err_t applyAccessories(const char *jsonArray, size_t jsonArraySize);
+
+  /**
+   * @brief Start the Matter stack.
+   * @return ESP_OK on success, the error of the factory data check or of esp_matter::start() otherwise.
+   */
   esp_err_t startMatter();
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Matter lifecycle events recorded in the journal.
+ */
+enum class JournalEvent : uint8_t {
+  Boot,                         ///< Device booted, data holds the esp_reset_reason_t
+  InterfaceIpAddressChanged,    ///< IP address changed, data holds the change type
+  CommissioningSessionStarted,  ///< PASE session established
+  CommissioningSessionStopped,  ///< PASE session closed
+  CommissioningWindowOpened,    ///< Commissioning window opened
+  CommissioningWindowClosed,    ///< Commissioning window closed
+  CommissioningComplete,        ///< Commissioning complete, data holds the fabric index
+  FailSafeTimerExpired,         ///< Commissioning failed, fail safe timer expired
+  FabricWillBeRemoved,          ///< Fabric will be removed, data holds the fabric index
+  FabricRemoved,                ///< Fabric removed, data holds the fabric index
+  FabricUpdated,                ///< Fabric updated, data holds the fabric index
+  FabricCommitted,              ///< Fabric committed, data holds the fabric index
+  BleDeinitialized,             ///< BLE stack shut down and its memory released
+};
+
+/**
+ * @brief Compact binary journal entry.
+ */
+struct JournalEntry {
+  uint32_t uptimeMs;   ///< Milliseconds since the boot the entry was recorded in
+  uint16_t bootCount;  ///< Boot the entry was recorded in
+  JournalEvent event;  ///< Recorded event
+  uint8_t data;        ///< Event specific data
+};
+
+/**
+ * @brief Ring buffer of Matter lifecycle events kept in RTC no-init memory, so it survives warm resets.
+ */
+class EventJournal {
+ public:
+  /**
+   * @brief Validate the journal left by the previous boot, or reset it after a power loss, and record
+   * the boot. Must be called once before record().
+   */
+  static void init();
+
+  /**
+   * @brief Append an event, overwriting the oldest entry when the journal is full.
+   * @param event The event to record.
+   * @param data Event specific data.
+   */
+  static void record(JournalEvent event, uint8_t data = 0);
+
+  /**
+   * @brief Copy the journal, oldest entry first.
+   * @param[out] entries Destination buffer.
+   * @param maxEntries Capacity of the destination buffer.
+   * @param[out] count Number of copied entries.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a pointer is null.
+   */
+  static esp_err_t read(JournalEntry* entries, size_t maxEntries, size_t* count);
+
+  /**
+   * @brief Get the number of entries in the journal.
+   * @return Number of entries.
+   */
+  static size_t size();
+
+  /**
+   * @brief Get the name of an event.
+   * @param event The event.
+   * @return A static, human readable name.
+   */
+  static const char* eventName(JournalEvent event);
+
+  /**
+   * @brief Erase all entries, keeping the boot counter.
+   */
+  static void clear();
+
+  /**
+   * @brief Log every entry, oldest first.
+   */
+  static void dump();
+
+ private:
+  EventJournal() = delete;
+};
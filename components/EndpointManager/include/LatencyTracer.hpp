@@ -0,0 +1,159 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Points along the actuation paths that can be time-stamped.
+ */
+enum class TracePoint : uint8_t {
+  CommandReceived,    ///< Matter attribute write reached app_attribute_cb (PRE_UPDATE)
+  AccessoryDispatch,  ///< updateAccessory is about to be called (POST_UPDATE)
+  RelayEdge,          ///< RelayModule::setPower changed the output
+  ButtonPressed,      ///< Button driver reported a press, before the accessory handles it
+  AccessoryCallback,  ///< Accessory reported the press to the device layer (PRE_UPDATE)
+  AttributeUpdate,    ///< Attribute update committed and queued for reporting (POST_UPDATE)
+  Count,
+};
+
+/**
+ * @brief Direction of a traced actuation.
+ */
+enum class LatencyPath : uint8_t {
+  CommandToRelay,  ///< Matter command to relay edge
+  ButtonToReport,  ///< Button press to attribute report
+  Count,
+};
+
+/**
+ * @brief Log2 latency histogram. Bucket 0 holds samples below 128 us, bucket i holds samples in
+ * [64 << i, 128 << i) us and the last bucket everything above.
+ */
+struct LatencyHistogram {
+  static constexpr uint8_t kBucketCount = 16;
+
+  uint32_t count;                  ///< Number of samples
+  uint32_t maxUs;                  ///< Largest sample in microseconds
+  uint64_t sumUs;                  ///< Sum of all samples in microseconds
+  uint16_t buckets[kBucketCount];  ///< Saturating sample counts per bucket
+};
+
+/**
+ * @brief Latency statistics of one traced endpoint.
+ */
+struct LatencyStats {
+  uint16_t endpointId;  ///< Matter endpoint id
+  uint32_t actuations;  ///< Relay edges seen on the endpoint
+  LatencyHistogram histograms[static_cast<size_t>(LatencyPath::Count)];  ///< One histogram per path
+};
+
+/**
+ * @brief Lightweight, allocation free tracer for end-to-end actuation latency.
+ *
+ * Every endpoint owns a slot holding the pending timestamps of the current actuation and one histogram
+ * per path. Marks are a spinlock protected store of esp_timer_get_time(), so the tracer can stay enabled
+ * in production builds. A slot is released with its device, live edits do not use slots up.
+ */
+class LatencyTracer {
+ public:
+  /**
+   * @brief Open a slot for the device that is about to be created.
+   * Relays and buttons created until bindSlot() is called are attached to this slot.
+   * @return ESP_OK on success, ESP_ERR_NO_MEM if all slots are bound.
+   */
+  static esp_err_t openSlot();
+
+  /**
+   * @brief Bind the open slot to the endpoint of the created device.
+   * @param endpointId Endpoint id of the created device.
+   */
+  static void bindSlot(uint16_t endpointId);
+
+  /**
+   * @brief Release the open slot without binding it, e.g. when device creation failed.
+   */
+  static void discardSlot();
+
+  /**
+   * @brief Release the slot of an endpoint whose device was deleted, for the next device to bind.
+   * @param endpointId Endpoint id of the deleted device.
+   */
+  static void releaseSlot(uint16_t endpointId);
+
+  /**
+   * @brief Get the index of the open slot, used by traced relays at construction time.
+   * @return The slot index, or -1 if no slot is open.
+   */
+  static int8_t currentSlot();
+
+
+  /**
+   * @brief Record a trace point for an endpoint.
+   * @param endpointId Matter endpoint id.
+   * @param point The trace point reached.
+   */
+  static void mark(uint16_t endpointId, TracePoint point);
+
+  /**
+   * @brief Record a relay edge for a slot, ignored while the slot is not bound.
+   * @param slot Slot index returned by currentSlot() when the relay was created.
+   */
+  static void markRelayEdge(int8_t slot);
+
+  /**
+   * @brief Record a button press for a slot. Only the first press of a burst counts, until its attribute
+   * update or CONFIG_EM_LATENCY_TRACE_BUTTON_TIMEOUT_MS. Ignored while the slot is not bound.
+   * @param slot Slot index returned by currentSlot() when the button was created.
+   */
+  static void markButtonPress(int8_t slot);
+
+  /**
+   * @brief Get the number of bound slots.
+   * @return Number of traced endpoints.
+   */
+  static size_t getEndpointCount();
+
+  /**
+   * @brief Copy the statistics of a traced endpoint.
+   * @param index Index in [0, getEndpointCount()).
+   * @param[out] stats Destination of the statistics.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the index is out of range.
+   */
+  static esp_err_t getStats(size_t index, LatencyStats* stats);
+
+  /**
+   * @brief Copy the histogram of one endpoint and path.
+   * @param endpointId Matter endpoint id.
+   * @param path Path to query.
+   * @param[out] histogram Destination of the histogram.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the endpoint is not traced.
+   */
+  static esp_err_t getHistogram(uint16_t endpointId, LatencyPath path, LatencyHistogram* histogram);
+
+  /**
+   * @brief Estimate a percentile from a histogram.
+   * @param histogram The histogram.
+   * @param percentile Percentile in [0, 100].
+   * @return Upper bound of the bucket holding the percentile, in microseconds.
+   */
+  static uint32_t percentileUs(const LatencyHistogram& histogram, uint8_t percentile);
+
+  /**
+   * @brief Clear all histograms and counters, keeping the endpoint bindings.
+   */
+  static void reset();
+
+  /**
+   * @brief Release every slot, when all devices were deleted at once.
+   */
+  static void releaseAllSlots();
+
+  /**
+   * @brief Log a one line summary per endpoint and path.
+   */
+  static void dump();
+
+ private:
+  LatencyTracer() = delete;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <ButtonModule.hpp>
+
+/**
+ * @brief ButtonModule that reports every press to the LatencyTracer before the accessory handles it.
+ *
+ * The press callbacks of the accessory are wrapped, the GPIO interrupt stays with the button driver. The
+ * trace slot is taken from LatencyTracer::currentSlot() at construction, so the button must be created
+ * between LatencyTracer::openSlot() and LatencyTracer::bindSlot().
+ */
+class TracedButtonModule : public ButtonModule {
+ public:
+  /**
+   * @brief Constructor.
+   * @param pin GPIO number of the button.
+   */
+  explicit TracedButtonModule(uint8_t pin);
+
+  void setSinglePressCallback(void (*callback)(void *arg), void *arg) override;
+  void setDoublePressCallback(void (*callback)(void *arg), void *arg) override;
+  void setLongPressCallback(void (*callback)(void *arg), void *arg) override;
+
+ private:
+  /**
+   * @brief Callback of the accessory for one kind of press.
+   */
+  struct PressCallback {
+    TracedButtonModule *button;
+    void (*callback)(void *arg);
+    void *arg;
+  };
+
+  int8_t m_traceSlot;            ///< Trace slot of the endpoint owning the button
+  PressCallback m_callbacks[3];  ///< Single, double and long press callbacks of the accessory
+
+  /**
+   * @brief Record the press, then run the callback of the accessory.
+   * @param arg The PressCallback of the press.
+   */
+  static void onPress(void *arg);
+
+  // Delete the copy constructor and assignment operator
+  TracedButtonModule(const TracedButtonModule &) = delete;
+  TracedButtonModule &operator=(const TracedButtonModule &) = delete;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <RelayModule.hpp>
+
+/**
+ * @brief RelayModule that reports every setPower edge to the LatencyTracer and records the relay state
+ * in the WarmBootCache.
+ *
+ * The trace slot is taken from LatencyTracer::currentSlot() at construction, so the relay must be
+ * created between LatencyTracer::openSlot() and LatencyTracer::bindSlot().
+ */
+class TracedRelayModule : public RelayModule {
+ public:
+  /**
+   * @brief Constructor.
+   * @param pin GPIO number driving the relay.
+   * @param restoreState Switch the relay back to the state it had before a software restart. Only for
+   * relays whose accessory has no timing of its own, a motor must not resume blindly.
+   */
+  explicit TracedRelayModule(uint8_t pin, bool restoreState = false);
+
+  /**
+   * @brief Set the relay output and record the edge.
+   * @param power The new relay state.
+   */
+  void setPower(bool power) override;
+
+ private:
+  int8_t m_traceSlot;  ///< Trace slot of the endpoint owning the relay
+  uint8_t m_pin;       ///< GPIO number driving the relay
+
+  // Delete the copy constructor and assignment operator
+  TracedRelayModule(const TracedRelayModule&) = delete;
+  TracedRelayModule& operator=(const TracedRelayModule&) = delete;
+};
@@ -1,6 +1,7 @@
 #include "EndpointCreator.hpp"
 
 #include <esp_log.h>
+#include <string.h>
 
 #include <BlindAccessory.hpp>
 #include <ButtonModule.hpp>
@@ -10,6 +11,9 @@
 #include <RelayModule.hpp>
 #include <StatelessButtonAccessory.hpp>
 
+#include "TracedButtonModule.hpp"
+#include "TracedRelayModule.hpp"
+
 static const char* TAG = "EndpointCreator";
 
 static const char* lightJsonProprties = "[\"name\", \"lightPin\", \"buttonPin\"]";
@@ -20,11 +24,11 @@ static const char* windowJsonProprties =
     "[\"name\", \"motorUpPin\", \"motorDownPin\", \"buttonUpPin\", \"buttonDownPin\", \"timeToOpen\", "
     "\"timeToClose\"]";
 
-static const DeviceType m_deviceTypes[] = {{"LIGHT", DeviceCreator::createLight},
-                                           {"FAN", DeviceCreator::createFan},
-                                           {"PLUGIN", DeviceCreator::createPlugin},
-                                           {"BUTTON", DeviceCreator::createButton},
-                                           {"WINDOW", DeviceCreator::createWindow}};
+static const DeviceType m_deviceTypes[] = {{"LIGHT", DeviceCreator::createLight, lightJsonProprties},
+                                           {"FAN", DeviceCreator::createFan, fanJsonProprties},
+                                           {"PLUGIN", DeviceCreator::createPlugin, pluginJsonProprties},
+                                           {"BUTTON", DeviceCreator::createButton, buttonJsonProprties},
+                                           {"WINDOW", DeviceCreator::createWindow, windowJsonProprties}};
 
 void DeviceCreator::getJsonSchemaForAllDevices(char* jsonSchema, size_t schemaSize) {
   snprintf(jsonSchema, schemaSize, "{\"LIGHT\":%s,\"FAN\":%s,\"PLUGIN\":%s,\"BUTTON\":%s,\"WINDOW\":%s}",
@@ -54,6 +58,63 @@ BaseDeviceInterface* DeviceCreator::createDevice(JsonObject deviceJson, esp_matt
   return nullptr;
 }
 
+esp_err_t DeviceCreator::planDevice(JsonObject deviceJson, DevicePlan* plan) {
+  const char* type = deviceJson["type"].as<const char*>();
+
+  for (int i = 0; i < sizeof(m_deviceTypes) / sizeof(DeviceType); i++) {
+    if (type == nullptr || strcmp(type, m_deviceTypes[i].type) != 0) {
+      continue;
+    }
+
+    StaticJsonDocument<200> doc;
+    deserializeJson(doc, m_deviceTypes[i].properties);
+    JsonArray properties = doc.as<JsonArray>();
+    if (properties.size() > DevicePlan::kValueCount + 1) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+
+    const char* name = deviceJson[properties[0].as<JsonString>()].as<const char*>();
+    if (name == nullptr) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(name) >= DevicePlan::kNameLength) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(plan, 0, sizeof(*plan));
+    strcpy(plan->name, name);
+    plan->type = i;
+    // the create functions narrow the pins again, out of range values end up the same
+    for (size_t k = 1; k < properties.size(); k++) {
+      plan->values[k - 1] = deviceJson[properties[k].as<JsonString>()].as<uint32_t>();
+    }
+    return ESP_OK;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+BaseDeviceInterface* DeviceCreator::createDevice(const DevicePlan& plan, esp_matter::endpoint_t* aggregator) {
+  if (plan.type >= sizeof(m_deviceTypes) / sizeof(DeviceType)) {
+    ESP_LOGE(TAG, "Device type not found: %u", plan.type);
+    return nullptr;
+  }
+  const DeviceType& deviceType = m_deviceTypes[plan.type];
+
+  StaticJsonDocument<200> properties;
+  deserializeJson(properties, deviceType.properties);
+  JsonArray keys = properties.as<JsonArray>();
+
+  // Rebuild the JSON input in place of parsing it, the create functions read nothing else
+  StaticJsonDocument<512> doc;
+  JsonObject deviceJson = doc.to<JsonObject>();
+  deviceJson["type"] = deviceType.type;
+  deviceJson[keys[0].as<JsonString>()] = plan.name;
+  for (size_t k = 1; k < keys.size(); k++) {
+    deviceJson[keys[k].as<JsonString>()] = plan.values[k - 1];
+  }
+  return deviceType.createFunction(deviceJson, aggregator);
+}
+
 BaseDeviceInterface* DeviceCreator::createLight(JsonObject deviceJson, esp_matter::endpoint_t* aggregator) {
   // Parse the JSON properties array
   StaticJsonDocument<200> doc;
@@ -66,8 +127,8 @@ BaseDeviceInterface* DeviceCreator::createLight(JsonObject deviceJson, esp_matte
   uint8_t buttonPin = deviceJson[properties[2].as<JsonString>()].as<uint8_t>();
 
   // Extract lightJsonProprties and initialize the light device
-  ButtonModule* button = new ButtonModule(getButtonPin(buttonPin));
-  RelayModule* relay = new RelayModule(getRelayPin(lightPin));
+  ButtonModule* button = new TracedButtonModule(getButtonPin(buttonPin));
+  RelayModule* relay = new TracedRelayModule(getRelayPin(lightPin), true);
 
   LightAccessory* lightAccessory = new LightAccessory(relay, button);
   LightDevice* lightDevice = new LightDevice((char*)name, lightAccessory, aggregator);
@@ -85,8 +146,8 @@ BaseDeviceInterface* DeviceCreator::createFan(JsonObject deviceJson, esp_matter:
   uint8_t buttonPin = deviceJson[properties[2].as<JsonString>()].as<uint8_t>();
 
   // Extract fanJsonProprties and initialize the fan device
-  ButtonModule* button = new ButtonModule(getButtonPin(buttonPin));
-  RelayModule* relay = new RelayModule(getRelayPin(fanPin));
+  ButtonModule* button = new TracedButtonModule(getButtonPin(buttonPin));
+  RelayModule* relay = new TracedRelayModule(getRelayPin(fanPin), true);
 
   FanAccessory* fanAccessory = new FanAccessory(relay, button);
   FanDevice* fanDevice = new FanDevice((char*)name, fanAccessory, aggregator);
@@ -104,8 +165,8 @@ BaseDeviceInterface* DeviceCreator::createPlugin(JsonObject deviceJson, esp_matt
   uint8_t buttonPin = deviceJson[properties[2].as<JsonString>()].as<uint8_t>();
 
   // Extract pluginJsonProprties and initialize the plugin device
-  ButtonModule* button = new ButtonModule(getButtonPin(buttonPin));
-  RelayModule* relay = new RelayModule(getRelayPin(pluginPin));
+  ButtonModule* button = new TracedButtonModule(getButtonPin(buttonPin));
+  RelayModule* relay = new TracedRelayModule(getRelayPin(pluginPin), true);
 
   PluginAccessory* pluginAccessory = new PluginAccessory(relay, button);
   PluginDevice* pluginDevice = new PluginDevice((char*)name, pluginAccessory, aggregator);
@@ -122,7 +183,7 @@ BaseDeviceInterface* DeviceCreator::createButton(JsonObject deviceJson, esp_matt
   uint8_t buttonPin = deviceJson[properties[1].as<JsonString>()].as<uint8_t>();
 
   // Extract buttonJsonProprties and initialize the button device
-  ButtonModule* button = new ButtonModule(getButtonPin(buttonPin));
+  ButtonModule* button = new TracedButtonModule(getButtonPin(buttonPin));
   StatelessButtonAccessory* buttonAccessory = new StatelessButtonAccessory(button);
   ButtonDevice* buttonDevice = new ButtonDevice((char*)name, buttonAccessory, aggregator);
   return buttonDevice;
@@ -143,10 +204,10 @@ BaseDeviceInterface* DeviceCreator::createWindow(JsonObject deviceJson, esp_matt
   uint32_t timeToClose = deviceJson[properties[6].as<JsonString>()].as<uint32_t>();
 
   // Extract windowJsonProprties and initialize the window device
-  ButtonModule* buttonUp = new ButtonModule(getButtonPin(buttonUpPin));
-  ButtonModule* buttonDown = new ButtonModule(getButtonPin(buttonDownPin));
-  RelayModule* motorUp = new RelayModule(getRelayPin(motorUpPin));
-  RelayModule* motorDown = new RelayModule(getRelayPin(motorDownPin));
+  ButtonModule* buttonUp = new TracedButtonModule(getButtonPin(buttonUpPin));
+  ButtonModule* buttonDown = new TracedButtonModule(getButtonPin(buttonDownPin));
+  RelayModule* motorUp = new TracedRelayModule(getRelayPin(motorUpPin));
+  RelayModule* motorDown = new TracedRelayModule(getRelayPin(motorDownPin));
 
   BlindAccessory* blindAccessory =
       new BlindAccessory(motorUp, motorDown, buttonUp, buttonDown, timeToOpen, timeToClose);
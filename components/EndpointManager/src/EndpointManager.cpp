@@ -3,16 +3,77 @@
 #include <app/server/CommissioningWindowManager.h>
 #include <app/server/Server.h>
 #include <esp_err.h>
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 #include <esp_matter.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <stdlib.h>
 
+#include "AppEventBus.hpp"
+#include "BootTimeline.hpp"
 #include "EndpointCreator.hpp"
+#include "EventJournal.hpp"
+#include "LatencyTracer.hpp"
+#include "WarmBootCache.hpp"
 
 static const char *TAG = "EndpointManager";
 
-EndpointManager::EndpointManager(bool isBridge) : node(nullptr), aggregator(nullptr) {
+/* Set once the Matter stack shut down BLE and released the controller memory */
+static bool s_bleReleased = false;
+
+/* Endpoints are appended to the node, so the last one belongs to the device created most recently */
+static uint16_t get_last_endpoint_id(esp_matter::node_t *node) {
+  uint16_t endpoint_id = chip::kInvalidEndpointId;
+  for (esp_matter::endpoint_t *ep = esp_matter::endpoint::get_first(node); ep != nullptr;
+       ep = esp_matter::endpoint::get_next(ep)) {
+    endpoint_id = esp_matter::endpoint::get_id(ep);
+  }
+  return endpoint_id;
+}
+
+/**
+ * @brief ArduinoJson writer feeding the serialized accessory into a CRC-32, so it is compared without a copy.
+ */
+struct ChecksumWriter {
+  uint32_t crc = 0;
+
+  size_t write(uint8_t c) {
+    crc = esp_rom_crc32_le(crc, &c, 1);
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t length) {
+    crc = esp_rom_crc32_le(crc, data, length);
+    return length;
+  }
+};
+
+static uint32_t accessory_checksum(JsonObject accessory) {
+  ChecksumWriter writer;
+  serializeJson(accessory, writer);
+  /* Never 0, which marks a matched accessory */
+  return writer.crc | 1;
+}
+
+/**
+ * @brief Accessory as kept in the warm boot plan, the plan is an array of them.
+ */
+struct PlannedAccessory {
+  DevicePlan device;
+  uint32_t checksum;
+  uint16_t accessoryId;
+};
+
+EndpointManager::EndpointManager(bool isBridge)
+    : node(nullptr), aggregator(nullptr), devices(), deviceCount(0) {
   ESP_LOGI(TAG, "EndpointManager constructor");
 
+  /* Pick up the lifecycle journal left by the previous boot */
+  EventJournal::init();
+
   /* Initialize the Matter stack */
   esp_matter::node::config_t node_config;
   node = esp_matter::node::create(&node_config, app_attribute_cb, app_identification_cb);
@@ -36,26 +97,248 @@ esp_err_t EndpointManager::createArrayOfEndpoints(const char *jsonArray, size_t
   // Get the reference to the Accessories array
   JsonArray accessories = doc.as<JsonArray>();
 
+  // Keep the decoded accessories, a software restart creates the endpoints from them without the JSON
+  size_t count = accessories.size();
+  PlannedAccessory *plan =
+      static_cast<PlannedAccessory *>(calloc(count > 0 ? count : 1, sizeof(PlannedAccessory)));
+  bool planned = plan != nullptr && count * sizeof(PlannedAccessory) <= WarmBootCache::maxPlanLength();
   DeviceCreator deviceCreator;
+  size_t i = 0;
 
   // Loop through the Accessories array
   for (JsonVariant v : accessories) {
     // Get the reference to the Accessory object
     JsonObject accessory = v.as<JsonObject>();
+    uint32_t checksum = accessory_checksum(accessory);
+    addDevice(accessory, checksum);
+
+    if (planned) {
+      planned = deviceCreator.planDevice(accessory, &plan[i].device) == ESP_OK;
+      plan[i].checksum = checksum;
+      plan[i].accessoryId = accessory["id"].as<uint16_t>();
+      i++;
+    }
+  }
 
-    // Create the device
-    BaseDeviceInterface *device = deviceCreator.createDevice(accessory, aggregator);
+  if (planned) {
+    WarmBootCache::setPlan(plan, count * sizeof(PlannedAccessory));
+  } else {
+    ESP_LOGW(TAG, "Accessories do not fit into the warm boot plan");
+    WarmBootCache::invalidatePlan();
   }
+  free(plan);
   return ESP_OK;
 }
 
-esp_err_t EndpointManager::startMatter() {
-  // start the Matter stack
-  esp_matter::start(app_event_cb);
+esp_err_t EndpointManager::createEndpointsFromWarmBoot() {
+  size_t maxLength = WarmBootCache::maxPlanLength();
+  if (!WarmBootCache::isWarm() || maxLength == 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  PlannedAccessory *plan = static_cast<PlannedAccessory *>(malloc(maxLength));
+  if (plan == nullptr) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  size_t length = 0;
+  if (WarmBootCache::getPlan(plan, maxLength, &length) != ESP_OK || length % sizeof(PlannedAccessory) != 0) {
+    free(plan);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  size_t count = length / sizeof(PlannedAccessory);
+  for (size_t i = 0; i < count; i++) {
+    addDevice(plan[i].device, plan[i].accessoryId, plan[i].checksum);
+  }
+  free(plan);
 
+  ESP_LOGI(TAG, "Created %u accessories from the warm boot plan", (unsigned)count);
   return ESP_OK;
 }
 
+esp_err_t EndpointManager::applyAccessories(const char *jsonArray, size_t jsonArraySize) {
+  DynamicJsonDocument doc(CONFIG_JSON_ACCESSORIES_LENGTH);
+  if (deserializeJson(doc, jsonArray, jsonArraySize) || !doc.is<JsonArray>()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  JsonArray accessories = doc.as<JsonArray>();
+
+  /* Checksums of the new accessories, 0 once an accessory is matched by a device that is kept */
+  size_t count = accessories.size();
+  uint32_t *checksums = static_cast<uint32_t *>(calloc(count > 0 ? count : 1, sizeof(uint32_t)));
+  if (checksums == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+  size_t i = 0;
+  for (JsonObject accessory : accessories) {
+    checksums[i++] = accessory_checksum(accessory);
+  }
+
+  esp_matter::lock::chip_stack_lock(portMAX_DELAY);
+
+  /* Drop the devices whose accessory is gone or changed first, their pins may be taken by the new ones */
+  size_t kept = 0;
+  size_t removed = 0;
+  for (size_t d = 0; d < deviceCount;) {
+    BridgedDevice &device = devices[d];
+    bool keep = false;
+    i = 0;
+    for (JsonObject accessory : accessories) {
+      if (checksums[i] != 0 && device.checksum == checksums[i] &&
+          device.accessoryId == accessory["id"].as<uint16_t>()) {
+        checksums[i] = 0;
+        keep = true;
+        break;
+      }
+      i++;
+    }
+    if (keep) {
+      kept++;
+      d++;
+    } else {
+      removeDevice(d);
+      removed++;
+    }
+  }
+
+  esp_err_t err = ESP_OK;
+  size_t added = 0;
+  i = 0;
+  for (JsonObject accessory : accessories) {
+    if (checksums[i] != 0) {
+      esp_err_t result = addDevice(accessory, checksums[i]);
+      if (result == ESP_OK) {
+        added++;
+      } else {
+        err = result;
+      }
+    }
+    i++;
+  }
+
+  esp_matter::lock::chip_stack_unlock();
+  free(checksums);
+
+  ESP_LOGI(TAG, "Accessories applied: %u kept, %u removed, %u added", (unsigned)kept, (unsigned)removed,
+           (unsigned)added);
+  return err;
+}
+
+esp_err_t EndpointManager::addDevice(JsonObject accessory, uint32_t checksum) {
+  if (deviceCount >= CONFIG_EM_MAX_BRIDGED_DEVICES) {
+    ESP_LOGE(TAG, "No room for another device");
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Create the device, tracing its relays and buttons under its own endpoint
+  DeviceCreator deviceCreator;
+  LatencyTracer::openSlot();
+  return trackDevice(deviceCreator.createDevice(accessory, aggregator), accessory["id"].as<uint16_t>(),
+                     checksum);
+}
+
+esp_err_t EndpointManager::addDevice(const DevicePlan &plan, uint16_t accessoryId, uint32_t checksum) {
+  if (deviceCount >= CONFIG_EM_MAX_BRIDGED_DEVICES) {
+    ESP_LOGE(TAG, "No room for another device");
+    return ESP_ERR_NO_MEM;
+  }
+
+  DeviceCreator deviceCreator;
+  LatencyTracer::openSlot();
+  return trackDevice(deviceCreator.createDevice(plan, aggregator), accessoryId, checksum);
+}
+
+esp_err_t EndpointManager::trackDevice(BaseDeviceInterface *device, uint16_t accessoryId, uint32_t checksum) {
+  if (device == nullptr) {
+    LatencyTracer::discardSlot();
+    return ESP_ERR_NO_MEM;
+  }
+  uint16_t endpointId = get_last_endpoint_id(node);
+  LatencyTracer::bindSlot(endpointId);
+
+  /* Endpoints created before the start are enabled by it */
+  if (esp_matter::is_started()) {
+    esp_err_t err = esp_matter::endpoint::enable(esp_matter::endpoint::get(node, endpointId));
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to enable endpoint %u: %s", endpointId, esp_err_to_name(err));
+    }
+  }
+
+  devices[deviceCount++] = {device, accessoryId, endpointId, checksum};
+  return ESP_OK;
+}
+
+void EndpointManager::removeDevice(size_t index) {
+  BridgedDevice device = devices[index];
+  devices[index] = devices[--deviceCount];
+
+  /* The endpoint outlives a device that does not destroy it, and must not reach the deleted device */
+  delete device.device;
+  LatencyTracer::releaseSlot(device.endpointId);
+  esp_matter::endpoint_t *endpoint = esp_matter::endpoint::get(node, device.endpointId);
+  if (endpoint != nullptr) {
+    esp_matter::endpoint::destroy(node, endpoint);
+  }
+}
+
+#if CONFIG_ENABLE_ESP32_FACTORY_DATA_PROVIDER
+/* The factory provider reads the precomputed SPAKE2+ verifier and the DAC from the fctry partition,
+ * a unit that skipped manufacturing provisioning cannot be commissioned, so Matter is not started */
+static esp_err_t check_factory_data() {
+  const char *partition = CONFIG_CHIP_FACTORY_NAMESPACE_PARTITION_LABEL;
+  esp_err_t err = nvs_flash_init_partition(partition);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to init factory partition %s: %s", partition, esp_err_to_name(err));
+    return err;
+  }
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(partition, "chip-factory", NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Factory partition %s is not provisioned: %s", partition, esp_err_to_name(err));
+    return err;
+  }
+
+  // the mfg tool stores the verifier and the salt as base64 strings, the DAC as blobs
+  const char *stringKeys[] = {"verifier", "salt"};
+  const char *blobKeys[] = {"dac-cert", "dac-key"};
+  for (const char *key : stringKeys) {
+    size_t length = 0;
+    err = nvs_get_str(handle, key, nullptr, &length);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Factory data is missing %s: %s", key, esp_err_to_name(err));
+      break;
+    }
+  }
+  for (size_t i = 0; err == ESP_OK && i < sizeof(blobKeys) / sizeof(blobKeys[0]); i++) {
+    size_t length = 0;
+    err = nvs_get_blob(handle, blobKeys[i], nullptr, &length);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Factory data is missing %s: %s", blobKeys[i], esp_err_to_name(err));
+    }
+  }
+  nvs_close(handle);
+  return err;
+}
+#endif
+
+esp_err_t EndpointManager::startMatter() {
+#if CONFIG_ENABLE_ESP32_FACTORY_DATA_PROVIDER
+  esp_err_t factoryErr = check_factory_data();
+  if (factoryErr != ESP_OK) {
+    ESP_LOGE(TAG, "Not starting Matter without factory data");
+    return factoryErr;
+  }
+#endif
+
+  // start the Matter stack
+  esp_err_t err = esp_matter::start(app_event_cb);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start Matter: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
 esp_err_t EndpointManager::app_identification_cb(esp_matter::identification::callback_type type,
                                                  uint16_t endpoint_id, uint8_t effect_id,
                                                  uint8_t effect_variant, void *priv_data) {
@@ -73,10 +356,16 @@ esp_err_t EndpointManager::app_identification_cb(esp_matter::identification::cal
 esp_err_t EndpointManager::app_attribute_cb(esp_matter::attribute::callback_type type, uint16_t endpoint_id,
                                             uint32_t cluster_id, uint32_t attribute_id,
                                             esp_matter_attr_val_t *val, void *priv_data) {
+  if (type == esp_matter::attribute::callback_type_t::PRE_UPDATE) {
+    LatencyTracer::mark(endpoint_id, TracePoint::CommandReceived);
+    return ESP_OK;
+  }
+
   if (type == esp_matter::attribute::callback_type_t::POST_UPDATE) {
     if (priv_data != nullptr) {
       BaseDeviceInterface *device = static_cast<BaseDeviceInterface *>(priv_data);
       if (device != nullptr) {
+        LatencyTracer::mark(endpoint_id, TracePoint::AccessoryDispatch);
         device->updateAccessory(attribute_id);
       }
     }
@@ -89,60 +378,64 @@ esp_err_t EndpointManager::app_attribute_cb(esp_matter::attribute::callback_type
 void EndpointManager::app_event_cb(const chip::DeviceLayer::ChipDeviceEvent *event, intptr_t arg) {
   switch (event->Type) {
     case chip::DeviceLayer::DeviceEventType::kInterfaceIpAddressChanged:
-      ESP_LOGW(__FILENAME__, "Interface IP Address changed");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::InterfaceIpAddressChanged,
+                           static_cast<uint8_t>(event->InterfaceIpAddressChanged.Type));
+      /* A commissioned bridge is reachable by its controllers once Matter has an address */
+      BootTimeline::mark(BootPhase::MatterIpReady);
+      if (chip::Server::GetInstance().GetFabricTable().FabricCount() > 0) {
+        BootTimeline::mark(BootPhase::Operational);
+      }
+      AppEventBus::publish(AppEventType::MatterIpAddressChanged,
+                           static_cast<uint32_t>(event->InterfaceIpAddressChanged.Type));
       break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningComplete:
-      ESP_LOGW(__FILENAME__, "Commissioning complete");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::CommissioningComplete, event->CommissioningComplete.fabricIndex);
+      BootTimeline::mark(BootPhase::CommissioningComplete);
+      AppEventBus::publish(AppEventType::MatterCommissioningComplete,
+                           event->CommissioningComplete.fabricIndex);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kFailSafeTimerExpired:
-      ESP_LOGW(__FILENAME__, "Commissioning failed, fail safe timer expired");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::FailSafeTimerExpired, event->FailSafeTimerExpired.fabricIndex);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningSessionStarted:
-      ESP_LOGW(__FILENAME__, "Commissioning session started");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::CommissioningSessionStarted);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningSessionStopped:
-      ESP_LOGW(__FILENAME__, "Commissioning session stopped");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::CommissioningSessionStopped);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowOpened:
-      ESP_LOGW(__FILENAME__, "Commissioning window opened");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::CommissioningWindowOpened);
+      /* An uncommissioned bridge is as far as it gets on its own once it can be commissioned */
+      BootTimeline::mark(BootPhase::CommissioningWindowOpened);
+      if (chip::Server::GetInstance().GetFabricTable().FabricCount() == 0) {
+        BootTimeline::mark(BootPhase::Operational);
+      }
+      AppEventBus::publish(AppEventType::MatterCommissioningWindowOpened);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowClosed:
-      ESP_LOGW(__FILENAME__, "Commissioning window closed");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::CommissioningWindowClosed);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kFabricRemoved:
-      ESP_LOGW(__FILENAME__, "Fabric removed successfully");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::FabricRemoved, event->FabricRemoved.fabricIndex);
+      AppEventBus::publish(AppEventType::MatterFabricRemoved, event->FabricRemoved.fabricIndex);
       if (chip::Server::GetInstance().GetFabricTable().FabricCount() == 0) {
+#if CONFIG_EM_RESTART_FOR_BLE_COMMISSIONING
+        /* The BLE memory was handed back to the heap, a restart brings BLE up for the next commissioning */
+        if (s_bleReleased) {
+          ESP_LOGI(TAG, "Last fabric removed, restarting to re-enable BLE commissioning");
+          chip::DeviceLayer::SystemLayer().StartTimer(
+              chip::System::Clock::Milliseconds32(CONFIG_EM_BLE_RESTART_DELAY_MS),
+              [](chip::System::Layer *, void *) { esp_restart(); }, nullptr);
+          break;
+        }
+#endif
         chip::CommissioningWindowManager &commissionMgr =
             chip::Server::GetInstance().GetCommissioningWindowManager();
         constexpr auto kTimeoutSeconds = chip::System::Clock::Seconds16(300);
@@ -156,25 +449,24 @@ void EndpointManager::app_event_cb(const chip::DeviceLayer::ChipDeviceEvent *eve
       }
       break;
     case chip::DeviceLayer::DeviceEventType::kFabricWillBeRemoved:
-      ESP_LOGW(__FILENAME__, "Fabric will be removed");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::FabricWillBeRemoved, event->FabricWillBeRemoved.fabricIndex);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kFabricUpdated:
-      ESP_LOGW(__FILENAME__, "Fabric is updated");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::FabricUpdated, event->FabricUpdated.fabricIndex);
       break;
 
     case chip::DeviceLayer::DeviceEventType::kFabricCommitted:
-      ESP_LOGW(__FILENAME__, "Fabric is committed");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
-      ESP_LOGW(__FILENAME__, "---------------------------------");
+      EventJournal::record(JournalEvent::FabricCommitted, event->FabricCommitted.fabricIndex);
+      break;
+
+#if CONFIG_USE_BLE_ONLY_FOR_COMMISSIONING
+    case chip::DeviceLayer::DeviceEventType::kBLEDeinitialized:
+      s_bleReleased = true;
+      EventJournal::record(JournalEvent::BleDeinitialized);
+      ESP_LOGI(TAG, "BLE released, free heap %u bytes", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
       break;
+#endif
     default:
       break;
   }
@@ -0,0 +1,152 @@
+#include "EventJournal.hpp"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+static const char *TAG = "EventJournal";
+
+namespace {
+
+constexpr uint32_t kJournalMagic = 0x4A524E4C;  // "JRNL"
+constexpr uint16_t kJournalVersion = 1;
+
+struct Journal {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t capacity;
+  uint16_t head;
+  uint16_t count;
+  uint16_t bootCount;
+  uint16_t checksum;
+  JournalEntry entries[CONFIG_EM_EVENT_JOURNAL_SIZE];
+};
+
+RTC_NOINIT_ATTR Journal s_journal;
+portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint16_t headerChecksum(const Journal &journal) {
+  return static_cast<uint16_t>(journal.magic ^ (journal.magic >> 16) ^ journal.version ^ journal.capacity ^
+                               journal.head ^ journal.count ^ journal.bootCount ^ 0xA5A5);
+}
+
+bool isValid(const Journal &journal) {
+  return journal.magic == kJournalMagic && journal.version == kJournalVersion &&
+         journal.capacity == CONFIG_EM_EVENT_JOURNAL_SIZE && journal.head < journal.capacity &&
+         journal.count <= journal.capacity && journal.checksum == headerChecksum(journal);
+}
+
+}  // namespace
+
+void EventJournal::init() {
+  esp_reset_reason_t reason = esp_reset_reason();
+
+  portENTER_CRITICAL(&s_lock);
+  // RTC no-init memory holds garbage after power loss, start over unless the header is intact
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || !isValid(s_journal)) {
+    memset(&s_journal, 0, sizeof(s_journal));
+    s_journal.magic = kJournalMagic;
+    s_journal.version = kJournalVersion;
+    s_journal.capacity = CONFIG_EM_EVENT_JOURNAL_SIZE;
+  }
+  s_journal.bootCount++;
+  s_journal.checksum = headerChecksum(s_journal);
+  portEXIT_CRITICAL(&s_lock);
+
+  record(JournalEvent::Boot, static_cast<uint8_t>(reason));
+}
+
+void EventJournal::record(JournalEvent event, uint8_t data) {
+  uint32_t uptimeMs = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+
+  portENTER_CRITICAL(&s_lock);
+  JournalEntry &entry = s_journal.entries[s_journal.head];
+  entry.uptimeMs = uptimeMs;
+  entry.bootCount = s_journal.bootCount;
+  entry.event = event;
+  entry.data = data;
+
+  s_journal.head = (s_journal.head + 1) % s_journal.capacity;
+  if (s_journal.count < s_journal.capacity) {
+    s_journal.count++;
+  }
+  s_journal.checksum = headerChecksum(s_journal);
+  portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t EventJournal::read(JournalEntry *entries, size_t maxEntries, size_t *count) {
+  if (entries == nullptr || count == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  size_t available = s_journal.count;
+  size_t skip = available > maxEntries ? available - maxEntries : 0;
+  size_t oldest = (s_journal.head + s_journal.capacity - available) % s_journal.capacity;
+
+  *count = available - skip;
+  for (size_t i = 0; i < *count; i++) {
+    entries[i] = s_journal.entries[(oldest + skip + i) % s_journal.capacity];
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  return ESP_OK;
+}
+
+size_t EventJournal::size() { return s_journal.count; }
+
+const char *EventJournal::eventName(JournalEvent event) {
+  switch (event) {
+    case JournalEvent::Boot:
+      return "Boot";
+    case JournalEvent::InterfaceIpAddressChanged:
+      return "Interface IP Address changed";
+    case JournalEvent::CommissioningSessionStarted:
+      return "Commissioning session started";
+    case JournalEvent::CommissioningSessionStopped:
+      return "Commissioning session stopped";
+    case JournalEvent::CommissioningWindowOpened:
+      return "Commissioning window opened";
+    case JournalEvent::CommissioningWindowClosed:
+      return "Commissioning window closed";
+    case JournalEvent::CommissioningComplete:
+      return "Commissioning complete";
+    case JournalEvent::FailSafeTimerExpired:
+      return "Commissioning failed, fail safe timer expired";
+    case JournalEvent::FabricWillBeRemoved:
+      return "Fabric will be removed";
+    case JournalEvent::FabricRemoved:
+      return "Fabric removed";
+    case JournalEvent::FabricUpdated:
+      return "Fabric is updated";
+    case JournalEvent::FabricCommitted:
+      return "Fabric is committed";
+    case JournalEvent::BleDeinitialized:
+      return "BLE deinitialized";
+    default:
+      return "Unknown";
+  }
+}
+
+void EventJournal::clear() {
+  portENTER_CRITICAL(&s_lock);
+  s_journal.head = 0;
+  s_journal.count = 0;
+  s_journal.checksum = headerChecksum(s_journal);
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void EventJournal::dump() {
+  JournalEntry entries[CONFIG_EM_EVENT_JOURNAL_SIZE];
+  size_t count = 0;
+  read(entries, CONFIG_EM_EVENT_JOURNAL_SIZE, &count);
+
+  ESP_LOGI(TAG, "%u entries", (unsigned)count);
+  for (size_t i = 0; i < count; i++) {
+    ESP_LOGI(TAG, "boot %u +%lu ms: %s (%u)", entries[i].bootCount, (unsigned long)entries[i].uptimeMs,
+             eventName(entries[i].event), entries[i].data);
+  }
+}
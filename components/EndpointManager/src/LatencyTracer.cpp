@@ -0,0 +1,313 @@
+#include "LatencyTracer.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+static const char *TAG = "LatencyTracer";
+
+#ifdef CONFIG_EM_LATENCY_TRACE
+
+namespace {
+
+constexpr size_t kPointCount = static_cast<size_t>(TracePoint::Count);
+constexpr size_t kPathCount = static_cast<size_t>(LatencyPath::Count);
+constexpr int64_t kReverseTimeoutUs = CONFIG_EM_LATENCY_TRACE_BUTTON_TIMEOUT_MS * 1000LL;
+
+struct TraceSlot {
+  bool bound;
+  uint16_t endpointId;
+  uint32_t actuations;
+  int64_t stamps[kPointCount];
+  LatencyHistogram histograms[kPathCount];
+};
+
+/* Relays and buttons keep the index of their slot, a released slot is left in place for the next device */
+TraceSlot s_slots[CONFIG_EM_LATENCY_TRACE_MAX_ENDPOINTS];
+size_t s_boundSlots = 0;
+int8_t s_openSlot = -1;
+portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// called with s_lock held
+TraceSlot *findSlot(uint16_t endpointId) {
+  for (TraceSlot &slot : s_slots) {
+    if (slot.bound && slot.endpointId == endpointId) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+void record(LatencyHistogram &histogram, int64_t start, int64_t end) {
+  uint32_t us = end > start ? static_cast<uint32_t>(end - start) : 0;
+  int bucket = (31 - __builtin_clz(us | 1)) - 6;
+  if (bucket < 0) {
+    bucket = 0;
+  } else if (bucket >= LatencyHistogram::kBucketCount) {
+    bucket = LatencyHistogram::kBucketCount - 1;
+  }
+
+  histogram.count++;
+  histogram.sumUs += us;
+  if (us > histogram.maxUs) {
+    histogram.maxUs = us;
+  }
+  if (histogram.buckets[bucket] != UINT16_MAX) {
+    histogram.buckets[bucket]++;
+  }
+}
+
+}  // namespace
+
+esp_err_t LatencyTracer::openSlot() {
+  s_openSlot = -1;
+  portENTER_CRITICAL(&s_lock);
+  for (size_t i = 0; i < CONFIG_EM_LATENCY_TRACE_MAX_ENDPOINTS; i++) {
+    if (!s_slots[i].bound) {
+      memset(&s_slots[i], 0, sizeof(TraceSlot));
+      s_openSlot = static_cast<int8_t>(i);
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (s_openSlot < 0) {
+    ESP_LOGW(TAG, "No free trace slot, endpoint will not be traced");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+void LatencyTracer::bindSlot(uint16_t endpointId) {
+  if (s_openSlot < 0) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  s_slots[s_openSlot].endpointId = endpointId;
+  s_slots[s_openSlot].bound = true;
+  s_boundSlots++;
+  portEXIT_CRITICAL(&s_lock);
+  s_openSlot = -1;
+}
+
+void LatencyTracer::discardSlot() { s_openSlot = -1; }
+
+void LatencyTracer::releaseSlot(uint16_t endpointId) {
+  portENTER_CRITICAL(&s_lock);
+  TraceSlot *slot = findSlot(endpointId);
+  if (slot != nullptr) {
+    memset(slot, 0, sizeof(TraceSlot));
+    s_boundSlots--;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+int8_t LatencyTracer::currentSlot() { return s_openSlot; }
+
+void LatencyTracer::mark(uint16_t endpointId, TracePoint point) {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_lock);
+  TraceSlot *slot = findSlot(endpointId);
+  if (slot == nullptr) {
+    portEXIT_CRITICAL(&s_lock);
+    return;
+  }
+  int64_t *stamps = slot->stamps;
+  int64_t &pressed = stamps[static_cast<size_t>(TracePoint::ButtonPressed)];
+  bool reverse = pressed != 0 && now - pressed <= kReverseTimeoutUs;
+  switch (point) {
+    case TracePoint::CommandReceived:
+      // An attribute update that follows a button press is the reverse path reaching the device layer
+      point = reverse ? TracePoint::AccessoryCallback : TracePoint::CommandReceived;
+      stamps[static_cast<size_t>(point)] = now;
+      break;
+    case TracePoint::AccessoryDispatch:
+      if (reverse) {
+        stamps[static_cast<size_t>(TracePoint::AttributeUpdate)] = now;
+        record(slot->histograms[static_cast<size_t>(LatencyPath::ButtonToReport)], pressed, now);
+        pressed = 0;
+      } else {
+        stamps[static_cast<size_t>(TracePoint::AccessoryDispatch)] = now;
+      }
+      break;
+    default:
+      stamps[static_cast<size_t>(point)] = now;
+      break;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void LatencyTracer::markRelayEdge(int8_t slotIndex) {
+  if (slotIndex < 0 || slotIndex >= CONFIG_EM_LATENCY_TRACE_MAX_ENDPOINTS) {
+    return;
+  }
+
+  TraceSlot &slot = s_slots[slotIndex];
+  int64_t now = esp_timer_get_time();
+  int64_t &received = slot.stamps[static_cast<size_t>(TracePoint::CommandReceived)];
+
+  portENTER_CRITICAL(&s_lock);
+  // the edge restoring the state before bindSlot(), or of a module whose slot was released, is not counted
+  if (!slot.bound) {
+    portEXIT_CRITICAL(&s_lock);
+    return;
+  }
+  slot.actuations++;
+  slot.stamps[static_cast<size_t>(TracePoint::RelayEdge)] = now;
+  if (received != 0) {
+    record(slot.histograms[static_cast<size_t>(LatencyPath::CommandToRelay)], received, now);
+    received = 0;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void LatencyTracer::markButtonPress(int8_t slotIndex) {
+  if (slotIndex < 0 || slotIndex >= CONFIG_EM_LATENCY_TRACE_MAX_ENDPOINTS) {
+    return;
+  }
+
+  TraceSlot &slot = s_slots[slotIndex];
+  int64_t now = esp_timer_get_time();
+  int64_t &pressed = slot.stamps[static_cast<size_t>(TracePoint::ButtonPressed)];
+
+  portENTER_CRITICAL(&s_lock);
+  if (!slot.bound) {
+    portEXIT_CRITICAL(&s_lock);
+    return;
+  }
+  // A press whose attribute update is still pending keeps its time, the burst is one actuation
+  if (pressed == 0 || now - pressed > kReverseTimeoutUs) {
+    pressed = now;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+size_t LatencyTracer::getEndpointCount() { return s_boundSlots; }
+
+esp_err_t LatencyTracer::getStats(size_t index, LatencyStats *stats) {
+  if (stats == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // the index counts the bound slots only, released ones leave holes
+  esp_err_t err = ESP_ERR_INVALID_ARG;
+  portENTER_CRITICAL(&s_lock);
+  for (const TraceSlot &slot : s_slots) {
+    if (slot.bound && index-- == 0) {
+      stats->endpointId = slot.endpointId;
+      stats->actuations = slot.actuations;
+      memcpy(stats->histograms, slot.histograms, sizeof(stats->histograms));
+      err = ESP_OK;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
+
+esp_err_t LatencyTracer::getHistogram(uint16_t endpointId, LatencyPath path, LatencyHistogram *histogram) {
+  if (histogram == nullptr || path >= LatencyPath::Count) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  TraceSlot *slot = findSlot(endpointId);
+  if (slot != nullptr) {
+    *histogram = slot->histograms[static_cast<size_t>(path)];
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return slot != nullptr ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void LatencyTracer::reset() {
+  portENTER_CRITICAL(&s_lock);
+  for (TraceSlot &slot : s_slots) {
+    slot.actuations = 0;
+    memset(slot.stamps, 0, sizeof(slot.stamps));
+    memset(slot.histograms, 0, sizeof(slot.histograms));
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void LatencyTracer::releaseAllSlots() {
+  portENTER_CRITICAL(&s_lock);
+  memset(s_slots, 0, sizeof(s_slots));
+  s_boundSlots = 0;
+  portEXIT_CRITICAL(&s_lock);
+  s_openSlot = -1;
+}
+
+#else
+
+esp_err_t LatencyTracer::openSlot() { return ESP_OK; }
+
+void LatencyTracer::bindSlot(uint16_t endpointId) {}
+
+void LatencyTracer::discardSlot() {}
+
+void LatencyTracer::releaseSlot(uint16_t endpointId) {}
+
+int8_t LatencyTracer::currentSlot() { return -1; }
+
+void LatencyTracer::mark(uint16_t endpointId, TracePoint point) {}
+
+void LatencyTracer::markRelayEdge(int8_t slot) {}
+
+void LatencyTracer::markButtonPress(int8_t slot) {}
+
+size_t LatencyTracer::getEndpointCount() { return 0; }
+
+esp_err_t LatencyTracer::getStats(size_t index, LatencyStats *stats) { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t LatencyTracer::getHistogram(uint16_t endpointId, LatencyPath path, LatencyHistogram *histogram) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+void LatencyTracer::reset() {}
+
+void LatencyTracer::releaseAllSlots() {}
+
+#endif  // CONFIG_EM_LATENCY_TRACE
+
+uint32_t LatencyTracer::percentileUs(const LatencyHistogram &histogram, uint8_t percentile) {
+  if (histogram.count == 0) {
+    return 0;
+  }
+
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < LatencyHistogram::kBucketCount; i++) {
+    total += histogram.buckets[i];
+  }
+
+  uint32_t target = (total * percentile + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LatencyHistogram::kBucketCount; i++) {
+    seen += histogram.buckets[i];
+    if (seen >= target) {
+      uint32_t upper = 128UL << i;
+      return upper < histogram.maxUs ? upper : histogram.maxUs;
+    }
+  }
+  return histogram.maxUs;
+}
+
+void LatencyTracer::dump() {
+  static const char *pathNames[] = {"cmd->relay", "button->report"};
+
+  LatencyStats stats;
+  for (size_t i = 0; i < getEndpointCount(); i++) {
+    if (getStats(i, &stats) != ESP_OK) {
+      continue;
+    }
+    for (size_t path = 0; path < static_cast<size_t>(LatencyPath::Count); path++) {
+      const LatencyHistogram &histogram = stats.histograms[path];
+      ESP_LOGI(TAG, "ep %u %-14s n=%lu avg=%luus p50=%luus p99=%luus max=%luus act=%lu", stats.endpointId,
+               pathNames[path], (unsigned long)histogram.count,
+               (unsigned long)(histogram.count ? histogram.sumUs / histogram.count : 0),
+               (unsigned long)percentileUs(histogram, 50), (unsigned long)percentileUs(histogram, 99),
+               (unsigned long)histogram.maxUs, (unsigned long)stats.actuations);
+    }
+  }
+}
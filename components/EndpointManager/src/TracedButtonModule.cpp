@@ -0,0 +1,29 @@
+#include "TracedButtonModule.hpp"
+
+#include "LatencyTracer.hpp"
+
+TracedButtonModule::TracedButtonModule(uint8_t pin)
+    : ButtonModule(pin), m_traceSlot(LatencyTracer::currentSlot()), m_callbacks() {}
+
+void TracedButtonModule::setSinglePressCallback(void (*callback)(void *arg), void *arg) {
+  m_callbacks[0] = {this, callback, arg};
+  ButtonModule::setSinglePressCallback(onPress, &m_callbacks[0]);
+}
+
+void TracedButtonModule::setDoublePressCallback(void (*callback)(void *arg), void *arg) {
+  m_callbacks[1] = {this, callback, arg};
+  ButtonModule::setDoublePressCallback(onPress, &m_callbacks[1]);
+}
+
+void TracedButtonModule::setLongPressCallback(void (*callback)(void *arg), void *arg) {
+  m_callbacks[2] = {this, callback, arg};
+  ButtonModule::setLongPressCallback(onPress, &m_callbacks[2]);
+}
+
+void TracedButtonModule::onPress(void *arg) {
+  PressCallback *press = static_cast<PressCallback *>(arg);
+  LatencyTracer::markButtonPress(press->button->m_traceSlot);
+  if (press->callback != nullptr) {
+    press->callback(press->arg);
+  }
+}
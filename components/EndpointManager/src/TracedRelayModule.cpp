@@ -0,0 +1,19 @@
+#include "TracedRelayModule.hpp"
+
+#include "LatencyTracer.hpp"
+#include "WarmBootCache.hpp"
+
+TracedRelayModule::TracedRelayModule(uint8_t pin, bool restoreState)
+    : RelayModule(pin), m_traceSlot(LatencyTracer::currentSlot()), m_pin(pin) {
+  // the light stays on across a restart instead of going dark until Matter restores its attributes
+  bool power = false;
+  if (restoreState && WarmBootCache::isWarm() && WarmBootCache::getRelayState(pin, &power) == ESP_OK) {
+    RelayModule::setPower(power);
+  }
+}
+
+void TracedRelayModule::setPower(bool power) {
+  RelayModule::setPower(power);
+  WarmBootCache::setRelayState(m_pin, power);
+  LatencyTracer::markRelayEdge(m_traceSlot);
+}
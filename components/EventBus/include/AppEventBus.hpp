@@ -0,0 +1,149 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Application events carried by the bus.
+ */
+enum class AppEventType : uint8_t {
+  WifiStationStarted,               ///< Station interface started
+  WifiStationConnected,             ///< Station associated with an access point
+  WifiStationDisconnected,          ///< Station lost or failed an association, data holds the reason
+  WifiApStarted,                    ///< Soft access point started
+  WifiApStationConnected,           ///< A client joined the soft access point, data holds its association id
+  WifiApStationDisconnected,        ///< A client left the soft access point, data holds its association id
+  IpGotAddress,                     ///< Station got an IPv4 address, data holds it in network byte order
+  IpLostAddress,                    ///< Station lost its IPv4 address
+  MatterIpAddressChanged,           ///< Matter saw an IP address change, data holds the change type
+  MatterCommissioningComplete,      ///< Commissioning complete, data holds the fabric index
+  MatterFabricRemoved,              ///< Fabric removed, data holds the fabric index
+  MatterCommissioningWindowOpened,  ///< Commissioning window opened
+  ButtonPressed,                    ///< Control button pressed, data holds the ButtonPress
+  StorageProgramModeChanged,        ///< Program mode flag stored, data holds the flag
+  StorageAccessoriesChanged,        ///< Accessory configuration stored, data holds its version
+  Count,
+};
+
+/**
+ * @brief Press of the control button, the data of AppEventType::ButtonPressed.
+ */
+enum class ButtonPress : uint8_t {
+  Single,
+  Double,
+  Long,
+};
+
+/**
+ * @brief Set of event types a subscriber receives, one bit per AppEventType.
+ */
+using AppEventMask = uint32_t;
+
+/**
+ * @brief Get the mask of a single event type.
+ * @param type The event type.
+ * @return The mask.
+ */
+constexpr AppEventMask appEventMask(AppEventType type) { return 1UL << static_cast<uint8_t>(type); }
+
+static_assert(static_cast<size_t>(AppEventType::Count) <= 32, "AppEventMask has one bit per event type");
+
+/**
+ * @brief Event record, small enough to be copied through the queue.
+ */
+struct AppEvent {
+  AppEventType type;  ///< Event type
+  uint32_t data;      ///< Event specific data
+  uint32_t timeMs;    ///< Milliseconds since boot when the event was published
+};
+
+/**
+ * @brief Event bus counters since boot.
+ */
+struct AppEventBusStats {
+  uint32_t published;     ///< Events queued
+  uint32_t dropped;       ///< Events lost to a full queue
+  uint32_t dispatched;    ///< Events handed to the subscribers
+  uint32_t maxHandlerUs;  ///< Longest time a subscriber took for one event
+  uint16_t highWater;     ///< Most events waiting in the queue at once
+  uint16_t subscribers;   ///< Registered subscribers
+};
+
+/**
+ * @brief Application event bus decoupling the producers of events from the managers reacting to them.
+ *
+ * Events are published into a lock-free multi-producer ring buffer, so a producer never blocks and the
+ * Wi-Fi, IP, Matter and button handlers return right away. A single dispatcher task drains the queue and
+ * calls the subscribers whose mask has the event type, one event at a time and in publishing order, so the
+ * state transitions they drive never race each other.
+ *
+ * The Wi-Fi and IP events of the default event loop are forwarded by the bus itself.
+ */
+class AppEventBus {
+ public:
+  /**
+   * @brief Receives the events of a subscription, on the dispatcher task.
+   * @param event The event.
+   * @param context Context passed to subscribe().
+   */
+  using Handler = void (*)(const AppEvent& event, void* context);
+
+  static constexpr AppEventMask kWifiEvents =
+      appEventMask(AppEventType::WifiStationStarted) | appEventMask(AppEventType::WifiStationConnected) |
+      appEventMask(AppEventType::WifiStationDisconnected) | appEventMask(AppEventType::WifiApStarted) |
+      appEventMask(AppEventType::WifiApStationConnected) |
+      appEventMask(AppEventType::WifiApStationDisconnected);
+  static constexpr AppEventMask kIpEvents =
+      appEventMask(AppEventType::IpGotAddress) | appEventMask(AppEventType::IpLostAddress);
+  static constexpr AppEventMask kMatterEvents = appEventMask(AppEventType::MatterIpAddressChanged) |
+                                                appEventMask(AppEventType::MatterCommissioningComplete) |
+                                                appEventMask(AppEventType::MatterFabricRemoved) |
+                                                appEventMask(AppEventType::MatterCommissioningWindowOpened);
+  static constexpr AppEventMask kButtonEvents = appEventMask(AppEventType::ButtonPressed);
+  static constexpr AppEventMask kStorageEvents = appEventMask(AppEventType::StorageProgramModeChanged) |
+                                                 appEventMask(AppEventType::StorageAccessoriesChanged);
+
+  /**
+   * @brief Start the dispatcher task and forward the Wi-Fi and IP events of the default event loop,
+   * creating the loop if needed. Events published before are refused.
+   * @return ESP_OK on success, also when already started, an error from esp_err_t otherwise.
+   */
+  static esp_err_t start();
+
+  /**
+   * @brief Subscribe to a set of event types, before or after start().
+   * @param mask The event types.
+   * @param handler Called on the dispatcher task for each event of the set.
+   * @param context Passed to the handler.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the handler is null,
+   *         ESP_ERR_NO_MEM if CONFIG_EB_MAX_SUBSCRIBERS are already registered.
+   */
+  static esp_err_t subscribe(AppEventMask mask, Handler handler, void* context);
+
+  /**
+   * @brief Queue an event for the subscribers. Lock-free and never blocks, callable from any task.
+   * @param type The event type.
+   * @param data Event specific data.
+   * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the bus is not started,
+   *         ESP_ERR_NO_MEM if the queue is full and the event was dropped.
+   */
+  static esp_err_t publish(AppEventType type, uint32_t data = 0);
+
+  /**
+   * @brief Get the counters of the bus.
+   * @param[out] stats Pointer to a AppEventBusStats to store the counters.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is null.
+   */
+  static esp_err_t getStats(AppEventBusStats* stats);
+
+  /**
+   * @brief Get the name of an event type.
+   * @param type The event type.
+   * @return A static, human readable name.
+   */
+  static const char* eventName(AppEventType type);
+
+ private:
+  AppEventBus() = delete;
+};
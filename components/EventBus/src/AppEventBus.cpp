@@ -0,0 +1,281 @@
+#include "AppEventBus.hpp"
+
+#include <esp_event.h>
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+#include "BootTimeline.hpp"
+
+static const char *TAG = "AppEventBus";
+
+namespace {
+
+constexpr uint32_t kQueueLength = CONFIG_EB_QUEUE_LENGTH;
+static_assert((kQueueLength & (kQueueLength - 1)) == 0, "CONFIG_EB_QUEUE_LENGTH must be a power of two");
+
+/**
+ * @brief Slot of the ring buffer. The sequence tells its state for a position p of the slot:
+ * p when free to be written, p + 1 once written and not read yet.
+ */
+struct Cell {
+  std::atomic<uint32_t> sequence;
+  AppEvent event;
+};
+
+struct Subscriber {
+  AppEventMask mask;
+  AppEventBus::Handler handler;
+  void *context;
+};
+
+Cell s_cells[kQueueLength];
+std::atomic<uint32_t> s_enqueuePos(0);
+uint32_t s_dequeuePos = 0;  // only touched by the dispatcher
+
+Subscriber s_subscribers[CONFIG_EB_MAX_SUBSCRIBERS];
+std::atomic<uint32_t> s_subscriberCount(0);
+portMUX_TYPE s_subscribeLock = portMUX_INITIALIZER_UNLOCKED;
+
+TaskHandle_t s_dispatcher = nullptr;
+std::atomic<bool> s_running(false);
+
+std::atomic<uint32_t> s_published(0);
+std::atomic<uint32_t> s_dropped(0);
+std::atomic<uint32_t> s_dispatched(0);
+std::atomic<uint32_t> s_maxHandlerUs(0);
+std::atomic<uint32_t> s_highWater(0);
+
+bool dequeue(AppEvent *event) {
+  Cell &cell = s_cells[s_dequeuePos & (kQueueLength - 1)];
+  // a producer that claimed the slot but did not finish writing it yet notifies again once it did
+  if (cell.sequence.load(std::memory_order_acquire) != s_dequeuePos + 1) {
+    return false;
+  }
+  *event = cell.event;
+  cell.sequence.store(s_dequeuePos + kQueueLength, std::memory_order_release);
+  s_dequeuePos++;
+  return true;
+}
+
+void dispatch(const AppEvent &event) {
+  AppEventMask bit = appEventMask(event.type);
+  uint32_t count = s_subscriberCount.load(std::memory_order_acquire);
+  for (uint32_t i = 0; i < count; i++) {
+    const Subscriber &subscriber = s_subscribers[i];
+    if ((subscriber.mask & bit) == 0) {
+      continue;
+    }
+    int64_t start = esp_timer_get_time();
+    subscriber.handler(event, subscriber.context);
+    uint32_t elapsed = static_cast<uint32_t>(esp_timer_get_time() - start);
+    if (elapsed > s_maxHandlerUs.load(std::memory_order_relaxed)) {
+      s_maxHandlerUs.store(elapsed, std::memory_order_relaxed);
+    }
+  }
+  s_dispatched.fetch_add(1, std::memory_order_relaxed);
+}
+
+void dispatcherTask(void *arg) {
+  AppEvent event;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t waiting = s_enqueuePos.load(std::memory_order_relaxed) - s_dequeuePos;
+    if (waiting > s_highWater.load(std::memory_order_relaxed)) {
+      s_highWater.store(waiting, std::memory_order_relaxed);
+    }
+    while (dequeue(&event)) {
+      dispatch(event);
+    }
+  }
+}
+
+/* Runs on the event loop task, only translates the event into a record */
+void forwardSystemEvent(void *arg, esp_event_base_t eventBase, int32_t eventId, void *eventData) {
+  if (eventBase == WIFI_EVENT) {
+    switch (eventId) {
+      case WIFI_EVENT_STA_START:
+        AppEventBus::publish(AppEventType::WifiStationStarted);
+        break;
+      case WIFI_EVENT_STA_CONNECTED:
+        BootTimeline::mark(BootPhase::WifiConnected);
+        AppEventBus::publish(AppEventType::WifiStationConnected);
+        break;
+      case WIFI_EVENT_STA_DISCONNECTED:
+        AppEventBus::publish(AppEventType::WifiStationDisconnected,
+                             static_cast<wifi_event_sta_disconnected_t *>(eventData)->reason);
+        break;
+      case WIFI_EVENT_AP_START:
+        AppEventBus::publish(AppEventType::WifiApStarted);
+        break;
+      case WIFI_EVENT_AP_STACONNECTED:
+        AppEventBus::publish(AppEventType::WifiApStationConnected,
+                             static_cast<wifi_event_ap_staconnected_t *>(eventData)->aid);
+        break;
+      case WIFI_EVENT_AP_STADISCONNECTED:
+        AppEventBus::publish(AppEventType::WifiApStationDisconnected,
+                             static_cast<wifi_event_ap_stadisconnected_t *>(eventData)->aid);
+        break;
+      default:
+        break;
+    }
+  } else if (eventBase == IP_EVENT) {
+    if (eventId == IP_EVENT_STA_GOT_IP) {
+      BootTimeline::mark(BootPhase::IpAcquired);
+      AppEventBus::publish(AppEventType::IpGotAddress,
+                           static_cast<ip_event_got_ip_t *>(eventData)->ip_info.ip.addr);
+    } else if (eventId == IP_EVENT_STA_LOST_IP) {
+      AppEventBus::publish(AppEventType::IpLostAddress);
+    }
+  }
+}
+
+}  // namespace
+
+esp_err_t AppEventBus::start() {
+  if (s_running.load()) {
+    return ESP_OK;
+  }
+
+  for (uint32_t i = 0; i < kQueueLength; i++) {
+    s_cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  s_enqueuePos.store(0, std::memory_order_relaxed);
+  s_dequeuePos = 0;
+
+  if (xTaskCreate(dispatcherTask, "appEvents", CONFIG_EB_DISPATCH_STACK_SIZE, nullptr,
+                  CONFIG_EB_DISPATCH_PRIORITY, &s_dispatcher) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create the dispatcher task");
+    return ESP_ERR_NO_MEM;
+  }
+  s_running.store(true, std::memory_order_release);
+
+  esp_err_t err = esp_event_loop_create_default();
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(err));
+    return err;
+  }
+  err = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &forwardSystemEvent, nullptr);
+  if (err == ESP_OK) {
+    err = esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, &forwardSystemEvent, nullptr);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to register the system event forwarder: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  ESP_LOGI(TAG, "Event bus started, %u subscribers", (unsigned)s_subscriberCount.load());
+  return ESP_OK;
+}
+
+esp_err_t AppEventBus::subscribe(AppEventMask mask, Handler handler, void *context) {
+  if (handler == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // the dispatcher reads the table without a lock, an entry is published by the count that covers it
+  esp_err_t err = ESP_ERR_NO_MEM;
+  portENTER_CRITICAL(&s_subscribeLock);
+  uint32_t count = s_subscriberCount.load(std::memory_order_relaxed);
+  if (count < CONFIG_EB_MAX_SUBSCRIBERS) {
+    s_subscribers[count] = {mask, handler, context};
+    s_subscriberCount.store(count + 1, std::memory_order_release);
+    err = ESP_OK;
+  }
+  portEXIT_CRITICAL(&s_subscribeLock);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "No room for another subscriber");
+  }
+  return err;
+}
+
+esp_err_t AppEventBus::publish(AppEventType type, uint32_t data) {
+  if (!s_running.load(std::memory_order_acquire)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // claim the next position, a slot still holding an unread event means the queue is full
+  uint32_t pos = s_enqueuePos.load(std::memory_order_relaxed);
+  Cell *cell;
+  while (true) {
+    cell = &s_cells[pos & (kQueueLength - 1)];
+    int32_t diff = static_cast<int32_t>(cell->sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (s_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      s_dropped.fetch_add(1, std::memory_order_relaxed);
+      return ESP_ERR_NO_MEM;
+    } else {
+      pos = s_enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->event.type = type;
+  cell->event.data = data;
+  cell->event.timeMs = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+  cell->sequence.store(pos + 1, std::memory_order_release);
+
+  s_published.fetch_add(1, std::memory_order_relaxed);
+  xTaskNotifyGive(s_dispatcher);
+  return ESP_OK;
+}
+
+esp_err_t AppEventBus::getStats(AppEventBusStats *stats) {
+  if (stats == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  stats->published = s_published.load(std::memory_order_relaxed);
+  stats->dropped = s_dropped.load(std::memory_order_relaxed);
+  stats->dispatched = s_dispatched.load(std::memory_order_relaxed);
+  stats->maxHandlerUs = s_maxHandlerUs.load(std::memory_order_relaxed);
+  stats->highWater = static_cast<uint16_t>(s_highWater.load(std::memory_order_relaxed));
+  stats->subscribers = static_cast<uint16_t>(s_subscriberCount.load(std::memory_order_relaxed));
+  return ESP_OK;
+}
+
+const char *AppEventBus::eventName(AppEventType type) {
+  switch (type) {
+    case AppEventType::WifiStationStarted:
+      return "Wi-Fi station started";
+    case AppEventType::WifiStationConnected:
+      return "Wi-Fi station connected";
+    case AppEventType::WifiStationDisconnected:
+      return "Wi-Fi station disconnected";
+    case AppEventType::WifiApStarted:
+      return "Wi-Fi access point started";
+    case AppEventType::WifiApStationConnected:
+      return "Wi-Fi access point client connected";
+    case AppEventType::WifiApStationDisconnected:
+      return "Wi-Fi access point client disconnected";
+    case AppEventType::IpGotAddress:
+      return "IP address assigned";
+    case AppEventType::IpLostAddress:
+      return "IP address lost";
+    case AppEventType::MatterIpAddressChanged:
+      return "Matter IP address changed";
+    case AppEventType::MatterCommissioningComplete:
+      return "Matter commissioning complete";
+    case AppEventType::MatterFabricRemoved:
+      return "Matter fabric removed";
+    case AppEventType::MatterCommissioningWindowOpened:
+      return "Matter commissioning window opened";
+    case AppEventType::ButtonPressed:
+      return "Control button pressed";
+    case AppEventType::StorageProgramModeChanged:
+      return "Program mode stored";
+    case AppEventType::StorageAccessoriesChanged:
+      return "Accessories stored";
+    default:
+      return "Unknown";
+  }
+}
@@ -1,9 +1,6 @@
 #pragma once
 
-#include <esp_event.h>
-#include <esp_wifi.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
+#include <esp_timer.h>
 
 #include <ButtonModuleInterface.hpp>
 #include <RelayModuleInterface.hpp>
@@ -11,6 +8,9 @@
 #include "StatusControlManagerInterface.hpp"
 #include "StorageManagerInterface.hpp"
 
+struct AppEvent;
+enum class ButtonPress : uint8_t;
+
 /**
  * @brief Manages the status of the device, including Wi-Fi events and status modes.
  */
@@ -48,24 +48,56 @@ class StatusControlManager : public StatusControlManagerInterface {
    */
   void start() override;
 
+  /**
+   * @brief Mark a freshly updated firmware valid and cancel its rollback.
+   *
+   * Called on a health signal only: the config web server serving, an IPv4 address, or the Matter stack
+   * getting an address or opening its commissioning window. Until then the bootloader boots the previous
+   * firmware again after any reset, and the rollback timer forces that reset if the new firmware hangs.
+   */
+  void confirmFirmware() override;
+
+  /**
+   * @brief Handle the program mode press without a restart into program mode, and listen to the control
+   * button.
+   *
+   * Lets the running device open a configuration session next to Matter. The single and long presses
+   * keep restarting and factory resetting the device.
+   * @param handler Called on the program mode press, from the event bus dispatcher.
+   * @param context Passed to the handler.
+   */
+  void setLiveConfigHandler(LiveConfigHandler handler, void* context) override;
+
  private:
   DeviceStatusMode m_currentStatusMode;       ///< Current status mode of the device
   StorageManagerInterface* m_storageManager;  ///< Pointer to the storage manager interface
   RelayModuleInterface* m_relayModule;        ///< Pointer to the relay module interface
   ButtonModuleInterface* m_buttonModule;      ///< Pointer to the button module interface
-  TaskHandle_t* m_blinkTaskHandle;            ///< Handle of the blink task
+  esp_timer_handle_t m_ledTimer;              ///< Plays the blink pattern of the status mode
+  uint8_t m_ledStep;                          ///< Step of the blink pattern played next
+  bool m_ledRestart;                          ///< Start the pattern over, the status mode changed
+  esp_timer_handle_t m_rollbackTimer;         ///< Reboots into the previous firmware if not confirmed
+  LiveConfigHandler m_liveConfigHandler;      ///< Replaces the restart into program mode, if set
+  void* m_liveConfigContext;                  ///< Context of the live config handler
   bool internalRelayModule;                   ///< Flag to indicate if the relay module is internal
   bool internalButtonModule;                  ///< Flag to indicate if the button module is internal
 
   /**
-   * @brief Initialize the Wi-Fi event listener.
+   * @brief Set the button callbacks.
    */
-  void initWiFiEventListener();
+  void setButtonCallbacks();
 
   /**
-   * @brief Set the button callbacks.
+   * @brief Hand a press of the control button to the event bus, or handle it right away without one.
+   * @param press The press.
    */
-  void setButtonCallbacks();
+  void publishButtonPress(ButtonPress press);
+
+  /**
+   * @brief Run the action of a press of the control button.
+   * @param press The press.
+   */
+  void handleButtonPress(ButtonPress press);
 
   /**
    * @brief Callback for the button SINGLE press event.
@@ -83,23 +115,28 @@ class StatusControlManager : public StatusControlManagerInterface {
   void factoryResetCallBack();
 
   /**
-   * @brief Wi-Fi event handler.
-   * @param arg Pointer to the argument.
-   * @param eventBase Base of the event.
-   * @param eventId ID of the event.
-   * @param eventData Pointer to the event data.
+   * @brief Event bus handler, follows the Wi-Fi and IP state, confirms the firmware on the health events and
+   * runs the button presses.
+   * @param event The event.
+   * @param context Pointer to the manager.
+   */
+  static void onAppEvent(const AppEvent& event, void* context);
+
+  /**
+   * @brief Arm the rollback timer if the running firmware is still pending verification.
    */
-  static void wifiEventHandler(void* arg, esp_event_base_t eventBase, int32_t eventId, void* eventData);
+  void armFirmwareRollback();
 
   /**
-   * @brief Task to blink the LED based on the current status mode.
+   * @brief Set the LED for the next step of the blink pattern and arm the LED timer for its duration.
+   * Runs on the esp_timer task, which is the only one driving the LED.
    */
-  void ledBlinkingTask();
+  void playLedPattern();
 
   /**
-   * @brief Start the LED blinking task based on the current status mode.
+   * @brief Play the blink pattern of the current status mode from its start.
    */
-  void startLedTask();
+  void restartLedPattern();
 
   // Delete the copy constructor and assignment operator
   StatusControlManager(const StatusControlManager&) = delete;
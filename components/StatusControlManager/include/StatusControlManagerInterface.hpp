@@ -10,6 +10,12 @@ enum class DeviceStatusMode {
   InProgramMode,         ///< Device is in program mode
 };
 
+/**
+ * @brief Handler of the program mode press while the device runs Matter.
+ * @param context Context passed to StatusControlManagerInterface::setLiveConfigHandler().
+ */
+using LiveConfigHandler = void (*)(void* context);
+
 /**
  * @brief Interface for the Status Control Manager.
  */
@@ -36,4 +42,17 @@ class StatusControlManagerInterface {
    * @brief Start the status control manager.
    */
   virtual void start() = 0;
+
+  /**
+   * @brief Keep the running firmware, an update that reached this point is not rolled back.
+   */
+  virtual void confirmFirmware() = 0;
+
+  /**
+   * @brief Handle the program mode press without a restart into program mode, and listen to the control
+   * button.
+   * @param handler Called on the program mode press, from the button task.
+   * @param context Passed to the handler.
+   */
+  virtual void setLiveConfigHandler(LiveConfigHandler handler, void* context) = 0;
 };
@@ -1,12 +1,42 @@
 #include "StatusControlManager.hpp"
 
 #include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
 
 #include <ButtonModule.hpp>
 #include <RelayModule.hpp>
 
+#include "AppEventBus.hpp"
+
 static const char* TAG = "StatusControlManager";
 
+/**
+ * @brief Blink pattern of a status mode. The steps are durations in milliseconds, alternately on and off
+ * starting with on, played in a loop. A pattern without steps keeps the LED on.
+ */
+struct LedPattern {
+  const char* name;
+  uint16_t steps[4];
+  uint8_t stepCount;
+};
+
+// indexed by DeviceStatusMode
+static const LedPattern kLedPatterns[] = {
+    {"waiting for pairing", {250, 250}, 2},
+    {"waiting for connection", {250, 1000}, 2},
+    {"running as expected", {}, 0},
+    {"in program mode", {250, 100, 250, 1000}, 4},
+};
+
+// guards the status mode and the pattern step, shared by the callers of updateStatusMode() and the LED timer
+static portMUX_TYPE s_ledLock = portMUX_INITIALIZER_UNLOCKED;
+
+// the Matter stack is reachable by its controllers or for commissioning, an updated firmware is healthy
+static constexpr AppEventMask kMatterHealthEvents = appEventMask(AppEventType::MatterIpAddressChanged) |
+                                                    appEventMask(AppEventType::MatterCommissioningWindowOpened);
+
 StatusControlManager::StatusControlManager(StorageManagerInterface* storageManager,
                                            RelayModuleInterface* relayModule,
                                            ButtonModuleInterface* buttonModule)
@@ -14,7 +44,12 @@ StatusControlManager::StatusControlManager(StorageManagerInterface* storageManag
       m_storageManager(storageManager),
       m_relayModule(relayModule),
       m_buttonModule(buttonModule),
-      m_blinkTaskHandle(nullptr),
+      m_ledTimer(nullptr),
+      m_ledStep(0),
+      m_ledRestart(false),
+      m_rollbackTimer(nullptr),
+      m_liveConfigHandler(nullptr),
+      m_liveConfigContext(nullptr),
       internalRelayModule(false),
       internalButtonModule(false) {
   if (m_relayModule == nullptr) {
@@ -29,12 +64,30 @@ StatusControlManager::StatusControlManager(StorageManagerInterface* storageManag
         new ButtonModule(CONFIG_S_C_M_CONTROL_BUTTON_PIN, 1, CONFIG_S_C_M_CONTROL_BUTTON_DEBOUNCE_DELAY,
                          CONFIG_S_C_M_CONTROL_BUTTON_LONG_PRESS_DELAY);
   }
+
+  esp_timer_create_args_t args = {};
+  args.callback = [](void* arg) { static_cast<StatusControlManager*>(arg)->playLedPattern(); };
+  args.arg = this;
+  args.name = "statusLed";
+  if (esp_timer_create(&args, &m_ledTimer) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create the status LED timer");
+    m_ledTimer = nullptr;
+  }
+  // the presses are handled on the dispatcher, off the button task
+  AppEventBus::subscribe(AppEventBus::kButtonEvents | kMatterHealthEvents, &onAppEvent, this);
+  armFirmwareRollback();
 }
 
 StatusControlManager::~StatusControlManager() {
-  if (m_blinkTaskHandle != nullptr) {
-    vTaskDelete(*m_blinkTaskHandle);
-    m_blinkTaskHandle = nullptr;
+  if (m_rollbackTimer != nullptr) {
+    esp_timer_stop(m_rollbackTimer);
+    esp_timer_delete(m_rollbackTimer);
+    m_rollbackTimer = nullptr;
+  }
+  if (m_ledTimer != nullptr) {
+    esp_timer_stop(m_ledTimer);
+    esp_timer_delete(m_ledTimer);
+    m_ledTimer = nullptr;
   }
   if (m_relayModule != nullptr && internalRelayModule) {
     delete m_relayModule;
@@ -46,118 +99,173 @@ StatusControlManager::~StatusControlManager() {
   }
 }
 
-DeviceStatusMode StatusControlManager::getCurrentStatusMode() const { return m_currentStatusMode; }
+DeviceStatusMode StatusControlManager::getCurrentStatusMode() const {
+  portENTER_CRITICAL(&s_ledLock);
+  DeviceStatusMode mode = m_currentStatusMode;
+  portEXIT_CRITICAL(&s_ledLock);
+  return mode;
+}
 
 void StatusControlManager::updateStatusMode(DeviceStatusMode mode) {
+  portENTER_CRITICAL(&s_ledLock);
   m_currentStatusMode = mode;
-  ESP_LOGI(TAG, "Status mode changed to:");
-  startLedTask();
+  m_ledRestart = true;
+  portEXIT_CRITICAL(&s_ledLock);
+  ESP_LOGI(TAG, "Status mode changed to: %s", kLedPatterns[static_cast<size_t>(mode)].name);
+  restartLedPattern();
 }
 
-void StatusControlManager::start() {
-  initWiFiEventListener();
-  updateStatusMode(DeviceStatusMode::WaitingForPairing);
-  setButtonCallbacks();
-}
+void StatusControlManager::confirmFirmware() {
+  esp_ota_img_states_t state;
+  if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK ||
+      state != ESP_OTA_IMG_PENDING_VERIFY) {
+    return;
+  }
 
-void StatusControlManager::initWiFiEventListener() {
-  ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifiEventHandler, this));
-  ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifiEventHandler, this));
+  esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to confirm the firmware: %s", esp_err_to_name(err));
+    return;
+  }
+  if (m_rollbackTimer != nullptr) {
+    esp_timer_stop(m_rollbackTimer);
+  }
+  ESP_LOGI(TAG, "Firmware %s confirmed", esp_app_get_description()->version);
 }
 
-void StatusControlManager::wifiEventHandler(void* arg, esp_event_base_t eventBase, int32_t eventId,
-                                            void* eventData) {
-  StatusControlManager* manager = static_cast<StatusControlManager*>(arg);
+void StatusControlManager::armFirmwareRollback() {
+  esp_ota_img_states_t state;
+  if (CONFIG_S_C_M_FIRMWARE_CONFIRM_TIMEOUT == 0 ||
+      esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK ||
+      state != ESP_OTA_IMG_PENDING_VERIFY) {
+    return;
+  }
 
-  if (eventBase == WIFI_EVENT) {
-    if (eventId == WIFI_EVENT_STA_DISCONNECTED || eventId == WIFI_EVENT_STA_START) {
-      manager->updateStatusMode(DeviceStatusMode::WaitingForConnection);
-    } else if (eventId == WIFI_EVENT_AP_START) {
-      manager->updateStatusMode(DeviceStatusMode::InProgramMode);
-    }
-  } else if (eventBase == IP_EVENT) {
-    if (eventId == IP_EVENT_STA_GOT_IP) {
-      manager->updateStatusMode(DeviceStatusMode::RunningAsExpected);
-    }
+  /* A crash resets into the previous firmware on its own, a hang needs the reset forced */
+  esp_timer_create_args_t args = {};
+  args.callback = [](void* arg) {
+    ESP_LOGE(TAG, "Firmware not confirmed in time, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  };
+  args.name = "fwRollback";
+  if (esp_timer_create(&args, &m_rollbackTimer) != ESP_OK ||
+      esp_timer_start_once(m_rollbackTimer, CONFIG_S_C_M_FIRMWARE_CONFIRM_TIMEOUT * 1000000ULL) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to arm the firmware rollback timer");
+    return;
   }
+  ESP_LOGW(TAG, "Firmware %s is on trial for %d s", esp_app_get_description()->version,
+           CONFIG_S_C_M_FIRMWARE_CONFIRM_TIMEOUT);
 }
 
-void StatusControlManager::startLedTask() {
-  m_relayModule->setPower(false);
-  if (m_blinkTaskHandle != nullptr) {
-    vTaskDelete(*m_blinkTaskHandle);
-    m_blinkTaskHandle = nullptr;
-  }
+void StatusControlManager::setLiveConfigHandler(LiveConfigHandler handler, void* context) {
+  m_liveConfigHandler = handler;
+  m_liveConfigContext = context;
+  setButtonCallbacks();
+}
 
-  xTaskCreate(
-      [](void* arg) {
-        StatusControlManager* manager = static_cast<StatusControlManager*>(arg);
-        manager->ledBlinkingTask();
-      },
-      "ledBlinkingTask", CONFIG_S_C_M_BLINKING_TASK_STACK_SIZE, this, CONFIG_S_C_M_BLINKING_TASK_PRIORITY,
-      m_blinkTaskHandle);
+void StatusControlManager::start() {
+  ESP_ERROR_CHECK(
+      AppEventBus::subscribe(AppEventBus::kWifiEvents | AppEventBus::kIpEvents, &onAppEvent, this));
+  updateStatusMode(DeviceStatusMode::WaitingForPairing);
+  setButtonCallbacks();
 }
 
-void StatusControlManager::ledBlinkingTask() {
-  uint16_t delay1 = 0;
-  uint16_t delay2 = 0;
-  uint16_t delay3 = 0;
-  uint16_t delay4 = 0;
-  switch (m_currentStatusMode) {
-    case DeviceStatusMode::WaitingForPairing:
-      delay1 = 250;
-      delay2 = 250;
-      delay3 = 250;
-      delay4 = 250;
+void StatusControlManager::onAppEvent(const AppEvent& event, void* context) {
+  StatusControlManager* manager = static_cast<StatusControlManager*>(context);
+
+  switch (event.type) {
+    case AppEventType::WifiStationStarted:
+    case AppEventType::WifiStationDisconnected:
+      manager->updateStatusMode(DeviceStatusMode::WaitingForConnection);
+      break;
+    case AppEventType::WifiApStarted:
+      manager->updateStatusMode(DeviceStatusMode::InProgramMode);
+      break;
+    case AppEventType::IpGotAddress:
+      manager->updateStatusMode(DeviceStatusMode::RunningAsExpected);
+      manager->confirmFirmware();
       break;
-    case DeviceStatusMode::WaitingForConnection:
-      delay1 = 250;
-      delay2 = 1000;
-      delay3 = 250;
-      delay4 = 1000;
+    case AppEventType::MatterIpAddressChanged:
+    case AppEventType::MatterCommissioningWindowOpened:
+      manager->confirmFirmware();
       break;
-    case DeviceStatusMode::InProgramMode:
-      delay1 = 250;
-      delay2 = 100;
-      delay3 = 250;
-      delay4 = 1000;
+    case AppEventType::ButtonPressed:
+      manager->handleButtonPress(static_cast<ButtonPress>(event.data));
       break;
     default:
-      m_relayModule->setPower(true);
-      m_blinkTaskHandle = nullptr;
-      vTaskDelete(nullptr);
       break;
   }
+}
 
-  while (true) {
-    m_relayModule->setPower(true);
-    vTaskDelay(delay1 / portTICK_PERIOD_MS);
-    m_relayModule->setPower(false);
-    vTaskDelay(delay2 / portTICK_PERIOD_MS);
+void StatusControlManager::restartLedPattern() {
+  if (m_ledTimer == nullptr) {
+    return;
+  }
+  /* The first step is played on the timer task like the others. If the callback re-arms the timer in
+     between, the restart flag still starts the new pattern over on its next step */
+  esp_timer_stop(m_ledTimer);
+  esp_timer_start_once(m_ledTimer, 0);
+}
+
+void StatusControlManager::playLedPattern() {
+  portENTER_CRITICAL(&s_ledLock);
+  if (m_ledRestart) {
+    m_ledStep = 0;
+    m_ledRestart = false;
+  }
+  const LedPattern& pattern = kLedPatterns[static_cast<size_t>(m_currentStatusMode)];
+  uint8_t step = m_ledStep;
+  if (pattern.stepCount > 0) {
+    m_ledStep = (step + 1) % pattern.stepCount;
+  }
+  portEXIT_CRITICAL(&s_ledLock);
+
+  if (pattern.stepCount == 0) {
     m_relayModule->setPower(true);
-    vTaskDelay(delay3 / portTICK_PERIOD_MS);
-    m_relayModule->setPower(false);
-    vTaskDelay(delay4 / portTICK_PERIOD_MS);
+    return;
   }
+  m_relayModule->setPower(step % 2 == 0);
+  esp_timer_start_once(m_ledTimer, pattern.steps[step] * 1000ULL);
 }
 
 void StatusControlManager::setButtonCallbacks() {
   m_buttonModule->setSinglePressCallback([](void* arg) {
     StatusControlManager* manager = static_cast<StatusControlManager*>(arg);
-    manager->resetartCallBack();
+    manager->publishButtonPress(ButtonPress::Single);
   });
 
   m_buttonModule->setDoublePressCallback([](void* arg) {
     StatusControlManager* manager = static_cast<StatusControlManager*>(arg);
-    manager->programModeCallBack();
+    manager->publishButtonPress(ButtonPress::Double);
   });
 
   m_buttonModule->setLongPressCallback([](void* arg) {
     StatusControlManager* manager = static_cast<StatusControlManager*>(arg);
-    manager->factoryResetCallBack();
+    manager->publishButtonPress(ButtonPress::Long);
   });
 }
 
+void StatusControlManager::publishButtonPress(ButtonPress press) {
+  // a press must never be lost, without the bus it is handled right here
+  if (AppEventBus::publish(AppEventType::ButtonPressed, static_cast<uint32_t>(press)) != ESP_OK) {
+    handleButtonPress(press);
+  }
+}
+
+void StatusControlManager::handleButtonPress(ButtonPress press) {
+  switch (press) {
+    case ButtonPress::Single:
+      resetartCallBack();
+      break;
+    case ButtonPress::Double:
+      programModeCallBack();
+      break;
+    case ButtonPress::Long:
+      factoryResetCallBack();
+      break;
+  }
+}
+
 void StatusControlManager::resetartCallBack() {
   if (m_storageManager != nullptr) {
     m_storageManager->setProgramMode(false);
@@ -166,6 +274,10 @@ void StatusControlManager::resetartCallBack() {
 }
 
 void StatusControlManager::programModeCallBack() {
+  if (m_liveConfigHandler != nullptr) {
+    m_liveConfigHandler(m_liveConfigContext);
+    return;
+  }
   if (m_storageManager != nullptr) {
     m_storageManager->setProgramMode(true);
   }
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "StorageManagerInterface.hpp"
 
+struct AccessoryDbMeta;
+
 /**
  * @brief Manages storage operations using NVS.
  */
@@ -76,22 +80,24 @@ class StorageManager : public StorageManagerInterface {
   esp_err_t getDeviceNameLength(size_t* length) override;
 
   /**
-   * @brief Sets the accessory JSON configuration.
+   * @brief Gets the accessory JSON configuration, an array of accessory objects each with its "id".
    *
-   * @param json Pointer to a char array containing the JSON configuration.
-   * @param length Length of the JSON configuration.
+   * @param[out] json Pointer to a char array to store the JSON configuration.
+   * @param length Maximum length of the JSON configuration to be retrieved.
    * @return ESP_OK on success, an error from esp_err_t otherwise.
    */
-  esp_err_t setAccessoryJson(const char* json, size_t length) override;
+  esp_err_t getAccessoryJson(char* json, size_t length) override;
 
   /**
-   * @brief Gets the accessory JSON configuration.
+   * @brief Gets a copy of the accessory JSON configuration, sized and read in one step so a change in
+   * between cannot make the buffer too small.
    *
-   * @param[out] json Pointer to a char array to store the JSON configuration.
-   * @param length Maximum length of the JSON configuration to be retrieved.
-   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   * @param[out] json Set to the NUL-terminated configuration, to be released with free().
+   * @param[out] length Set to the length of the configuration without the NUL, may be nullptr.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no configuration is stored, ESP_ERR_NO_MEM if the
+   *         copy cannot be allocated, an error from esp_err_t otherwise.
    */
-  esp_err_t getAccessoryJson(char* json, size_t length) override;
+  esp_err_t getAccessoryJsonCopy(char** json, size_t* length) override;
 
   /**
    * @brief Gets the length of the accessory JSON configuration.
@@ -101,7 +107,157 @@ class StorageManager : public StorageManagerInterface {
    */
   esp_err_t getAccessoryJsonLength(size_t* length) override;
 
+  /**
+   * @brief Reads the accessory JSON configuration in buffer-sized pieces, without holding it whole.
+   *
+   * The accessory DB stays locked until the reader returned for the last piece, it must not wait for
+   * another task changing the accessories.
+   *
+   * @param reader Function called with each piece, in order.
+   * @param context Passed to the reader.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no configuration is stored, the reader's error
+   *         if it stopped the read, an error from esp_err_t otherwise.
+   */
+  esp_err_t readAccessoryJson(AccessoryJsonReader reader, void* context) override;
+
+  /**
+   * @brief Gets the version of the accessory JSON configuration, 0 for a configuration saved before
+   * versions were recorded.
+   *
+   * @param[out] version Pointer to a uint32_t to store the version.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no configuration is stored,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t getAccessoryJsonVersion(uint32_t* version) override;
+
+  /**
+   * @brief Reads one accessory object, with its "id".
+   *
+   * @param id Id of the accessory.
+   * @param reader Function called with the accessory.
+   * @param context Passed to the reader.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such accessory,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t readAccessory(uint16_t id, AccessoryJsonReader reader, void* context) override;
+
+  /**
+   * @brief Creates or replaces one accessory, leaving the others untouched.
+   *
+   * @param[in,out] id Id of the accessory to replace, or 0 to create one and receive its id.
+   * @param json The accessory object without its "id".
+   * @param length Length of json.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no accessory to replace,
+   *         ESP_ERR_NO_MEM if no more accessories can be created, an error from esp_err_t otherwise.
+   */
+  esp_err_t setAccessory(uint16_t* id, const char* json, size_t length) override;
+
+  /**
+   * @brief Deletes one accessory, leaving the others untouched.
+   *
+   * @param id Id of the accessory.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such accessory,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t deleteAccessory(uint16_t id) override;
+
+  /**
+   * @brief Starts replacing the whole accessory JSON configuration.
+   *
+   * The accessories are staged next to the stored configuration, which stays readable until
+   * commitAccessoryJsonWrite() replaces it in a single step.
+   *
+   * @return ESP_OK on success, ESP_ERR_INVALID_STATE if a write is already in progress,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t beginAccessoryJsonWrite() override;
+
+  /**
+   * @brief Adds an accessory to the configuration write in progress.
+   *
+   * @param id Id of the accessory, or 0 to give it a new one.
+   * @param json The accessory object without its "id".
+   * @param length Length of json.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the id is already staged,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t stageAccessory(uint16_t id, const char* json, size_t length) override;
+
+  /**
+   * @brief Makes the accessory JSON write in progress the stored configuration.
+   *
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  esp_err_t commitAccessoryJsonWrite() override;
+
+  /**
+   * @brief Drops the accessory JSON write in progress, the stored configuration is left untouched.
+   *
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  esp_err_t abortAccessoryJsonWrite() override;
+
+  /**
+   * @brief Sets the credentials of the network the station joins.
+   *
+   * @param credentials The credentials.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  esp_err_t setWifiCredentials(const WifiCredentials* credentials) override;
+
+  /**
+   * @brief Gets the credentials of the network the station joins.
+   *
+   * @param[out] credentials Pointer to a WifiCredentials to store the credentials.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no credentials are stored,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t getWifiCredentials(WifiCredentials* credentials) override;
+
+  /**
+   * @brief Sets the access point of the last successful station connection.
+   *
+   * @param cache The access point, or nullptr to forget it.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  esp_err_t setWifiConnectionCache(const WifiConnectionCache* cache) override;
+
+  /**
+   * @brief Gets the access point of the last successful station connection.
+   *
+   * @param[out] cache Pointer to a WifiConnectionCache to store the access point.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if none is stored, an error from esp_err_t otherwise.
+   */
+  esp_err_t getWifiConnectionCache(WifiConnectionCache* cache) override;
+
+  /**
+   * @brief Gets the storage operation counters.
+   *
+   * @param[out] stats Pointer to a StorageStats to store the counters.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  esp_err_t getStats(StorageStats* stats) override;
+
  private:
+  StorageStats m_stats;  ///< Operation counters
+
+  uint32_t m_writeHandle;        ///< NVS handle of the accessory JSON write in progress
+  AccessoryDbMeta* m_writeMeta;  ///< Index of the staged accessories, nullptr when no write is in progress
+
+  // Serializes the accessory DB, the web server, the HTTP workers and the live config session use it
+  // from their own tasks. Changes hold it across the read-modify-write of the index, reads while they
+  // walk the records the index lists
+  StaticSemaphore_t m_accessoryLockBuffer;
+  SemaphoreHandle_t m_accessoryLock;
+
+  // drop the staged accessories, called with the accessory lock held
+  void dropAccessoryJsonWrite();
+
+  // store a fixed size blob under key, or erase the key when data is nullptr
+  esp_err_t writeBlob(const char* key, const void* data, size_t length);
+  // read a fixed size blob, ESP_ERR_NOT_FOUND if it is missing or has another size
+  esp_err_t readBlob(const char* key, void* data, size_t length);
+
   // Disable copy constructor and assignment operator
   StorageManager(const StorageManager&) = delete;
   StorageManager& operator=(const StorageManager&) = delete;
@@ -1,6 +1,50 @@
 #pragma once
 
 #include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Counters of the storage operations performed since boot.
+ */
+struct StorageStats {
+  uint32_t reads;         ///< Number of read operations
+  uint32_t writes;        ///< Number of write operations, erases included
+  uint32_t errors;        ///< Number of failed operations
+  uint32_t bytesRead;     ///< Payload bytes read
+  uint32_t bytesWritten;  ///< Payload bytes written
+  uint64_t readTimeUs;    ///< Total time spent in reads, in microseconds
+  uint64_t writeTimeUs;   ///< Total time spent in writes, in microseconds
+  uint32_t maxReadUs;     ///< Slowest read, in microseconds
+  uint32_t maxWriteUs;    ///< Slowest write, in microseconds
+};
+
+/**
+ * @brief Credentials of the network the station joins.
+ */
+struct WifiCredentials {
+  char ssid[33];      ///< NUL-terminated SSID, at most 32 bytes
+  char password[65];  ///< NUL-terminated passphrase, empty for an open network
+};
+
+/**
+ * @brief Access point of the last successful station connection, so a reconnect can skip the scan.
+ */
+struct WifiConnectionCache {
+  char ssid[33];     ///< NUL-terminated SSID the access point was joined with
+  uint8_t bssid[6];  ///< BSSID of the access point
+  uint8_t channel;   ///< Primary channel of the access point
+};
+
+/**
+ * @brief Receives the accessory JSON configuration piece by piece.
+ *
+ * @param data Pointer to the next piece of the configuration, not NUL-terminated.
+ * @param length Length of the piece.
+ * @param context Context passed to StorageManagerInterface::readAccessoryJson().
+ * @return ESP_OK to continue reading, any other value stops the read and is returned by it.
+ */
+using AccessoryJsonReader = esp_err_t (*)(const char* data, size_t length, void* context);
 
 /**
  * @brief Interface for managing storage operations.
@@ -66,22 +110,24 @@ class StorageManagerInterface {
   virtual esp_err_t getDeviceNameLength(size_t* length) = 0;
 
   /**
-   * @brief Sets the accessory JSON configuration.
+   * @brief Gets the accessory JSON configuration, an array of accessory objects each with its "id".
    *
-   * @param json Pointer to a char array containing the JSON configuration.
-   * @param length Length of the JSON configuration.
+   * @param[out] json Pointer to a char array to store the JSON configuration.
+   * @param length Maximum length of the JSON configuration to be retrieved.
    * @return ESP_OK on success, an error from esp_err_t otherwise.
    */
-  virtual esp_err_t setAccessoryJson(const char* json, size_t length) = 0;
+  virtual esp_err_t getAccessoryJson(char* json, size_t length) = 0;
 
   /**
-   * @brief Gets the accessory JSON configuration.
+   * @brief Gets a copy of the accessory JSON configuration, sized and read in one step so a change in
+   * between cannot make the buffer too small.
    *
-   * @param[out] json Pointer to a char array to store the JSON configuration.
-   * @param length Maximum length of the JSON configuration to be retrieved.
-   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   * @param[out] json Set to the NUL-terminated configuration, to be released with free().
+   * @param[out] length Set to the length of the configuration without the NUL, may be nullptr.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no configuration is stored, ESP_ERR_NO_MEM if the
+   *         copy cannot be allocated, an error from esp_err_t otherwise.
    */
-  virtual esp_err_t getAccessoryJson(char* json, size_t length) = 0;
+  virtual esp_err_t getAccessoryJsonCopy(char** json, size_t* length) = 0;
 
   /**
    * @brief Gets the length of the accessory JSON configuration.
@@ -90,4 +136,134 @@ class StorageManagerInterface {
    * @return ESP_OK on success, an error from esp_err_t otherwise.
    */
   virtual esp_err_t getAccessoryJsonLength(size_t* length) = 0;
+
+  /**
+   * @brief Reads the accessory JSON configuration in buffer-sized pieces, without holding it whole.
+   *
+   * The accessory DB stays locked until the reader returned for the last piece, it must not wait for
+   * another task changing the accessories.
+   *
+   * @param reader Function called with each piece, in order.
+   * @param context Passed to the reader.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no configuration is stored, the reader's error
+   *         if it stopped the read, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t readAccessoryJson(AccessoryJsonReader reader, void* context) = 0;
+
+  /**
+   * @brief Gets the version of the accessory JSON configuration, which changes on every save.
+   *
+   * @param[out] version Pointer to a uint32_t to store the version.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no configuration is stored,
+   *         an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t getAccessoryJsonVersion(uint32_t* version) = 0;
+
+  /**
+   * @brief Reads one accessory object, with its "id".
+   *
+   * @param id Id of the accessory.
+   * @param reader Function called with the accessory.
+   * @param context Passed to the reader.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such accessory,
+   *         an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t readAccessory(uint16_t id, AccessoryJsonReader reader, void* context) = 0;
+
+  /**
+   * @brief Creates or replaces one accessory, leaving the others untouched.
+   *
+   * @param[in,out] id Id of the accessory to replace, or 0 to create one and receive its id.
+   * @param json The accessory object without its "id".
+   * @param length Length of json.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no accessory to replace,
+   *         ESP_ERR_NO_MEM if no more accessories can be created, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t setAccessory(uint16_t* id, const char* json, size_t length) = 0;
+
+  /**
+   * @brief Deletes one accessory, leaving the others untouched.
+   *
+   * @param id Id of the accessory.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such accessory,
+   *         an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t deleteAccessory(uint16_t id) = 0;
+
+  /**
+   * @brief Starts replacing the whole accessory JSON configuration.
+   *
+   * The accessories are staged next to the stored configuration, which stays readable until
+   * commitAccessoryJsonWrite() replaces it in a single step.
+   *
+   * @return ESP_OK on success, ESP_ERR_INVALID_STATE if a write is already in progress,
+   *         an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t beginAccessoryJsonWrite() = 0;
+
+  /**
+   * @brief Adds an accessory to the configuration write in progress.
+   *
+   * @param id Id of the accessory, or 0 to give it a new one.
+   * @param json The accessory object without its "id".
+   * @param length Length of json.
+   * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the id is already staged,
+   *         an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t stageAccessory(uint16_t id, const char* json, size_t length) = 0;
+
+  /**
+   * @brief Makes the accessory JSON write in progress the stored configuration.
+   *
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t commitAccessoryJsonWrite() = 0;
+
+  /**
+   * @brief Drops the accessory JSON write in progress, the stored configuration is left untouched.
+   *
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t abortAccessoryJsonWrite() = 0;
+
+  /**
+   * @brief Sets the credentials of the network the station joins.
+   *
+   * @param credentials The credentials.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t setWifiCredentials(const WifiCredentials* credentials) = 0;
+
+  /**
+   * @brief Gets the credentials of the network the station joins.
+   *
+   * @param[out] credentials Pointer to a WifiCredentials to store the credentials.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no credentials are stored,
+   *         an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t getWifiCredentials(WifiCredentials* credentials) = 0;
+
+  /**
+   * @brief Sets the access point of the last successful station connection.
+   *
+   * @param cache The access point, or nullptr to forget it.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t setWifiConnectionCache(const WifiConnectionCache* cache) = 0;
+
+  /**
+   * @brief Gets the access point of the last successful station connection.
+   *
+   * @param[out] cache Pointer to a WifiConnectionCache to store the access point.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if none is stored, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t getWifiConnectionCache(WifiConnectionCache* cache) = 0;
+
+  /**
+   * @brief Gets the storage operation counters.
+   *
+   * @param[out] stats Pointer to a StorageStats to store the counters.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  virtual esp_err_t getStats(StorageStats* stats) = 0;
 };
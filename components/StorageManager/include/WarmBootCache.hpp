@@ -0,0 +1,116 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "StorageManagerInterface.hpp"
+
+/**
+ * @brief Decoded boot state kept in RTC no-init memory, so a software restart does not read it back from
+ * NVS and the accessory configuration is not parsed again.
+ *
+ * The state is only trusted after a software restart of the same firmware with an intact checksum. After a
+ * power loss, a crash or an update it is dropped and the device boots cold, filling it again as the
+ * values are read from NVS. Every writer of the underlying NVS values keeps it in sync.
+ */
+class WarmBootCache {
+ public:
+  /**
+   * @brief Validate the state left by the previous boot, or drop it. Called by the StorageManager
+   * constructor, before anything is read.
+   */
+  static void init();
+
+  /**
+   * @brief Check if the state of the previous boot was kept.
+   * @return true after a software restart with an intact state.
+   */
+  static bool isWarm();
+
+  /**
+   * @brief Drop the whole state, the relay states included.
+   */
+  static void clear();
+
+  /**
+   * @brief Get the cached program mode flag.
+   * @param[out] enabled The flag.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if it is not cached.
+   */
+  static esp_err_t getProgramMode(bool* enabled);
+
+  /**
+   * @brief Cache the program mode flag as it is stored in NVS.
+   * @param enabled The flag.
+   */
+  static void setProgramMode(bool enabled);
+
+  /**
+   * @brief Get the cached access point of the last station connection.
+   * @param[out] cache The access point.
+   * @param[out] stored false if it is cached that none is stored.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if it is not cached.
+   */
+  static esp_err_t getWifiConnectionCache(WifiConnectionCache* cache, bool* stored);
+
+  /**
+   * @brief Cache the access point of the last station connection as it is stored in NVS.
+   * @param cache The access point, or nullptr when none is stored.
+   */
+  static void setWifiConnectionCache(const WifiConnectionCache* cache);
+
+  /**
+   * @brief Check if an accessory plan is cached.
+   * @return true if getPlan() has one.
+   */
+  static bool hasPlan();
+
+  /**
+   * @brief Copy the cached accessory plan, the decoded configuration the endpoints were created from.
+   * @param[out] plan Destination buffer.
+   * @param maxLength Capacity of the destination buffer.
+   * @param[out] length Length of the plan.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no plan is cached,
+   *         ESP_ERR_INVALID_SIZE if the buffer is too small.
+   */
+  static esp_err_t getPlan(void* plan, size_t maxLength, size_t* length);
+
+  /**
+   * @brief Cache the accessory plan. Its layout is up to the caller, the cache is dropped with a firmware
+   * update.
+   * @param plan The plan.
+   * @param length Length of the plan.
+   * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if it does not fit, the plan is then dropped.
+   */
+  static esp_err_t setPlan(const void* plan, size_t length);
+
+  /**
+   * @brief Drop the accessory plan and the relay states, the accessory configuration changed.
+   */
+  static void invalidatePlan();
+
+  /**
+   * @brief Get the maximum length of an accessory plan.
+   * @return Length in bytes, 0 if the cache is disabled.
+   */
+  static size_t maxPlanLength();
+
+  /**
+   * @brief Get the state a relay had before the restart.
+   * @param pin GPIO number driving the relay.
+   * @param[out] power The relay state.
+   * @return ESP_OK on success, ESP_ERR_NOT_FOUND if it is not known.
+   */
+  static esp_err_t getRelayState(uint8_t pin, bool* power);
+
+  /**
+   * @brief Record the state of a relay, called on every relay edge. Only kept while a plan is cached.
+   * @param pin GPIO number driving the relay.
+   * @param power The relay state.
+   */
+  static void setRelayState(uint8_t pin, bool power);
+
+ private:
+  WarmBootCache() = delete;
+};
@@ -2,16 +2,309 @@
 
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_random.h>
 #include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <nvs.h>
 #include <nvs_flash.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "AppEventBus.hpp"
+#include "WarmBootCache.hpp"
+
 static const char *TAG = "StorageManager";
 
-StorageManager::StorageManager() { ESP_LOGI(TAG, "StorageManager instance created"); }
+static portMUX_TYPE s_statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Times one storage operation and adds it to the counters when it goes out of scope.
+ */
+class OperationTimer {
+ public:
+  OperationTimer(StorageStats &stats, bool write, const esp_err_t &err)
+      : m_stats(stats), m_write(write), m_err(err), m_bytes(0), m_start(esp_timer_get_time()) {}
+
+  ~OperationTimer() {
+    uint32_t elapsed = static_cast<uint32_t>(esp_timer_get_time() - m_start);
+
+    portENTER_CRITICAL(&s_statsLock);
+    if (m_write) {
+      m_stats.writes++;
+      m_stats.bytesWritten += m_bytes;
+      m_stats.writeTimeUs += elapsed;
+      if (elapsed > m_stats.maxWriteUs) {
+        m_stats.maxWriteUs = elapsed;
+      }
+    } else {
+      m_stats.reads++;
+      m_stats.bytesRead += m_bytes;
+      m_stats.readTimeUs += elapsed;
+      if (elapsed > m_stats.maxReadUs) {
+        m_stats.maxReadUs = elapsed;
+      }
+    }
+    if (m_err != ESP_OK && m_err != ESP_ERR_NVS_NOT_FOUND) {
+      m_stats.errors++;
+    }
+    portEXIT_CRITICAL(&s_statsLock);
+  }
+
+  void setBytes(size_t bytes) { m_bytes = bytes; }
+
+ private:
+  StorageStats &m_stats;
+  bool m_write;
+  const esp_err_t &m_err;
+  size_t m_bytes;
+  int64_t m_start;
+};
+
+/**
+ * @brief Holds the accessory DB lock until it goes out of scope. The lock is recursive, so a locked call
+ * can be made of other locked calls.
+ */
+class AccessoryDbLock {
+ public:
+  explicit AccessoryDbLock(SemaphoreHandle_t lock) : m_lock(lock) {
+    xSemaphoreTakeRecursive(m_lock, portMAX_DELAY);
+  }
+
+  ~AccessoryDbLock() { xSemaphoreGiveRecursive(m_lock); }
+
+ private:
+  SemaphoreHandle_t m_lock;
+};
+
+/**
+ * @brief Index of the stored accessories. Each accessory is a blob holding its JSON object without the
+ * "id", under the key "<prefix>_a<id>" or "<prefix>_b<id>". There are two slots so a whole new
+ * configuration can be staged while the old one stays readable. Writing the index switches slots, and
+ * it is the commit point of every change. Only the first count ids are stored.
+ */
+struct AccessoryDbMeta {
+  uint32_t magic;
+  uint32_t version;  ///< Changed on every write, seeded randomly so an erase does not reuse versions
+  uint16_t count;    ///< Number of accessories
+  uint16_t nextId;   ///< Id given to the next new accessory
+  uint8_t slot;      ///< Slot holding the accessories, 0 or 1
+  uint8_t reserved[3];
+  uint16_t ids[CONFIG_SM_MAX_ACCESSORIES];  ///< Accessory ids in configuration order
+};
+
+static constexpr uint32_t kAccessoryDbMagic = 0x32424441;  // "ADB2"
+static constexpr size_t kAccessoryIdPrefixSize = sizeof("{\"id\":65535");
+
+static size_t accessory_meta_size(const AccessoryDbMeta &meta) {
+  return offsetof(AccessoryDbMeta, ids) + meta.count * sizeof(meta.ids[0]);
+}
+
+static void accessory_meta_key(char *key, size_t size) {
+  snprintf(key, size, "%s_meta", CONFIG_SM_NVS_KEY_ACCESSORY_PREFIX);
+}
+
+static int accessory_slot_prefix(char *key, size_t size, uint8_t slot) {
+  return snprintf(key, size, "%s_%c", CONFIG_SM_NVS_KEY_ACCESSORY_PREFIX, slot ? 'b' : 'a');
+}
+
+static void accessory_record_key(char *key, size_t size, uint8_t slot, uint16_t id) {
+  int length = accessory_slot_prefix(key, size, slot);
+  snprintf(key + length, size - length, "%u", id);
+}
+
+static int find_accessory(const AccessoryDbMeta &meta, uint16_t id) {
+  for (uint16_t i = 0; i < meta.count; i++) {
+    if (meta.ids[i] == id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static esp_err_t read_accessory_meta(nvs_handle_t handle, AccessoryDbMeta *meta) {
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  accessory_meta_key(key, sizeof(key));
+
+  size_t length = sizeof(*meta);
+  esp_err_t err = nvs_get_blob(handle, key, meta, &length);
+  if (err == ESP_OK && (length < offsetof(AccessoryDbMeta, ids) || meta->magic != kAccessoryDbMagic ||
+                        meta->slot > 1 || meta->count > CONFIG_SM_MAX_ACCESSORIES ||
+                        length != accessory_meta_size(*meta))) {
+    ESP_LOGE(TAG, "Ignoring invalid accessory DB index");
+    err = ESP_ERR_NVS_NOT_FOUND;
+  }
+  return err;
+}
+
+static esp_err_t write_accessory_meta(nvs_handle_t handle, const AccessoryDbMeta &meta) {
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  accessory_meta_key(key, sizeof(key));
+
+  esp_err_t err = nvs_set_blob(handle, key, &meta, accessory_meta_size(meta));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  return err;
+}
+
+// An empty index for the first accessory stored, unless a legacy configuration would be hidden by it
+static esp_err_t init_accessory_meta(nvs_handle_t handle, AccessoryDbMeta *meta) {
+  size_t length = 0;
+  if (nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, NULL, &length) == ESP_OK) {
+    ESP_LOGE(TAG, "The legacy accessory DB must be saved whole before accessories are edited");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  memset(meta, 0, sizeof(*meta));
+  meta->magic = kAccessoryDbMagic;
+  meta->version = esp_random();
+  meta->nextId = 1;
+  return ESP_OK;
+}
+
+// Drops every record of a slot, including leftovers of a write interrupted by a reset. NVS must not be
+// modified while it is iterated, so the keys are collected in batches and erased in between.
+static void clear_accessory_slot(nvs_handle_t handle, uint8_t slot) {
+  char prefix[NVS_KEY_NAME_MAX_SIZE];
+  size_t prefixLength = accessory_slot_prefix(prefix, sizeof(prefix), slot);
+
+  bool more = true;
+  while (more) {
+    uint16_t ids[16];
+    size_t count = 0;
+
+    nvs_iterator_t it = nullptr;
+    esp_err_t err = nvs_entry_find(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_TYPE_BLOB, &it);
+    while (err == ESP_OK && count < sizeof(ids) / sizeof(ids[0])) {
+      nvs_entry_info_t info;
+      nvs_entry_info(it, &info);
+      if (strncmp(info.key, prefix, prefixLength) == 0) {
+        ids[count++] = atoi(&info.key[prefixLength]);
+      }
+      err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    more = count == sizeof(ids) / sizeof(ids[0]);
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (size_t i = 0; i < count; i++) {
+      accessory_record_key(key, sizeof(key), slot, ids[i]);
+      nvs_erase_key(handle, key);
+    }
+  }
+}
+
+/**
+ * @brief Buffers the accessories read for an AccessoryJsonReader, so it is called with few large pieces
+ * instead of one per accessory.
+ */
+class AccessoryOutput {
+ public:
+  AccessoryOutput(AccessoryJsonReader reader, void *context)
+      : m_reader(reader), m_context(context), m_buffer(nullptr), m_fill(0), m_total(0) {}
+
+  ~AccessoryOutput() { free(m_buffer); }
+
+  esp_err_t begin() {
+    m_buffer = static_cast<char *>(malloc(CONFIG_SM_ACCESSORY_BUFFER_SIZE));
+    return m_buffer != nullptr ? ESP_OK : ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t append(const char *data, size_t length) {
+    while (length > 0) {
+      if (m_fill == CONFIG_SM_ACCESSORY_BUFFER_SIZE) {
+        esp_err_t err = flush();
+        if (err != ESP_OK) {
+          return err;
+        }
+      }
+      size_t copy = CONFIG_SM_ACCESSORY_BUFFER_SIZE - m_fill;
+      if (copy > length) {
+        copy = length;
+      }
+      memcpy(m_buffer + m_fill, data, copy);
+      m_fill += copy;
+      m_total += copy;
+      data += copy;
+      length -= copy;
+    }
+    return ESP_OK;
+  }
+
+  /**
+   * @brief Append a stored accessory with its "id" put back as the first property.
+   */
+  esp_err_t appendRecord(nvs_handle_t handle, uint8_t slot, uint16_t id) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    accessory_record_key(key, sizeof(key), slot, id);
+
+    size_t length = 0;
+    esp_err_t err = nvs_get_blob(handle, key, NULL, &length);
+    if (err != ESP_OK) {
+      return err;
+    }
+    if (length < 2 || length > CONFIG_SM_ACCESSORY_BUFFER_SIZE - kAccessoryIdPrefixSize) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    if (m_fill + kAccessoryIdPrefixSize + length > CONFIG_SM_ACCESSORY_BUFFER_SIZE) {
+      err = flush();
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
 
-StorageManager::~StorageManager() { ESP_LOGI(TAG, "StorageManager instance destroyed"); }
+    // The record's '{' becomes the ',' after the id, or is dropped for an empty object
+    size_t prefixLength = snprintf(m_buffer + m_fill, kAccessoryIdPrefixSize, "{\"id\":%u", id);
+    char *record = m_buffer + m_fill + prefixLength;
+    err = nvs_get_blob(handle, key, record, &length);
+    if (err != ESP_OK) {
+      return err;
+    }
+    if (length == 2) {
+      record[0] = '}';
+      length = 1;
+    } else {
+      record[0] = ',';
+    }
+    m_fill += prefixLength + length;
+    m_total += prefixLength + length;
+    return ESP_OK;
+  }
+
+  esp_err_t flush() {
+    esp_err_t err = m_fill > 0 ? m_reader(m_buffer, m_fill, m_context) : ESP_OK;
+    m_fill = 0;
+    return err;
+  }
+
+  size_t total() const { return m_total; }
+
+ private:
+  AccessoryJsonReader m_reader;
+  void *m_context;
+  char *m_buffer;
+  size_t m_fill;
+  size_t m_total;
+};
+
+StorageManager::StorageManager()
+    : m_stats(), m_writeHandle(0), m_writeMeta(nullptr), m_accessoryLockBuffer(), m_accessoryLock(nullptr) {
+  ESP_LOGI(TAG, "StorageManager instance created");
+  m_accessoryLock = xSemaphoreCreateRecursiveMutexStatic(&m_accessoryLockBuffer);
+
+  /* Pick up the boot state a software restart left behind */
+  WarmBootCache::init();
+}
+
+StorageManager::~StorageManager() {
+  abortAccessoryJsonWrite();
+  vSemaphoreDelete(m_accessoryLock);
+  ESP_LOGI(TAG, "StorageManager instance destroyed");
+}
 
 esp_err_t StorageManager::initialize() {
   ESP_LOGI(TAG, "Initializing StorageManager");
@@ -54,7 +347,11 @@ esp_err_t StorageManager::initialize() {
 esp_err_t StorageManager::eraseAllData() {
   ESP_LOGI(TAG, "Erasing all Partitions data");
 
-  esp_err_t err = nvs_flash_erase();
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
+  WarmBootCache::clear();
+  err = nvs_flash_erase();
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to erase all Partitions data: %s", esp_err_to_name(err));
   }
@@ -65,9 +362,11 @@ esp_err_t StorageManager::eraseAllData() {
 esp_err_t StorageManager::setProgramMode(bool enable) {
   ESP_LOGI(TAG, "Setting program mode to %s", enable ? "enabled" : "disabled");
 
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
@@ -90,15 +389,25 @@ esp_err_t StorageManager::setProgramMode(bool enable) {
   }
 
   nvs_close(handle);
+  if (err == ESP_OK) {
+    WarmBootCache::setProgramMode(enable);
+    AppEventBus::publish(AppEventType::StorageProgramModeChanged, enable);
+  }
   return err;
 }
 
 esp_err_t StorageManager::isProgramModeEnabled(bool *isEnabled) {
   ESP_LOGI(TAG, "Checking if program mode is enabled");
 
+  if (WarmBootCache::getProgramMode(isEnabled) == ESP_OK) {
+    return ESP_OK;
+  }
+
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
@@ -116,6 +425,9 @@ esp_err_t StorageManager::isProgramModeEnabled(bool *isEnabled) {
   } else {
     ESP_LOGE(TAG, "Failed to get program mode: %s", esp_err_to_name(err));
   }
+  if (err == ESP_OK) {
+    WarmBootCache::setProgramMode(*isEnabled);
+  }
 
   return err;
 }
@@ -123,15 +435,18 @@ esp_err_t StorageManager::isProgramModeEnabled(bool *isEnabled) {
 esp_err_t StorageManager::setDeviceName(const char *name, size_t length) {
   ESP_LOGI(TAG, "Setting device name");
 
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
   }
 
   err = nvs_set_blob(handle, CONFIG_SM_NVS_KEY_DEVICE_NAME, name, length);
+  timer.setBytes(length);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to set device name: %s", esp_err_to_name(err));
     nvs_close(handle);
@@ -150,9 +465,11 @@ esp_err_t StorageManager::setDeviceName(const char *name, size_t length) {
 esp_err_t StorageManager::getDeviceName(char *name, size_t length) {
   ESP_LOGI(TAG, "Getting device name");
 
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
@@ -160,6 +477,7 @@ esp_err_t StorageManager::getDeviceName(char *name, size_t length) {
 
   size_t requiredSize = length;
   err = nvs_get_blob(handle, CONFIG_SM_NVS_KEY_DEVICE_NAME, name, &requiredSize);
+  timer.setBytes(requiredSize);
   nvs_close(handle);
 
   if (err == ESP_ERR_NVS_NOT_FOUND) {
@@ -175,9 +493,11 @@ esp_err_t StorageManager::getDeviceName(char *name, size_t length) {
 esp_err_t StorageManager::getDeviceNameLength(size_t *length) {
   ESP_LOGI(TAG, "Getting device name length");
 
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
@@ -193,75 +513,616 @@ esp_err_t StorageManager::getDeviceNameLength(size_t *length) {
   return err;
 }
 
+/**
+ * @brief Destination of getAccessoryJson(), filled by copy_accessory_json().
+ */
+struct AccessoryJsonCopy {
+  char *json;
+  size_t size;
+  size_t fill;
+};
+
+static esp_err_t copy_accessory_json(const char *data, size_t length, void *context) {
+  AccessoryJsonCopy *copy = static_cast<AccessoryJsonCopy *>(context);
+  if (copy->fill + length >= copy->size) {
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  }
+  memcpy(copy->json + copy->fill, data, length);
+  copy->fill += length;
+  return ESP_OK;
+}
+
 esp_err_t StorageManager::getAccessoryJson(char *json, size_t length) {
   ESP_LOGI(TAG, "Getting accessory JSON");
 
+  AccessoryJsonCopy copy = {json, length, 0};
+  esp_err_t err = readAccessoryJson(copy_accessory_json, &copy);
+  if (err == ESP_ERR_NOT_FOUND) {
+    ESP_LOGI(TAG, "Accessory JSON not found");
+    return ESP_FAIL;
+  } else if (err == ESP_OK) {
+    json[copy.fill] = '\0';
+  }
+
+  return err;
+}
+
+esp_err_t StorageManager::getAccessoryJsonCopy(char **json, size_t *length) {
+  if (json == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *json = nullptr;
+
+  // Sized and read under one hold of the lock, so a change in between cannot outgrow the buffer
+  AccessoryDbLock lock(m_accessoryLock);
+  size_t size = 0;
+  esp_err_t err = getAccessoryJsonLength(&size);
+  if (err != ESP_OK) {
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+  }
+
+  char *buffer = static_cast<char *>(malloc(size));
+  if (buffer == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+  AccessoryJsonCopy copy = {buffer, size, 0};
+  err = readAccessoryJson(copy_accessory_json, &copy);
+  if (err != ESP_OK) {
+    free(buffer);
+    return err;
+  }
+
+  buffer[copy.fill] = '\0';
+  *json = buffer;
+  if (length != nullptr) {
+    *length = copy.fill;
+  }
+  return ESP_OK;
+}
+
+esp_err_t StorageManager::getAccessoryJsonLength(size_t *length) {
+  ESP_LOGI(TAG, "Getting accessory JSON length");
+
+  AccessoryDbLock lock(m_accessoryLock);
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
   }
 
-  size_t requiredSize = length;
-  err = nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, json, &requiredSize);
+  // Like nvs_get_str, the length includes the terminating NUL
+  AccessoryDbMeta meta;
+  err = read_accessory_meta(handle, &meta);
+  if (err == ESP_OK) {
+    size_t total = sizeof("[]");
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (uint16_t i = 0; i < meta.count && err == ESP_OK; i++) {
+      accessory_record_key(key, sizeof(key), meta.slot, meta.ids[i]);
+      size_t recordLength = 0;
+      err = nvs_get_blob(handle, key, NULL, &recordLength);
+      total += (i > 0) + snprintf(NULL, 0, "{\"id\":%u", meta.ids[i]) + (recordLength > 2 ? recordLength : 1);
+    }
+    *length = total;
+  } else {
+    err = nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, NULL, length);
+  }
+  nvs_close(handle);
+
+  if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+    ESP_LOGE(TAG, "Failed to get accessory JSON length: %s", esp_err_to_name(err));
+  }
+
+  return err;
+}
+
+esp_err_t StorageManager::readAccessoryJson(AccessoryJsonReader reader, void *context) {
+  ESP_LOGI(TAG, "Reading accessory JSON");
+
+  // Held until the last record is read, a change would otherwise drop records the index still lists
+  AccessoryDbLock lock(m_accessoryLock);
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  AccessoryDbMeta meta;
+  if (read_accessory_meta(handle, &meta) == ESP_OK) {
+    AccessoryOutput output(reader, context);
+    err = output.begin();
+    if (err == ESP_OK) {
+      err = output.append("[", 1);
+    }
+    for (uint16_t i = 0; i < meta.count && err == ESP_OK; i++) {
+      err = i > 0 ? output.append(",", 1) : ESP_OK;
+      if (err == ESP_OK) {
+        err = output.appendRecord(handle, meta.slot, meta.ids[i]);
+      }
+    }
+    if (err == ESP_OK) {
+      err = output.append("]", 1);
+    }
+    if (err == ESP_OK) {
+      err = output.flush();
+    }
+    timer.setBytes(output.total());
+  } else {
+    // A legacy configuration is a single string, read whole; it is at most one NVS string long
+    size_t bufferSize = 0;
+    err = nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, NULL, &bufferSize);
+    char *buffer = err == ESP_OK ? static_cast<char *>(malloc(bufferSize)) : nullptr;
+    if (err == ESP_OK && buffer == nullptr) {
+      err = ESP_ERR_NO_MEM;
+    }
+    if (err == ESP_OK) {
+      err = nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, buffer, &bufferSize);
+    }
+    if (err == ESP_OK) {
+      timer.setBytes(strlen(buffer));
+      err = reader(buffer, strlen(buffer), context);
+    }
+    free(buffer);
+  }
   nvs_close(handle);
 
   if (err == ESP_ERR_NVS_NOT_FOUND) {
-    ESP_LOGI(TAG, "Accessory JSON not found");
-    return ESP_FAIL;
+    return ESP_ERR_NOT_FOUND;
   } else if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to get accessory JSON: %s", esp_err_to_name(err));
+    ESP_LOGE(TAG, "Failed to read accessory JSON: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+esp_err_t StorageManager::getAccessoryJsonVersion(uint32_t *version) {
+  AccessoryDbLock lock(m_accessoryLock);
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  AccessoryDbMeta meta;
+  err = read_accessory_meta(handle, &meta);
+  if (err == ESP_OK) {
+    *version = meta.version;
+  } else {
+    size_t length = 0;
+    err = nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, NULL, &length);
+    *version = 0;
   }
+  nvs_close(handle);
+
+  return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+}
+
+esp_err_t StorageManager::readAccessory(uint16_t id, AccessoryJsonReader reader, void *context) {
+  ESP_LOGI(TAG, "Reading accessory %u", id);
+
+  AccessoryDbLock lock(m_accessoryLock);
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  AccessoryDbMeta meta;
+  err = read_accessory_meta(handle, &meta);
+  if (err == ESP_OK && find_accessory(meta, id) < 0) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  AccessoryOutput output(reader, context);
+  if (err == ESP_OK) {
+    err = output.begin();
+  }
+  if (err == ESP_OK) {
+    err = output.appendRecord(handle, meta.slot, id);
+  }
+  if (err == ESP_OK) {
+    err = output.flush();
+  }
+  timer.setBytes(output.total());
+  nvs_close(handle);
 
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    return ESP_ERR_NOT_FOUND;
+  } else if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to read accessory %u: %s", id, esp_err_to_name(err));
+  }
   return err;
 }
 
-esp_err_t StorageManager::setAccessoryJson(const char *json, size_t length) {
-  ESP_LOGI(TAG, "Setting accessory JSON");
+esp_err_t StorageManager::setAccessory(uint16_t *id, const char *json, size_t length) {
+  ESP_LOGI(TAG, "Setting accessory %u", *id);
+
+  // Held until the index is written, another change would otherwise write an index without this one
+  AccessoryDbLock lock(m_accessoryLock);
+
+  // The live slot is replaced when the staged configuration is committed
+  if (m_writeMeta != nullptr) {
+    ESP_LOGE(TAG, "An accessory JSON write is in progress");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
+  // The endpoints of the next boot have to be created from the stored configuration again
+  WarmBootCache::invalidatePlan();
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  AccessoryDbMeta meta;
+  err = read_accessory_meta(handle, &meta);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    err = init_accessory_meta(handle, &meta);
+  }
+
+  uint16_t recordId = *id;
+  if (err == ESP_OK && recordId == 0) {
+    recordId = meta.nextId;
+    if (meta.count == CONFIG_SM_MAX_ACCESSORIES || recordId == 0) {
+      err = ESP_ERR_NO_MEM;
+    }
+  } else if (err == ESP_OK && find_accessory(meta, recordId) < 0) {
+    err = ESP_ERR_NOT_FOUND;
+  }
+
+  // A new accessory only exists once the index lists it, so an interrupted create leaves nothing behind
+  if (err == ESP_OK) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    accessory_record_key(key, sizeof(key), meta.slot, recordId);
+    err = nvs_set_blob(handle, key, json, length);
+    timer.setBytes(length);
+  }
+  if (err == ESP_OK) {
+    if (*id == 0) {
+      meta.ids[meta.count++] = recordId;
+      meta.nextId++;
+    }
+    meta.version++;
+    err = write_accessory_meta(handle, meta);
+  }
+  nvs_close(handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set accessory %u: %s", *id, esp_err_to_name(err));
+    return err;
+  }
+
+  *id = recordId;
+  AppEventBus::publish(AppEventType::StorageAccessoriesChanged, meta.version);
+  return ESP_OK;
+}
+
+esp_err_t StorageManager::deleteAccessory(uint16_t id) {
+  ESP_LOGI(TAG, "Deleting accessory %u", id);
+
+  AccessoryDbLock lock(m_accessoryLock);
+  if (m_writeMeta != nullptr) {
+    ESP_LOGE(TAG, "An accessory JSON write is in progress");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
+  WarmBootCache::invalidatePlan();
 
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
   }
 
-  err = nvs_set_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, json);
+  AccessoryDbMeta meta;
+  err = read_accessory_meta(handle, &meta);
+  int index = err == ESP_OK ? find_accessory(meta, id) : -1;
+  if (err == ESP_OK && index < 0) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  // Drop the accessory from the index first, the record is unreachable from then on
+  if (err == ESP_OK) {
+    memmove(&meta.ids[index], &meta.ids[index + 1], (meta.count - index - 1) * sizeof(meta.ids[0]));
+    meta.count--;
+    meta.version++;
+    err = write_accessory_meta(handle, meta);
+  }
+  if (err == ESP_OK) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    accessory_record_key(key, sizeof(key), meta.slot, id);
+    nvs_erase_key(handle, key);
+    nvs_commit(handle);
+  }
+  nvs_close(handle);
+
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    return ESP_ERR_NOT_FOUND;
+  } else if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to delete accessory %u: %s", id, esp_err_to_name(err));
+  } else {
+    AppEventBus::publish(AppEventType::StorageAccessoriesChanged, meta.version);
+  }
+  return err;
+}
+
+esp_err_t StorageManager::beginAccessoryJsonWrite() {
+  ESP_LOGI(TAG, "Starting accessory JSON write");
+
+  AccessoryDbLock lock(m_accessoryLock);
+  if (m_writeMeta != nullptr) {
+    ESP_LOGE(TAG, "An accessory JSON write is already in progress");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
   if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to set accessory JSON: %s", esp_err_to_name(err));
+    ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  AccessoryDbMeta *staged = static_cast<AccessoryDbMeta *>(malloc(sizeof(AccessoryDbMeta)));
+  if (staged == nullptr) {
     nvs_close(handle);
+    err = ESP_ERR_NO_MEM;
     return err;
   }
 
-  err = nvs_commit(handle);
+  // Stage the new configuration in the slot the stored one does not use, keeping its ids in use
+  if (read_accessory_meta(handle, staged) == ESP_OK) {
+    staged->slot = !staged->slot;
+    staged->version++;
+  } else {
+    memset(staged, 0, sizeof(*staged));
+    staged->magic = kAccessoryDbMagic;
+    staged->version = esp_random();
+    staged->nextId = 1;
+  }
+  staged->count = 0;
+  clear_accessory_slot(handle, staged->slot);
+
+  m_writeHandle = handle;
+  m_writeMeta = staged;
+  return ESP_OK;
+}
+
+esp_err_t StorageManager::stageAccessory(uint16_t id, const char *json, size_t length) {
+  AccessoryDbLock lock(m_accessoryLock);
+  if (m_writeMeta == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  AccessoryDbMeta &staged = *m_writeMeta;
+  if (staged.count == CONFIG_SM_MAX_ACCESSORIES) {
+    ESP_LOGE(TAG, "More than %d accessories", CONFIG_SM_MAX_ACCESSORIES);
+    return ESP_ERR_NO_MEM;
+  }
+  if (id == 0) {
+    id = staged.nextId++;
+    if (id == 0) {
+      return ESP_ERR_NO_MEM;
+    }
+  } else if (find_accessory(staged, id) >= 0) {
+    ESP_LOGE(TAG, "Accessory id %u is used twice", id);
+    return ESP_ERR_INVALID_ARG;
+  } else if (id >= staged.nextId) {
+    staged.nextId = id + 1;
+  }
+
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  accessory_record_key(key, sizeof(key), staged.slot, id);
+  err = nvs_set_blob(m_writeHandle, key, json, length);
+  timer.setBytes(length);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write accessory %u: %s", id, esp_err_to_name(err));
+    return err;
+  }
+
+  staged.ids[staged.count++] = id;
+  return ESP_OK;
+}
+
+esp_err_t StorageManager::commitAccessoryJsonWrite() {
+  AccessoryDbLock lock(m_accessoryLock);
+  if (m_writeMeta == nullptr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
+
+  WarmBootCache::invalidatePlan();
+
+  // Writing the index is the commit point, until then readers see the previous configuration
+  nvs_handle_t handle = m_writeHandle;
+  err = write_accessory_meta(handle, *m_writeMeta);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to commit accessory JSON: %s", esp_err_to_name(err));
+    dropAccessoryJsonWrite();
+    return err;
   }
 
+  // Drop the previous configuration
+  clear_accessory_slot(handle, !m_writeMeta->slot);
+  nvs_erase_key(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB);
+  nvs_commit(handle);
   nvs_close(handle);
+
+  ESP_LOGI(TAG, "Accessory JSON committed: %u accessories, version %lu", m_writeMeta->count,
+           (unsigned long)m_writeMeta->version);
+  AppEventBus::publish(AppEventType::StorageAccessoriesChanged, m_writeMeta->version);
+  free(m_writeMeta);
+  m_writeMeta = nullptr;
+  return ESP_OK;
+}
+
+esp_err_t StorageManager::abortAccessoryJsonWrite() {
+  AccessoryDbLock lock(m_accessoryLock);
+  if (m_writeMeta != nullptr) {
+    dropAccessoryJsonWrite();
+  }
+  return ESP_OK;
+}
+
+void StorageManager::dropAccessoryJsonWrite() {
+  clear_accessory_slot(m_writeHandle, m_writeMeta->slot);
+  nvs_commit(m_writeHandle);
+  nvs_close(m_writeHandle);
+  free(m_writeMeta);
+  m_writeMeta = nullptr;
+
+  ESP_LOGW(TAG, "Accessory JSON write aborted");
+}
+
+esp_err_t StorageManager::setWifiCredentials(const WifiCredentials *credentials) {
+  ESP_LOGI(TAG, "Setting WiFi credentials");
+  if (credentials == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return writeBlob(CONFIG_SM_NVS_KEY_WIFI_CREDENTIALS, credentials, sizeof(*credentials));
+}
+
+esp_err_t StorageManager::getWifiCredentials(WifiCredentials *credentials) {
+  if (credentials == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  esp_err_t err = readBlob(CONFIG_SM_NVS_KEY_WIFI_CREDENTIALS, credentials, sizeof(*credentials));
+  if (err == ESP_OK) {
+    credentials->ssid[sizeof(credentials->ssid) - 1] = '\0';
+    credentials->password[sizeof(credentials->password) - 1] = '\0';
+  }
   return err;
 }
 
-esp_err_t StorageManager::getAccessoryJsonLength(size_t *length) {
-  ESP_LOGI(TAG, "Getting accessory JSON length");
+esp_err_t StorageManager::setWifiConnectionCache(const WifiConnectionCache *cache) {
+  esp_err_t err = writeBlob(CONFIG_SM_NVS_KEY_WIFI_CACHE, cache, sizeof(*cache));
+  if (err == ESP_OK) {
+    WarmBootCache::setWifiConnectionCache(cache);
+  }
+  return err;
+}
+
+esp_err_t StorageManager::getWifiConnectionCache(WifiConnectionCache *cache) {
+  if (cache == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  bool stored = false;
+  if (WarmBootCache::getWifiConnectionCache(cache, &stored) == ESP_OK) {
+    return stored ? ESP_OK : ESP_ERR_NOT_FOUND;
+  }
+
+  esp_err_t err = readBlob(CONFIG_SM_NVS_KEY_WIFI_CACHE, cache, sizeof(*cache));
+  if (err == ESP_OK) {
+    cache->ssid[sizeof(cache->ssid) - 1] = '\0';
+    WarmBootCache::setWifiConnectionCache(cache);
+  } else if (err == ESP_ERR_NOT_FOUND) {
+    WarmBootCache::setWifiConnectionCache(nullptr);
+  }
+  return err;
+}
+
+esp_err_t StorageManager::writeBlob(const char *key, const void *data, size_t length) {
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, true, err);
 
   nvs_handle_t handle;
-  esp_err_t err =
-      nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  if (data != nullptr) {
+    err = nvs_set_blob(handle, key, data, length);
+    timer.setBytes(length);
+  } else {
+    err = nvs_erase_key(handle, key);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+      nvs_close(handle);
+      return ESP_OK;
+    }
+  }
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
   if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write %s: %s", key, esp_err_to_name(err));
+  }
+
+  nvs_close(handle);
+  return err;
+}
+
+esp_err_t StorageManager::readBlob(const char *key, void *data, size_t length) {
+  esp_err_t err = ESP_OK;
+  OperationTimer timer(m_stats, false, err);
+
+  nvs_handle_t handle;
+  err = nvs_open_from_partition(CONFIG_SM_NVS_PARTITION, CONFIG_SM_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    return ESP_ERR_NOT_FOUND;
+  } else if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
     return err;
   }
 
-  err = nvs_get_str(handle, CONFIG_SM_NVS_KEY_ACCESSORY_DB, NULL, length);
+  // A blob of another size was written by another layout of the struct, it is as good as missing
+  size_t stored = 0;
+  err = nvs_get_blob(handle, key, nullptr, &stored);
+  if (err == ESP_OK && stored != length) {
+    ESP_LOGW(TAG, "Ignoring %s of %u bytes", key, (unsigned)stored);
+    err = ESP_ERR_NVS_NOT_FOUND;
+  }
+  if (err == ESP_OK) {
+    err = nvs_get_blob(handle, key, data, &length);
+    timer.setBytes(length);
+  }
   nvs_close(handle);
 
   if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-    ESP_LOGE(TAG, "Failed to get accessory JSON length: %s", esp_err_to_name(err));
+    ESP_LOGE(TAG, "Failed to read %s: %s", key, esp_err_to_name(err));
   }
+  return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+}
 
-  return err;
+esp_err_t StorageManager::getStats(StorageStats *stats) {
+  if (stats == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&s_statsLock);
+  *stats = m_stats;
+  portEXIT_CRITICAL(&s_statsLock);
+
+  return ESP_OK;
 }
@@ -0,0 +1,291 @@
+#include "WarmBootCache.hpp"
+
+#include <esp_app_desc.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <stddef.h>
+#include <string.h>
+
+static const char *TAG = "WarmBootCache";
+
+#ifdef CONFIG_SM_WARM_BOOT_CACHE
+
+namespace {
+
+constexpr uint32_t kStateMagic = 0x57524D42;  // "WRMB"
+constexpr uint16_t kStateVersion = 1;
+constexpr size_t kFirmwareIdLength = 8;
+
+constexpr uint8_t kProgramModeKnown = 1 << 0;
+constexpr uint8_t kWifiKnown = 1 << 1;
+constexpr uint8_t kWifiStored = 1 << 2;
+constexpr uint8_t kPlanKnown = 1 << 3;
+
+struct BootState {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t planLength;
+  uint8_t firmware[kFirmwareIdLength];  // start of the ELF SHA-256 of the firmware that wrote the state
+  uint8_t flags;
+  uint8_t programMode;
+  uint8_t resetReason;  // esp_reset_reason_t of the boot that validated the state
+  uint8_t reserved;
+  WifiConnectionCache wifi;
+  uint8_t plan[CONFIG_SM_WARM_BOOT_PLAN_SIZE];
+  uint32_t checksum;
+};
+
+/* Relays switch often, they have their own checksum so an edge does not hash the plan again */
+struct RelayStates {
+  uint64_t known;  // bit n set when the state of the relay on GPIO n is recorded
+  uint64_t power;
+  uint32_t checksum;
+};
+
+RTC_NOINIT_ATTR BootState s_state;
+RTC_NOINIT_ATTR RelayStates s_relays;
+portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+bool s_warm = false;
+
+/* Only the used part of the plan is covered, so an update of the flags stays cheap */
+uint32_t stateChecksum() {
+  uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&s_state), offsetof(BootState, plan));
+  return esp_rom_crc32_le(crc, s_state.plan, s_state.planLength);
+}
+
+uint32_t relayChecksum() {
+  return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&s_relays), offsetof(RelayStates, checksum));
+}
+
+bool isValid(esp_reset_reason_t reason, const uint8_t *firmware) {
+  // a crash may come from the state itself and an update may change the layout of the plan, only a
+  // software restart of the same firmware keeps it
+  return reason == ESP_RST_SW && s_state.magic == kStateMagic && s_state.version == kStateVersion &&
+         s_state.planLength <= sizeof(s_state.plan) &&
+         memcmp(s_state.firmware, firmware, kFirmwareIdLength) == 0 && s_state.checksum == stateChecksum();
+}
+
+}  // namespace
+
+void WarmBootCache::init() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  const uint8_t *firmware = esp_app_get_description()->app_elf_sha256;
+
+  portENTER_CRITICAL(&s_lock);
+  // RTC no-init memory holds garbage after power loss, start over unless the whole state is intact
+  s_warm = isValid(reason, firmware);
+  if (!s_warm) {
+    memset(&s_state, 0, sizeof(s_state));
+    s_state.magic = kStateMagic;
+    s_state.version = kStateVersion;
+    memcpy(s_state.firmware, firmware, kFirmwareIdLength);
+  }
+  if (!s_warm || s_relays.checksum != relayChecksum()) {
+    memset(&s_relays, 0, sizeof(s_relays));
+    s_relays.checksum = relayChecksum();
+  }
+  s_state.resetReason = static_cast<uint8_t>(reason);
+  s_state.checksum = stateChecksum();
+  uint8_t flags = s_state.flags;
+  portEXIT_CRITICAL(&s_lock);
+
+  ESP_LOGI(TAG, "%s boot, reset reason %d, cached:%s%s%s", s_warm ? "Warm" : "Cold", reason,
+           (flags & kProgramModeKnown) ? " program mode" : "", (flags & kWifiKnown) ? " wifi" : "",
+           (flags & kPlanKnown) ? " plan" : "");
+}
+
+bool WarmBootCache::isWarm() { return s_warm; }
+
+void WarmBootCache::clear() {
+  portENTER_CRITICAL(&s_lock);
+  s_state.flags = 0;
+  s_state.planLength = 0;
+  s_state.checksum = stateChecksum();
+  memset(&s_relays, 0, sizeof(s_relays));
+  s_relays.checksum = relayChecksum();
+  portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t WarmBootCache::getProgramMode(bool *enabled) {
+  if (enabled == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  portENTER_CRITICAL(&s_lock);
+  if (s_state.flags & kProgramModeKnown) {
+    *enabled = s_state.programMode;
+    err = ESP_OK;
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
+
+void WarmBootCache::setProgramMode(bool enabled) {
+  portENTER_CRITICAL(&s_lock);
+  s_state.flags |= kProgramModeKnown;
+  s_state.programMode = enabled;
+  s_state.checksum = stateChecksum();
+  portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t WarmBootCache::getWifiConnectionCache(WifiConnectionCache *cache, bool *stored) {
+  if (cache == nullptr || stored == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  portENTER_CRITICAL(&s_lock);
+  if (s_state.flags & kWifiKnown) {
+    *stored = (s_state.flags & kWifiStored) != 0;
+    *cache = s_state.wifi;
+    err = ESP_OK;
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
+
+void WarmBootCache::setWifiConnectionCache(const WifiConnectionCache *cache) {
+  portENTER_CRITICAL(&s_lock);
+  s_state.flags |= kWifiKnown;
+  if (cache != nullptr) {
+    s_state.flags |= kWifiStored;
+    s_state.wifi = *cache;
+  } else {
+    s_state.flags &= ~kWifiStored;
+    memset(&s_state.wifi, 0, sizeof(s_state.wifi));
+  }
+  s_state.checksum = stateChecksum();
+  portEXIT_CRITICAL(&s_lock);
+}
+
+bool WarmBootCache::hasPlan() {
+  portENTER_CRITICAL(&s_lock);
+  bool known = (s_state.flags & kPlanKnown) != 0;
+  portEXIT_CRITICAL(&s_lock);
+  return known;
+}
+
+esp_err_t WarmBootCache::getPlan(void *plan, size_t maxLength, size_t *length) {
+  if (plan == nullptr || length == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  portENTER_CRITICAL(&s_lock);
+  if (s_state.flags & kPlanKnown) {
+    *length = s_state.planLength;
+    if (s_state.planLength <= maxLength) {
+      memcpy(plan, s_state.plan, s_state.planLength);
+      err = ESP_OK;
+    } else {
+      err = ESP_ERR_INVALID_SIZE;
+    }
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
+
+esp_err_t WarmBootCache::setPlan(const void *plan, size_t length) {
+  if (plan == nullptr && length > 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (length > sizeof(s_state.plan)) {
+    invalidatePlan();
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  memcpy(s_state.plan, plan, length);
+  s_state.planLength = length;
+  s_state.flags |= kPlanKnown;
+  s_state.checksum = stateChecksum();
+  portEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+void WarmBootCache::invalidatePlan() {
+  portENTER_CRITICAL(&s_lock);
+  s_state.flags &= ~kPlanKnown;
+  s_state.planLength = 0;
+  s_state.checksum = stateChecksum();
+  // the pins may belong to other accessories from now on
+  memset(&s_relays, 0, sizeof(s_relays));
+  s_relays.checksum = relayChecksum();
+  portEXIT_CRITICAL(&s_lock);
+}
+
+size_t WarmBootCache::maxPlanLength() { return sizeof(s_state.plan); }
+
+esp_err_t WarmBootCache::getRelayState(uint8_t pin, bool *power) {
+  if (power == nullptr || pin >= 64) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  uint64_t mask = 1ULL << pin;
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  portENTER_CRITICAL(&s_lock);
+  if (s_relays.known & mask) {
+    *power = (s_relays.power & mask) != 0;
+    err = ESP_OK;
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
+
+void WarmBootCache::setRelayState(uint8_t pin, bool power) {
+  if (pin >= 64) {
+    return;
+  }
+
+  uint64_t mask = 1ULL << pin;
+  portENTER_CRITICAL(&s_lock);
+  // relay states are only kept along with the plan of the accessories they belong to
+  if (s_state.flags & kPlanKnown) {
+    s_relays.known |= mask;
+    if (power) {
+      s_relays.power |= mask;
+    } else {
+      s_relays.power &= ~mask;
+    }
+    s_relays.checksum = relayChecksum();
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+#else
+
+void WarmBootCache::init() {}
+
+bool WarmBootCache::isWarm() { return false; }
+
+void WarmBootCache::clear() {}
+
+esp_err_t WarmBootCache::getProgramMode(bool *enabled) { return ESP_ERR_NOT_FOUND; }
+
+void WarmBootCache::setProgramMode(bool enabled) {}
+
+esp_err_t WarmBootCache::getWifiConnectionCache(WifiConnectionCache *cache, bool *stored) {
+  return ESP_ERR_NOT_FOUND;
+}
+
+void WarmBootCache::setWifiConnectionCache(const WifiConnectionCache *cache) {}
+
+bool WarmBootCache::hasPlan() { return false; }
+
+esp_err_t WarmBootCache::getPlan(void *plan, size_t maxLength, size_t *length) { return ESP_ERR_NOT_FOUND; }
+
+esp_err_t WarmBootCache::setPlan(const void *plan, size_t length) { return ESP_ERR_NOT_SUPPORTED; }
+
+void WarmBootCache::invalidatePlan() {}
+
+size_t WarmBootCache::maxPlanLength() { return 0; }
+
+esp_err_t WarmBootCache::getRelayState(uint8_t pin, bool *power) { return ESP_ERR_NOT_FOUND; }
+
+void WarmBootCache::setRelayState(uint8_t pin, bool power) {}
+
+#endif  // CONFIG_SM_WARM_BOOT_CACHE
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_wifi.h>
+#include <stdint.h>
+
+#include <StorageManagerInterface.hpp>
+
+/**
+ * @brief Joins the station to its network, straight to the last access point when one is cached.
+ *
+ * Once a connection got an IP, its channel and BSSID are stored through the StorageManager. The next
+ * connection is directed at them with a fast scan of that channel only, instead of the scan of every
+ * channel needed to find the network. If the directed connection fails, the cache is forgotten and the
+ * station falls back to a full scan. The time from the start of the connection to IP_EVENT_STA_GOT_IP is
+ * logged and kept for connectTimeMs().
+ *
+ * When Matter owns the station, it connects and reconnects on its own. The station configuration is then
+ * only prepared before each attempt, from the credentials Matter was commissioned with, or from the
+ * stored ones if it has none.
+ */
+class WifiStation {
+ public:
+  /**
+   * @param storageManager Storage of the credentials and of the cached access point.
+   */
+  explicit WifiStation(StorageManagerInterface *storageManager);
+  ~WifiStation();
+
+  /**
+   * @brief Listen to the station events, before the WiFi driver is started.
+   * @param ownsConnection Whether this class connects the station, false when Matter does.
+   * @return ESP_OK on success, an error from esp_err_t otherwise.
+   */
+  esp_err_t start(bool ownsConnection);
+
+  /**
+   * @brief Connect with the stored credentials, dropping the current connection. The station is added
+   * to the access point if the driver runs the access point only.
+   * @return ESP_OK once the connection is started, ESP_ERR_NOT_FOUND if no credentials are stored,
+   *         an error from esp_err_t otherwise.
+   */
+  esp_err_t connect();
+
+  /**
+   * @brief Whether a connection is in progress, including the full scan after a directed attempt failed.
+   */
+  bool connecting() const { return m_state == State::Connecting || m_state == State::Reconnecting; }
+
+  /**
+   * @brief Milliseconds the last connection took to get an IP, 0 before the first one.
+   */
+  uint32_t connectTimeMs() const { return m_connectTimeMs; }
+
+  /**
+   * @brief Whether the last connection went straight to the cached access point.
+   */
+  bool connectedDirected() const { return m_connectedDirected; }
+
+ private:
+  enum class State : uint8_t {
+    Idle,          ///< No connection, or the last one failed
+    Connecting,    ///< Connection in progress
+    Reconnecting,  ///< Dropping the connection to connect again
+    Connected,     ///< Connection has an IP
+  };
+
+  StorageManagerInterface *m_storageManager;  ///< Storage of the credentials and the cached access point
+  bool m_ownsConnection;                      ///< Whether this class connects the station
+  volatile State m_state;                     ///< Connection state, changed by connect() and the events
+  bool m_directed;                            ///< Whether the attempt is directed at the cached access point
+  int64_t m_connectStartUs;                   ///< esp_timer time the connection started
+  uint32_t m_connectTimeMs;                   ///< Time the last connection took to get an IP
+  bool m_connectedDirected;                   ///< Whether the last connection was directed
+  bool m_linkLost;                            ///< Whether an owned connection dropped, retried until back
+
+  // fill the station configuration, directed at the cached access point when directed is true
+  esp_err_t configure(bool directed);
+  // configure and connect, the state must already be Connecting
+  void attempt(bool directed);
+  // store the access point the station just got an IP from
+  void cacheAccessPoint();
+
+  static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+  // delete the copy constructor and the assignment operator
+  WifiStation(const WifiStation &) = delete;
+  WifiStation &operator=(const WifiStation &) = delete;
+};
@@ -0,0 +1,240 @@
+#include "WifiStation.hpp"
+
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+static const char *TAG = "WifiStation";
+
+static portMUX_TYPE s_stateLock = portMUX_INITIALIZER_UNLOCKED;
+
+WifiStation::WifiStation(StorageManagerInterface *storageManager)
+    : m_storageManager(storageManager),
+      m_ownsConnection(false),
+      m_state(State::Idle),
+      m_directed(false),
+      m_connectStartUs(0),
+      m_connectTimeMs(0),
+      m_connectedDirected(false),
+      m_linkLost(false) {}
+
+WifiStation::~WifiStation() {
+  esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler);
+  esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler);
+}
+
+esp_err_t WifiStation::start(bool ownsConnection) {
+  m_ownsConnection = ownsConnection;
+
+  esp_err_t err = esp_event_loop_create_default();
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  err = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, this);
+  if (err == ESP_OK) {
+    err = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, this);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to register station event handler: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+esp_err_t WifiStation::connect() {
+  if (!m_ownsConnection) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  WifiCredentials credentials;
+  esp_err_t err = m_storageManager->getWifiCredentials(&credentials);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  wifi_mode_t mode;
+  err = esp_wifi_get_mode(&mode);
+  if (err != ESP_OK) {
+    return err;
+  }
+  if (mode == WIFI_MODE_AP) {
+    /* The station starts next to the access point, WIFI_EVENT_STA_START connects it */
+    return esp_wifi_set_mode(WIFI_MODE_APSTA);
+  }
+
+  portENTER_CRITICAL(&s_stateLock);
+  State state = m_state;
+  m_state = state == State::Idle ? State::Connecting : State::Reconnecting;
+  m_connectStartUs = esp_timer_get_time();
+  /* New credentials get a single directed attempt and full scan, like the first connection */
+  m_linkLost = false;
+  portEXIT_CRITICAL(&s_stateLock);
+
+  if (state == State::Idle) {
+    attempt(true);
+    return ESP_OK;
+  }
+  /* WIFI_EVENT_STA_DISCONNECTED connects again */
+  return state == State::Reconnecting ? ESP_OK : esp_wifi_disconnect();
+}
+
+esp_err_t WifiStation::configure(bool directed) {
+  wifi_config_t config;
+  esp_err_t err = esp_wifi_get_config(WIFI_IF_STA, &config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  /* Matter's credentials win over the stored ones, it was commissioned with them */
+  WifiCredentials credentials;
+  if ((m_ownsConnection || config.sta.ssid[0] == '\0') &&
+      m_storageManager->getWifiCredentials(&credentials) == ESP_OK) {
+    memset(config.sta.ssid, 0, sizeof(config.sta.ssid));
+    memset(config.sta.password, 0, sizeof(config.sta.password));
+    memcpy(config.sta.ssid, credentials.ssid, strnlen(credentials.ssid, sizeof(config.sta.ssid)));
+    memcpy(config.sta.password, credentials.password,
+           strnlen(credentials.password, sizeof(config.sta.password)));
+  }
+  if (config.sta.ssid[0] == '\0') {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  WifiConnectionCache cache = {};
+#ifdef CONFIG_WM_DIRECTED_CONNECT
+  const char *ssid = reinterpret_cast<const char *>(config.sta.ssid);
+  directed = directed && m_storageManager->getWifiConnectionCache(&cache) == ESP_OK && cache.channel != 0 &&
+             strncmp(cache.ssid, ssid, sizeof(config.sta.ssid)) == 0;
+#else
+  directed = false;
+#endif
+  if (directed) {
+    /* Probe the cached channel only and join the cached BSSID, no matter what else answers */
+    config.sta.scan_method = WIFI_FAST_SCAN;
+    config.sta.bssid_set = true;
+    memcpy(config.sta.bssid, cache.bssid, sizeof(config.sta.bssid));
+    config.sta.channel = cache.channel;
+  } else {
+    config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    config.sta.bssid_set = false;
+    config.sta.channel = 0;
+  }
+  m_directed = directed;
+
+  err = esp_wifi_set_config(WIFI_IF_STA, &config);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set the station config: %s", esp_err_to_name(err));
+  } else if (directed) {
+    ESP_LOGI(TAG, "Connecting to " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+  }
+  return err;
+}
+
+void WifiStation::attempt(bool directed) {
+  esp_err_t err = configure(directed);
+  if (err == ESP_OK) {
+    err = esp_wifi_connect();
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Station not connected: %s", esp_err_to_name(err));
+    portENTER_CRITICAL(&s_stateLock);
+    m_state = State::Idle;
+    portEXIT_CRITICAL(&s_stateLock);
+  }
+}
+
+void WifiStation::cacheAccessPoint() {
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+    return;
+  }
+
+  WifiConnectionCache cache;
+  memset(&cache, 0, sizeof(cache));
+  memcpy(cache.ssid, ap.ssid, sizeof(cache.ssid) - 1);
+  memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+  cache.channel = ap.primary;
+
+  /* Spare the flash, the access point is usually the cached one */
+  WifiConnectionCache stored;
+  if (m_storageManager->getWifiConnectionCache(&stored) == ESP_OK &&
+      memcmp(&stored, &cache, sizeof(cache)) == 0) {
+    return;
+  }
+  if (m_storageManager->setWifiConnectionCache(&cache) == ESP_OK) {
+    ESP_LOGI(TAG, "Cached " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+  }
+}
+
+void WifiStation::event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+  WifiStation *self = static_cast<WifiStation *>(arg);
+
+  if (event_base == IP_EVENT) {
+    portENTER_CRITICAL(&s_stateLock);
+    self->m_state = State::Connected;
+    self->m_linkLost = false;
+    portEXIT_CRITICAL(&s_stateLock);
+
+    self->m_connectTimeMs = static_cast<uint32_t>((esp_timer_get_time() - self->m_connectStartUs) / 1000);
+    self->m_connectedDirected = self->m_directed;
+    ESP_LOGI(TAG, "Got an IP %lu ms after the connection started, %s", (unsigned long)self->m_connectTimeMs,
+             self->m_directed ? "directed at the cached access point" : "after a full scan");
+    self->cacheAccessPoint();
+    return;
+  }
+
+  if (event_id == WIFI_EVENT_STA_START) {
+    portENTER_CRITICAL(&s_stateLock);
+    self->m_state = State::Connecting;
+    self->m_connectStartUs = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_stateLock);
+
+    /* Matter connects once its own handler ran, with the configuration left here */
+    if (self->m_ownsConnection) {
+      self->attempt(true);
+    } else {
+      self->configure(true);
+    }
+  } else if (event_id == WIFI_EVENT_STA_STOP) {
+    portENTER_CRITICAL(&s_stateLock);
+    self->m_state = State::Idle;
+    self->m_linkLost = false;
+    portEXIT_CRITICAL(&s_stateLock);
+  } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+    wifi_event_sta_disconnected_t *event = static_cast<wifi_event_sta_disconnected_t *>(event_data);
+
+    /* A directed attempt that failed is retried with a full scan, the access point may have moved. A
+       connection this class made that dropped, e.g. as the access point rebooted, is retried the same
+       way until it is back */
+    portENTER_CRITICAL(&s_stateLock);
+    State state = self->m_state;
+    bool fallback = state == State::Connecting && self->m_directed;
+    if (state == State::Connected) {
+      self->m_connectStartUs = esp_timer_get_time();
+      self->m_linkLost = self->m_ownsConnection;
+    }
+    bool retry = fallback || self->m_linkLost || state == State::Reconnecting || !self->m_ownsConnection;
+    self->m_state = retry ? State::Connecting : State::Idle;
+    portEXIT_CRITICAL(&s_stateLock);
+
+    if (state == State::Connected && self->m_ownsConnection) {
+      ESP_LOGW(TAG, "Connection lost (reason %u), reconnecting", event->reason);
+    }
+    if (fallback) {
+      ESP_LOGW(TAG, "Directed connection failed (reason %u), scanning all channels", event->reason);
+      self->m_storageManager->setWifiConnectionCache(nullptr);
+    }
+    if (self->m_ownsConnection) {
+      if (retry) {
+        self->attempt(!fallback);
+      }
+    } else if (fallback || state == State::Connected) {
+      /* Matter reconnects after its own delay, with whatever is configured by then */
+      self->configure(!fallback);
+    }
+  }
+}
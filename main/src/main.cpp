@@ -3,23 +3,53 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <nvs_flash.h>
+#include <stdlib.h>
 
 #include "AccessPoint.hpp"
+#include "AppEventBus.hpp"
+#include "BootTimeline.hpp"
 #include "ButtonModule.hpp"
 #include "EndpointManager.hpp"
+#include "PerfConsole.hpp"
 #include "RelayModule.hpp"
 #include "StatusControlManager.hpp"
 #include "StorageManager.hpp"
+#include "TaskMonitor.hpp"
+#include "WarmBootCache.hpp"
 
 static const char *TAG = "main";
 
+// read the stored accessory DB, sized to it as it is no longer bounded by a single NVS string, empty if none
+static char *read_accessory_json(StorageManager *storageManager) {
+  char *jsonArray = nullptr;
+  if (storageManager->getAccessoryJsonCopy(&jsonArray, nullptr) != ESP_OK) {
+    jsonArray = (char *)calloc(1, sizeof(char));
+  }
+  return jsonArray;
+}
+
 extern "C" void app_main() {
+  // first, every later phase is stamped against this boot's timeline
+  BootTimeline::init();
   ESP_ERROR_CHECK(nvs_flash_init());
+  BootTimeline::mark(BootPhase::NvsReady);
+  // before the managers, they subscribe and publish from their constructors on
+  ESP_ERROR_CHECK(AppEventBus::start());
+
+  // FreeRTOS does not report stack sizes, the monitor rates the stacks we size against them
+  TaskMonitor::setStackSize("main", CONFIG_ESP_MAIN_TASK_STACK_SIZE);
+  TaskMonitor::setStackSize("esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE);
+  TaskMonitor::setStackSize("httpd", CONFIG_AP_WEB_STACK_SIZE);
+  TaskMonitor::setStackSize("httpWorker", CONFIG_AP_WORKER_STACK_SIZE);
+  TaskMonitor::setStackSize("apSession", CONFIG_AP_WORKER_STACK_SIZE);
+  TaskMonitor::setStackSize("appEvents", CONFIG_EB_DISPATCH_STACK_SIZE);
+  TaskMonitor::start();
 
   ESP_LOGI(TAG, "Starting Access Point Manager");
 
   // create an instance of the StorageManager class
   StorageManager *storageManager = new StorageManager();
+  BootTimeline::mark(BootPhase::StorageReady);
   ButtonModule *buttonModule = new ButtonModule(5);
   RelayModule *relayModule = new RelayModule(2);
   StatusControlManager *statusControlManager =
@@ -27,27 +57,60 @@ extern "C" void app_main() {
   AccessPoint *accessPoint;
   EndpointManager *endpointManager;
 
-  int numAcc = 4000;
-  char *jsonArray = (char *)calloc(numAcc, sizeof(char));
-
+  // after a software restart the flag comes from the warm boot cache instead of NVS
   bool progFlag = false;
-  if (storageManager->isProgramModeEnabled(&progFlag) == ESP_OK && (progFlag == true)) {
+  esp_err_t programModeErr = storageManager->isProgramModeEnabled(&progFlag);
+  BootTimeline::mark(BootPhase::ProgramModeRead);
+  if (programModeErr == ESP_OK && (progFlag == true)) {
     // create an instance of the AccessPoint class
     statusControlManager->updateStatusMode(DeviceStatusMode::InProgramMode);
     accessPoint = new AccessPoint(storageManager);
-    accessPoint->startWebServer();
+    // a firmware that serves the config UI can always be updated again
+    if (accessPoint->startWebServer() == ESP_OK) {
+      BootTimeline::mark(BootPhase::WebServerStarted);
+      BootTimeline::mark(BootPhase::Operational);
+      statusControlManager->confirmFirmware();
+    }
   } else {
-    storageManager->getAccessoryJson(jsonArray, numAcc);
-    if (strlen(jsonArray) <= 0) {
+    // a software restart kept the decoded accessories, the accessory DB is then neither read nor parsed
+    bool warmBoot = WarmBootCache::hasPlan();
+    char *jsonArray = warmBoot ? nullptr : read_accessory_json(storageManager);
+    BootTimeline::mark(BootPhase::AccessoriesRead);
+    if (!warmBoot && strlen(jsonArray) <= 0) {
       statusControlManager->updateStatusMode(DeviceStatusMode::InProgramMode);
       accessPoint = new AccessPoint(storageManager);
-      accessPoint->startWebServer();
+      if (accessPoint->startWebServer() == ESP_OK) {
+        BootTimeline::mark(BootPhase::WebServerStarted);
+        BootTimeline::mark(BootPhase::Operational);
+        statusControlManager->confirmFirmware();
+      }
     } else {
       // create an instance of the EndpointManager class
-      statusControlManager->updateStatusMode(DeviceStatusMode::RunningAsExpected);
       endpointManager = new EndpointManager(true);
-      endpointManager->createArrayOfEndpoints(jsonArray, strlen(jsonArray));
-      endpointManager->startMatter();
+      if (!warmBoot || endpointManager->createEndpointsFromWarmBoot() != ESP_OK) {
+        if (jsonArray == nullptr) {
+          jsonArray = read_accessory_json(storageManager);
+        }
+        endpointManager->createArrayOfEndpoints(jsonArray, strlen(jsonArray));
+      }
+      BootTimeline::mark(BootPhase::EndpointsCreated);
+      // the config UI runs next to Matter, a double press opens a session and applies the changes live
+      accessPoint = new AccessPoint(storageManager, endpointManager);
+      accessPoint->setSessionListener(
+          [](bool open, void *context) {
+            static_cast<StatusControlManager *>(context)->updateStatusMode(
+                open ? DeviceStatusMode::InProgramMode : DeviceStatusMode::RunningAsExpected);
+          },
+          statusControlManager);
+      statusControlManager->setLiveConfigHandler(
+          [](void *context) { static_cast<AccessPoint *>(context)->toggleSession(); }, accessPoint);
+      // an updated firmware is confirmed later, once the Matter stack has an address or can be commissioned
+      if (endpointManager->startMatter() == ESP_OK) {
+        BootTimeline::mark(BootPhase::MatterStarted);
+        statusControlManager->updateStatusMode(DeviceStatusMode::RunningAsExpected);
+      }
+      PerfConsole::registerCommands(storageManager);
     }
+    free(jsonArray);
   }
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Compare two runs of the endpoint creation benchmark of the host build (tools/loadtest/host).
+
+Each result is matched by its name, device type and database size. The median time, the allocations and
+the peak heap of the new run are printed next to the baseline, and the script fails when one grew past its
+threshold. Times vary from run to run, allocations and heap only with the code, so they get a tighter one.
+
+Example:
+  cmake -S tools/loadtest/host -B build-host && cmake --build build-host
+  build-host/endpoint_bench --label "$(git rev-parse --short HEAD)" --output out/bench-baseline.json
+  # ... change and rebuild ...
+  build-host/endpoint_bench --output out/bench.json
+  tools/loadtest/bench_compare.py out/bench-baseline.json out/bench.json
+"""
+
+import argparse
+import json
+import sys
+
+TIME_METRICS = ("median_ns",)
+MEMORY_METRICS = ("allocations", "peak_heap")
+
+
+def key(result):
+    return (result["name"], result.get("type", ""), result["devices"])
+
+
+def describe(result):
+    name, kind, devices = key(result)
+    return "{} {}".format(name, kind) if kind else "{} x{}".format(name, devices)
+
+
+def compare(current, baseline, max_time_regression, max_memory_regression):
+    """Print the metrics of both runs and list those that grew past their threshold, in percent."""
+    previous = {key(result): result for result in baseline["results"]}
+    regressions = []
+    print("{:<36} {:>24} {:>20} {:>22}".format("result", "median ns", "allocations", "peak heap"))
+    for result in current["results"]:
+        before = previous.get(key(result))
+        if before is None:
+            continue
+        cells = []
+        for metric in TIME_METRICS + MEMORY_METRICS:
+            old, new = before.get(metric), result.get(metric)
+            if old is None or new is None:
+                cells.append("-")
+                continue
+            growth = (new - old) * 100.0 / old if old else (100.0 if new else 0.0)
+            cells.append("{} -> {} ({:+.0f}%)".format(old, new, growth))
+            limit = max_time_regression if metric in TIME_METRICS else max_memory_regression
+            if growth > limit:
+                regressions.append("{} {}: {} -> {} (+{:.0f}%)".format(describe(result), metric, old, new,
+                                                                      growth))
+        print("{:<36} {:>24} {:>20} {:>22}".format(describe(result), *cells))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", help="endpoint_bench output of the earlier commit")
+    parser.add_argument("current", help="endpoint_bench output to check")
+    parser.add_argument("--max-regression", type=float, default=20.0,
+                        help="percent the median time of a result may grow over the baseline")
+    parser.add_argument("--max-memory-regression", type=float, default=0.0,
+                        help="percent the allocations or peak heap of a result may grow over the baseline")
+    args = parser.parse_args()
+
+    with open(args.baseline) as baseline, open(args.current) as current:
+        regressions = compare(json.load(current), json.load(baseline), args.max_regression,
+                              args.max_memory_regression)
+    for regression in regressions:
+        print("REGRESSION " + regression)
+    if regressions:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
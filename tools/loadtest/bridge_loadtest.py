@@ -0,0 +1,387 @@
+#!/usr/bin/env python3
+"""Controller-side load generator for the Matter bridge.
+
+Drives a commissioned bridge (or any Matter bridge reachable from this host) through chip-tool in
+interactive mode:
+
+  * one subscription to OnOff per bridged endpoint, kept alive for the whole run,
+  * OnOff toggles at a configurable rate, spread round-robin over the endpoints by several workers,
+  * optional group toggles to a pre-provisioned group,
+  * periodic reads of the Software Diagnostics heap attributes.
+
+It reports p50/p99 command latency (command sent to command response), p50/p99 report latency (command
+sent to the subscription report of the same endpoint), command timeouts, dropped subscriptions and the
+device heap over time. The summary is printed and optionally written as JSON, so runs can be compared.
+
+Example:
+  tools/loadtest/bridge_loadtest.py --node-id 0x1234 --pair-code MT:Y.K9042C00KA0648G00 \\
+      --endpoints 2-41 --rate 20 --workers 4 --duration 300 --json out/loadtest.json
+"""
+
+import argparse
+import itertools
+import json
+import math
+import os
+import queue
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+RE_COMMAND_STATUS = re.compile(
+    r"Received Command Response Status for Endpoint=(\d+) Cluster=0x0000_0006 Command=0x[0-9A-Fa-f_]+ "
+    r"Status=0x([0-9A-Fa-f]+)")
+RE_REPORT = re.compile(r"Endpoint: (\d+) Cluster: 0x0000_0006 Attribute 0x0000_0000")
+RE_SUBSCRIPTION_DROP = re.compile(r"Subscription Liveness timeout|OnResubscriptionNeeded|Resubscription")
+RE_SUBSCRIPTION_ESTABLISHED = re.compile(r"Subscription established with SubscriptionID")
+RE_HEAP = re.compile(r"(CurrentHeapFree|CurrentHeapUsed|CurrentHeapHighWatermark): (\d+)")
+RE_PARTS = re.compile(r"^\s*\[\d+\]:\s*(\d+)\s*$")
+
+
+def percentile(samples, pct):
+    if not samples:
+        return None
+    ordered = sorted(samples)
+    index = min(len(ordered) - 1, max(0, math.ceil(pct / 100.0 * len(ordered)) - 1))
+    return ordered[index]
+
+
+def parse_endpoints(spec):
+    endpoints = []
+    for part in spec.split(","):
+        if "-" in part:
+            first, last = part.split("-")
+            endpoints.extend(range(int(first), int(last) + 1))
+        elif part:
+            endpoints.append(int(part))
+    return endpoints
+
+
+class ChipToolSession:
+    """A chip-tool interactive process, with every output line fanned out to listeners."""
+
+    def __init__(self, chip_tool, storage, name):
+        self.name = name
+        self.listeners = []
+        self.lock = threading.Lock()
+        self.process = subprocess.Popen(
+            [chip_tool, "interactive", "start", "--storage-directory", storage],
+            stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True, bufsize=1)
+        self.reader = threading.Thread(target=self._read, name=name + "-reader", daemon=True)
+        self.reader.start()
+
+    def _read(self):
+        for line in self.process.stdout:
+            with self.lock:
+                listeners = list(self.listeners)
+            for listener in listeners:
+                listener(line)
+
+    def add_listener(self, listener):
+        with self.lock:
+            self.listeners.append(listener)
+
+    def send(self, command):
+        self.process.stdin.write(command + "\n")
+        self.process.stdin.flush()
+
+    def close(self):
+        try:
+            self.send("quit()")
+            self.process.wait(timeout=5)
+        except (OSError, subprocess.TimeoutExpired):
+            self.process.kill()
+
+
+class Stats:
+    """Thread safe collection of all measurements of a run."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.command_latency = []
+        self.report_latency = []
+        self.command_errors = 0
+        self.command_timeouts = 0
+        self.group_commands = 0
+        self.subscriptions = 0
+        self.subscription_drops = 0
+        self.heap = []
+        self.pending_reports = {}
+
+    def command_sent(self, endpoint, sent):
+        with self.lock:
+            self.pending_reports[endpoint] = sent
+
+    def command_done(self, latency, ok):
+        with self.lock:
+            if latency is None:
+                self.command_timeouts += 1
+            elif ok:
+                self.command_latency.append(latency)
+            else:
+                self.command_errors += 1
+
+    def report_received(self, endpoint, received):
+        with self.lock:
+            sent = self.pending_reports.pop(endpoint, None)
+            if sent is not None:
+                self.report_latency.append(received - sent)
+
+    def snapshot(self):
+        with self.lock:
+            return {
+                "commands": len(self.command_latency),
+                "command_errors": self.command_errors,
+                "command_timeouts": self.command_timeouts,
+                "command_p50_ms": _ms(percentile(self.command_latency, 50)),
+                "command_p99_ms": _ms(percentile(self.command_latency, 99)),
+                "reports": len(self.report_latency),
+                "report_p50_ms": _ms(percentile(self.report_latency, 50)),
+                "report_p99_ms": _ms(percentile(self.report_latency, 99)),
+                "group_commands": self.group_commands,
+                "subscriptions": self.subscriptions,
+                "subscription_drops": self.subscription_drops,
+                "heap_free": self.heap[-1]["CurrentHeapFree"] if self.heap else None,
+            }
+
+
+def _ms(seconds):
+    return None if seconds is None else round(seconds * 1000.0, 2)
+
+
+class CommandWorker(threading.Thread):
+    """Sends OnOff toggles from the shared schedule and waits for each command response."""
+
+    def __init__(self, session, args, schedule, stats, stop):
+        super().__init__(name=session.name, daemon=True)
+        self.session = session
+        self.args = args
+        self.schedule = schedule
+        self.stats = stats
+        self.stop = stop
+        self.responses = queue.Queue()
+        session.add_listener(self._on_line)
+
+    def _on_line(self, line):
+        match = RE_COMMAND_STATUS.search(line)
+        if match:
+            self.responses.put((int(match.group(1)), int(match.group(2), 16) == 0, time.monotonic()))
+
+    def run(self):
+        while not self.stop.is_set():
+            try:
+                endpoint = self.schedule.get(timeout=0.2)
+            except queue.Empty:
+                continue
+
+            while not self.responses.empty():
+                self.responses.get_nowait()
+
+            sent = time.monotonic()
+            self.stats.command_sent(endpoint, sent)
+            self.session.send("onoff toggle {} {}".format(self.args.node_id, endpoint))
+
+            deadline = sent + self.args.timeout
+            latency, ok = None, False
+            while time.monotonic() < deadline:
+                try:
+                    responded, ok, received = self.responses.get(timeout=max(0.0, deadline - time.monotonic()))
+                except queue.Empty:
+                    break
+                if responded == endpoint:
+                    latency = received - sent
+                    break
+            self.stats.command_done(latency, ok)
+
+
+class SubscriptionMonitor:
+    """Keeps one OnOff subscription per endpoint and polls the device heap on the same session."""
+
+    def __init__(self, session, args, endpoints, stats):
+        self.session = session
+        self.args = args
+        self.endpoints = endpoints
+        self.stats = stats
+        self.heap_sample = {}
+        session.add_listener(self._on_line)
+
+    def _on_line(self, line):
+        now = time.monotonic()
+        match = RE_REPORT.search(line)
+        if match:
+            self.stats.report_received(int(match.group(1)), now)
+            return
+        if RE_SUBSCRIPTION_ESTABLISHED.search(line):
+            with self.stats.lock:
+                self.stats.subscriptions += 1
+            return
+        if RE_SUBSCRIPTION_DROP.search(line):
+            with self.stats.lock:
+                self.stats.subscription_drops += 1
+            return
+        match = RE_HEAP.search(line)
+        if match:
+            self.heap_sample[match.group(1)] = int(match.group(2))
+            if len(self.heap_sample) == 3:
+                sample = dict(self.heap_sample, t=round(now - self.args.started, 1))
+                with self.stats.lock:
+                    self.stats.heap.append(sample)
+                self.heap_sample = {}
+
+    def subscribe(self):
+        for endpoint in self.endpoints:
+            self.session.send("onoff subscribe on-off {} {} {} {} --keepSubscriptions true".format(
+                self.args.min_interval, self.args.max_interval, self.args.node_id, endpoint))
+            time.sleep(self.args.subscribe_spacing)
+
+    def poll_heap(self):
+        for attribute in ("current-heap-free", "current-heap-used", "current-heap-high-watermark"):
+            self.session.send("softwarediagnostics read {} {} 0".format(attribute, self.args.node_id))
+
+
+def commission(args):
+    command = [args.chip_tool, "pairing", "code", str(args.node_id), args.pair_code,
+               "--storage-directory", args.storage]
+    print("Commissioning node {} ...".format(args.node_id), flush=True)
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True,
+                            timeout=args.commission_timeout)
+    if result.returncode != 0:
+        sys.exit("Commissioning failed:\n" + result.stdout[-4000:])
+
+
+def discover_endpoints(args):
+    command = [args.chip_tool, "descriptor", "read", "parts-list", str(args.node_id), "1",
+               "--storage-directory", args.storage]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True, timeout=60)
+    endpoints = []
+    for line in result.stdout.splitlines():
+        match = RE_PARTS.search(line.split("CHIP:TOO:")[-1])
+        if match:
+            endpoints.append(int(match.group(1)))
+    if not endpoints:
+        sys.exit("Could not read the aggregator parts list, pass --endpoints")
+    return endpoints
+
+
+def worker_storage(args, index):
+    """Each chip-tool process gets its own copy of the commissioned fabric storage."""
+    path = os.path.join(args.workdir, "worker{}".format(index))
+    shutil.copytree(args.storage, path, dirs_exist_ok=True)
+    return path
+
+
+def positive_int(value):
+    """Argument type of the counts that need at least one, e.g. the workers the group toggles go out on."""
+    number = int(value)
+    if number < 1:
+        raise argparse.ArgumentTypeError("must be at least 1, got {}".format(value))
+    return number
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--chip-tool", default="chip-tool", help="path of the chip-tool binary")
+    parser.add_argument("--storage", default=os.path.join(tempfile.gettempdir(), "bridge_loadtest"),
+                        help="chip-tool storage directory holding the controller fabric")
+    parser.add_argument("--node-id", type=lambda v: int(v, 0), required=True, help="node id of the bridge")
+    parser.add_argument("--pair-code", help="commission the bridge with this setup code before the run")
+    parser.add_argument("--commission-timeout", type=int, default=180)
+    parser.add_argument("--endpoints", help="endpoints to drive, e.g. 2-41 (default: aggregator parts list)")
+    parser.add_argument("--rate", type=float, default=10.0, help="total toggle commands per second")
+    parser.add_argument("--workers", type=positive_int, default=4,
+                        help="parallel chip-tool command sessions, the first also sends the group toggles")
+    parser.add_argument("--timeout", type=float, default=10.0, help="command response timeout in seconds")
+    parser.add_argument("--group-id", type=lambda v: int(v, 0), help="pre-provisioned group to toggle")
+    parser.add_argument("--group-period", type=float, default=5.0, help="seconds between group toggles")
+    parser.add_argument("--min-interval", type=int, default=0, help="subscription min interval")
+    parser.add_argument("--max-interval", type=int, default=60, help="subscription max interval")
+    parser.add_argument("--subscribe-spacing", type=float, default=0.2, help="seconds between subscribes")
+    parser.add_argument("--heap-period", type=float, default=10.0, help="seconds between heap reads")
+    parser.add_argument("--interval", type=float, default=10.0, help="seconds between progress lines")
+    parser.add_argument("--duration", type=float, default=60.0, help="length of the load phase in seconds")
+    parser.add_argument("--json", help="write the summary as JSON to this file")
+    args = parser.parse_args()
+
+    os.makedirs(args.storage, exist_ok=True)
+    args.workdir = tempfile.mkdtemp(prefix="bridge_loadtest_")
+
+    if args.pair_code:
+        commission(args)
+    endpoints = parse_endpoints(args.endpoints) if args.endpoints else discover_endpoints(args)
+    print("Driving {} endpoints: {}".format(len(endpoints), endpoints), flush=True)
+
+    stats = Stats()
+    stop = threading.Event()
+    schedule = queue.Queue(maxsize=args.workers * 2)
+    args.started = time.monotonic()
+
+    monitor_session = ChipToolSession(args.chip_tool, worker_storage(args, 0), "subscriber")
+    monitor = SubscriptionMonitor(monitor_session, args, endpoints, stats)
+    monitor.subscribe()
+
+    sessions = [monitor_session]
+    workers = []
+    for index in range(args.workers):
+        session = ChipToolSession(args.chip_tool, worker_storage(args, index + 1), "worker{}".format(index))
+        sessions.append(session)
+        workers.append(CommandWorker(session, args, schedule, stats, stop))
+    for worker in workers:
+        worker.start()
+
+    targets = itertools.cycle(endpoints)
+    period = 1.0 / args.rate
+    started = time.monotonic()
+    next_command = next_group = next_heap = next_progress = started
+    try:
+        while time.monotonic() - started < args.duration:
+            now = time.monotonic()
+            if now >= next_command:
+                try:
+                    schedule.put_nowait(next(targets))
+                except queue.Full:
+                    pass  # workers saturated, the achieved rate shows up in the command count
+                next_command += period
+            if args.group_id is not None and now >= next_group:
+                # sessions[0] is the subscriber, group toggles go out on the first worker session
+                sessions[1].send("onoff toggle 0xFFFFFFFFFFFF{:04X} 1".format(args.group_id))
+                with stats.lock:
+                    stats.group_commands += 1
+                next_group += args.group_period
+            if now >= next_heap:
+                monitor.poll_heap()
+                next_heap += args.heap_period
+            if now >= next_progress:
+                print("[{:6.1f}s] {}".format(now - started, json.dumps(stats.snapshot())), flush=True)
+                next_progress += args.interval
+            time.sleep(max(0.0, min(next_command, next_progress) - time.monotonic()))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stop.set()
+        for worker in workers:
+            worker.join(timeout=args.timeout)
+        for session in sessions:
+            session.close()
+        shutil.rmtree(args.workdir, ignore_errors=True)
+
+    elapsed = time.monotonic() - started
+    summary = stats.snapshot()
+    summary.update({
+        "endpoints": len(endpoints),
+        "duration_s": round(elapsed, 1),
+        "target_rate": args.rate,
+        "achieved_rate": round(summary["commands"] / elapsed, 2) if elapsed else 0,
+        "heap": stats.heap,
+    })
+    print(json.dumps(summary, indent=2))
+    if args.json:
+        with open(args.json, "w") as out:
+            json.dump(summary, out, indent=2)
+
+
+if __name__ == "__main__":
+    main()
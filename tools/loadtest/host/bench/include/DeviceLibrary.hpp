@@ -0,0 +1,174 @@
+#pragma once
+
+#include <esp_matter.h>
+#include <stdint.h>
+
+/* Host stand-in for the devicemodule and accessorymodule libraries. Modules keep their pin and state,
+   accessories own their modules and devices own their accessory and a bridged endpoint without clusters,
+   so creating a device allocates the same objects as on the device minus the Matter data model */
+
+class RelayModuleInterface {
+ public:
+  virtual ~RelayModuleInterface() = default;
+  virtual void setPower(bool power) = 0;
+  virtual bool getPower() = 0;
+};
+
+class RelayModule : public RelayModuleInterface {
+ public:
+  explicit RelayModule(uint8_t pin, uint8_t level = 1, bool saveState = false) : m_pin(pin), m_power(false) {}
+  void setPower(bool power) override { m_power = power; }
+  bool getPower() override { return m_power; }
+
+ private:
+  uint8_t m_pin;
+  bool m_power;
+};
+
+class ButtonModuleInterface {
+ public:
+  typedef void (*ButtonCallback)(void *arg);
+
+  virtual ~ButtonModuleInterface() = default;
+  virtual void setSinglePressCallback(ButtonCallback callback, void *arg) = 0;
+  virtual void setDoublePressCallback(ButtonCallback callback, void *arg) = 0;
+  virtual void setLongPressCallback(ButtonCallback callback, void *arg) = 0;
+};
+
+class ButtonModule : public ButtonModuleInterface {
+ public:
+  explicit ButtonModule(uint8_t pin, uint8_t level = 0, uint16_t debounceMs = 50, uint16_t longPressMs = 1000,
+                        uint16_t doublePressMs = 300)
+      : m_pin(pin), m_callbacks() {}
+  void setSinglePressCallback(ButtonCallback callback, void *arg) override {
+    m_callbacks[0] = {callback, arg};
+  }
+  void setDoublePressCallback(ButtonCallback callback, void *arg) override {
+    m_callbacks[1] = {callback, arg};
+  }
+  void setLongPressCallback(ButtonCallback callback, void *arg) override {
+    m_callbacks[2] = {callback, arg};
+  }
+
+ private:
+  struct Callback {
+    ButtonCallback callback;
+    void *arg;
+  };
+  uint8_t m_pin;
+  Callback m_callbacks[3];
+};
+
+class AccessoryInterface {
+ public:
+  virtual ~AccessoryInterface() = default;
+  virtual void identify() {}
+};
+
+/* Light, fan and plugin accessories share their shape, a relay toggled by a button */
+class SwitchedAccessory : public AccessoryInterface {
+ public:
+  SwitchedAccessory(RelayModuleInterface *relay, ButtonModuleInterface *button)
+      : m_relay(relay), m_button(button) {
+    m_button->setSinglePressCallback(
+        [](void *self) { static_cast<SwitchedAccessory *>(self)->toggle(); }, this);
+  }
+  ~SwitchedAccessory() override {
+    delete m_relay;
+    delete m_button;
+  }
+  void toggle() { m_relay->setPower(!m_relay->getPower()); }
+
+ private:
+  RelayModuleInterface *m_relay;
+  ButtonModuleInterface *m_button;
+};
+
+class LightAccessory : public SwitchedAccessory {
+  using SwitchedAccessory::SwitchedAccessory;
+};
+
+class FanAccessory : public SwitchedAccessory {
+  using SwitchedAccessory::SwitchedAccessory;
+};
+
+class PluginAccessory : public SwitchedAccessory {
+  using SwitchedAccessory::SwitchedAccessory;
+};
+
+class StatelessButtonAccessory : public AccessoryInterface {
+ public:
+  explicit StatelessButtonAccessory(ButtonModuleInterface *button) : m_button(button) {}
+  ~StatelessButtonAccessory() override { delete m_button; }
+
+ private:
+  ButtonModuleInterface *m_button;
+};
+
+class BlindAccessory : public AccessoryInterface {
+ public:
+  BlindAccessory(RelayModuleInterface *motorUp, RelayModuleInterface *motorDown,
+                 ButtonModuleInterface *buttonUp, ButtonModuleInterface *buttonDown, uint32_t timeToOpen,
+                 uint32_t timeToClose)
+      : m_motorUp(motorUp),
+        m_motorDown(motorDown),
+        m_buttonUp(buttonUp),
+        m_buttonDown(buttonDown),
+        m_timeToOpen(timeToOpen),
+        m_timeToClose(timeToClose) {}
+  ~BlindAccessory() override {
+    delete m_motorUp;
+    delete m_motorDown;
+    delete m_buttonUp;
+    delete m_buttonDown;
+  }
+
+ private:
+  RelayModuleInterface *m_motorUp;
+  RelayModuleInterface *m_motorDown;
+  ButtonModuleInterface *m_buttonUp;
+  ButtonModuleInterface *m_buttonDown;
+  uint32_t m_timeToOpen;
+  uint32_t m_timeToClose;
+};
+
+class BaseDeviceInterface {
+ public:
+  virtual ~BaseDeviceInterface() = default;
+  virtual void identify() = 0;
+  virtual void updateAccessory(uint32_t attributeId) = 0;
+};
+
+/* A bridged endpoint under the aggregator, or on the root node without one */
+class BridgedDevice : public BaseDeviceInterface {
+ public:
+  BridgedDevice(char *name, AccessoryInterface *accessory, esp_matter::endpoint_t *aggregator);
+  ~BridgedDevice() override { delete m_accessory; }
+  void identify() override { m_accessory->identify(); }
+  void updateAccessory(uint32_t attributeId) override {}
+
+ private:
+  char m_name[33];
+  AccessoryInterface *m_accessory;
+  esp_matter::endpoint_t *m_endpoint;
+};
+
+class LightDevice : public BridgedDevice {
+  using BridgedDevice::BridgedDevice;
+};
+
+class FanDevice : public BridgedDevice {
+  using BridgedDevice::BridgedDevice;
+};
+
+class PluginDevice : public BridgedDevice {
+  using BridgedDevice::BridgedDevice;
+};
+
+class ButtonDevice : public BridgedDevice {
+  using BridgedDevice::BridgedDevice;
+};
+
+class WindowDevice : public BridgedDevice {
+  using BridgedDevice::BridgedDevice;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Host stand-in for the commissioning window and the CHIP error and timer types it uses */
+typedef int32_t CHIP_ERROR;
+#define CHIP_NO_ERROR 0
+
+namespace chip {
+
+inline const char *ErrorStr(CHIP_ERROR err) { return err == CHIP_NO_ERROR ? "No error" : "Error"; }
+
+namespace System {
+namespace Clock {
+struct Seconds16 {
+  explicit constexpr Seconds16(uint16_t count) : value(count) {}
+  uint16_t value;
+};
+struct Milliseconds32 {
+  explicit constexpr Milliseconds32(uint32_t count) : value(count) {}
+  uint32_t value;
+};
+}  // namespace Clock
+
+class Layer {
+ public:
+  typedef void (*TimerCompleteCallback)(Layer *layer, void *appState);
+  CHIP_ERROR StartTimer(Clock::Milliseconds32 delay, TimerCompleteCallback callback, void *appState) {
+    return CHIP_NO_ERROR;
+  }
+};
+}  // namespace System
+
+namespace DeviceLayer {
+System::Layer &SystemLayer();
+}  // namespace DeviceLayer
+
+enum class CommissioningWindowAdvertisement { kAllSupported, kDnssdOnly };
+
+class CommissioningWindowManager {
+ public:
+  bool IsCommissioningWindowOpen() const { return m_open; }
+  CHIP_ERROR OpenBasicCommissioningWindow(System::Clock::Seconds16 timeout,
+                                          CommissioningWindowAdvertisement advertisement) {
+    m_open = true;
+    return CHIP_NO_ERROR;
+  }
+
+ private:
+  bool m_open = false;
+};
+
+}  // namespace chip
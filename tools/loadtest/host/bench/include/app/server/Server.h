@@ -0,0 +1,26 @@
+#pragma once
+
+#include <esp_matter.h>
+
+#include "CommissioningWindowManager.h"
+
+/* Host stand-in for the Matter server, a device without fabrics and a closed commissioning window */
+namespace chip {
+
+class FabricTable {
+ public:
+  uint8_t FabricCount() const { return 0; }
+};
+
+class Server {
+ public:
+  static Server &GetInstance();
+  FabricTable &GetFabricTable() { return m_fabrics; }
+  CommissioningWindowManager &GetCommissioningWindowManager() { return m_windowManager; }
+
+ private:
+  FabricTable m_fabrics;
+  CommissioningWindowManager m_windowManager;
+};
+
+}  // namespace chip
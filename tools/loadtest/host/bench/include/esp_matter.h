@@ -0,0 +1,128 @@
+#pragma once
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Host stand-in for the esp_matter data model, only what the endpoint manager uses. Endpoints are list
+   nodes without clusters or attributes, so the benchmark measures the configuration path of this repo and
+   not the Matter stack. The handles are opaque like on the device */
+
+#ifndef __FILENAME__
+#define __FILENAME__ __FILE__
+#endif
+
+typedef struct {
+  union {
+    bool b;
+    int32_t i32;
+    uint32_t u32;
+  } val;
+} esp_matter_attr_val_t;
+
+namespace chip {
+
+constexpr uint16_t kInvalidEndpointId = 0xFFFF;
+
+namespace DeviceLayer {
+
+namespace DeviceEventType {
+enum {
+  kInterfaceIpAddressChanged = 0x8000,
+  kCommissioningComplete,
+  kFailSafeTimerExpired,
+  kCommissioningSessionStarted,
+  kCommissioningSessionStopped,
+  kCommissioningWindowOpened,
+  kCommissioningWindowClosed,
+  kFabricRemoved,
+  kFabricWillBeRemoved,
+  kFabricUpdated,
+  kFabricCommitted,
+  kBLEDeinitialized,
+};
+}  // namespace DeviceEventType
+
+struct FabricEvent {
+  uint8_t fabricIndex;
+};
+
+struct ChipDeviceEvent {
+  uint16_t Type;
+  union {
+    struct {
+      int Type;
+    } InterfaceIpAddressChanged;
+    FabricEvent CommissioningComplete;
+    FabricEvent FailSafeTimerExpired;
+    FabricEvent FabricRemoved;
+    FabricEvent FabricWillBeRemoved;
+    FabricEvent FabricUpdated;
+    FabricEvent FabricCommitted;
+  };
+};
+
+}  // namespace DeviceLayer
+}  // namespace chip
+
+namespace esp_matter {
+
+typedef size_t node_t;
+typedef size_t endpoint_t;
+
+typedef void (*event_callback_t)(const chip::DeviceLayer::ChipDeviceEvent *event, intptr_t arg);
+
+esp_err_t start(event_callback_t callback, intptr_t callback_arg = 0);
+bool is_started();
+
+namespace lock {
+typedef enum { FAILED, SUCCESS, ALREADY_TAKEN } status_t;
+status_t chip_stack_lock(uint32_t ticks_to_wait);
+status_t chip_stack_unlock();
+}  // namespace lock
+
+namespace identification {
+typedef enum callback_type { START, STOP, EFFECT } callback_type_t;
+typedef esp_err_t (*callback_t)(callback_type_t type, uint16_t endpoint_id, uint8_t effect_id,
+                                uint8_t effect_variant, void *priv_data);
+}  // namespace identification
+
+namespace attribute {
+typedef enum callback_type { PRE_UPDATE, POST_UPDATE, READ, WRITE } callback_type_t;
+typedef esp_err_t (*callback_t)(callback_type_t type, uint16_t endpoint_id, uint32_t cluster_id,
+                                uint32_t attribute_id, esp_matter_attr_val_t *val, void *priv_data);
+}  // namespace attribute
+
+namespace endpoint_flags {
+enum { ENDPOINT_FLAG_NONE = 0x00, ENDPOINT_FLAG_DESTROYABLE = 0x01, ENDPOINT_FLAG_BRIDGE = 0x02 };
+}  // namespace endpoint_flags
+
+namespace node {
+typedef struct {
+} config_t;
+
+node_t *create(config_t *config, attribute::callback_t attribute_callback,
+               identification::callback_t identification_callback);
+}  // namespace node
+
+namespace endpoint {
+endpoint_t *create(node_t *node, uint8_t flags, void *priv_data);
+esp_err_t destroy(node_t *node, endpoint_t *endpoint);
+endpoint_t *get(node_t *node, uint16_t endpoint_id);
+endpoint_t *get_first(node_t *node);
+endpoint_t *get_next(endpoint_t *endpoint);
+uint16_t get_id(endpoint_t *endpoint);
+node_t *get_node(endpoint_t *endpoint);
+esp_err_t set_parent_endpoint(endpoint_t *endpoint, endpoint_t *parent_endpoint);
+esp_err_t enable(endpoint_t *endpoint);
+
+namespace aggregator {
+typedef struct {
+} config_t;
+
+endpoint_t *create(node_t *node, config_t *config, uint8_t flags, void *priv_data);
+}  // namespace aggregator
+}  // namespace endpoint
+
+}  // namespace esp_matter
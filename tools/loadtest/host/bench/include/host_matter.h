@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @brief Destroy every node and endpoint created through the esp_matter stand-in, so the next run starts
+ * from an empty data model. Devices still pointing at them must be gone.
+ */
+void host_matter_reset(void);
+
+/**
+ * @brief Endpoints on all nodes, the aggregator and the root endpoint included.
+ */
+size_t host_matter_endpoint_count(void);
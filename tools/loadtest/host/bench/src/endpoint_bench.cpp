@@ -0,0 +1,394 @@
+#include <ArduinoJson.h>
+#include <esp_log.h>
+#include <getopt.h>
+#include <host_heap.h>
+#include <host_matter.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "EndpointCreator.hpp"
+#include "EndpointManager.hpp"
+#include "LatencyTracer.hpp"
+
+/* Micro-benchmark of the boot path from the stored accessory JSON to the bridged endpoints: the real
+   EndpointManager and DeviceCreator on stand-ins for esp_matter and the device libraries.
+   The stand-ins do next to nothing, so the times and allocations are those of this repo's code and
+   ArduinoJson, not of the Matter data model */
+
+static const char *kTypes[] = {"LIGHT", "FAN", "PLUGIN", "BUTTON", "WINDOW"};
+static constexpr size_t kTypeCount = sizeof(kTypes) / sizeof(kTypes[0]);
+
+struct Options {
+  std::vector<size_t> sizes = {1, 2, 4, 8, 16, 32, 64, 128};
+  size_t iterations = 20;
+  size_t warmup = 2;
+  const char *label = "";
+  const char *output = nullptr;
+};
+
+/* One measured run of an operation */
+struct Sample {
+  uint64_t ns;
+  uint64_t allocations;
+  size_t peakHeap;      // most bytes held above the level before the run
+  int64_t retainedHeap;  // bytes still held after it
+};
+
+struct Result {
+  std::string name;
+  std::string type;  // device type, empty for the whole database
+  size_t devices;
+  size_t created;
+  size_t jsonBytes;
+  std::vector<Sample> samples;
+};
+
+static uint64_t now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Accessory of the given type, as the config UI stores it. Pins cycle through the eight of the board */
+static void append_accessory(std::string &json, size_t index, const char *type) {
+  char buffer[256];
+  unsigned id = static_cast<unsigned>(index + 1);
+  unsigned pin = static_cast<unsigned>(index % 8 + 1);
+  unsigned other = static_cast<unsigned>((index + 3) % 8 + 1);
+  if (strcmp(type, "WINDOW") == 0) {
+    snprintf(buffer, sizeof(buffer),
+             "{\"id\":%u,\"type\":\"WINDOW\",\"name\":\"Window %u\",\"motorUpPin\":%u,\"motorDownPin\":%u,"
+             "\"buttonUpPin\":%u,\"buttonDownPin\":%u,\"timeToOpen\":%u,\"timeToClose\":%u}",
+             id, id, pin, other, pin, other, 10000 + id * 100, 9000 + id * 100);
+  } else if (strcmp(type, "BUTTON") == 0) {
+    snprintf(buffer, sizeof(buffer),
+             "{\"id\":%u,\"type\":\"BUTTON\",\"name\":\"Button %u\",\"buttonPin\":%u}", id, id, pin);
+  } else {
+    const char *pinKey = "pluginPin";
+    if (strcmp(type, "LIGHT") == 0) {
+      pinKey = "lightPin";
+    } else if (strcmp(type, "FAN") == 0) {
+      pinKey = "fanPin";
+    }
+    snprintf(buffer, sizeof(buffer),
+             "{\"id\":%u,\"type\":\"%s\",\"name\":\"%s %u\",\"%s\":%u,\"buttonPin\":%u}", id, type, type, id,
+             pinKey, pin, other);
+  }
+  json += buffer;
+}
+
+/* Mixed database, the types in turn so every size has each of them once it has five devices */
+static std::string make_database(size_t count) {
+  std::string json = "[";
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      json += ",";
+    }
+    append_accessory(json, i, kTypes[i % kTypeCount]);
+  }
+  json += "]";
+  return json;
+}
+
+/* Run an operation warmup + iterations times, keeping the samples of the measured runs */
+template <typename Setup, typename Run, typename Teardown>
+static std::vector<Sample> measure(const Options &options, Setup setup, Run run, Teardown teardown) {
+  std::vector<Sample> samples;
+  samples.reserve(options.iterations);
+  for (size_t i = 0; i < options.warmup + options.iterations; i++) {
+    setup();
+    size_t before = host_heap_current();
+    uint64_t allocations = host_heap_allocations();
+    int slot = host_heap_track_begin();
+    uint64_t start = now_ns();
+    run();
+    uint64_t elapsed = now_ns() - start;
+    size_t peak = host_heap_track_end(slot);
+    Sample sample = {elapsed, host_heap_allocations() - allocations, peak,
+                     static_cast<int64_t>(host_heap_current()) - static_cast<int64_t>(before)};
+    teardown();
+    if (i >= options.warmup) {
+      samples.push_back(sample);
+    }
+  }
+  return samples;
+}
+
+/* A benchmark that stops short of the firmware path would time less work, it fails instead */
+static void fail(const char *what, const char *detail) {
+  fprintf(stderr, "%s failed: %s\n", what, detail);
+  exit(1);
+}
+
+static Result bench_parse(const Options &options, size_t count) {
+  std::string json = make_database(count);
+  DynamicJsonDocument *doc = nullptr;
+  DeserializationError error;
+  Result result = {"parse", "", count, count, json.size(), {}};
+  result.samples = measure(
+      options, [&] { doc = new DynamicJsonDocument(CONFIG_JSON_ACCESSORIES_LENGTH); },
+      [&] { error = deserializeJson(*doc, json.c_str()); },
+      [&] {
+        if (error) {
+          fail("parse", error.c_str());
+        }
+        delete doc;
+      });
+  return result;
+}
+
+/* The boot path of the bridge: parse, checksum, create every device and store the warm boot plan.
+   EndpointManager lives for the whole uptime and never deletes its devices, neither does the benchmark,
+   their bytes show up as retained. Their trace slots are released, so every run traces its devices */
+static Result bench_create_endpoints(const Options &options, size_t count) {
+  std::string json = make_database(count);
+  EndpointManager *manager = nullptr;
+  size_t endpointsBefore = 0;
+  Result result = {"create_endpoints", "", count, 0, json.size(), {}};
+  result.samples = measure(
+      options,
+      [&] {
+        manager = new EndpointManager(true);
+        endpointsBefore = host_matter_endpoint_count();
+      },
+      [&] { manager->createArrayOfEndpoints(json.c_str(), json.size()); },
+      [&] {
+        // as on the device, the devices past the trace slots are created untraced
+        result.created = host_matter_endpoint_count() - endpointsBefore;
+        if (LatencyTracer::getEndpointCount() !=
+            std::min<size_t>(result.created, CONFIG_EM_LATENCY_TRACE_MAX_ENDPOINTS)) {
+          fail("create_endpoints", "trace slots left over from an earlier run");
+        }
+        delete manager;
+        host_matter_reset();
+        LatencyTracer::releaseAllSlots();
+      });
+  return result;
+}
+
+/* A single device from its JSON, as addDevice() does for each accessory */
+static Result bench_create_device(const Options &options, const char *type) {
+  std::string json;
+  append_accessory(json, 0, type);
+  DynamicJsonDocument doc(CONFIG_JSON_ACCESSORIES_LENGTH);
+  DeserializationError error = deserializeJson(doc, json.c_str());
+  if (error) {
+    fail("create_device", error.c_str());
+  }
+  JsonObject accessory = doc.as<JsonObject>();
+
+  esp_matter::node::config_t nodeConfig;
+  esp_matter::endpoint::aggregator::config_t aggregatorConfig;
+  esp_matter::node_t *node = esp_matter::node::create(&nodeConfig, nullptr, nullptr);
+  esp_matter::endpoint_t *aggregator = esp_matter::endpoint::aggregator::create(
+      node, &aggregatorConfig, esp_matter::endpoint_flags::ENDPOINT_FLAG_NONE, nullptr);
+
+  DeviceCreator creator;
+  BaseDeviceInterface *device = nullptr;
+  Result result = {"create_device", type, 1, 1, json.size(), {}};
+  result.samples = measure(
+      options, [&] { LatencyTracer::openSlot(); },
+      [&] { device = creator.createDevice(accessory, aggregator); },
+      [&] {
+        if (device == nullptr) {
+          fail("create_device", type);
+        }
+        LatencyTracer::discardSlot();
+        delete device;
+      });
+  host_matter_reset();
+  return result;
+}
+
+/* A single device from the warm boot plan, without the accessory JSON */
+static Result bench_create_device_from_plan(const Options &options, const char *type) {
+  std::string json;
+  append_accessory(json, 0, type);
+  DynamicJsonDocument doc(CONFIG_JSON_ACCESSORIES_LENGTH);
+  DeserializationError error = deserializeJson(doc, json.c_str());
+  if (error) {
+    fail("create_device_from_plan", error.c_str());
+  }
+
+  DeviceCreator creator;
+  DevicePlan plan;
+  creator.planDevice(doc.as<JsonObject>(), &plan);
+
+  esp_matter::node::config_t nodeConfig;
+  esp_matter::endpoint::aggregator::config_t aggregatorConfig;
+  esp_matter::node_t *node = esp_matter::node::create(&nodeConfig, nullptr, nullptr);
+  esp_matter::endpoint_t *aggregator = esp_matter::endpoint::aggregator::create(
+      node, &aggregatorConfig, esp_matter::endpoint_flags::ENDPOINT_FLAG_NONE, nullptr);
+
+  BaseDeviceInterface *device = nullptr;
+  Result result = {"create_device_from_plan", type, 1, 1, sizeof(plan), {}};
+  result.samples = measure(
+      options, [&] { LatencyTracer::openSlot(); }, [&] { device = creator.createDevice(plan, aggregator); },
+      [&] {
+        if (device == nullptr) {
+          fail("create_device_from_plan", type);
+        }
+        LatencyTracer::discardSlot();
+        delete device;
+      });
+  host_matter_reset();
+  return result;
+}
+
+static uint64_t percentile(std::vector<uint64_t> values, double share) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(share * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+static void write_result(FILE *out, const Result &result, bool last) {
+  std::vector<uint64_t> ns;
+  uint64_t allocations = 0;
+  size_t peakHeap = 0;
+  int64_t retainedHeap = 0;
+  for (const Sample &sample : result.samples) {
+    ns.push_back(sample.ns);
+    // the code paths do not depend on the iteration, the most of them is the steady state
+    allocations = std::max(allocations, sample.allocations);
+    peakHeap = std::max(peakHeap, sample.peakHeap);
+    retainedHeap = std::max(retainedHeap, sample.retainedHeap);
+  }
+  uint64_t median = percentile(ns, 0.5);
+
+  fprintf(out, "    {\"name\": \"%s\", ", result.name.c_str());
+  if (!result.type.empty()) {
+    fprintf(out, "\"type\": \"%s\", ", result.type.c_str());
+  }
+  fprintf(out,
+          "\"devices\": %zu, \"created\": %zu, \"input_bytes\": %zu, \"min_ns\": %llu, \"median_ns\": %llu, "
+          "\"p90_ns\": %llu, \"max_ns\": %llu, \"median_ns_per_device\": %llu, \"allocations\": %llu, "
+          "\"peak_heap\": %zu, \"retained_heap\": %lld}%s\n",
+          result.devices, result.created, result.jsonBytes, (unsigned long long)percentile(ns, 0.0),
+          (unsigned long long)median, (unsigned long long)percentile(ns, 0.9),
+          (unsigned long long)percentile(ns, 1.0),
+          (unsigned long long)(result.created > 0 ? median / result.created : 0),
+          (unsigned long long)allocations, peakHeap, (long long)retainedHeap, last ? "" : ",");
+}
+
+static bool parse_sizes(const char *list, std::vector<size_t> *sizes) {
+  sizes->clear();
+  std::string value(list);
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    char *rest = nullptr;
+    unsigned long size = strtoul(value.substr(start, end - start).c_str(), &rest, 10);
+    if (size == 0 || rest == nullptr || *rest != '\0') {
+      return false;
+    }
+    sizes->push_back(size);
+    start = end + 1;
+  }
+  return !sizes->empty();
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--sizes <n,n,...>] [--iterations <n>] [--warmup <n>] [--label <text>]\n"
+          "          [--output <file>] [--log-level <0-5>]\n"
+          "Time the parsing of the accessory database and the creation of its endpoints, print JSON results\n"
+          "that tools/loadtest/bench_compare.py compares between commits.\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  static const struct option longOptions[] = {
+      {"sizes", required_argument, nullptr, 's'},
+      {"iterations", required_argument, nullptr, 'i'},
+      {"warmup", required_argument, nullptr, 'w'},
+      {"label", required_argument, nullptr, 'L'},
+      {"output", required_argument, nullptr, 'o'},
+      {"log-level", required_argument, nullptr, 'l'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  Options options;
+  esp_log_level_t logLevel = ESP_LOG_NONE;
+  int option;
+  while ((option = getopt_long(argc, argv, "s:i:w:L:o:l:h", longOptions, nullptr)) != -1) {
+    switch (option) {
+      case 's':
+        if (!parse_sizes(optarg, &options.sizes)) {
+          fprintf(stderr, "Invalid --sizes: %s\n", optarg);
+          return 2;
+        }
+        break;
+      case 'i':
+        options.iterations = strtoul(optarg, nullptr, 0);
+        break;
+      case 'w':
+        options.warmup = strtoul(optarg, nullptr, 0);
+        break;
+      case 'L':
+        options.label = optarg;
+        break;
+      case 'o':
+        options.output = optarg;
+        break;
+      case 'l':
+        logLevel = static_cast<esp_log_level_t>(atoi(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 2;
+    }
+  }
+  if (options.iterations == 0) {
+    fprintf(stderr, "--iterations must be at least 1\n");
+    return 2;
+  }
+  // the devices log their creation, which would be most of what is measured
+  host_log_set_level(logLevel);
+
+  std::vector<Result> results;
+  for (size_t count : options.sizes) {
+    results.push_back(bench_parse(options, count));
+  }
+  for (size_t count : options.sizes) {
+    results.push_back(bench_create_endpoints(options, count));
+  }
+  for (const char *type : kTypes) {
+    results.push_back(bench_create_device(options, type));
+  }
+  for (const char *type : kTypes) {
+    results.push_back(bench_create_device_from_plan(options, type));
+  }
+
+  FILE *out = stdout;
+  if (options.output != nullptr) {
+    out = fopen(options.output, "w");
+    if (out == nullptr) {
+      perror(options.output);
+      return 1;
+    }
+  }
+  fprintf(out, "{\n  \"label\": \"%s\",\n  \"iterations\": %zu,\n  \"warmup\": %zu,\n", options.label,
+          options.iterations, options.warmup);
+  fprintf(out, "  \"max_bridged_devices\": %d,\n  \"results\": [\n", CONFIG_EM_MAX_BRIDGED_DEVICES);
+  for (size_t i = 0; i < results.size(); i++) {
+    write_result(out, results[i], i + 1 == results.size());
+  }
+  fprintf(out, "  ]\n}\n");
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
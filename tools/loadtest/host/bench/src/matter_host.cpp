@@ -0,0 +1,202 @@
+#include <esp_matter.h>
+#include <host_matter.h>
+#include <string.h>
+
+#include <app/server/Server.h>
+
+#include "AppEventBus.hpp"
+#include "DeviceLibrary.hpp"
+
+/* Endpoints are handed out as opaque handles, like the esp_matter data model does */
+namespace {
+
+struct Node;
+
+struct Endpoint {
+  Node *node;
+  Endpoint *next;
+  uint16_t id;
+  uint8_t flags;
+  void *privData;
+};
+
+struct Node {
+  Node *next;
+  Endpoint *first;
+  Endpoint *last;
+  uint16_t nextId;
+};
+
+Node *s_nodes = nullptr;
+size_t s_endpointCount = 0;
+bool s_started = false;
+
+Endpoint *asEndpoint(esp_matter::endpoint_t *endpoint) { return reinterpret_cast<Endpoint *>(endpoint); }
+
+esp_matter::endpoint_t *asHandle(Endpoint *endpoint) {
+  return reinterpret_cast<esp_matter::endpoint_t *>(endpoint);
+}
+
+Node *asNode(esp_matter::node_t *node) { return reinterpret_cast<Node *>(node); }
+
+}  // namespace
+
+namespace esp_matter {
+
+esp_err_t start(event_callback_t callback, intptr_t callback_arg) {
+  s_started = true;
+  return ESP_OK;
+}
+
+bool is_started() { return s_started; }
+
+namespace lock {
+status_t chip_stack_lock(uint32_t ticks_to_wait) { return SUCCESS; }
+
+status_t chip_stack_unlock() { return SUCCESS; }
+}  // namespace lock
+
+namespace node {
+node_t *create(config_t *config, attribute::callback_t attribute_callback,
+               identification::callback_t identification_callback) {
+  Node *node = new Node{s_nodes, nullptr, nullptr, 0};
+  s_nodes = node;
+  // the root endpoint, with the identity of the node
+  endpoint::create(reinterpret_cast<node_t *>(node), endpoint_flags::ENDPOINT_FLAG_NONE, nullptr);
+  return reinterpret_cast<node_t *>(node);
+}
+}  // namespace node
+
+namespace endpoint {
+endpoint_t *create(node_t *node, uint8_t flags, void *priv_data) {
+  Node *owner = asNode(node);
+  if (owner == nullptr) {
+    return nullptr;
+  }
+  Endpoint *endpoint = new Endpoint{owner, nullptr, owner->nextId++, flags, priv_data};
+  if (owner->last != nullptr) {
+    owner->last->next = endpoint;
+  } else {
+    owner->first = endpoint;
+  }
+  owner->last = endpoint;
+  s_endpointCount++;
+  return asHandle(endpoint);
+}
+
+esp_err_t destroy(node_t *node, endpoint_t *endpoint) {
+  Node *owner = asNode(node);
+  Endpoint *target = asEndpoint(endpoint);
+  if (owner == nullptr || target == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  Endpoint *previous = nullptr;
+  for (Endpoint *ep = owner->first; ep != nullptr; previous = ep, ep = ep->next) {
+    if (ep != target) {
+      continue;
+    }
+    if (previous != nullptr) {
+      previous->next = ep->next;
+    } else {
+      owner->first = ep->next;
+    }
+    if (owner->last == ep) {
+      owner->last = previous;
+    }
+    delete ep;
+    s_endpointCount--;
+    return ESP_OK;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+endpoint_t *get(node_t *node, uint16_t endpoint_id) {
+  Node *owner = asNode(node);
+  for (Endpoint *ep = owner != nullptr ? owner->first : nullptr; ep != nullptr; ep = ep->next) {
+    if (ep->id == endpoint_id) {
+      return asHandle(ep);
+    }
+  }
+  return nullptr;
+}
+
+endpoint_t *get_first(node_t *node) { return node != nullptr ? asHandle(asNode(node)->first) : nullptr; }
+
+endpoint_t *get_next(endpoint_t *endpoint) {
+  return endpoint != nullptr ? asHandle(asEndpoint(endpoint)->next) : nullptr;
+}
+
+uint16_t get_id(endpoint_t *endpoint) {
+  return endpoint != nullptr ? asEndpoint(endpoint)->id : chip::kInvalidEndpointId;
+}
+
+node_t *get_node(endpoint_t *endpoint) {
+  return endpoint != nullptr ? reinterpret_cast<node_t *>(asEndpoint(endpoint)->node) : nullptr;
+}
+
+esp_err_t set_parent_endpoint(endpoint_t *endpoint, endpoint_t *parent_endpoint) {
+  return endpoint != nullptr && parent_endpoint != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t enable(endpoint_t *endpoint) { return endpoint != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG; }
+
+namespace aggregator {
+endpoint_t *create(node_t *node, config_t *config, uint8_t flags, void *priv_data) {
+  return endpoint::create(node, flags, priv_data);
+}
+}  // namespace aggregator
+}  // namespace endpoint
+
+}  // namespace esp_matter
+
+void host_matter_reset(void) {
+  while (s_nodes != nullptr) {
+    Node *node = s_nodes;
+    s_nodes = node->next;
+    for (Endpoint *ep = node->first; ep != nullptr;) {
+      Endpoint *next = ep->next;
+      delete ep;
+      ep = next;
+    }
+    delete node;
+  }
+  s_endpointCount = 0;
+  s_started = false;
+}
+
+size_t host_matter_endpoint_count(void) { return s_endpointCount; }
+
+namespace chip {
+
+Server &Server::GetInstance() {
+  static Server server;
+  return server;
+}
+
+namespace DeviceLayer {
+System::Layer &SystemLayer() {
+  static System::Layer layer;
+  return layer;
+}
+}  // namespace DeviceLayer
+
+}  // namespace chip
+
+BridgedDevice::BridgedDevice(char *name, AccessoryInterface *accessory, esp_matter::endpoint_t *aggregator)
+    : m_name(), m_accessory(accessory), m_endpoint(nullptr) {
+  strncpy(m_name, name != nullptr ? name : "", sizeof(m_name) - 1);
+  esp_matter::node_t *node = esp_matter::endpoint::get_node(aggregator);
+  m_endpoint = esp_matter::endpoint::create(node, esp_matter::endpoint_flags::ENDPOINT_FLAG_BRIDGE, this);
+  esp_matter::endpoint::set_parent_endpoint(m_endpoint, aggregator);
+}
+
+/* Nothing runs the dispatcher, the events published by EndpointManager are dropped */
+esp_err_t AppEventBus::start() { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t AppEventBus::subscribe(AppEventMask mask, Handler handler, void *context) { return ESP_OK; }
+
+esp_err_t AppEventBus::publish(AppEventType type, uint32_t data) { return ESP_ERR_INVALID_STATE; }
+
+esp_err_t AppEventBus::getStats(AppEventBusStats *stats) { return ESP_ERR_NOT_SUPPORTED; }
+
+const char *AppEventBus::eventName(AppEventType type) { return "Unknown"; }
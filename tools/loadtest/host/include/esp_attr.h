@@ -0,0 +1,7 @@
+#pragma once
+
+/* A host process starts with zeroed memory like a power-on reset, nothing survives a restart */
+#define RTC_NOINIT_ATTR
+
+/* Code and data placement of the device, the host has one kind of memory */
+#define IRAM_ATTR
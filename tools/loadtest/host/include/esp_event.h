@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* Host stand-in for the default event loop, handlers are accepted but no event is ever posted */
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id,
+                                    void *event_data);
+
+#define ESP_EVENT_ANY_ID -1
+
+extern const esp_event_base_t WIFI_EVENT;
+extern const esp_event_base_t IP_EVENT;
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg);
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler);
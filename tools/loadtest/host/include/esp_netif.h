@@ -0,0 +1,18 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+/* Host stand-in for esp_netif, the interfaces are placeholders */
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP,
+  IP_EVENT_STA_LOST_IP,
+  IP_EVENT_AP_STAIPASSIGNED,
+} ip_event_t;
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/* CRC-32 as computed by the ROM of the chip, the same as zlib's crc32() */
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+/* Host stand-in for the WiFi driver: it keeps the mode and configurations it is given, never connects and
+   never reports a client */
+typedef enum {
+  WIFI_MODE_NULL,
+  WIFI_MODE_STA,
+  WIFI_MODE_AP,
+  WIFI_MODE_APSTA,
+} wifi_mode_t;
+
+typedef enum {
+  WIFI_IF_STA,
+  WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum {
+  WIFI_AUTH_OPEN,
+  WIFI_AUTH_WEP,
+  WIFI_AUTH_WPA_PSK,
+  WIFI_AUTH_WPA2_PSK,
+  WIFI_AUTH_WPA_WPA2_PSK,
+  WIFI_AUTH_WPA2_ENTERPRISE,
+  WIFI_AUTH_WPA3_PSK,
+} wifi_auth_mode_t;
+
+typedef enum {
+  WIFI_FAST_SCAN,
+  WIFI_ALL_CHANNEL_SCAN,
+} wifi_scan_method_t;
+
+typedef enum {
+  WIFI_CONNECT_AP_BY_SIGNAL,
+  WIFI_CONNECT_AP_BY_SECURITY,
+} wifi_sort_method_t;
+
+typedef struct {
+  bool capable;
+  bool required;
+} wifi_pmf_config_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  uint8_t ssid_len;
+  uint8_t channel;
+  wifi_auth_mode_t authmode;
+  uint8_t ssid_hidden;
+  uint8_t max_connection;
+  uint16_t beacon_interval;
+  int pairwise_cipher;
+  bool ftm_responder;
+  wifi_pmf_config_t pmf_cfg;
+} wifi_ap_config_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  wifi_scan_method_t scan_method;
+  bool bssid_set;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint16_t listen_interval;
+  wifi_sort_method_t sort_method;
+  wifi_pmf_config_t pmf_cfg;
+} wifi_sta_config_t;
+
+typedef union {
+  wifi_ap_config_t ap;
+  wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t ssid[33];
+  uint8_t primary;
+  int8_t rssi;
+  wifi_auth_mode_t authmode;
+} wifi_ap_record_t;
+
+typedef struct {
+  uint8_t mac[6];
+  int8_t rssi;
+} wifi_sta_info_t;
+
+#define ESP_WIFI_MAX_CONN_NUM 15
+
+typedef struct {
+  wifi_sta_info_t sta[ESP_WIFI_MAX_CONN_NUM];
+  int num;
+} wifi_sta_list_t;
+
+typedef enum {
+  WIFI_EVENT_WIFI_READY,
+  WIFI_EVENT_SCAN_DONE,
+  WIFI_EVENT_STA_START,
+  WIFI_EVENT_STA_STOP,
+  WIFI_EVENT_STA_CONNECTED,
+  WIFI_EVENT_STA_DISCONNECTED,
+  WIFI_EVENT_STA_AUTHMODE_CHANGE,
+  WIFI_EVENT_STA_WPS_ER_SUCCESS,
+  WIFI_EVENT_STA_WPS_ER_FAILED,
+  WIFI_EVENT_STA_WPS_ER_TIMEOUT,
+  WIFI_EVENT_STA_WPS_ER_PIN,
+  WIFI_EVENT_STA_WPS_ER_PBC_OVERLAP,
+  WIFI_EVENT_AP_START,
+  WIFI_EVENT_AP_STOP,
+  WIFI_EVENT_AP_STACONNECTED,
+  WIFI_EVENT_AP_STADISCONNECTED,
+} wifi_event_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t ssid_len;
+  uint8_t bssid[6];
+  uint8_t reason;
+  int8_t rssi;
+} wifi_event_sta_disconnected_t;
+
+typedef struct {
+  int magic;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() \
+  { .magic = 0x1F2F3F4F }
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta);
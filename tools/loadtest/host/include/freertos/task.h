@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/**
+ * @brief Run the task on a detached thread with the given stack size. Priorities are ignored.
+ */
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created_task);
+
+/**
+ * @brief Delete a task. Another task is only forgotten, its thread keeps blocking where it is; the calling
+ * task ends.
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap accounting of the host build. malloc() and friends are interposed to count the bytes the process
+   holds, which stands in for the device heap and gives each request the peak it reached while in flight */
+
+/**
+ * @brief Size the simulated device heap. Its free heap is this size minus what the process allocated
+ * since, the bytes already held belong to the host runtime.
+ */
+void host_heap_set_size(size_t size);
+size_t host_heap_size(void);
+
+/**
+ * @brief Bytes held by the process now, and the most it held since the last reset.
+ */
+size_t host_heap_current(void);
+size_t host_heap_peak(void);
+void host_heap_reset_peak(void);
+
+/**
+ * @brief Blocks handed out since the start of the process, a realloc() counts as one.
+ */
+uint64_t host_heap_allocations(void);
+
+/**
+ * @brief Start following the heap for a request.
+ * @return Slot to pass to host_heap_track_end(), -1 if every slot is taken.
+ */
+int host_heap_track_begin(void);
+
+/**
+ * @brief Stop following the heap for a request.
+ * @return Highest number of bytes the process held above the level at host_heap_track_begin(), while the
+ *         request was in flight. Concurrent requests count in each other's peak.
+ */
+size_t host_heap_track_end(int slot);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_err.h"
+#include "nvs.h"
+
+esp_err_t nvs_flash_init_partition(const char *partition_label);
+esp_err_t nvs_flash_erase_partition(const char *partition_label);
+esp_err_t nvs_flash_erase(void);
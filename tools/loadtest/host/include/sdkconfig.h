@@ -0,0 +1,54 @@
+#pragma once
+
+/* Configuration of the host build: the Kconfig defaults of the components it compiles, and the project
+   settings of sdkconfig.defaults they depend on */
+
+#define CONFIG_IDF_FIRMWARE_CHIP_ID 0x0000
+
+#define CONFIG_SM_NVS_NAMESPACE "metahouse"
+#define CONFIG_SM_NVS_PARTITION "nvs"
+#define CONFIG_SM_NVS_KEY_PROGRAM_MODE "program_mode"
+#define CONFIG_SM_NVS_KEY_DEVICE_NAME "device_name"
+#define CONFIG_SM_NVS_KEY_ACCESSORY_DB "accessory_db"
+#define CONFIG_SM_NVS_KEY_ACCESSORY_PREFIX "adb"
+#define CONFIG_SM_NVS_KEY_WIFI_CREDENTIALS "wifi_creds"
+#define CONFIG_SM_NVS_KEY_WIFI_CACHE "wifi_cache"
+#define CONFIG_SM_MAX_ACCESSORIES 64
+#define CONFIG_SM_ACCESSORY_BUFFER_SIZE 1024
+#define CONFIG_SM_WARM_BOOT_CACHE 1
+#define CONFIG_SM_WARM_BOOT_PLAN_SIZE 2048
+
+#define CONFIG_WM_DIRECTED_CONNECT 1
+
+#define CONFIG_AP_SSID "MetaHouse AP"
+#define CONFIG_AP_PASSWORD "123456789"
+#define CONFIG_AP_CHANNEL 1
+#define CONFIG_AP_MAX_CONNECTIONS 4
+#define CONFIG_AP_WEB_STACK_SIZE 8192
+#define CONFIG_AP_FRONTEND_PARTITION "frontend"
+#define CONFIG_AP_ASSET_MAX_AGE 31536000
+#define CONFIG_AP_RECV_CHUNK_SIZE 512
+#define CONFIG_AP_MAX_OPEN_SOCKETS 7
+#define CONFIG_AP_LIVE_MAX_OPEN_SOCKETS 5
+#define CONFIG_AP_MATTER_SOCKETS 6
+#define CONFIG_AP_WORKER_COUNT 3
+#define CONFIG_AP_WORKER_STACK_SIZE 8192
+#define CONFIG_AP_OTA_CHUNK_SIZE 4096
+#define CONFIG_AP_SESSION_TIMEOUT 600
+
+#define CONFIG_JSON_ACCESSORIES_LENGTH 4000
+#define CONFIG_EM_MAX_BRIDGED_DEVICES 64
+#define CONFIG_EM_LATENCY_TRACE 1
+#define CONFIG_EM_LATENCY_TRACE_MAX_ENDPOINTS 32
+#define CONFIG_EM_LATENCY_TRACE_BUTTON_TIMEOUT_MS 2000
+#define CONFIG_EM_EVENT_JOURNAL_SIZE 64
+
+#define CONFIG_BT_BOOT_TIMELINE 1
+#define CONFIG_BT_HISTORY 8
+
+/* The host has no task list, CONFIG_FREERTOS_USE_TRACE_FACILITY is left out and /metrics has no task
+   families */
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_WS_SUPPORT 1
+#define CONFIG_LWIP_MAX_SOCKETS 16
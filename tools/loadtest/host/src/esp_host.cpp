@@ -0,0 +1,512 @@
+#include <esp_app_desc.h>
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_random.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <fcntl.h>
+#include <mbedtls/sha256.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *TAG = "host";
+
+/* Log */
+
+static esp_log_level_t s_logLevel = ESP_LOG_INFO;
+static pthread_mutex_t s_logLock = PTHREAD_MUTEX_INITIALIZER;
+
+void host_log_set_level(esp_log_level_t level) { s_logLevel = level; }
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+  if (level > s_logLevel) {
+    return;
+  }
+
+  static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+  va_list args;
+  va_start(args, format);
+  pthread_mutex_lock(&s_logLock);
+  fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+  vfprintf(stderr, format, args);
+  fputc('\n', stderr);
+  pthread_mutex_unlock(&s_logLock);
+  va_end(args);
+}
+
+/* Errors */
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK:
+      return "ESP_OK";
+    case ESP_FAIL:
+      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+      return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+      return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+      return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+      return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+      return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_WIFI_NOT_CONNECT:
+      return "ESP_ERR_WIFI_NOT_CONNECT";
+    case ESP_ERR_NVS_NOT_FOUND:
+      return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+      return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES:
+      return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_NEW_VERSION_FOUND:
+      return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+    default:
+      return "UNKNOWN ERROR";
+  }
+}
+
+void host_abort_on_error(esp_err_t err, const char *file, int line, const char *expression) {
+  fprintf(stderr, "ESP_ERROR_CHECK failed: %s at %s:%d (%s)\n", esp_err_to_name(err), file, line, expression);
+  abort();
+}
+
+/* System */
+
+void esp_restart(void) {
+  ESP_LOGW(TAG, "Restart requested, the host build exits");
+  exit(0);
+}
+
+esp_reset_reason_t esp_reset_reason(void) { return ESP_RST_POWERON; }
+
+uint32_t esp_random(void) {
+  uint32_t value = 0;
+  while (getrandom(&value, sizeof(value), 0) != sizeof(value)) {
+  }
+  return value;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  static uint32_t table[256];
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, [] {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int bit = 0; bit < 8; bit++) {
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  });
+
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/* Timer */
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void *arg;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  int64_t deadlineUs;  ///< Time the callback is due, -1 while stopped
+  bool deleted;
+};
+
+int64_t esp_timer_get_time(void) {
+  static struct timespec boot;
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, [] { clock_gettime(CLOCK_MONOTONIC, &boot); });
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)(now.tv_sec - boot.tv_sec) * 1000000 + (now.tv_nsec - boot.tv_nsec) / 1000;
+}
+
+static void *run_timer(void *arg) {
+  esp_timer *timer = static_cast<esp_timer *>(arg);
+
+  pthread_mutex_lock(&timer->lock);
+  while (!timer->deleted) {
+    if (timer->deadlineUs < 0) {
+      pthread_cond_wait(&timer->changed, &timer->lock);
+      continue;
+    }
+
+    int64_t waitUs = timer->deadlineUs - esp_timer_get_time();
+    if (waitUs > 0) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      int64_t ns = deadline.tv_nsec + waitUs * 1000;
+      deadline.tv_sec += ns / 1000000000;
+      deadline.tv_nsec = ns % 1000000000;
+      pthread_cond_timedwait(&timer->changed, &timer->lock, &deadline);
+      continue;
+    }
+
+    timer->deadlineUs = -1;
+    pthread_mutex_unlock(&timer->lock);
+    timer->callback(timer->arg);
+    pthread_mutex_lock(&timer->lock);
+  }
+  pthread_mutex_unlock(&timer->lock);
+
+  pthread_mutex_destroy(&timer->lock);
+  pthread_cond_destroy(&timer->changed);
+  free(timer);
+  return nullptr;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+  esp_timer *timer = static_cast<esp_timer *>(calloc(1, sizeof(esp_timer)));
+  if (timer == nullptr) {
+    return ESP_ERR_NO_MEM;
+  }
+  timer->callback = create_args->callback;
+  timer->arg = create_args->arg;
+  timer->deadlineUs = -1;
+  pthread_mutex_init(&timer->lock, nullptr);
+  pthread_cond_init(&timer->changed, nullptr);
+  if (pthread_create(&timer->thread, nullptr, run_timer, timer) != 0) {
+    free(timer);
+    return ESP_ERR_NO_MEM;
+  }
+  pthread_detach(timer->thread);
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  pthread_mutex_lock(&timer->lock);
+  bool running = timer->deadlineUs >= 0;
+  if (!running) {
+    timer->deadlineUs = esp_timer_get_time() + (int64_t)timeout_us;
+    pthread_cond_signal(&timer->changed);
+  }
+  pthread_mutex_unlock(&timer->lock);
+  return running ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  pthread_mutex_lock(&timer->lock);
+  bool running = timer->deadlineUs >= 0;
+  timer->deadlineUs = -1;
+  pthread_cond_signal(&timer->changed);
+  pthread_mutex_unlock(&timer->lock);
+  return running ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  pthread_mutex_lock(&timer->lock);
+  timer->deleted = true;
+  pthread_cond_signal(&timer->changed);
+  pthread_mutex_unlock(&timer->lock);
+  return ESP_OK;
+}
+
+/* Events, WiFi and network interfaces */
+
+const esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+const esp_event_base_t IP_EVENT = "IP_EVENT";
+
+static pthread_mutex_t s_wifiLock = PTHREAD_MUTEX_INITIALIZER;
+static wifi_mode_t s_wifiMode = WIFI_MODE_NULL;
+static wifi_config_t s_apConfig;
+static wifi_config_t s_staConfig;
+
+struct esp_netif_obj {
+  const char *key;
+};
+
+static esp_netif_t s_apNetif = {"WIFI_AP_DEF"};
+static esp_netif_t s_staNetif = {"WIFI_STA_DEF"};
+static bool s_apNetifCreated = false;
+
+esp_err_t esp_event_loop_create_default(void) {
+  static bool created = false;
+  if (created) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  created = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg) {
+  return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler) {
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void) { return ESP_OK; }
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+  s_apNetifCreated = true;
+  return &s_apNetif;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) { return &s_staNetif; }
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key) {
+  if (strcmp(if_key, s_apNetif.key) == 0) {
+    return s_apNetifCreated ? &s_apNetif : nullptr;
+  }
+  return strcmp(if_key, s_staNetif.key) == 0 ? &s_staNetif : nullptr;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) { return ESP_OK; }
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+  pthread_mutex_lock(&s_wifiLock);
+  s_wifiMode = mode;
+  pthread_mutex_unlock(&s_wifiLock);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode) {
+  pthread_mutex_lock(&s_wifiLock);
+  *mode = s_wifiMode;
+  pthread_mutex_unlock(&s_wifiLock);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+  pthread_mutex_lock(&s_wifiLock);
+  *(interface == WIFI_IF_AP ? &s_apConfig : &s_staConfig) = *conf;
+  pthread_mutex_unlock(&s_wifiLock);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf) {
+  pthread_mutex_lock(&s_wifiLock);
+  *conf = *(interface == WIFI_IF_AP ? &s_apConfig : &s_staConfig);
+  pthread_mutex_unlock(&s_wifiLock);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) { return ESP_OK; }
+
+/* The station never joins anything, a connection attempt just never completes */
+esp_err_t esp_wifi_connect(void) { return ESP_OK; }
+
+esp_err_t esp_wifi_disconnect(void) { return ESP_OK; }
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) { return ESP_ERR_WIFI_NOT_CONNECT; }
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta) {
+  memset(sta, 0, sizeof(*sta));
+  return ESP_OK;
+}
+
+/* Partitions */
+
+static constexpr size_t kMaxPartitions = 4;
+
+struct HostPartition {
+  esp_partition_t partition;
+  int fd;
+};
+
+static HostPartition s_partitions[kMaxPartitions];
+static size_t s_partitionCount = 0;
+
+struct HostMapping {
+  void *address;
+  size_t length;
+};
+
+static HostMapping s_mappings[8];
+static pthread_mutex_t s_mappingLock = PTHREAD_MUTEX_INITIALIZER;
+
+esp_err_t host_partition_register(const char *label, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (s_partitionCount == kMaxPartitions) {
+    close(fd);
+    return ESP_ERR_NO_MEM;
+  }
+
+  HostPartition *entry = &s_partitions[s_partitionCount++];
+  memset(entry, 0, sizeof(*entry));
+  entry->partition.type = ESP_PARTITION_TYPE_DATA;
+  entry->partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+  entry->partition.size = info.st_size;
+  entry->partition.erase_size = 4096;
+  entry->partition.readonly = true;
+  strncpy(entry->partition.label, label, sizeof(entry->partition.label) - 1);
+  entry->fd = fd;
+  return ESP_OK;
+}
+
+static const HostPartition *find_partition(const esp_partition_t *partition) {
+  for (size_t i = 0; i < s_partitionCount; i++) {
+    if (&s_partitions[i].partition == partition) {
+      return &s_partitions[i];
+    }
+  }
+  return nullptr;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+  for (size_t i = 0; i < s_partitionCount; i++) {
+    const esp_partition_t *partition = &s_partitions[i].partition;
+    if (partition->type == type && (label == nullptr || strcmp(partition->label, label) == 0)) {
+      return partition;
+    }
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+  const HostPartition *entry = find_partition(partition);
+  if (entry == nullptr || src_offset + size > partition->size) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return pread(entry->fd, dst, size, src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+  const HostPartition *entry = find_partition(partition);
+  if (entry == nullptr || offset + size > partition->size || offset % sysconf(_SC_PAGESIZE) != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, entry->fd, offset);
+  if (address == MAP_FAILED) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  pthread_mutex_lock(&s_mappingLock);
+  for (size_t i = 0; i < sizeof(s_mappings) / sizeof(s_mappings[0]); i++) {
+    if (s_mappings[i].address == nullptr) {
+      s_mappings[i] = {address, size};
+      pthread_mutex_unlock(&s_mappingLock);
+      *out_ptr = address;
+      *out_handle = i + 1;
+      return ESP_OK;
+    }
+  }
+  pthread_mutex_unlock(&s_mappingLock);
+  munmap(address, size);
+  return ESP_ERR_NO_MEM;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+  pthread_mutex_lock(&s_mappingLock);
+  if (handle > 0 && handle <= sizeof(s_mappings) / sizeof(s_mappings[0])) {
+    HostMapping &mapping = s_mappings[handle - 1];
+    if (mapping.address != nullptr) {
+      munmap(mapping.address, mapping.length);
+      mapping = {};
+    }
+  }
+  pthread_mutex_unlock(&s_mappingLock);
+}
+
+/* OTA, the running image is a placeholder with no content and no slot to update */
+
+static const esp_partition_t s_runningPartition = {
+    .flash_chip = nullptr,
+    .type = ESP_PARTITION_TYPE_APP,
+    .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_0,
+    .address = 0x20000,
+    .size = 0,
+    .erase_size = 4096,
+    .label = "ota_0",
+    .encrypted = false,
+    .readonly = true,
+};
+
+const esp_partition_t *esp_ota_get_running_partition(void) { return &s_runningPartition; }
+
+const esp_partition_t *esp_ota_get_boot_partition(void) { return &s_runningPartition; }
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+  return nullptr;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) { return ESP_OK; }
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) { return ESP_ERR_NOT_SUPPORTED; }
+
+const esp_app_desc_t *esp_app_get_description(void) {
+  static const esp_app_desc_t description = {
+      .magic_word = ESP_APP_DESC_MAGIC_WORD,
+      .secure_version = 0,
+      .reserv1 = {},
+      .version = "host",
+      .project_name = "MatterApplication",
+      .time = "00:00:00",
+      .date = "Jan  1 1970",
+      .idf_ver = "v5.1.2",
+      .app_elf_sha256 = {},
+      .reserv2 = {},
+  };
+  return &description;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) { return 0; }
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen) { return 0; }
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char *output) {
+  memset(output, 0, 32);
+  return 0;
+}
@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct host_task {
+  TaskFunction_t function;
+  void *arg;
+  pthread_t thread;
+  char name[configMAX_TASK_NAME_LEN];
+};
+
+struct host_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  UBaseType_t head;
+  UBaseType_t count;
+  uint8_t *items;
+};
+
+static thread_local host_task *s_currentTask = nullptr;
+
+static void *run_task(void *arg) {
+  host_task *task = static_cast<host_task *>(arg);
+  s_currentTask = task;
+  pthread_setname_np(pthread_self(), task->name);
+  task->function(task->arg);
+  /* A FreeRTOS task must not return, treat it as deleting itself */
+  vTaskDelete(nullptr);
+  return nullptr;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created_task) {
+  host_task *task = static_cast<host_task *>(calloc(1, sizeof(host_task)));
+  if (task == nullptr) {
+    return pdFAIL;
+  }
+  task->function = function;
+  task->arg = arg;
+  strncpy(task->name, name, sizeof(task->name) - 1);
+
+  /* The stack depth is in bytes on ESP-IDF, the host libc needs more than the device */
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  size_t stackSize = stack_depth < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : stack_depth;
+  pthread_attr_setstacksize(&attr, stackSize < 65536 ? 65536 : stackSize);
+  int err = pthread_create(&task->thread, &attr, run_task, task);
+  pthread_attr_destroy(&attr);
+  if (err != 0) {
+    free(task);
+    return pdFAIL;
+  }
+  if (created_task != nullptr) {
+    *created_task = task;
+  }
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == s_currentTask) {
+    task = s_currentTask;
+    free(task);
+    pthread_exit(nullptr);
+  }
+}
+
+void vTaskDelay(TickType_t ticks) { usleep(static_cast<useconds_t>(ticks) * 1000 * portTICK_PERIOD_MS); }
+
+TickType_t xTaskGetTickCount(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<TickType_t>(now.tv_sec * 1000 + now.tv_nsec / 1000000) / portTICK_PERIOD_MS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  host_queue *queue = static_cast<host_queue *>(calloc(1, sizeof(host_queue)));
+  if (queue == nullptr) {
+    return nullptr;
+  }
+  queue->items = static_cast<uint8_t *>(malloc(length * item_size));
+  if (queue->items == nullptr) {
+    free(queue);
+    return nullptr;
+  }
+  pthread_mutex_init(&queue->lock, nullptr);
+  pthread_cond_init(&queue->changed, nullptr);
+  queue->length = length;
+  queue->itemSize = item_size;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  pthread_cond_destroy(&queue->changed);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->items);
+  free(queue);
+}
+
+/**
+ * @brief Wait on the queue until the condition holds, for at most the given ticks. Called with the lock held.
+ */
+template <typename Condition>
+static bool wait_for(host_queue *queue, TickType_t ticks, Condition condition) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  uint64_t ns = static_cast<uint64_t>(ticks) * portTICK_PERIOD_MS * 1000000ULL + deadline.tv_nsec;
+  deadline.tv_sec += ns / 1000000000ULL;
+  deadline.tv_nsec = ns % 1000000000ULL;
+
+  while (!condition()) {
+    if (ticks == 0) {
+      return false;
+    }
+    if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(&queue->changed, &queue->lock);
+    } else if (pthread_cond_timedwait(&queue->changed, &queue->lock, &deadline) == ETIMEDOUT) {
+      return condition();
+    }
+  }
+  return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+  pthread_mutex_lock(&queue->lock);
+  if (!wait_for(queue, ticks_to_wait, [queue] { return queue->count < queue->length; })) {
+    pthread_mutex_unlock(&queue->lock);
+    return pdFALSE;
+  }
+  UBaseType_t tail = (queue->head + queue->count) % queue->length;
+  memcpy(queue->items + tail * queue->itemSize, item, queue->itemSize);
+  queue->count++;
+  pthread_cond_broadcast(&queue->changed);
+  pthread_mutex_unlock(&queue->lock);
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait) {
+  pthread_mutex_lock(&queue->lock);
+  if (!wait_for(queue, ticks_to_wait, [queue] { return queue->count > 0; })) {
+    pthread_mutex_unlock(&queue->lock);
+    return pdFALSE;
+  }
+  memcpy(buffer, queue->items + queue->head * queue->itemSize, queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  pthread_cond_broadcast(&queue->changed);
+  pthread_mutex_unlock(&queue->lock);
+  return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buffer) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&buffer->mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return buffer;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) { pthread_mutex_destroy(&semaphore->mutex); }
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+  if (ticks_to_wait == portMAX_DELAY) {
+    return pthread_mutex_lock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+  }
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  uint64_t ns = static_cast<uint64_t>(ticks_to_wait) * portTICK_PERIOD_MS * 1000000ULL + deadline.tv_nsec;
+  deadline.tv_sec += ns / 1000000000ULL;
+  deadline.tv_nsec = ns % 1000000000ULL;
+  return pthread_mutex_timedlock(&semaphore->mutex, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+  return pthread_mutex_unlock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,149 @@
+#include <errno.h>
+#include <esp_heap_caps.h>
+#include <host_heap.h>
+#include <malloc.h>
+
+#include <atomic>
+
+/* The allocator of the process is glibc's, these wrappers only count the usable size of each block */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static constexpr int kTrackSlots = 64;
+
+struct TrackSlot {
+  std::atomic<bool> active;
+  size_t base;               ///< Bytes held when the request started
+  std::atomic<size_t> peak;  ///< Most bytes held since then
+};
+
+static std::atomic<size_t> s_current(0);
+static std::atomic<size_t> s_peak(0);
+static std::atomic<uint64_t> s_allocations(0);
+static std::atomic<int> s_activeSlots(0);
+static TrackSlot s_slots[kTrackSlots];
+static size_t s_heapSize = 320 * 1024;
+static size_t s_heapBase = 0;  ///< Bytes held before the simulated heap was sized, the host runtime's
+
+static void raise_to(std::atomic<size_t> &peak, size_t value) {
+  size_t seen = peak.load(std::memory_order_relaxed);
+  while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+static void *counted(void *ptr) {
+  if (ptr == nullptr) {
+    return nullptr;
+  }
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  size_t size = malloc_usable_size(ptr);
+  size_t current = s_current.fetch_add(size, std::memory_order_relaxed) + size;
+  raise_to(s_peak, current);
+  if (s_activeSlots.load(std::memory_order_relaxed) > 0) {
+    for (TrackSlot &slot : s_slots) {
+      if (slot.active.load(std::memory_order_acquire)) {
+        raise_to(slot.peak, current);
+      }
+    }
+  }
+  return ptr;
+}
+
+static void uncount(void *ptr) {
+  if (ptr != nullptr) {
+    s_current.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+  }
+}
+
+extern "C" {
+
+void *malloc(size_t size) { return counted(__libc_malloc(size)); }
+
+void *calloc(size_t count, size_t size) { return counted(__libc_calloc(count, size)); }
+
+void *realloc(void *ptr, size_t size) {
+  uncount(ptr);
+  void *moved = __libc_realloc(ptr, size);
+  if (moved == nullptr && size > 0) {
+    // the block is left as it was
+    return counted(ptr);
+  }
+  return counted(moved);
+}
+
+void *memalign(size_t alignment, size_t size) { return counted(__libc_memalign(alignment, size)); }
+
+void *aligned_alloc(size_t alignment, size_t size) { return counted(__libc_memalign(alignment, size)); }
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  void *ptr = counted(__libc_memalign(alignment, size));
+  if (ptr == nullptr) {
+    return ENOMEM;
+  }
+  *memptr = ptr;
+  return 0;
+}
+
+void free(void *ptr) {
+  uncount(ptr);
+  __libc_free(ptr);
+}
+}
+
+void host_heap_set_size(size_t size) {
+  s_heapSize = size;
+  s_heapBase = host_heap_current();
+}
+
+size_t host_heap_size(void) { return s_heapSize; }
+
+size_t host_heap_current(void) { return s_current.load(std::memory_order_relaxed); }
+
+size_t host_heap_peak(void) { return s_peak.load(std::memory_order_relaxed); }
+
+void host_heap_reset_peak(void) { s_peak.store(host_heap_current(), std::memory_order_relaxed); }
+
+uint64_t host_heap_allocations(void) { return s_allocations.load(std::memory_order_relaxed); }
+
+int host_heap_track_begin(void) {
+  for (int i = 0; i < kTrackSlots; i++) {
+    bool expected = false;
+    TrackSlot &slot = s_slots[i];
+    if (!slot.active.load(std::memory_order_relaxed) &&
+        slot.active.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      slot.base = host_heap_current();
+      slot.peak.store(slot.base, std::memory_order_relaxed);
+      s_activeSlots.fetch_add(1, std::memory_order_relaxed);
+      return i;
+    }
+  }
+  return -1;
+}
+
+size_t host_heap_track_end(int slot) {
+  if (slot < 0 || slot >= kTrackSlots) {
+    return 0;
+  }
+  TrackSlot &entry = s_slots[slot];
+  size_t peak = entry.peak.load(std::memory_order_relaxed);
+  size_t growth = peak > entry.base ? peak - entry.base : 0;
+  s_activeSlots.fetch_sub(1, std::memory_order_relaxed);
+  entry.active.store(false, std::memory_order_release);
+  return growth;
+}
+
+static size_t free_below(size_t held) {
+  size_t used = held > s_heapBase ? held - s_heapBase : 0;
+  return used < s_heapSize ? s_heapSize - used : 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) { return free_below(host_heap_current()); }
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) { return free_below(host_heap_peak()); }
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) { return heap_caps_get_free_size(caps); }
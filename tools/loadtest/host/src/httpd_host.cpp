@@ -0,0 +1,1239 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <host_heap.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+static const char *TAG = "httpd";
+
+// Requests of the load generator name their type in this header, the others are counted by method and path
+static const char *kTypeHeader = "X-Loadtest-Type";
+
+// Path of the per request type statistics, answered by the server itself
+static const char *kStatsPath = "/_host/stats";
+
+uint16_t host_httpd_port = 8080;
+
+struct HostServer;
+
+/**
+ * @brief A client connection.
+ */
+struct HostSession {
+  int fd;
+  bool websocket;
+  bool handedOff;  ///< An async handler owns the socket, it is out of the select
+  bool closing;    ///< Close once the async handler completes
+  uint64_t lastUse;
+  std::string buffer;  ///< Bytes received past the current request head
+  const httpd_uri_t *wsHandler;
+};
+
+/**
+ * @brief Counters of one request type.
+ */
+struct RequestStats {
+  uint32_t count;
+  uint32_t failures;
+  uint64_t totalUs;
+  uint64_t maxUs;
+  size_t peakHeap;  ///< Most heap growth of a single request while in flight
+  uint64_t heapSum;
+};
+
+struct HostServer {
+  httpd_config_t config;
+  int listenFd;
+  int wakePipe[2];
+  pthread_t thread;
+  bool running;
+  std::vector<httpd_uri_t> handlers;
+
+  std::mutex sessionsLock;  ///< Guards the map, the sessions themselves are only changed by the server thread
+  std::map<int, HostSession *> sessions;
+  uint64_t useCounter;
+
+  std::mutex workLock;
+  std::deque<std::pair<httpd_work_fn_t, void *>> work;
+
+  std::mutex statsLock;
+  std::map<std::string, RequestStats> stats;
+};
+
+/**
+ * @brief State of a request, req->aux.
+ */
+struct HostRequest {
+  HostServer *server;
+  HostSession *session;
+  std::vector<std::pair<std::string, std::string>> headers;
+  size_t bodyLeft;
+
+  std::string status;
+  std::string type;
+  std::vector<std::pair<std::string, std::string>> respHeaders;
+  bool headersSent;
+  bool finished;
+
+  bool asyncBegun;  ///< The request was handed off, the copy completes it
+
+  httpd_ws_type_t wsType;
+  bool wsFinal;
+  bool wsMasked;
+  uint8_t wsMask[4];
+  size_t wsLength;
+  size_t wsRead;
+
+  std::string statsKey;
+  int64_t startUs;
+  int heapSlot;
+};
+
+/**
+ * @brief A request and its state. httpd_req_t has a const uri, so holders are created with {{}, {}}.
+ */
+struct HostRequestHolder {
+  httpd_req_t req;
+  HostRequest aux;
+};
+
+static HostRequest *aux_of(httpd_req_t *r) { return static_cast<HostRequest *>(r->aux); }
+
+static void wake(HostServer *server) {
+  char byte = 0;
+  (void)!write(server->wakePipe[1], &byte, 1);
+}
+
+/* Socket I/O */
+
+static bool send_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+/**
+ * @brief Read what the session has buffered, or one recv() from its socket.
+ * @return Bytes read, HTTPD_SOCK_ERR_TIMEOUT after the receive timeout, HTTPD_SOCK_ERR_FAIL if the client
+ *         closed the connection or the socket failed.
+ */
+static int session_read(HostSession *session, char *buf, size_t length) {
+  if (!session->buffer.empty()) {
+    size_t take = length < session->buffer.size() ? length : session->buffer.size();
+    memcpy(buf, session->buffer.data(), take);
+    session->buffer.erase(0, take);
+    return take;
+  }
+
+  while (true) {
+    ssize_t received = recv(session->fd, buf, length, 0);
+    if (received > 0) {
+      return received;
+    }
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    return HTTPD_SOCK_ERR_FAIL;
+  }
+}
+
+static bool session_read_all(HostSession *session, void *buf, size_t length) {
+  char *bytes = static_cast<char *>(buf);
+  while (length > 0) {
+    int received = session_read(session, bytes, length);
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    length -= received;
+  }
+  return true;
+}
+
+/**
+ * @brief Read and drop the part of the body the handler left, so the next request starts at its head.
+ */
+static bool discard_body(HostRequest *request) {
+  char scratch[512];
+  while (request->bodyLeft > 0) {
+    int received = session_read(request->session, scratch,
+                                request->bodyLeft < sizeof(scratch) ? request->bodyLeft : sizeof(scratch));
+    if (received <= 0) {
+      return false;
+    }
+    request->bodyLeft -= received;
+  }
+  return true;
+}
+
+/* Sessions */
+
+static void close_session(HostServer *server, HostSession *session) {
+  if (session->handedOff) {
+    session->closing = true;
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(server->sessionsLock);
+    server->sessions.erase(session->fd);
+  }
+  if (server->config.close_fn != nullptr) {
+    server->config.close_fn(server, session->fd);
+  }
+  close(session->fd);
+  delete session;
+}
+
+static HostSession *find_session(HostServer *server, int fd) {
+  std::lock_guard<std::mutex> lock(server->sessionsLock);
+  auto it = server->sessions.find(fd);
+  return it == server->sessions.end() ? nullptr : it->second;
+}
+
+static void accept_session(HostServer *server) {
+  int fd = accept(server->listenFd, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+
+  /* Like the device, a full server closes the least recently used idle session or refuses the client */
+  HostSession *oldest = nullptr;
+  size_t count;
+  {
+    std::lock_guard<std::mutex> lock(server->sessionsLock);
+    count = server->sessions.size();
+    for (const auto &entry : server->sessions) {
+      if (!entry.second->handedOff && (oldest == nullptr || entry.second->lastUse < oldest->lastUse)) {
+        oldest = entry.second;
+      }
+    }
+  }
+  if (count >= server->config.max_open_sockets) {
+    if (!server->config.lru_purge_enable || oldest == nullptr) {
+      ESP_LOGW(TAG, "No free session, closing %d", fd);
+      close(fd);
+      return;
+    }
+    ESP_LOGD(TAG, "Closing the least recently used session %d", oldest->fd);
+    close_session(server, oldest);
+  }
+
+  struct timeval timeout = {.tv_sec = server->config.recv_wait_timeout, .tv_usec = 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  timeout.tv_sec = server->config.send_wait_timeout;
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (server->config.open_fn != nullptr && server->config.open_fn(server, fd) != ESP_OK) {
+    close(fd);
+    return;
+  }
+
+  HostSession *session = new HostSession{fd, false, false, false, ++server->useCounter, {}, nullptr};
+  std::lock_guard<std::mutex> lock(server->sessionsLock);
+  server->sessions[fd] = session;
+}
+
+/* Statistics */
+
+static void stats_begin(HostRequest *request, const char *method, const char *uri) {
+  char type[64];
+  request->statsKey.clear();
+  for (const auto &header : request->headers) {
+    if (strcasecmp(header.first.c_str(), kTypeHeader) == 0) {
+      request->statsKey = header.second;
+    }
+  }
+  if (request->statsKey.empty()) {
+    snprintf(type, sizeof(type), "%s %.*s", method, (int)strcspn(uri, "?"), uri);
+    request->statsKey = type;
+  }
+  request->startUs = esp_timer_get_time();
+  request->heapSlot = host_heap_track_begin();
+}
+
+static void stats_end(HostRequest *request, esp_err_t result) {
+  size_t heap = host_heap_track_end(request->heapSlot);
+  request->heapSlot = -1;
+  uint64_t elapsedUs = esp_timer_get_time() - request->startUs;
+
+  std::lock_guard<std::mutex> lock(request->server->statsLock);
+  RequestStats &stats = request->server->stats[request->statsKey];
+  stats.count++;
+  if (result != ESP_OK) {
+    stats.failures++;
+  }
+  stats.totalUs += elapsedUs;
+  stats.maxUs = elapsedUs > stats.maxUs ? elapsedUs : stats.maxUs;
+  stats.peakHeap = heap > stats.peakHeap ? heap : stats.peakHeap;
+  stats.heapSum += heap;
+}
+
+static void send_stats(HostServer *server, HostSession *session, bool reset) {
+  std::string body = "{\"heap\": {\"current\": " + std::to_string(host_heap_current()) +
+                     ", \"peak\": " + std::to_string(host_heap_peak()) + "}, \"requests\": {";
+  {
+    std::lock_guard<std::mutex> lock(server->statsLock);
+    bool first = true;
+    for (const auto &entry : server->stats) {
+      const RequestStats &stats = entry.second;
+      char line[320];
+      snprintf(line, sizeof(line),
+               "%s\"%s\": {\"count\": %u, \"failures\": %u, \"mean_us\": %llu, \"max_us\": %llu, "
+               "\"peak_heap\": %zu, \"mean_heap\": %llu}",
+               first ? "" : ", ", entry.first.c_str(), stats.count, stats.failures,
+               (unsigned long long)(stats.count ? stats.totalUs / stats.count : 0),
+               (unsigned long long)stats.maxUs, stats.peakHeap,
+               (unsigned long long)(stats.count ? stats.heapSum / stats.count : 0));
+      body += line;
+      first = false;
+    }
+    if (reset) {
+      server->stats.clear();
+      host_heap_reset_peak();
+    }
+  }
+  body += "}}";
+
+  std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                     std::to_string(body.size()) + "\r\nCache-Control: no-store\r\n\r\n";
+  send_all(session->fd, head.data(), head.size());
+  send_all(session->fd, body.data(), body.size());
+}
+
+/* WebSocket */
+
+static void sha1(const uint8_t *data, size_t length, uint8_t digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  std::string message(reinterpret_cast<const char *>(data), length);
+  message += '\x80';
+  while (message.size() % 64 != 56) {
+    message += '\0';
+  }
+  uint64_t bits = static_cast<uint64_t>(length) * 8;
+  for (int i = 7; i >= 0; i--) {
+    message += static_cast<char>(bits >> (i * 8));
+  }
+
+  auto rotl = [](uint32_t value, int count) { return (value << count) | (value >> (32 - count)); };
+  for (size_t block = 0; block < message.size(); block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      const uint8_t *p = reinterpret_cast<const uint8_t *>(message.data()) + block + i * 4;
+      w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+    for (int i = 16; i < 80; i++) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  for (int i = 0; i < 20; i++) {
+    digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+  }
+}
+
+static std::string base64(const uint8_t *data, size_t length) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t group = (uint32_t)data[i] << 16;
+    if (i + 1 < length) {
+      group |= (uint32_t)data[i + 1] << 8;
+    }
+    if (i + 2 < length) {
+      group |= data[i + 2];
+    }
+    out += alphabet[(group >> 18) & 0x3F];
+    out += alphabet[(group >> 12) & 0x3F];
+    out += i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+    out += i + 2 < length ? alphabet[group & 0x3F] : '=';
+  }
+  return out;
+}
+
+static bool ws_handshake(HostRequest *request) {
+  std::string accept;
+  for (const auto &header : request->headers) {
+    if (strcasecmp(header.first.c_str(), "Sec-WebSocket-Key") == 0) {
+      std::string input = header.second + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+      uint8_t digest[20];
+      sha1(reinterpret_cast<const uint8_t *>(input.data()), input.size(), digest);
+      accept = base64(digest, sizeof(digest));
+    }
+  }
+  if (accept.empty()) {
+    return false;
+  }
+  std::string response =
+      "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: " +
+      accept + "\r\n\r\n";
+  return send_all(request->session->fd, response.data(), response.size());
+}
+
+static esp_err_t ws_send(int fd, httpd_ws_type_t type, bool final, const uint8_t *payload, size_t length) {
+  uint8_t header[10];
+  size_t headerLength = 2;
+  header[0] = (final ? 0x80 : 0x00) | type;
+  if (length < 126) {
+    header[1] = length;
+  } else if (length <= 0xFFFF) {
+    header[1] = 126;
+    header[2] = length >> 8;
+    header[3] = length;
+    headerLength = 4;
+  } else {
+    header[1] = 127;
+    for (int i = 0; i < 8; i++) {
+      header[2 + i] = static_cast<uint64_t>(length) >> (56 - i * 8);
+    }
+    headerLength = 10;
+  }
+  if (!send_all(fd, reinterpret_cast<const char *>(header), headerLength) ||
+      !send_all(fd, reinterpret_cast<const char *>(payload), length)) {
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/**
+ * @brief Read the payload of the current frame and unmask it.
+ */
+static bool ws_read_payload(HostRequest *request, uint8_t *buf, size_t length) {
+  if (!session_read_all(request->session, buf, length)) {
+    return false;
+  }
+  if (request->wsMasked) {
+    for (size_t i = 0; i < length; i++) {
+      buf[i] ^= request->wsMask[(request->wsRead + i) % 4];
+    }
+  }
+  request->wsRead += length;
+  return true;
+}
+
+/**
+ * @brief Handle a frame from a WebSocket client: answer the control frames, hand the others to the handler.
+ */
+static void handle_ws_frame(HostServer *server, HostSession *session) {
+  HostRequestHolder holder{{}, {}};
+  HostRequest *request = &holder.aux;
+  request->server = server;
+  request->session = session;
+  request->heapSlot = -1;
+  holder.req.aux = request;
+  holder.req.handle = server;
+
+  uint8_t header[2];
+  if (!session_read_all(session, header, sizeof(header))) {
+    close_session(server, session);
+    return;
+  }
+  request->wsFinal = header[0] & 0x80;
+  request->wsType = static_cast<httpd_ws_type_t>(header[0] & 0x0F);
+  request->wsMasked = header[1] & 0x80;
+  uint64_t length = header[1] & 0x7F;
+  uint8_t extended[8];
+  if (length == 126) {
+    if (!session_read_all(session, extended, 2)) {
+      close_session(server, session);
+      return;
+    }
+    length = (uint64_t)extended[0] << 8 | extended[1];
+  } else if (length == 127) {
+    if (!session_read_all(session, extended, 8)) {
+      close_session(server, session);
+      return;
+    }
+    length = 0;
+    for (int i = 0; i < 8; i++) {
+      length = length << 8 | extended[i];
+    }
+  }
+  if (request->wsMasked && !session_read_all(session, request->wsMask, sizeof(request->wsMask))) {
+    close_session(server, session);
+    return;
+  }
+  request->wsLength = length;
+
+  const httpd_uri_t *handler = session->wsHandler;
+  if (request->wsType >= HTTPD_WS_TYPE_CLOSE && !handler->handle_ws_control_frames) {
+    uint8_t payload[125];
+    if (length > sizeof(payload) || !ws_read_payload(request, payload, length)) {
+      close_session(server, session);
+      return;
+    }
+    if (request->wsType == HTTPD_WS_TYPE_PING) {
+      ws_send(session->fd, HTTPD_WS_TYPE_PONG, true, payload, length);
+    } else if (request->wsType == HTTPD_WS_TYPE_CLOSE) {
+      ws_send(session->fd, HTTPD_WS_TYPE_CLOSE, true, nullptr, 0);
+      close_session(server, session);
+    }
+    return;
+  }
+
+  /* Data frames reach the handler with a method other than GET, like on the device */
+  holder.req.method = 0;
+  memcpy(const_cast<char *>(holder.req.uri), handler->uri,
+         strnlen(handler->uri, sizeof(holder.req.uri) - 1));
+  holder.req.user_ctx = handler->user_ctx;
+  esp_err_t result = handler->handler(&holder.req);
+
+  /* Drop what the handler did not read */
+  uint8_t scratch[256];
+  bool ok = result == ESP_OK;
+  while (ok && request->wsRead < request->wsLength) {
+    size_t left = request->wsLength - request->wsRead;
+    ok = ws_read_payload(request, scratch, left < sizeof(scratch) ? left : sizeof(scratch));
+  }
+  if (!ok) {
+    close_session(server, session);
+  }
+}
+
+/* Requests */
+
+static void send_plain_error(HostSession *session, const char *status) {
+  std::string response = std::string("HTTP/1.1 ") + status +
+                         "\r\nContent-Type: text/html\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  send_all(session->fd, response.data(), response.size());
+}
+
+/**
+ * @brief Read the head of the next request into the session buffer.
+ * @return Length of the head including its blank line, 0 if the session must be closed, an error was sent.
+ */
+static size_t read_head(HostSession *session) {
+  static constexpr size_t kMaxHead = HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN + 32;
+  char chunk[1024];
+  while (true) {
+    size_t end = session->buffer.find("\r\n\r\n");
+    if (end != std::string::npos) {
+      return end + 4;
+    }
+    if (session->buffer.size() > kMaxHead) {
+      size_t line = session->buffer.find("\r\n");
+      send_plain_error(session, line == std::string::npos || line > HTTPD_MAX_URI_LEN + 16
+                                    ? "414 URI Too Long"
+                                    : "431 Request Header Fields Too Large");
+      return 0;
+    }
+
+    ssize_t received = recv(session->fd, chunk, sizeof(chunk), 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !session->buffer.empty()) {
+      send_plain_error(session, "408 Request Timeout");
+      return 0;
+    }
+    if (received <= 0) {
+      return 0;
+    }
+    session->buffer.append(chunk, received);
+  }
+}
+
+static const char *kMethods[] = {"DELETE", "GET", "HEAD", "POST", "PUT"};
+
+static int parse_method(const std::string &method) {
+  for (size_t i = 0; i < sizeof(kMethods) / sizeof(kMethods[0]); i++) {
+    if (method == kMethods[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static bool matches(HostServer *server, const httpd_uri_t &handler, const char *uri, size_t length) {
+  if (server->config.uri_match_fn != nullptr) {
+    return server->config.uri_match_fn(handler.uri, uri, length);
+  }
+  return strlen(handler.uri) == length && strncmp(handler.uri, uri, length) == 0;
+}
+
+/**
+ * @brief Finish a request whose handler returned on the server thread or whose async copy completed.
+ * @return Whether the session can serve the next request.
+ */
+static bool finish_request(HostRequest *request, esp_err_t result) {
+  bool keep = result == ESP_OK && discard_body(request);
+  for (const auto &header : request->headers) {
+    if (strcasecmp(header.first.c_str(), "Connection") == 0 &&
+        strcasecmp(header.second.c_str(), "close") == 0) {
+      keep = false;
+    }
+  }
+  stats_end(request, result);
+  return keep;
+}
+
+/**
+ * @brief Serve the next request of an HTTP session.
+ */
+static void handle_request(HostServer *server, HostSession *session) {
+  size_t headLength = read_head(session);
+  if (headLength == 0) {
+    close_session(server, session);
+    return;
+  }
+  std::string head = session->buffer.substr(0, headLength - 2);
+  session->buffer.erase(0, headLength);
+  session->lastUse = ++server->useCounter;
+
+  HostRequestHolder *holder = new HostRequestHolder{{}, {}};
+  HostRequest *request = &holder->aux;
+  httpd_req_t *req = &holder->req;
+  request->server = server;
+  request->session = session;
+  request->status = "200 OK";
+  request->type = "text/html";
+  request->heapSlot = -1;
+  req->aux = request;
+  req->handle = server;
+
+  /* Request line */
+  size_t lineEnd = head.find("\r\n");
+  std::string line = head.substr(0, lineEnd);
+  size_t methodEnd = line.find(' ');
+  size_t uriEnd = line.rfind(' ');
+  if (methodEnd == std::string::npos || uriEnd == methodEnd) {
+    send_plain_error(session, "400 Bad Request");
+    delete holder;
+    close_session(server, session);
+    return;
+  }
+  std::string uri = line.substr(methodEnd + 1, uriEnd - methodEnd - 1);
+  const char *tooLong = nullptr;
+  if (uri.size() > HTTPD_MAX_URI_LEN) {
+    tooLong = "414 URI Too Long";
+  } else if (head.size() - lineEnd > HTTPD_MAX_REQ_HDR_LEN) {
+    tooLong = "431 Request Header Fields Too Large";
+  }
+  if (tooLong != nullptr) {
+    send_plain_error(session, tooLong);
+    delete holder;
+    close_session(server, session);
+    return;
+  }
+  memcpy(const_cast<char *>(req->uri), uri.data(), uri.size());
+  req->method = parse_method(line.substr(0, methodEnd));
+
+  /* Header fields */
+  size_t position = lineEnd + 2;
+  while (position < head.size()) {
+    size_t end = head.find("\r\n", position);
+    std::string field = head.substr(position, end - position);
+    position = end + 2;
+    size_t colon = field.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    size_t valueStart = field.find_first_not_of(" \t", colon + 1);
+    request->headers.emplace_back(field.substr(0, colon),
+                                  valueStart == std::string::npos ? "" : field.substr(valueStart));
+    if (strcasecmp(request->headers.back().first.c_str(), "Content-Length") == 0) {
+      req->content_len = strtoul(request->headers.back().second.c_str(), nullptr, 10);
+    }
+  }
+  request->bodyLeft = req->content_len;
+
+  if (req->method == HTTP_GET && strncmp(req->uri, kStatsPath, strlen(kStatsPath)) == 0) {
+    send_stats(server, session, strstr(req->uri, "reset=1") != nullptr);
+    bool keep = discard_body(request);
+    delete holder;
+    if (!keep) {
+      close_session(server, session);
+    }
+    return;
+  }
+
+  /* Route */
+  size_t matchLength = strcspn(req->uri, "?");
+  const httpd_uri_t *handler = nullptr;
+  bool uriKnown = false;
+  for (const httpd_uri_t &candidate : server->handlers) {
+    if (matches(server, candidate, req->uri, matchLength)) {
+      uriKnown = true;
+      if (candidate.method == req->method) {
+        handler = &candidate;
+        break;
+      }
+    }
+  }
+  stats_begin(request, line.substr(0, methodEnd).c_str(), req->uri);
+  if (handler == nullptr) {
+    httpd_resp_send_err(req, uriKnown ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, nullptr);
+    bool keep = finish_request(request, ESP_OK);
+    delete holder;
+    if (!keep) {
+      close_session(server, session);
+    }
+    return;
+  }
+  req->user_ctx = handler->user_ctx;
+
+  if (handler->is_websocket) {
+    esp_err_t result = ws_handshake(request) ? handler->handler(req) : ESP_FAIL;
+    stats_end(request, result);
+    delete holder;
+    if (result != ESP_OK) {
+      close_session(server, session);
+      return;
+    }
+    session->websocket = true;
+    session->wsHandler = handler;
+    return;
+  }
+
+  esp_err_t result = handler->handler(req);
+  if (request->asyncBegun) {
+    /* The copy owns the request and the socket now */
+    delete holder;
+    return;
+  }
+  bool keep = finish_request(request, result);
+  delete holder;
+  if (!keep) {
+    close_session(server, session);
+  }
+}
+
+/**
+ * @brief Whether a session that is back in the select has the head of its next request buffered already.
+ */
+static bool has_buffered_head(HostSession *session) {
+  return !session->websocket && session->buffer.find("\r\n\r\n") != std::string::npos;
+}
+
+static void run_work(HostServer *server) {
+  std::deque<std::pair<httpd_work_fn_t, void *>> work;
+  {
+    std::lock_guard<std::mutex> lock(server->workLock);
+    work.swap(server->work);
+  }
+  for (const auto &item : work) {
+    item.first(item.second);
+  }
+}
+
+static void *run_server(void *arg) {
+  HostServer *server = static_cast<HostServer *>(arg);
+
+  while (server->running) {
+    run_work(server);
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(server->listenFd, &readable);
+    FD_SET(server->wakePipe[0], &readable);
+    int maxFd = server->listenFd > server->wakePipe[0] ? server->listenFd : server->wakePipe[0];
+    std::vector<HostSession *> ready;
+    {
+      std::lock_guard<std::mutex> lock(server->sessionsLock);
+      for (const auto &entry : server->sessions) {
+        HostSession *session = entry.second;
+        if (session->handedOff) {
+          continue;
+        }
+        if (has_buffered_head(session)) {
+          ready.push_back(session);
+        }
+        FD_SET(session->fd, &readable);
+        maxFd = session->fd > maxFd ? session->fd : maxFd;
+      }
+    }
+
+    struct timeval poll = {0, 0};
+    if (select(maxFd + 1, &readable, nullptr, nullptr, ready.empty() ? nullptr : &poll) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ESP_LOGE(TAG, "select failed: %s", strerror(errno));
+      break;
+    }
+
+    if (FD_ISSET(server->wakePipe[0], &readable)) {
+      char drain[64];
+      while (read(server->wakePipe[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(server->sessionsLock);
+      for (const auto &entry : server->sessions) {
+        HostSession *session = entry.second;
+        if (!session->handedOff && FD_ISSET(session->fd, &readable) && !has_buffered_head(session)) {
+          ready.push_back(session);
+        }
+      }
+    }
+    for (HostSession *session : ready) {
+      if (session->websocket) {
+        handle_ws_frame(server, session);
+      } else {
+        handle_request(server, session);
+      }
+    }
+
+    if (FD_ISSET(server->listenFd, &readable)) {
+      accept_session(server);
+    }
+  }
+  return nullptr;
+}
+
+/* API */
+
+const char *http_method_str(enum http_method m) {
+  return m >= 0 && m < sizeof(kMethods) / sizeof(kMethods[0]) ? kMethods[m] : "<unknown>";
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+  HostServer *server = new HostServer();
+  server->config = *config;
+  server->running = true;
+
+  server->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int one = 1;
+  setsockopt(server->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(config->server_port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(server->listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(server->listenFd, config->backlog_conn > 64 ? config->backlog_conn : 64) != 0 ||
+      pipe2(server->wakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+    ESP_LOGE(TAG, "Failed to listen on port %u: %s", config->server_port, strerror(errno));
+    close(server->listenFd);
+    delete server;
+    return ESP_ERR_HTTPD_TASK;
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, config->stack_size < 65536 ? 65536 : config->stack_size);
+  int err = pthread_create(&server->thread, &attr, run_server, server);
+  pthread_attr_destroy(&attr);
+  if (err != 0) {
+    close(server->listenFd);
+    delete server;
+    return ESP_ERR_HTTPD_TASK;
+  }
+  pthread_setname_np(server->thread, "httpd");
+
+  ESP_LOGI(TAG, "Listening on port %u", config->server_port);
+  *handle = server;
+  return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+  HostServer *server = static_cast<HostServer *>(handle);
+  server->running = false;
+  wake(server);
+  pthread_join(server->thread, nullptr);
+
+  for (const auto &entry : server->sessions) {
+    close(entry.first);
+    delete entry.second;
+  }
+  close(server->listenFd);
+  close(server->wakePipe[0]);
+  close(server->wakePipe[1]);
+  if (server->config.global_user_ctx_free_fn != nullptr) {
+    server->config.global_user_ctx_free_fn(server->config.global_user_ctx);
+  } else {
+    free(server->config.global_user_ctx);
+  }
+  delete server;
+  return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+  HostServer *server = static_cast<HostServer *>(handle);
+  if (server->handlers.size() >= server->config.max_uri_handlers) {
+    return ESP_ERR_HTTPD_HANDLERS_FULL;
+  }
+  for (const httpd_uri_t &handler : server->handlers) {
+    if (handler.method == uri_handler->method && strcmp(handler.uri, uri_handler->uri) == 0) {
+      return ESP_ERR_HTTPD_HANDLER_EXISTS;
+    }
+  }
+  /* The server thread reads the handlers without a lock, they are all registered before the first client */
+  server->handlers.reserve(server->config.max_uri_handlers);
+  server->handlers.push_back(*uri_handler);
+  return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+  /* A trailing '*' matches any rest, a '?' before it or at the end makes the character before optional */
+  size_t length = strlen(uri_template);
+  bool asterisk = length > 0 && uri_template[length - 1] == '*';
+  size_t prefix = length - asterisk;
+  bool quest = prefix > 0 && uri_template[prefix - 1] == '?';
+  prefix -= quest;
+
+  if (quest && match_upto + 1 == prefix && strncmp(uri_template, uri_to_match, match_upto) == 0) {
+    return true;
+  }
+  if (match_upto < prefix || strncmp(uri_template, uri_to_match, prefix) != 0) {
+    return false;
+  }
+  return asterisk || match_upto == prefix;
+}
+
+void *httpd_get_global_user_ctx(httpd_handle_t handle) {
+  return static_cast<HostServer *>(handle)->config.global_user_ctx;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+  HostServer *server = static_cast<HostServer *>(handle);
+  {
+    std::lock_guard<std::mutex> lock(server->workLock);
+    server->work.emplace_back(work, arg);
+  }
+  wake(server);
+  return ESP_OK;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds) {
+  HostServer *server = static_cast<HostServer *>(handle);
+  std::lock_guard<std::mutex> lock(server->sessionsLock);
+  size_t count = 0;
+  for (const auto &entry : server->sessions) {
+    if (count == *fds) {
+      break;
+    }
+    client_fds[count++] = entry.first;
+  }
+  *fds = count;
+  return ESP_OK;
+}
+
+/**
+ * @brief Work item closing a session on the server thread.
+ */
+struct CloseWork {
+  HostServer *server;
+  int fd;
+};
+
+static void close_work(void *arg) {
+  CloseWork *work = static_cast<CloseWork *>(arg);
+  HostSession *session = find_session(work->server, work->fd);
+  if (session != nullptr) {
+    close_session(work->server, session);
+  }
+  delete work;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+  HostServer *server = static_cast<HostServer *>(handle);
+  if (find_session(server, sockfd) == nullptr) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return httpd_queue_work(handle, close_work, new CloseWork{server, sockfd});
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) { return aux_of(r)->session->fd; }
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+  HostRequest *request = aux_of(r);
+  if (request->bodyLeft == 0) {
+    return 0;
+  }
+  size_t length = buf_len < request->bodyLeft ? buf_len : request->bodyLeft;
+  int received = session_read(request->session, buf, length);
+  if (received > 0) {
+    request->bodyLeft -= received;
+  }
+  return received;
+}
+
+static const std::string *find_header(httpd_req_t *r, const char *field) {
+  for (const auto &header : aux_of(r)->headers) {
+    if (strcasecmp(header.first.c_str(), field) == 0) {
+      return &header.second;
+    }
+  }
+  return nullptr;
+}
+
+static esp_err_t copy_value(const char *value, size_t length, char *out, size_t size) {
+  if (size == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  size_t copy = length < size - 1 ? length : size - 1;
+  memcpy(out, value, copy);
+  out[copy] = '\0';
+  return copy < length ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+  if (r == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const std::string *value = find_header(r, field);
+  if (value == nullptr) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return copy_value(value->data(), value->size(), val, val_size);
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+  const std::string *value = find_header(r, field);
+  return value == nullptr ? 0 : value->size();
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+  const char *query = strchr(r->uri, '?');
+  if (query == nullptr) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  query++;
+  return copy_value(query, strcspn(query, "#"), buf, buf_len);
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+  size_t keyLength = strlen(key);
+  const char *pair = qry;
+  while (pair != nullptr && *pair != '\0') {
+    size_t pairLength = strcspn(pair, "&");
+    if (pairLength > keyLength && strncmp(pair, key, keyLength) == 0 && pair[keyLength] == '=') {
+      return copy_value(pair + keyLength + 1, pairLength - keyLength - 1, val, val_size);
+    }
+    pair = pair[pairLength] == '&' ? pair + pairLength + 1 : nullptr;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+  HostRequest *request = aux_of(r);
+  HostRequestHolder *copy = new HostRequestHolder{{}, {}};
+  memcpy(&copy->req, r, sizeof(*r));
+  copy->aux = *request;
+  copy->req.aux = &copy->aux;
+
+  /* The copy carries the statistics from here */
+  request->asyncBegun = true;
+  request->heapSlot = -1;
+  request->session->handedOff = true;
+  *out = &copy->req;
+  return ESP_OK;
+}
+
+/**
+ * @brief Work item giving a handed off session back to the server thread.
+ */
+struct ReleaseWork {
+  HostServer *server;
+  HostSession *session;
+  bool keep;
+};
+
+static void release_work(void *arg) {
+  ReleaseWork *work = static_cast<ReleaseWork *>(arg);
+  HostSession *session = work->session;
+  session->handedOff = false;
+  session->lastUse = ++work->server->useCounter;
+  if (!work->keep || session->closing) {
+    close_session(work->server, session);
+  }
+  delete work;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+  HostRequestHolder *holder = reinterpret_cast<HostRequestHolder *>(r);
+  HostRequest *request = &holder->aux;
+  HostServer *server = request->server;
+
+  /* A failed handler closes the session with httpd_sess_trigger_close() before it completes */
+  bool keep = finish_request(request, ESP_OK);
+  ReleaseWork *work = new ReleaseWork{server, request->session, keep};
+  delete holder;
+  return httpd_queue_work(server, release_work, work);
+}
+
+/* Responses */
+
+static esp_err_t send_head(HostRequest *request, const char *framing) {
+  std::string head = "HTTP/1.1 " + request->status + "\r\nContent-Type: " + request->type + "\r\n" + framing;
+  for (const auto &header : request->respHeaders) {
+    head += header.first + ": " + header.second + "\r\n";
+  }
+  head += "\r\n";
+  request->headersSent = true;
+  return send_all(request->session->fd, head.data(), head.size()) ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+  aux_of(r)->status = status;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+  aux_of(r)->type = type;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+  HostRequest *request = aux_of(r);
+  if (request->respHeaders.size() >= request->server->config.max_resp_headers) {
+    return ESP_ERR_HTTPD_RESP_HDR;
+  }
+  request->respHeaders.emplace_back(field, value);
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+  HostRequest *request = aux_of(r);
+  size_t length = buf_len == HTTPD_RESP_USE_STRLEN ? (buf != nullptr ? strlen(buf) : 0) : buf_len;
+  std::string framing = "Content-Length: " + std::to_string(length) + "\r\n";
+  esp_err_t err = send_head(request, framing.c_str());
+  if (err == ESP_OK && length > 0 && !send_all(request->session->fd, buf, length)) {
+    err = ESP_ERR_HTTPD_RESP_SEND;
+  }
+  request->finished = true;
+  return err;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+  HostRequest *request = aux_of(r);
+  if (!request->headersSent) {
+    esp_err_t err = send_head(request, "Transfer-Encoding: chunked\r\n");
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  size_t length = buf_len == HTTPD_RESP_USE_STRLEN ? (buf != nullptr ? strlen(buf) : 0) : buf_len;
+  char size[16];
+  snprintf(size, sizeof(size), "%zx\r\n", length);
+  int fd = request->session->fd;
+  if (!send_all(fd, size, strlen(size)) || (length > 0 && !send_all(fd, buf, length)) ||
+      !send_all(fd, "\r\n", 2)) {
+    return ESP_ERR_HTTPD_RESP_SEND;
+  }
+  if (length == 0) {
+    request->finished = true;
+  }
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+  static const struct {
+    const char *status;
+    const char *message;
+  } errors[] = {
+      {"500 Internal Server Error", "Server has encountered an unexpected error"},
+      {"501 Method Not Implemented", "Server does not support this method"},
+      {"505 Version Not Supported", "HTTP version not supported by server"},
+      {"400 Bad Request", "Bad request syntax"},
+      {"401 Unauthorized", "No permission -- see authorization schemes"},
+      {"403 Forbidden", "Request forbidden -- authorization will not help"},
+      {"404 Not Found", "Nothing matches the given URI"},
+      {"405 Method Not Allowed", "Specified method is invalid for this resource"},
+      {"408 Request Timeout", "Server closed this connection"},
+      {"411 Length Required", "Chunked encoding not supported"},
+      {"414 URI Too Long", "URI is too long"},
+      {"431 Request Header Fields Too Large", "Header fields are too long"},
+  };
+  if (error >= HTTPD_ERR_CODE_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  HostRequest *request = aux_of(req);
+  request->status = errors[error].status;
+  request->type = "text/html";
+  return httpd_resp_send(req, msg != nullptr ? msg : errors[error].message, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+  HostRequest *request = aux_of(req);
+  pkt->final = request->wsFinal;
+  pkt->fragmented = !request->wsFinal;
+  pkt->type = request->wsType;
+  if (max_len == 0) {
+    pkt->len = request->wsLength;
+    return ESP_OK;
+  }
+
+  size_t left = request->wsLength - request->wsRead;
+  size_t length = max_len < left ? max_len : left;
+  if (!ws_read_payload(request, pkt->payload, length)) {
+    return ESP_FAIL;
+  }
+  pkt->len = length;
+  return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+  return ws_send(fd, frame->type, frame->final, frame->payload, frame->len);
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+  HostServer *server = static_cast<HostServer *>(hd);
+  std::lock_guard<std::mutex> lock(server->sessionsLock);
+  auto it = server->sessions.find(fd);
+  if (it == server->sessions.end()) {
+    return HTTPD_WS_CLIENT_INVALID;
+  }
+  return it->second->websocket ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+}
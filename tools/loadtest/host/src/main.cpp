@@ -0,0 +1,87 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <getopt.h>
+#include <host_heap.h>
+#include <nvs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "AccessPoint.hpp"
+#include "StorageManager.hpp"
+
+static const char *TAG = "main";
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s --bundle <frontend.bin> [--port <port>] [--flash-delay-us <us>] [--heap <bytes>]\n"
+          "          [--log-level <0-5>]\n"
+          "Serve the config UI of the program mode on this host, see tools/loadtest/web_loadtest.py.\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+      {"bundle", required_argument, nullptr, 'b'},
+      {"port", required_argument, nullptr, 'p'},
+      {"flash-delay-us", required_argument, nullptr, 'd'},
+      {"heap", required_argument, nullptr, 'm'},
+      {"log-level", required_argument, nullptr, 'l'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  const char *bundle = nullptr;
+  size_t heap = 200 * 1024;
+  int option;
+  while ((option = getopt_long(argc, argv, "b:p:d:m:l:h", options, nullptr)) != -1) {
+    switch (option) {
+      case 'b':
+        bundle = optarg;
+        break;
+      case 'p':
+        host_httpd_port = strtoul(optarg, nullptr, 0);
+        break;
+      case 'd':
+        host_nvs_set_write_delay(strtoul(optarg, nullptr, 0));
+        break;
+      case 'm':
+        heap = strtoul(optarg, nullptr, 0);
+        break;
+      case 'l':
+        host_log_set_level(static_cast<esp_log_level_t>(atoi(optarg)));
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 2;
+    }
+  }
+  if (bundle == nullptr) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  /* Everything the process holds from here on counts against the simulated device heap */
+  host_heap_set_size(heap);
+
+  esp_err_t err = host_partition_register(CONFIG_AP_FRONTEND_PARTITION, bundle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open the frontend bundle %s: %s", bundle, esp_err_to_name(err));
+    return 1;
+  }
+
+  // the host always serves the program mode, the live config session needs the Matter endpoints
+  StorageManager *storageManager = new StorageManager();
+  // like a device that was put in program mode, which also creates the NVS namespace the routes read
+  storageManager->setProgramMode(true);
+  AccessPoint *accessPoint = new AccessPoint(storageManager);
+  if (accessPoint->startWebServer() != ESP_OK) {
+    return 1;
+  }
+
+  while (true) {
+    pause();
+  }
+}
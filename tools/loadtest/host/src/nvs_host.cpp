@@ -0,0 +1,200 @@
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* One in-memory NVS partition, shared by every partition label. Entries are keyed by namespace and key,
+   and a lock serializes the operations like the NVS lock on the device */
+
+struct NvsEntry {
+  nvs_type_t type;
+  std::vector<uint8_t> value;
+};
+
+using NvsKey = std::pair<std::string, std::string>;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<NvsKey, NvsEntry> s_entries;
+static std::vector<std::string> s_namespaces;  ///< Namespace of each handle, handle - 1 is the index
+static uint32_t s_writeDelayUs = 0;
+
+struct nvs_opaque_iterator_t {
+  std::vector<nvs_entry_info_t> entries;
+  size_t position;
+};
+
+void host_nvs_set_write_delay(uint32_t delay_us) { s_writeDelayUs = delay_us; }
+
+/**
+ * @brief Hold the lock for as long as the flash write would take. Called with the lock held.
+ */
+static void flash_write() {
+  if (s_writeDelayUs > 0) {
+    usleep(s_writeDelayUs);
+  }
+}
+
+static bool namespace_exists(const std::string &name) {
+  for (const auto &entry : s_entries) {
+    if (entry.first.first == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+esp_err_t nvs_open_from_partition(const char *part_name, const char *namespace_name,
+                                  nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+  pthread_mutex_lock(&s_lock);
+  if (open_mode == NVS_READONLY && !namespace_exists(namespace_name)) {
+    pthread_mutex_unlock(&s_lock);
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  nvs_handle_t handle = 0;
+  for (size_t i = 0; i < s_namespaces.size() && handle == 0; i++) {
+    if (s_namespaces[i] == namespace_name) {
+      handle = i + 1;
+    }
+  }
+  if (handle == 0) {
+    s_namespaces.push_back(namespace_name);
+    handle = s_namespaces.size();
+  }
+  pthread_mutex_unlock(&s_lock);
+
+  *out_handle = handle;
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_OK; }
+
+static esp_err_t get_value(nvs_handle_t handle, const char *key, nvs_type_t type, void *out_value,
+                           size_t *length) {
+  pthread_mutex_lock(&s_lock);
+  auto it = s_entries.find({s_namespaces[handle - 1], key});
+  if (it == s_entries.end() || it->second.type != type) {
+    pthread_mutex_unlock(&s_lock);
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  const std::vector<uint8_t> &value = it->second.value;
+  esp_err_t err = ESP_OK;
+  if (out_value == nullptr) {
+    *length = value.size();
+  } else if (*length < value.size()) {
+    err = ESP_ERR_NVS_INVALID_LENGTH;
+  } else {
+    memcpy(out_value, value.data(), value.size());
+    *length = value.size();
+  }
+  pthread_mutex_unlock(&s_lock);
+  return err;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value,
+                           size_t length) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(value);
+  pthread_mutex_lock(&s_lock);
+  s_entries[{s_namespaces[handle - 1], key}] = {type, std::vector<uint8_t>(bytes, bytes + length)};
+  flash_write();
+  pthread_mutex_unlock(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+  size_t length = sizeof(*out_value);
+  return get_value(handle, key, NVS_TYPE_U8, out_value, &length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+  return set_value(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+  return get_value(handle, key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+  return set_value(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+  return get_value(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+  return set_value(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+  pthread_mutex_lock(&s_lock);
+  bool erased = s_entries.erase({s_namespaces[handle - 1], key}) > 0;
+  if (erased) {
+    flash_write();
+  }
+  pthread_mutex_unlock(&s_lock);
+  return erased ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type,
+                         nvs_iterator_t *output_iterator) {
+  nvs_iterator_t iterator = new nvs_opaque_iterator_t{{}, 0};
+  pthread_mutex_lock(&s_lock);
+  for (const auto &entry : s_entries) {
+    if ((namespace_name == nullptr || entry.first.first == namespace_name) &&
+        (type == NVS_TYPE_ANY || entry.second.type == type)) {
+      nvs_entry_info_t info = {};
+      strncpy(info.namespace_name, entry.first.first.c_str(), sizeof(info.namespace_name) - 1);
+      strncpy(info.key, entry.first.second.c_str(), sizeof(info.key) - 1);
+      info.type = entry.second.type;
+      iterator->entries.push_back(info);
+    }
+  }
+  pthread_mutex_unlock(&s_lock);
+
+  if (iterator->entries.empty()) {
+    delete iterator;
+    *output_iterator = nullptr;
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  *output_iterator = iterator;
+  return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator) {
+  /* Like ESP-IDF 5, the iterator is released once it runs past the last entry */
+  if (++(*iterator)->position == (*iterator)->entries.size()) {
+    delete *iterator;
+    *iterator = nullptr;
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info) {
+  *out_info = iterator->entries[iterator->position];
+  return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator) { delete iterator; }
+
+esp_err_t nvs_flash_init_partition(const char *partition_label) { return ESP_OK; }
+
+esp_err_t nvs_flash_erase_partition(const char *partition_label) { return nvs_flash_erase(); }
+
+esp_err_t nvs_flash_erase(void) {
+  pthread_mutex_lock(&s_lock);
+  s_entries.clear();
+  flash_write();
+  pthread_mutex_unlock(&s_lock);
+  return ESP_OK;
+}
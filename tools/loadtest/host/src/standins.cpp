@@ -0,0 +1,62 @@
+#include <stdio.h>
+
+#include "AppEventBus.hpp"
+#include "DeltaPatcher.hpp"
+#include "EndpointCreator.hpp"
+#include "EndpointManager.hpp"
+
+/* The same schema as EndpointCreator.cpp, keep them in sync */
+static const char* lightJsonProprties = "[\"name\", \"lightPin\", \"buttonPin\"]";
+static const char* fanJsonProprties = "[\"name\", \"fanPin\", \"buttonPin\"]";
+static const char* pluginJsonProprties = "[\"name\", \"pluginPin\", \"buttonPin\"]";
+static const char* buttonJsonProprties = "[\"name\", \"buttonPin\"]";
+static const char* windowJsonProprties =
+    "[\"name\", \"motorUpPin\", \"motorDownPin\", \"buttonUpPin\", \"buttonDownPin\", \"timeToOpen\", "
+    "\"timeToClose\"]";
+
+void DeviceCreator::getJsonSchemaForAllDevices(char* jsonSchema, size_t schemaSize) {
+  snprintf(jsonSchema, schemaSize, "{\"LIGHT\":%s,\"FAN\":%s,\"PLUGIN\":%s,\"BUTTON\":%s,\"WINDOW\":%s}",
+           lightJsonProprties, fanJsonProprties, pluginJsonProprties, buttonJsonProprties,
+           windowJsonProprties);
+}
+
+esp_err_t EndpointManager::applyAccessories(const char* jsonArray, size_t jsonArraySize) { return ESP_OK; }
+
+/* Nothing posts Wi-Fi or IP events on the host, the bus is never started and drops what is published */
+esp_err_t AppEventBus::start() { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t AppEventBus::subscribe(AppEventMask mask, Handler handler, void* context) { return ESP_OK; }
+
+esp_err_t AppEventBus::publish(AppEventType type, uint32_t data) { return ESP_ERR_INVALID_STATE; }
+
+esp_err_t AppEventBus::getStats(AppEventBusStats* stats) { return ESP_ERR_NOT_SUPPORTED; }
+
+const char* AppEventBus::eventName(AppEventType type) { return "Unknown"; }
+
+/* The host has no running image to patch and no miniz, a delta upload is refused like a missing slot */
+DeltaPatcher::DeltaPatcher(FirmwareUpdate* update)
+    : m_update(update),
+      m_source(nullptr),
+      m_inflater(nullptr),
+      m_window(nullptr),
+      m_windowPos(0),
+      m_streamEnd(false),
+      m_chunk(nullptr),
+      m_chunkFill(0),
+      m_state(State::Header),
+      m_pending(),
+      m_pendingFill(0),
+      m_sourceSize(0),
+      m_targetHash(),
+      m_sourcePos(0),
+      m_diffLeft(0),
+      m_extraLeft(0),
+      m_seek(0) {}
+
+DeltaPatcher::~DeltaPatcher() {}
+
+esp_err_t DeltaPatcher::begin() { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t DeltaPatcher::feed(const uint8_t* data, size_t length) { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t DeltaPatcher::finish() { return ESP_ERR_NOT_SUPPORTED; }
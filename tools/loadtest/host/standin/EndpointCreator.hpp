@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @brief Stand-in for the device factory of EndpointManager, which needs esp_matter. It only provides the
+ * schema the accessories are validated against, the same as the firmware's.
+ */
+class DeviceCreator {
+ public:
+  DeviceCreator() = default;
+  ~DeviceCreator() = default;
+
+  /**
+   * @brief Get the JSON schema for all devices.
+   * @param jsonSchema Pointer to the JSON schema buffer.
+   * @param schemaSize Size of the JSON schema buffer.
+   */
+  void getJsonSchemaForAllDevices(char* jsonSchema, size_t schemaSize);
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+
+/**
+ * @brief Stand-in for the bridge endpoints. The host serves the program mode, where no endpoint exists,
+ * so nothing is ever applied to it.
+ */
+class EndpointManager {
+ public:
+  esp_err_t applyAccessories(const char *jsonArray, size_t jsonArraySize);
+};
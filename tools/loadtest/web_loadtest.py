@@ -0,0 +1,472 @@
+#!/usr/bin/env python3
+"""Load generator for the config web server, the phones of several installers opening the UI at once.
+
+Every virtual client replays what a browser does with the config UI, over its own keep-alive connections:
+
+  * a page load: index.html, then the stylesheet, script and images it references (with their "?v="
+    version), the accessory database (GET /accessories, the handler of /accessories/stored), the stored
+    WiFi network, the /events WebSocket and the icons script.js draws the accessory list with,
+  * reloads with a warm cache, which revalidate with If-None-Match and skip the versioned assets the
+    server marked immutable,
+  * saves: an accessory edited in place, one added and removed again, or the whole database replaced.
+
+It reports throughput, p50/p99 latency and errors per request type. Against the host build
+(tools/loadtest/host) it also reports the peak heap each request type reached, from /_host/stats; against
+a device only the lowest free heap of the run, from /metrics. The summary is printed and optionally written
+as JSON, and can be compared with an earlier run to fail on regressions.
+
+Example:
+  cmake -S tools/loadtest/host -B build-host && cmake --build build-host
+  build-host/ap_host --bundle build-host/frontend.bin --port 8080 --flash-delay-us 2000 &
+  tools/loadtest/web_loadtest.py --url http://127.0.0.1:8080 --clients 6 --duration 60 \\
+      --json out/web.json --compare out/web-baseline.json
+"""
+
+import argparse
+import base64
+import gzip
+import http.client
+import json
+import math
+import os
+import random
+import re
+import socket
+import sys
+import threading
+import time
+import urllib.parse
+from concurrent.futures import ThreadPoolExecutor
+
+RE_ASSET = re.compile(r"""(?:href|src)\s*=\s*["']([^"'#]+)["']""")
+RE_SCRIPT_IMAGE = re.compile(r"""["']([\w-]+\.(?:png|jpg|svg|ico))["']""")
+RE_HEAP_MIN_FREE = re.compile(r'^metahouse_heap_min_free_bytes\{caps="default"\} (\d+)', re.MULTILINE)
+
+TYPE_HEADER = "X-Loadtest-Type"
+
+ACCESSORY_TEMPLATES = [
+    {"type": "LIGHT", "name": "Light", "lightPin": 2, "buttonPin": 3},
+    {"type": "FAN", "name": "Fan", "fanPin": 4, "buttonPin": 5},
+    {"type": "PLUGIN", "name": "Plug", "pluginPin": 6, "buttonPin": 7},
+    {"type": "BUTTON", "name": "Button", "buttonPin": 8},
+    {"type": "WINDOW", "name": "Blind", "motorUpPin": 9, "motorDownPin": 10, "buttonUpPin": 11,
+     "buttonDownPin": 12, "timeToOpen": 20, "timeToClose": 20},
+]
+
+
+def percentile(samples, pct):
+    if not samples:
+        return None
+    ordered = sorted(samples)
+    index = min(len(ordered) - 1, max(0, math.ceil(pct / 100.0 * len(ordered)) - 1))
+    return ordered[index]
+
+
+def _ms(seconds):
+    return None if seconds is None else round(seconds * 1000.0, 2)
+
+
+def asset_type(path):
+    """Request type of a static asset, by extension."""
+    extension = os.path.splitext(path)[1].lower()
+    return {".html": "index", ".css": "css", ".js": "js"}.get(extension, "image")
+
+
+class Stats:
+    """Thread safe latencies and outcomes of every request type."""
+
+    OUTCOMES = ("errors", "not_modified", "busy", "gone")
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latency = {}
+        self.outcomes = {}
+        self.page_loads = 0
+
+    def record(self, kind, latency, outcome=None):
+        """Record a response. outcome is one of OUTCOMES, None for a plain success. The latency of a
+        304 counts, errors and busy replies are only counted."""
+        with self.lock:
+            self.latency.setdefault(kind, [])
+            counts = self.outcomes.setdefault(kind, dict.fromkeys(self.OUTCOMES, 0))
+            if outcome is not None:
+                counts[outcome] += 1
+            if outcome in (None, "not_modified", "gone"):
+                self.latency[kind].append(latency)
+
+    def snapshot(self, elapsed):
+        with self.lock:
+            result = {}
+            for kind in sorted(self.latency):
+                samples = self.latency[kind]
+                result[kind] = dict({
+                    "requests": len(samples),
+                    "rate": round(len(samples) / elapsed, 2) if elapsed > 0 else None,
+                    "p50_ms": _ms(percentile(samples, 50)),
+                    "p99_ms": _ms(percentile(samples, 99)),
+                    "max_ms": _ms(max(samples) if samples else None),
+                }, **self.outcomes[kind])
+            return result
+
+
+class Connection:
+    """A keep-alive HTTP connection of a virtual client, reopened after an error or a close."""
+
+    def __init__(self, args):
+        self.args = args
+        self.connection = None
+
+    def request(self, method, path, kind, body=None, headers=None):
+        """Send a request and read the whole response. Returns (status, headers, body, latency)."""
+        headers = dict(headers or {})
+        headers[TYPE_HEADER] = kind
+        headers["Accept-Encoding"] = "gzip, deflate"
+        if body is not None:
+            headers["Content-Type"] = "application/json"
+        for attempt in range(2):
+            if self.connection is None:
+                self.connection = http.client.HTTPConnection(self.args.host, self.args.port,
+                                                             timeout=self.args.timeout)
+            started = time.monotonic()
+            try:
+                self.connection.request(method, path, body=body, headers=headers)
+                response = self.connection.getresponse()
+                data = response.read()
+                latency = time.monotonic() - started
+                if response.headers.get("Content-Encoding") == "gzip":
+                    data = gzip.decompress(data)
+                if response.will_close:
+                    self.close()
+                return response.status, response.headers, data, latency
+            except (OSError, http.client.HTTPException):
+                # the server purges idle sockets, a request on a purged keep-alive socket is retried once
+                self.close()
+                if attempt == 1:
+                    raise
+
+    def close(self):
+        if self.connection is not None:
+            self.connection.close()
+            self.connection = None
+
+
+class EventSocket:
+    """The /events WebSocket a page keeps open, the frames it receives are drained and dropped."""
+
+    def __init__(self, args):
+        self.sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = ("GET /events HTTP/1.1\r\nHost: {}:{}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: {}\r\nSec-WebSocket-Version: 13\r\n{}: events\r\n\r\n").format(
+                       args.host, args.port, key, TYPE_HEADER)
+        self.sock.sendall(request.encode())
+        response = b""
+        while b"\r\n\r\n" not in response:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise OSError("connection closed during the handshake")
+            response += chunk
+        if not response.startswith(b"HTTP/1.1 101"):
+            raise OSError("upgrade refused: " + response.split(b"\r\n")[0].decode(errors="replace"))
+        self.sock.setblocking(False)
+
+    def drain(self):
+        try:
+            while self.sock.recv(4096):
+                pass
+        except (BlockingIOError, OSError):
+            pass
+
+    def close(self):
+        try:
+            # masked close frame without a payload
+            self.sock.setblocking(True)
+            self.sock.sendall(b"\x88\x80" + os.urandom(4))
+        except OSError:
+            pass
+        self.sock.close()
+
+
+class VirtualClient(threading.Thread):
+    """A phone with the config UI open: page loads, reloads and saves until the run ends."""
+
+    def __init__(self, index, args, stats, stop):
+        super().__init__(name="client{}".format(index), daemon=True)
+        self.args = args
+        self.stats = stats
+        self.stop = stop
+        self.random = random.Random(args.seed_random + index)
+        self.local = threading.local()
+        self.pool = ThreadPoolExecutor(max_workers=args.connections, thread_name_prefix=self.name)
+        self.connections = []
+        self.connections_lock = threading.Lock()
+        self.etags = {}
+        self.bodies = {}  # cached bodies, served for a 304
+        self.immutable = set()  # versioned assets a warm cache does not request again
+        self.events = None
+        self.accessory_ids = []
+
+    def _connection(self):
+        if not hasattr(self.local, "connection"):
+            self.local.connection = Connection(self.args)
+            with self.connections_lock:
+                self.connections.append(self.local.connection)
+        return self.local.connection
+
+    def fetch(self, method, path, kind, body=None, cached=False):
+        """One request on a connection of the calling thread, recorded under its type. Returns the body."""
+        headers = {}
+        if cached and path in self.immutable:
+            return self.bodies[path]
+        if cached and path in self.etags:
+            headers["If-None-Match"] = self.etags[path]
+        try:
+            status, response_headers, data, latency = self._connection().request(method, path, kind, body,
+                                                                                  headers)
+        except (OSError, http.client.HTTPException):
+            self.stats.record(kind, None, "errors")
+            return None
+        if status == 503:
+            # the accessory database is busy with the request of another client, the UI shows the error
+            self.stats.record(kind, latency, "busy")
+            return None
+        if status == 404 and kind in ("edit", "delete"):
+            # another client replaced the database without this accessory
+            self.stats.record(kind, latency, "gone")
+            return None
+        if not (200 <= status < 300 or status == 304):
+            self.stats.record(kind, latency, "errors")
+            return None
+        self.stats.record(kind, latency, "not_modified" if status == 304 else None)
+        if status == 304:
+            return self.bodies.get(path)
+        if response_headers.get("ETag"):
+            self.etags[path] = response_headers["ETag"]
+            self.bodies[path] = data
+        if "immutable" in response_headers.get("Cache-Control", ""):
+            self.immutable.add(path)
+            self.bodies[path] = data
+        return data
+
+    def fetch_all(self, requests):
+        """Fetch in parallel over the client's connections, like a browser fetching the assets of a page."""
+        return list(self.pool.map(lambda request: self.fetch(*request), requests))
+
+    def page_load(self, cached):
+        if self.events is not None:
+            self.events.close()
+            self.events = None
+
+        index = self.fetch("GET", "/", "index", cached=cached)
+        if index is None:
+            return
+        assets = []
+        for reference in RE_ASSET.findall(index.decode(errors="replace")):
+            if "://" not in reference:
+                path = "/" + reference.lstrip("/")
+                assets.append(("GET", path, asset_type(urllib.parse.urlsplit(path).path), None, cached))
+        assets += [("GET", "/accessories", "accessories", None, cached), ("GET", "/wifi/stored", "wifi")]
+        results = self.fetch_all(assets)
+
+        started = time.monotonic()
+        try:
+            self.events = EventSocket(self.args)
+            self.stats.record("events", time.monotonic() - started)
+        except OSError:
+            self.stats.record("events", None, "errors")
+
+        # the accessory list is drawn with the icons script.js references
+        images = set()
+        for request, data in zip(assets, results):
+            if request[2] == "js" and data is not None:
+                images.update(RE_SCRIPT_IMAGE.findall(data.decode(errors="replace")))
+            if request[2] == "accessories" and data:
+                self.accessory_ids = [entry["id"] for entry in json.loads(data).get("data", []) if "id" in entry]
+        self.fetch_all([("GET", "/" + image, "image", None, cached) for image in sorted(images)])
+        with self.stats.lock:
+            self.stats.page_loads += 1
+
+    def save(self):
+        choice = self.random.random()
+        template = dict(self.random.choice(ACCESSORY_TEMPLATES))
+        template["name"] += " {}".format(self.random.randint(1, 999))
+        if choice < self.args.save_all_ratio:
+            database = [dict(template, id=id) for id in self.accessory_ids] or [template]
+            self.fetch("POST", "/accessories/save", "save_all", json.dumps(database))
+        elif choice < 0.5 or not self.accessory_ids:
+            data = self.fetch("POST", "/accessories", "add", json.dumps(template))
+            if data is not None:
+                self.fetch("DELETE", "/accessories/{}".format(json.loads(data)["data"]["id"]), "delete")
+        else:
+            id = self.random.choice(self.accessory_ids)
+            if self.fetch("PUT", "/accessories/{}".format(id), "edit", json.dumps(template)) is None:
+                self.accessory_ids.remove(id)
+
+    def run(self):
+        cached = False
+        while not self.stop.is_set():
+            self.page_load(cached)
+            cached = self.random.random() < self.args.reload_ratio
+            for _ in range(self.args.saves_per_page):
+                if self.random.random() < self.args.save_ratio and not self.stop.is_set():
+                    self.save()
+            if self.events is not None:
+                self.events.drain()
+            self.stop.wait(self.random.uniform(0, 2 * self.args.think_time))
+        if self.events is not None:
+            self.events.close()
+        self.pool.shutdown()
+        with self.connections_lock:
+            for connection in self.connections:
+                connection.close()
+
+
+def get(args, path):
+    """A request outside the measured load. Returns (status, body)."""
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    try:
+        connection.request("GET", path)
+        response = connection.getresponse()
+        return response.status, response.read()
+    finally:
+        connection.close()
+
+
+def seed_accessories(args):
+    database = [dict(ACCESSORY_TEMPLATES[i % len(ACCESSORY_TEMPLATES)], name="Accessory {}".format(i + 1))
+                for i in range(args.accessories)]
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    try:
+        connection.request("POST", "/accessories/save", body=json.dumps(database),
+                           headers={"Content-Type": "application/json"})
+        response = connection.getresponse()
+        response.read()
+        if response.status != 200:
+            sys.exit("Seeding {} accessories failed with {}".format(args.accessories, response.status))
+    finally:
+        connection.close()
+
+
+def heap_min_free(args):
+    """Lowest free heap of a device since boot, from /metrics."""
+    status, body = get(args, "/metrics")
+    match = RE_HEAP_MIN_FREE.search(body.decode(errors="replace")) if status == 200 else None
+    return int(match.group(1)) if match else None
+
+
+def compare(summary, baseline, max_regression):
+    """List the request types with new errors, or whose p99 latency or peak heap grew past max_regression
+    percent."""
+    regressions = []
+    for kind, current in summary["requests"].items():
+        previous = baseline.get("requests", {}).get(kind)
+        if previous is None:
+            continue
+        if current["errors"] > previous.get("errors", 0):
+            regressions.append("{} errors: {} -> {}".format(kind, previous.get("errors", 0), current["errors"]))
+        for metric in ("p99_ms", "peak_heap"):
+            if current.get(metric) is None or not previous.get(metric):
+                continue
+            growth = (current[metric] - previous[metric]) * 100.0 / previous[metric]
+            if growth > max_regression:
+                regressions.append("{} {}: {} -> {} (+{:.0f}%)".format(kind, metric, previous[metric],
+                                                                      current[metric], growth))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", default="http://192.168.4.1", help="base URL of the config web server")
+    parser.add_argument("--clients", type=int, default=4, help="phones with the config UI open at once")
+    parser.add_argument("--connections", type=int, default=2, help="parallel connections of each client")
+    parser.add_argument("--timeout", type=float, default=10.0, help="request timeout in seconds")
+    parser.add_argument("--accessories", type=int, default=8,
+                        help="accessories stored before the run, 0 keeps the stored ones")
+    parser.add_argument("--reload-ratio", type=float, default=0.5,
+                        help="share of page loads revalidating a warm cache")
+    parser.add_argument("--save-ratio", type=float, default=0.3, help="chance of each save after a page load")
+    parser.add_argument("--saves-per-page", type=int, default=2, help="save attempts after each page load")
+    parser.add_argument("--save-all-ratio", type=float, default=0.1,
+                        help="share of the saves replacing the whole database")
+    parser.add_argument("--think-time", type=float, default=0.5, help="mean seconds between page loads")
+    parser.add_argument("--seed-random", type=int, default=1, help="seed of the client choices")
+    parser.add_argument("--interval", type=float, default=10.0, help="seconds between progress lines")
+    parser.add_argument("--duration", type=float, default=30.0, help="length of the load phase in seconds")
+    parser.add_argument("--json", help="write the summary as JSON to this file")
+    parser.add_argument("--compare", help="summary JSON of an earlier run to compare with")
+    parser.add_argument("--max-regression", type=float, default=20.0,
+                        help="percent the p99 latency or peak heap of a request type may grow over --compare")
+    args = parser.parse_args()
+
+    url = urllib.parse.urlsplit(args.url)
+    args.host = url.hostname
+    args.port = url.port or 80
+
+    if args.accessories > 0:
+        seed_accessories(args)
+
+    # the host build measures the heap of every request type, a device only its lowest free heap
+    status, _ = get(args, "/_host/stats?reset=1")
+    host = status == 200
+    heap_before = None if host else heap_min_free(args)
+
+    stats = Stats()
+    stop = threading.Event()
+    clients = [VirtualClient(i, args, stats, stop) for i in range(args.clients)]
+    started = time.monotonic()
+    for client in clients:
+        client.start()
+    print("Running {} clients for {:.0f}s against {}".format(args.clients, args.duration, args.url), flush=True)
+
+    try:
+        while time.monotonic() - started < args.duration:
+            time.sleep(min(args.interval, max(0.0, args.duration - (time.monotonic() - started))))
+            now = time.monotonic()
+            totals = stats.snapshot(now - started)
+            print("[{:6.1f}s] page loads {}, {}".format(
+                now - started, stats.page_loads,
+                ", ".join("{} {}".format(kind, value["requests"]) for kind, value in totals.items())), flush=True)
+    except KeyboardInterrupt:
+        pass
+    stop.set()
+    for client in clients:
+        client.join(timeout=args.timeout + 5)
+    elapsed = time.monotonic() - started
+
+    summary = {
+        "url": args.url,
+        "clients": args.clients,
+        "connections": args.connections,
+        "duration_s": round(elapsed, 1),
+        "page_loads": stats.page_loads,
+        "requests": stats.snapshot(elapsed),
+    }
+    if host:
+        status, body = get(args, "/_host/stats")
+        server = json.loads(body) if status == 200 else {"heap": {}, "requests": {}}
+        for kind, value in summary["requests"].items():
+            measured = server["requests"].get(kind)
+            value["peak_heap"] = measured["peak_heap"] if measured else None
+            value["server_mean_ms"] = _ms(measured["mean_us"] / 1e6) if measured else None
+        summary["heap_peak"] = server["heap"].get("peak")
+    else:
+        summary["heap_min_free_before"] = heap_before
+        summary["heap_min_free_after"] = heap_min_free(args)
+
+    print(json.dumps(summary, indent=2))
+    if args.json:
+        os.makedirs(os.path.dirname(os.path.abspath(args.json)), exist_ok=True)
+        with open(args.json, "w") as out:
+            json.dump(summary, out, indent=2)
+
+    if args.compare:
+        with open(args.compare) as baseline:
+            regressions = compare(summary, json.load(baseline), args.max_regression)
+        for regression in regressions:
+            print("REGRESSION " + regression)
+        if regressions:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
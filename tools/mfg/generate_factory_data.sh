@@ -0,0 +1,97 @@
+#!/usr/bin/env bash
+#
+# Generate per-unit factory data images for the fctry partition.
+#
+# Each image holds the onboarding data (discriminator, passcode derived SPAKE2+ verifier, salt and
+# iteration count), the DAC certificate and key, the PAI certificate, the certification declaration and
+# the device instance info, so the device never computes a verifier at runtime.
+#
+# Requires esp-matter-mfg-tool (pip install esp-matter-mfg-tool).
+#
+# Usage:
+#   tools/mfg/generate_factory_data.sh -n <count> --pai-cert <pai.pem> --pai-key <pai.key> \
+#       --cd <cd.der> [--vendor-id 0xFFF2] [--product-id 0x8001] [--outdir out/mfg]
+#
+# Flash one unit with:
+#   esptool.py write_flash <fctry offset> <outdir>/<vid>_<pid>/<uuid>/<uuid>-partition.bin
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(cd "${SCRIPT_DIR}/../.." && pwd)"
+PARTITIONS="${PROJECT_DIR}/partitions.csv"
+
+COUNT=1
+VENDOR_ID="0xFFF2"
+PRODUCT_ID="0x8001"
+VENDOR_NAME="MetaHouse"
+PRODUCT_NAME="MatterBridge"
+HW_VER=1
+HW_VER_STR="1.0"
+PAI_CERT=""
+PAI_KEY=""
+CD=""
+OUTDIR="${PROJECT_DIR}/out/mfg"
+
+usage() {
+  sed -n '2,16p' "$0" | sed 's/^# \{0,1\}//'
+  exit 1
+}
+
+while [[ $# -gt 0 ]]; do
+  case "$1" in
+    -n | --count) COUNT="$2"; shift 2 ;;
+    --vendor-id) VENDOR_ID="$2"; shift 2 ;;
+    --product-id) PRODUCT_ID="$2"; shift 2 ;;
+    --vendor-name) VENDOR_NAME="$2"; shift 2 ;;
+    --product-name) PRODUCT_NAME="$2"; shift 2 ;;
+    --hw-ver) HW_VER="$2"; shift 2 ;;
+    --hw-ver-str) HW_VER_STR="$2"; shift 2 ;;
+    --pai-cert) PAI_CERT="$2"; shift 2 ;;
+    --pai-key) PAI_KEY="$2"; shift 2 ;;
+    --cd) CD="$2"; shift 2 ;;
+    --outdir) OUTDIR="$2"; shift 2 ;;
+    -h | --help) usage ;;
+    *) echo "Unknown argument: $1" >&2; usage ;;
+  esac
+done
+
+if [[ -z "${PAI_CERT}" || -z "${PAI_KEY}" || -z "${CD}" ]]; then
+  echo "--pai-cert, --pai-key and --cd are required" >&2
+  usage
+fi
+
+if ! command -v esp-matter-mfg-tool > /dev/null; then
+  echo "esp-matter-mfg-tool not found, install it with: pip install esp-matter-mfg-tool" >&2
+  exit 1
+fi
+
+# Size and offset of the fctry partition, so the images always match the partition table
+read -r FCTRY_OFFSET FCTRY_SIZE < <(awk -F',' '$1 ~ /^[[:space:]]*fctry[[:space:]]*$/ {
+  gsub(/[[:space:]]/, "", $4); gsub(/[[:space:]]/, "", $5); print $4, $5 }' "${PARTITIONS}")
+
+if [[ -z "${FCTRY_OFFSET:-}" ]]; then
+  echo "No fctry partition in ${PARTITIONS}" >&2
+  exit 1
+fi
+
+esp-matter-mfg-tool \
+  --count "${COUNT}" \
+  --size "${FCTRY_SIZE}" \
+  --target esp32 \
+  --vendor-id "${VENDOR_ID}" \
+  --product-id "${PRODUCT_ID}" \
+  --vendor-name "${VENDOR_NAME}" \
+  --product-name "${PRODUCT_NAME}" \
+  --hw-ver "${HW_VER}" \
+  --hw-ver-str "${HW_VER_STR}" \
+  --pai \
+  --cert "${PAI_CERT}" \
+  --key "${PAI_KEY}" \
+  --cert-dclrn "${CD}" \
+  --outdir "${OUTDIR}"
+
+echo
+echo "Generated ${COUNT} factory image(s) of ${FCTRY_SIZE} bytes in ${OUTDIR}"
+echo "Onboarding codes are listed in the summary CSV next to the images."
+echo "Flash a unit with: esptool.py write_flash ${FCTRY_OFFSET} <uuid>-partition.bin"